@@ -0,0 +1,116 @@
+// Parser micro-benchmark: compares prepare_statement against the sscanf
+// based parsing it replaced, on a mix of insert/select/update/drop lines.
+//
+//   make bench
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "statement.h"
+
+#define ITERATIONS 2000000
+
+static const char* sample_statements[] = {
+    "insert 123456789 alice alice@example.com",
+    "select 42",
+    "select",
+    "update 987654 set email=someone@example.org",
+    "drop 31337",
+    "insert 5 bob_the_builder bob@builders.example.com",
+};
+#define NUM_SAMPLES (sizeof(sample_statements) / sizeof(sample_statements[0]))
+
+// The sscanf chains prepare_statement used before the hand-written parser,
+// kept here only as the baseline for comparison.
+static PrepareResult legacy_prepare(const char* buffer, Statement* statement) {
+    if (strncmp(buffer, "insert", 6) == 0) {
+        char username[USERNAME_MAX_LENGTH + 2];
+        char email[EMAIL_MAX_LENGTH + 2];
+        int id;
+        if (sscanf(buffer, "insert %d %40s %260s", &id, username, email) != 3)
+            return PREPARE_SYNTAX_ERROR;
+        if (id < 0)
+            return PREPARE_NEGATIVE_ID;
+        if (strlen(username) > USERNAME_MAX_LENGTH || strlen(email) > EMAIL_MAX_LENGTH)
+            return PREPARE_STRING_TOO_LONG;
+        statement->type = STATEMENT_INSERT;
+        statement->payload.user_to_insert.id = id;
+        strcpy((char*)statement->payload.user_to_insert.values, username);
+        strcpy((char*)statement->payload.user_to_insert.values + USERNAME_MAX_LENGTH + 1, email);
+        return PREPARE_SUCCESS;
+    }
+    if (strncmp(buffer, "select", 6) == 0) {
+        int id;
+        char extra[2];
+        if (sscanf(buffer, "select %d", &id) == 1) {
+            if (sscanf(buffer, "select %d %1s", &id, extra) == 2)
+                return PREPARE_SYNTAX_ERROR;
+            statement->type = STATEMENT_SPECIFIC_SELECT;
+            statement->payload.user_to_insert.id = id;
+            return PREPARE_SUCCESS;
+        }
+        if (sscanf(buffer, "select %1s", extra) == 1)
+            return PREPARE_SYNTAX_ERROR;
+        statement->type = STATEMENT_SELECT;
+        return PREPARE_SUCCESS;
+    }
+    if (strncmp(buffer, "drop", 4) == 0) {
+        int id;
+        if (sscanf(buffer, "drop %d", &id) != 1)
+            return PREPARE_SYNTAX_ERROR;
+        statement->type = STATEMENT_DROP;
+        statement->payload.user_to_insert.id = id;
+        return PREPARE_SUCCESS;
+    }
+    if (strncmp(buffer, "update", 6) == 0) {
+        int id;
+        char field[USERNAME_MAX_LENGTH + 2];
+        char value[EMAIL_MAX_LENGTH + 2];
+        if (sscanf(buffer, "update %d set %32[a-zA-Z]=%256[^ \n]", &id, field, value) != 3)
+            return PREPARE_SYNTAX_ERROR;
+        statement->type = STATEMENT_UPDATE;
+        statement->payload.update_payload.id = id;
+        statement->payload.update_payload.field_offset = strcmp(field, "email") == 0 ? ROW_PAYLOAD_OFFSET + USERNAME_MAX_LENGTH + 1 : ROW_PAYLOAD_OFFSET;
+        strcpy((char*)statement->payload.update_payload.new_value, value);
+        return PREPARE_SUCCESS;
+    }
+    return PREPARE_UNRECOGNIZED_STATEMENT;
+}
+
+static double elapsed_seconds(struct timespec start, struct timespec end) {
+    return (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main(void) {
+    InputBuffer inputs[NUM_SAMPLES];
+    for (size_t i = 0; i < NUM_SAMPLES; i++) {
+        inputs[i].buffer = (char*)sample_statements[i];
+        inputs[i].input_length = (ssize_t)strlen(sample_statements[i]);
+    }
+
+    Schema schema;
+    schema_init_default(&schema);
+    Statement statement;
+    struct timespec start, end;
+    volatile uint32_t failures = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < ITERATIONS; i++)
+        if (legacy_prepare(sample_statements[i % NUM_SAMPLES], &statement) != PREPARE_SUCCESS)
+            failures++;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double legacy = elapsed_seconds(start, end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < ITERATIONS; i++)
+        if (prepare_statement(&inputs[i % NUM_SAMPLES], &schema, &statement) != PREPARE_SUCCESS)
+            failures++;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double lexer = elapsed_seconds(start, end);
+
+    printf("statements parsed:  %u per parser (%u failures)\n", ITERATIONS, failures);
+    printf("sscanf parser:      %8.1f ns/statement\n", legacy * 1e9 / ITERATIONS);
+    printf("lexer parser:       %8.1f ns/statement\n", lexer * 1e9 / ITERATIONS);
+    printf("speedup:            %8.2fx\n", legacy / lexer);
+    return 0;
+}
@@ -0,0 +1,161 @@
+#include "analyze.h"
+
+#define FILL_BUCKETS 10
+
+typedef struct {
+    uint32_t num_leaves;
+    uint32_t num_internal;
+    uint64_t num_entries;       // cells of leaves, keys of internal nodes
+} LevelShape;
+
+typedef struct {
+    DbTable*   table;
+    uint8_t*   page_use;
+    uint32_t   height;
+    LevelShape levels[MAX_TREE_HEIGHT];
+    uint64_t   leaf_fill[FILL_BUCKETS];
+    uint64_t   internal_fill[FILL_BUCKETS];
+    uint64_t   num_cells;
+    uint64_t   num_tombstones;
+    uint64_t   num_tree_pages;
+    uint64_t   leaf_links;
+    uint64_t   scattered_links;     // next_leaf is not the following page
+    uint64_t   num_bad_references;  // past the end, already seen, or too deep
+} TreeShape;
+
+static void record_fill(uint64_t* histogram, uint32_t used, uint32_t capacity) {
+    uint32_t bucket = (uint32_t)((uint64_t)used * FILL_BUCKETS / capacity);
+    histogram[bucket < FILL_BUCKETS ? bucket : FILL_BUCKETS - 1]++;
+}
+
+static void analyze_node(TreeShape* shape, uint32_t page_idx, uint32_t depth) {
+    DbTable* table = shape->table;
+    NodeLayout* layout = &table->layout;
+    if (page_idx >= table->db_pager->num_pages || depth >= MAX_TREE_HEIGHT || shape->page_use[page_idx] == PAGE_USE_TREE) {
+        shape->num_bad_references++;
+        return;
+    }
+    if (shape->page_use[page_idx] != PAGE_USE_UNKNOWN)
+        shape->num_bad_references++;    // also on the free list or the catalog; counted as tree
+    shape->page_use[page_idx] = PAGE_USE_TREE;
+    shape->num_tree_pages++;
+    if (depth + 1 > shape->height)
+        shape->height = depth + 1;
+
+    LevelShape* level = &shape->levels[depth];
+    void* node = get_page(table->db_pager, page_idx);
+    if (get_node_type(node) == NODE_LEAF) {
+        uint32_t num_cells = *leaf_node_num_cells(node);
+        uint32_t next_leaf = *leaf_node_next_leaf(node);
+        level->num_leaves++;
+        level->num_entries += num_cells;
+        shape->num_cells += num_cells;
+        shape->num_tombstones += *leaf_node_num_tombstones(node);
+        record_fill(shape->leaf_fill, num_cells, layout->leaf_node_max_cells);
+        if (next_leaf != 0) {
+            shape->leaf_links++;
+            if (next_leaf != page_idx + 1)
+                shape->scattered_links++;
+        }
+        return;
+    }
+
+    uint32_t num_keys = *internal_node_num_keys(node);
+    level->num_internal++;
+    level->num_entries += num_keys;
+    record_fill(shape->internal_fill, num_keys, layout->internal_node_max_keys);
+    for (uint32_t i = 0; i < num_keys; i++)
+        analyze_node(shape, *internal_node_child(table, node, i), depth + 1);
+    uint32_t right_child = *internal_node_right_child(node);
+    if (right_child != INVALID_PAGE_IDX)
+        analyze_node(shape, right_child, depth + 1);
+}
+
+// Pages a bottom-up rebuild of num_rows would take, with levels sized
+// the way restore_table plans them.
+static uint64_t rebuilt_tree_pages(NodeLayout* layout, uint64_t num_rows) {
+    uint64_t num_pages = 0;
+    uint64_t items = num_rows;
+    uint64_t capacity = layout->leaf_node_max_cells;
+    do {
+        uint64_t num_nodes = items > 0 ? (items + capacity - 1) / capacity : 1;
+        num_pages += num_nodes;
+        items = num_nodes;
+        capacity = (uint64_t)layout->internal_node_max_keys + 1;
+    } while (items > 1);
+    return num_pages;
+}
+
+static void print_fill_row(const char* label, const uint64_t* histogram) {
+    printf("%-15s", label);
+    for (uint32_t i = 0; i < FILL_BUCKETS; i++)
+        printf(" %8" PRIu64, histogram[i]);
+    printf("\n");
+}
+
+static void print_tree_shape(TreeShape* shape) {
+    DbPager* db_pager = shape->table->db_pager;
+    printf("Height: %u\n", shape->height);
+    printf("%-15s %8s %8s %10s\n", "level", "internal", "leaves", "entries");
+    for (uint32_t i = 0; i < shape->height; i++) {
+        LevelShape* level = &shape->levels[i];
+        printf("%-15u %8u %8u %10" PRIu64 "\n", i, level->num_internal, level->num_leaves, level->num_entries);
+    }
+
+    printf("%-15s", "fill %");
+    for (uint32_t i = 0; i < FILL_BUCKETS; i++) {
+        char bucket[16];
+        snprintf(bucket, sizeof(bucket), "%u-%u", i * 100 / FILL_BUCKETS, (i + 1) * 100 / FILL_BUCKETS - (i + 1 < FILL_BUCKETS));
+        printf(" %8s", bucket);
+    }
+    printf("\n");
+    print_fill_row("leaves", shape->leaf_fill);
+    print_fill_row("internal nodes", shape->internal_fill);
+    printf("Rows: %" PRIu64 " live, %" PRIu64 " deleted awaiting .compact\n",
+           shape->num_cells - shape->num_tombstones, shape->num_tombstones);
+
+    uint32_t num_free = 0, num_unreachable = 0;
+    uint32_t has_catalog = db_pager->header.catalog_page_idx != 0;
+    for (uint32_t page_idx = 1; page_idx < db_pager->num_pages; page_idx++) {
+        if (shape->page_use[page_idx] == PAGE_USE_FREE)
+            num_free++;
+        else if (shape->page_use[page_idx] == PAGE_USE_UNKNOWN)
+            num_unreachable++;
+    }
+    printf("Pages: %u in the file, 1 header, %u catalog, %" PRIu64 " tree, %u free, %u unreachable\n",
+           db_pager->num_pages, has_catalog, shape->num_tree_pages, num_free, num_unreachable);
+    if (shape->num_bad_references > 0)
+        printf(ANSI_COLOR_RED "%" PRIu64 " child pointers lead past the end of the file, to a page seen before, or to a free or catalog page\n" ANSI_COLOR_RESET,
+               shape->num_bad_references);
+
+    printf("Leaf chain: %" PRIu64 " links, %" PRIu64 " (%.1f%%) not to the next page\n", shape->leaf_links, shape->scattered_links,
+           shape->leaf_links > 0 ? 100.0 * (double)shape->scattered_links / (double)shape->leaf_links : 0.0);
+
+    uint64_t rebuilt_pages = 1 + has_catalog + rebuilt_tree_pages(&shape->table->layout, shape->num_cells - shape->num_tombstones);
+    uint64_t reclaimable = db_pager->num_pages > rebuilt_pages ? db_pager->num_pages - rebuilt_pages : 0;
+    printf("A rebuild would take %" PRIu64 " pages and reclaim %" PRIu64 " (%.1f MB)\n", rebuilt_pages, reclaimable,
+           (double)reclaimable * db_pager->page_size / (1024.0 * 1024.0));
+}
+
+// Walks every node of the tree and the free list once and reports the
+// tree's shape: nodes and fill per level, how pages are used, how often
+// the leaf chain jumps, and what a dump and restore would give back.
+void print_tree_analysis(DbTable* table) {
+    db_begin_access(table, false);
+    DbPager* db_pager = table->db_pager;
+    TreeShape* shape = calloc(1, sizeof(TreeShape));
+    shape->table = table;
+    shape->page_use = calloc(db_pager->num_pages > 0 ? db_pager->num_pages : 1, sizeof(uint8_t));
+
+    pager_mark_free_pages(db_pager, shape->page_use);
+    uint32_t catalog_page_idx = db_pager->header.catalog_page_idx;
+    if (catalog_page_idx != 0 && catalog_page_idx < db_pager->num_pages)
+        shape->page_use[catalog_page_idx] = PAGE_USE_CATALOG;
+    analyze_node(shape, table->root_page_idx, 0);
+    print_tree_shape(shape);
+
+    free(shape->page_use);
+    free(shape);
+    db_end_access(table);
+    pager_end_statement(db_pager);
+}
@@ -0,0 +1,12 @@
+#ifndef DB_ANALYZE_H
+#define DB_ANALYZE_H
+
+#include <stdlib.h>
+#include "common.h"
+#include "table.h"
+#include "pager.h"
+#include "node.h"
+
+void print_tree_analysis(DbTable* table);
+
+#endif
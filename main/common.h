@@ -3,24 +3,166 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <string.h>
+#include <pthread.h>
 
 #define size_of_attribute(Struct, Attribute) (sizeof(((Struct*)0)->Attribute))
 
 #define USERNAME_MAX_LENGTH     32
 #define EMAIL_MAX_LENGTH        255
 #define FILENAME_MAX_LENGTH     255
+#define KEY_LITERAL_MAX_LENGTH  41
 
-#define ID_FIELD_OFFSET         0
-#define USERNAME_FIELD_OFFSET   (ID_FIELD_OFFSET + sizeof(uint32_t))
-#define EMAIL_FIELD_OFFSET      (USERNAME_FIELD_OFFSET + USERNAME_MAX_LENGTH + 1)
-#define USER_ROW_SIZE           (sizeof(uint32_t) + USERNAME_MAX_LENGTH + 1 + EMAIL_MAX_LENGTH + 1)
+#define TENANT_ID_FIELD_OFFSET  0
+#define ID_FIELD_OFFSET         (TENANT_ID_FIELD_OFFSET + sizeof(uint64_t))
+#define USER_ROW_SIZE           (2 * sizeof(uint64_t) + USERNAME_MAX_LENGTH + 1 + EMAIL_MAX_LENGTH + 1)
 
-#define PAGE_SIZE_BYTES         4096
-#define MAX_PAGES               100
+// Every row is a USER_ROW_SIZE slot: the key fields, then the table's
+// columns packed into the payload. The default schema is the original
+// (username varchar(32), email varchar(255)) row.
+#define ROW_PAYLOAD_OFFSET      (ID_FIELD_OFFSET + sizeof(uint64_t))
+#define ROW_PAYLOAD_SIZE        (USER_ROW_SIZE - ROW_PAYLOAD_OFFSET)
+#define DEFAULT_TABLE_NAME      "users"
+#define TABLE_NAME_MAX_LENGTH   32
+#define COLUMN_NAME_MAX_LENGTH  32
+#define SCHEMA_MAX_COLUMNS      16
+
+#define KEY_MAX_SIZE            (2 * sizeof(uint64_t))
+
+#define DEFAULT_PAGE_SIZE       4096
+#define MIN_PAGE_SIZE           4096
+#define MAX_PAGE_SIZE           65536
+#define INITIAL_PAGE_SLOTS      128
 #define INVALID_PAGE_IDX        UINT32_MAX
 
+#define DEFAULT_DIRTY_RATIO_PERCENT  10
+#define DEFAULT_DIRTY_LIMIT_PERCENT  50
+#define DEFAULT_FLUSH_INTERVAL_MS    1000
+#define FLUSHER_BATCH_PAGES          64
+
+#define MAX_SCAN_THREADS             64
+#define SCAN_RANGES_PER_THREAD       4
+#define SCAN_RANGES_AHEAD_PER_THREAD 2
+
+#define DEFAULT_SORT_MEMORY_MB       64
+
+#define DUMP_MAGIC                   "CSQLDUMP"
+#define DUMP_FORMAT_VERSION          1
+#define DUMP_BLOCK_SIZE              (1024 * 1024)
+#define MAX_TREE_HEIGHT              32
+
+#define REPLICATION_LOG_MAGIC        "CSQLRLOG"
+#define REPLICATION_LOG_VERSION      2
+#define REPLICATION_LOG_HEADER_SIZE  16
+#define REPLICATION_BUFFER_SIZE      (64 * 1024)
+#define REPLICA_READ_SIZE            (1024 * 1024)
+#define REPLICA_POLL_INTERVAL_MS     100
+
+// fcntl lock bytes, far past any page so they never overlap data.
+#define LOCK_REGION_OFFSET           ((off_t)1 << 62)
+#define LOCK_PROCESS_OFFSET          LOCK_REGION_OFFSET
+#define LOCK_WRITER_OFFSET           (LOCK_REGION_OFFSET + 1)
+#define LOCK_READER_OFFSET           (LOCK_REGION_OFFSET + 2)
+#define SHM_FILE_SUFFIX              "-shm"
+#define SHM_PAGE_SLOTS               65536
+
+#define DEFAULT_CACHE_SIZE_MB        256
+#define MIN_CACHE_PAGES              64
+#define DIRECT_IO_ALIGNMENT          4096
+#define HUGE_PAGE_SIZE               (2 * 1024 * 1024)
+
+// LSM engine. A database's rows live in "<db>-run-<id>" files listed by
+// "<db>-manifest", plus a memtable rebuilt from "<db>-wal" at open.
+#define LSM_WAL_SUFFIX               "-wal"
+#define LSM_MANIFEST_SUFFIX          "-manifest"
+#define LSM_RUN_SUFFIX               "-run-"
+#define LSM_MANIFEST_MAGIC           "CSQLLSMM"
+#define LSM_RUN_MAGIC                "CSQLLSMR"
+#define LSM_FORMAT_VERSION           1
+#define LSM_RUN_FOOTER_SIZE          32
+#define LSM_BLOCK_SIZE               4096
+#define LSM_MEMTABLE_BYTES           (4 * 1024 * 1024)
+#define LSM_WAL_BUFFER_SIZE          (64 * 1024)
+#define LSM_SKIPLIST_MAX_HEIGHT      16
+#define LSM_BLOOM_BITS_PER_KEY       10
+#define LSM_BLOOM_HASHES             7
+#define LSM_L0_MAX_RUNS              4
+#define LSM_MAX_LEVELS               7
+#define LSM_LEVEL_SIZE_RATIO         10
+
+#define HASH_INDEX_INITIAL_CAPACITY  1024
+#define HASH_INDEX_MAX_LOAD_PERCENT  70
+
+#define IN_MEMORY_DB_NAME            ":memory:"
+
+// Partitioned databases. Rows live in "<db>-part-<n>" files, each a
+// complete database; the main file holds the header and the catalog.
+#define PARTITION_FILE_SUFFIX        "-part-"
+#define MAX_PARTITIONS               64
+#define IMPORT_BATCH_ROWS            4096
+
+// The catalog page holds the table's schema: magic[8] version:u32
+// num_columns:u32 name[32], then name[32] type:u32 length:u32 per column.
+#define CATALOG_MAGIC                "CSQLCATL"
+#define CATALOG_VERSION              1
+#define CATALOG_HEADER_SIZE          (16 + TABLE_NAME_MAX_LENGTH)
+#define CATALOG_COLUMN_SIZE          (COLUMN_NAME_MAX_LENGTH + 2 * sizeof(uint32_t))
+
+// Trace events are kept per thread in a ring of TRACE_RING_EVENTS
+// (a power of two); the oldest are overwritten when it wraps.
+#define TRACE_RING_EVENTS            32768
+
+#define HOT_LIST_SUFFIX              "-hot"
+#define HOT_LIST_MAGIC               "CSQLHOTP"
+#define HOT_LIST_VERSION             1
+#define HOT_LIST_HEADER_SIZE         16
+#define PAGER_READ_RUN_PAGES         64
+
+#define DB_HEADER_PAGE_IDX      0
+#define DB_HEADER_MAGIC         "CSQLDB\x1a"
+#define DB_FORMAT_VERSION       4
+// Versions at which header fields were appended or page layouts changed.
+#define DB_VERSION_KEY_TYPE     2   // key_type; keys widened to 64 bits
+#define DB_VERSION_PAGE_SIZE    3   // page_size, replica_log_offset
+#define DB_VERSION_TOMBSTONES   4   // leaf tombstones; free list, engine, catalog, partitions
+#define DB_PAGE_NUMBER_WIDTH    sizeof(uint32_t)
+
+#define HEADER_MAGIC_SIZE               8
+#define HEADER_MAGIC_OFFSET             0
+#define HEADER_FORMAT_VERSION_SIZE      sizeof(uint32_t)
+#define HEADER_FORMAT_VERSION_OFFSET    (HEADER_MAGIC_OFFSET + HEADER_MAGIC_SIZE)
+#define HEADER_PAGE_NUMBER_WIDTH_SIZE   sizeof(uint32_t)
+#define HEADER_PAGE_NUMBER_WIDTH_OFFSET (HEADER_FORMAT_VERSION_OFFSET + HEADER_FORMAT_VERSION_SIZE)
+#define HEADER_ROOT_PAGE_SIZE           sizeof(uint32_t)
+#define HEADER_ROOT_PAGE_OFFSET         (HEADER_PAGE_NUMBER_WIDTH_OFFSET + HEADER_PAGE_NUMBER_WIDTH_SIZE)
+#define HEADER_KEY_TYPE_SIZE            sizeof(uint32_t)
+#define HEADER_KEY_TYPE_OFFSET          (HEADER_ROOT_PAGE_OFFSET + HEADER_ROOT_PAGE_SIZE)
+#define HEADER_PAGE_SIZE_SIZE           sizeof(uint32_t)
+#define HEADER_PAGE_SIZE_OFFSET         (HEADER_KEY_TYPE_OFFSET + HEADER_KEY_TYPE_SIZE)
+#define HEADER_REPLICA_OFFSET_SIZE      sizeof(uint64_t)
+#define HEADER_REPLICA_OFFSET_OFFSET    (HEADER_PAGE_SIZE_OFFSET + HEADER_PAGE_SIZE_SIZE)
+#define HEADER_FREE_LIST_HEAD_SIZE      sizeof(uint32_t)
+#define HEADER_FREE_LIST_HEAD_OFFSET    (HEADER_REPLICA_OFFSET_OFFSET + HEADER_REPLICA_OFFSET_SIZE)
+#define HEADER_NUM_FREE_PAGES_SIZE      sizeof(uint32_t)
+#define HEADER_NUM_FREE_PAGES_OFFSET    (HEADER_FREE_LIST_HEAD_OFFSET + HEADER_FREE_LIST_HEAD_SIZE)
+#define HEADER_ENGINE_SIZE              sizeof(uint32_t)
+#define HEADER_ENGINE_OFFSET            (HEADER_NUM_FREE_PAGES_OFFSET + HEADER_NUM_FREE_PAGES_SIZE)
+#define HEADER_CATALOG_PAGE_SIZE        sizeof(uint32_t)
+#define HEADER_CATALOG_PAGE_OFFSET      (HEADER_ENGINE_OFFSET + HEADER_ENGINE_SIZE)
+#define HEADER_NUM_PARTITIONS_SIZE      sizeof(uint32_t)
+#define HEADER_NUM_PARTITIONS_OFFSET    (HEADER_CATALOG_PAGE_OFFSET + HEADER_CATALOG_PAGE_SIZE)
+#define HEADER_PARTITION_WIDTH_SIZE     sizeof(uint64_t)
+#define HEADER_PARTITION_WIDTH_OFFSET   (HEADER_NUM_PARTITIONS_OFFSET + HEADER_NUM_PARTITIONS_SIZE)
+#define HEADER_SIZE                     (HEADER_PARTITION_WIDTH_OFFSET + HEADER_PARTITION_WIDTH_SIZE)
+
+// Free pages are kept on a chain of trunk pages, each listing up to
+// (page_size - FREE_TRUNK_HEADER_SIZE) / 4 other free page numbers.
+#define FREE_TRUNK_NEXT_OFFSET          0
+#define FREE_TRUNK_COUNT_OFFSET         sizeof(uint32_t)
+#define FREE_TRUNK_HEADER_SIZE          (2 * sizeof(uint32_t))
+
 #define NODE_TYPE_SIZE              sizeof(uint8_t)
 #define NODE_TYPE_OFFSET            0
 #define IS_ROOT_SIZE                sizeof(uint8_t)
@@ -29,31 +171,40 @@
 #define PARENT_POINTER_OFFSET       (IS_ROOT_OFFSET + IS_ROOT_SIZE)
 #define COMMON_NODE_HEADER_SIZE     (NODE_TYPE_SIZE + IS_ROOT_SIZE + PARENT_POINTER_SIZE)
 
-#define LEAF_NODE_KEY_SIZE          sizeof(uint32_t)
 #define LEAF_NODE_KEY_OFFSET        0
 #define LEAF_NODE_VALUE_SIZE        USER_ROW_SIZE
-#define LEAF_NODE_CELL_SIZE         (LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE)
 #define LEAF_NODE_NUM_CELLS_SIZE    sizeof(uint32_t)
 #define LEAF_NODE_NUM_CELLS_OFFSET  COMMON_NODE_HEADER_SIZE
 #define LEAF_NODE_NEXT_LEAF_SIZE    sizeof(uint32_t)
 #define LEAF_NODE_NEXT_LEAF_OFFSET  (LEAF_NODE_NUM_CELLS_OFFSET + LEAF_NODE_NUM_CELLS_SIZE)
-#define LEAF_NODE_HEADER_SIZE       (COMMON_NODE_HEADER_SIZE + LEAF_NODE_NUM_CELLS_SIZE + LEAF_NODE_NEXT_LEAF_SIZE)
-#define LEAF_NODE_SPACE_FOR_CELLS   (PAGE_SIZE_BYTES - LEAF_NODE_HEADER_SIZE)
-#define LEAF_NODE_MAX_CELLS         (LEAF_NODE_SPACE_FOR_CELLS / LEAF_NODE_CELL_SIZE)
-#define LEAF_NODE_RIGHT_SPLIT_COUNT ((LEAF_NODE_MAX_CELLS + 1) / 2)
-#define LEAF_NODE_LEFT_SPLIT_COUNT  ((LEAF_NODE_MAX_CELLS + 1) - LEAF_NODE_RIGHT_SPLIT_COUNT)
-#define LEAF_NODE_MIN_CELLS         (LEAF_NODE_LEFT_SPLIT_COUNT - 1)
+#define LEAF_NODE_NUM_TOMBSTONES_SIZE   sizeof(uint32_t)
+#define LEAF_NODE_NUM_TOMBSTONES_OFFSET (LEAF_NODE_NEXT_LEAF_OFFSET + LEAF_NODE_NEXT_LEAF_SIZE)
+#define LEAF_NODE_HEADER_SIZE       (COMMON_NODE_HEADER_SIZE + LEAF_NODE_NUM_CELLS_SIZE + LEAF_NODE_NEXT_LEAF_SIZE + LEAF_NODE_NUM_TOMBSTONES_SIZE)
+#define LEAF_NODE_FLAGS_SIZE        sizeof(uint8_t)
+#define LEAF_CELL_TOMBSTONE         0x01
+#define LEAF_GARBAGE_PERCENT        50
 
 #define INTERNAL_NODE_NUM_KEYS_SIZE         sizeof(uint32_t)
 #define INTERNAL_NODE_NUM_KEYS_OFFSET       COMMON_NODE_HEADER_SIZE
 #define INTERNAL_NODE_RIGHT_CHILD_SIZE      sizeof(uint32_t)
 #define INTERNAL_NODE_RIGHT_CHILD_OFFSET    (INTERNAL_NODE_NUM_KEYS_OFFSET + INTERNAL_NODE_NUM_KEYS_SIZE)
 #define INTERNAL_NODE_HEADER_SIZE           (COMMON_NODE_HEADER_SIZE + INTERNAL_NODE_NUM_KEYS_SIZE + INTERNAL_NODE_RIGHT_CHILD_SIZE)
-#define INTERNAL_NODE_KEY_SIZE              sizeof(uint32_t)
 #define INTERNAL_NODE_CHILD_SIZE            sizeof(uint32_t)
-#define INTERNAL_NODE_CELL_SIZE             (INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_KEY_SIZE)
-#define INTERNAL_NODE_MAX_KEYS              ((PAGE_SIZE_BYTES - INTERNAL_NODE_HEADER_SIZE) / INTERNAL_NODE_CELL_SIZE)
-#define INTERNAL_NODE_MIN_KEYS              (INTERNAL_NODE_MAX_KEYS / 2)
+
+// Files from before DB_VERSION_TOMBSTONES, including the header-less
+// files that predate the header page, are copied into the current layout
+// when opened. Their leaves lack the tombstone count and the cell flags,
+// and before DB_VERSION_KEY_TYPE keys and ids were 32-bit.
+#define LEGACY_LEAF_NODE_HEADER_SIZE        LEAF_NODE_NUM_TOMBSTONES_OFFSET
+#define LEGACY_NARROW_KEY_SIZE              sizeof(uint32_t)
+#define LEGACY_NARROW_ROW_SIZE              (sizeof(uint32_t) + ROW_PAYLOAD_SIZE)
+#define UPGRADE_FILE_SUFFIX                 "-upgrade"
+#define UPGRADE_BACKUP_SUFFIX               "-legacy"
+
+#define HISTOGRAM_SUB_BUCKET_BITS   5
+#define HISTOGRAM_SUB_BUCKETS       (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_MAX_EXPONENT      40
+#define HISTOGRAM_BUCKETS           ((HISTOGRAM_MAX_EXPONENT - HISTOGRAM_SUB_BUCKET_BITS + 2) * HISTOGRAM_SUB_BUCKETS)
 
 #define ANSI_COLOR_GREEN    "\x1b[32m"
 #define ANSI_COLOR_YELLOW   "\x1b[33m"
@@ -81,29 +232,397 @@ typedef enum {
 
 typedef enum {
     STATEMENT_INSERT,
+    STATEMENT_INSERT_BATCH,
     STATEMENT_SELECT,
     STATEMENT_SPECIFIC_SELECT,
+    STATEMENT_PREFIX_SELECT,
+    STATEMENT_MULTI_SELECT,
     STATEMENT_DROP,
+    STATEMENT_DROP_RANGE,
     STATEMENT_IMPORT,
     STATEMENT_EXPORT,
-    STATEMENT_UPDATE
+    STATEMENT_UPDATE,
+    STATEMENT_CREATE_TABLE
 } StatementType;
 
+#define NUM_STATEMENT_TYPES (STATEMENT_CREATE_TABLE + 1)
+
+typedef enum {
+    PREDICATE_AND,
+    PREDICATE_OR,
+    PREDICATE_MATCH
+} PredicateNodeType;
+
+typedef enum {
+    MATCH_EQUALS,
+    MATCH_PREFIX,
+    MATCH_SUFFIX,
+    MATCH_CONTAINS,
+    MATCH_VALUE,        // encoded int or bool, compared byte for byte
+    MATCH_DOUBLE        // compared by value, so -0.0 matches 0 and NaN matches nothing
+} MatchKind;
+
+typedef enum {
+    LOG_RECORD_PUT,
+    LOG_RECORD_DELETE,
+    LOG_RECORD_COMMIT,
+    LOG_RECORD_DELETE_RANGE
+} LogRecordType;
+
 typedef enum {
     NODE_INTERNAL,
     NODE_LEAF
 } NodeType;
 
+// What .analyze found each page of the file to be used for.
+typedef enum {
+    PAGE_USE_UNKNOWN,
+    PAGE_USE_FREE,
+    PAGE_USE_TREE,
+    PAGE_USE_CATALOG
+} PageUse;
+
+typedef enum {
+    KEY_TYPE_INT64,
+    KEY_TYPE_TENANT_INT64
+} KeyType;
+
+typedef enum {
+    COLUMN_INT32,
+    COLUMN_INT64,
+    COLUMN_DOUBLE,
+    COLUMN_BOOL,
+    COLUMN_FIXED,
+    COLUMN_VARCHAR
+} ColumnType;
+
+typedef enum {
+    STORAGE_ENGINE_BTREE,
+    STORAGE_ENGINE_LSM
+} StorageEngine;
+
 typedef struct {
-    int       file_descriptor;
-    uint32_t  file_length;
+    KeyType  key_type;
+    StorageEngine engine;
+    uint32_t page_size;
+    uint32_t dirty_ratio_percent;
+    uint32_t dirty_limit_percent;
+    uint32_t flush_interval_ms;
+    uint32_t scan_threads;
+    uint32_t sort_memory_mb;
+    uint32_t cache_size_mb;
+    bool     huge_pages;
+    bool     direct_io;
+    bool     shared;
+    bool     warm_cache;
+    bool     hash_index;
+    uint32_t num_partitions;        // 0 for an unpartitioned database
+    uint64_t partition_width;       // ids per range partition, 0 to hash
+    const char* replication_log;
+    const char* replica_of;
+} DbOptions;
+
+typedef struct {
+    KeyType  key_type;
+    uint32_t key_size;
+    uint32_t page_size;
+    uint32_t leaf_node_space_for_cells;
+    uint32_t leaf_node_cell_size;
+    uint32_t leaf_node_max_cells;
+    uint32_t leaf_node_left_split_count;
+    uint32_t leaf_node_right_split_count;
+    uint32_t leaf_node_min_cells;
+    uint32_t internal_node_cell_size;
+    uint32_t internal_node_max_keys;
+    uint32_t internal_node_min_keys;
+} NodeLayout;
+
+typedef struct {
+    uint32_t format_version;
+    uint32_t page_number_width;
+    uint32_t root_page_idx;
+    uint32_t key_type;
+    uint32_t page_size;
+    uint64_t replica_log_offset;    // replication log bytes applied (replicas only)
+    uint32_t free_list_head;        // first free trunk page, 0 if none
+    uint32_t num_free_pages;
+    uint32_t engine;                // StorageEngine, chosen at creation
+    uint32_t catalog_page_idx;      // 0 while the table has the default schema
+    uint32_t num_partitions;        // chosen at creation, 0 if unpartitioned
+    uint64_t partition_width;       // range partitioning width, 0 for hash
+} DbHeader;
+
+// Fixed columns are zero-padded to their length; varchar columns get one
+// more byte so the value is always NUL-terminated.
+typedef struct {
+    char       name[COLUMN_NAME_MAX_LENGTH + 1];
+    ColumnType type;
+    uint32_t   length;          // characters, for fixed and varchar
+    uint32_t   offset;          // in the serialized row
+    uint32_t   size;
+} Column;
+
+// Offsets are computed once when a schema is built or loaded, so a row
+// is encoded and decoded with one copy per column.
+typedef struct {
+    char     name[TABLE_NAME_MAX_LENGTH + 1];
+    uint32_t num_columns;
+    Column   columns[SCHEMA_MAX_COLUMNS];
+} Schema;
+
+// Coordination region shared by every --shared process on one database,
+// mapped from the "<db>-shm" file. A committing writer stamps each page it
+// wrote with the new change counter; page_versions is indexed by page
+// number modulo SHM_PAGE_SLOTS, so collisions only cause extra reloads.
+typedef struct {
+    uint64_t change_counter;
+    uint64_t page_versions[SHM_PAGE_SLOTS];
+} SharedRegion;
+
+typedef struct {
+    int       file_descriptor;  // -1 for an in-memory database
+    bool      in_memory;
+    uint32_t  page_size;
+    uint64_t  file_length;
     uint32_t  num_pages;
-    void*     pages[MAX_PAGES];
+    uint32_t  num_page_slots;
+    void**    pages;
+    DbHeader  header;
+    uint64_t  pages_read;
+    uint64_t  pages_written;
+    uint64_t  pages_dirtied;    // clean pages marked dirty
+
+    // Page frames come from one page-aligned arena sized to the cache.
+    // A statement that needs more frames borrows them from the heap;
+    // the cache is shrunk back to capacity between statements.
+    void*     arena;
+    size_t    arena_length;
+    char*     frames;
+    uint32_t  cache_capacity;
+    uint32_t* free_frames;
+    uint32_t  num_free_frames;
+    uint8_t*  referenced_bitmap;
+    uint32_t  clock_hand;
+    uint16_t* hit_counts;  // saturating get_page count per page, for the hot list
+    uint32_t* page_generations;  // bumped when a page is freed
+
+    // Write-back state. The latch is held by the REPL while it runs a
+    // statement and by the flusher while it writes a batch of pages.
+    uint8_t*        dirty_bitmap;
+    uint32_t        num_cached_pages;
+    uint32_t        num_dirty_pages;
+    uint32_t        dirty_ratio_percent;
+    uint32_t        dirty_limit_percent;
+    uint32_t        flush_interval_ms;
+    pthread_mutex_t latch;
+    pthread_cond_t  flusher_wakeup;
+    pthread_t       flusher_thread;
+    bool            flusher_running;
+    bool            flusher_stop;
+
+    // Set while parallel scan workers share the pager; cache misses are
+    // then serialized on page_table_lock.
+    bool            shared_read;
+    pthread_mutex_t page_table_lock;
+
+    // Multi-process mode. Statements run under fcntl locks, and a writer's
+    // pages stay in its cache until the statement commits.
+    bool            shared;
+    bool            holds_write_lock;
+    SharedRegion*   shm;
+    uint64_t        seen_change_counter;
 } DbPager;
 
+// Log-linear latency histogram in nanoseconds: exact below
+// HISTOGRAM_SUB_BUCKETS, then HISTOGRAM_SUB_BUCKETS buckets per power of two
+// (about 3% relative error).
 typedef struct {
-    DbPager* db_pager;
-    uint32_t root_page_idx;
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total_count;
+    uint64_t min_value;
+    uint64_t max_value;
+} LatencyHistogram;
+
+typedef struct {
+    bool             timer_enabled;
+    FILE*            slow_log;
+    uint64_t         slow_threshold_ns;
+    LatencyHistogram histograms[NUM_STATEMENT_TYPES];
+} StatementStats;
+
+// One completed span. name and category point at static strings;
+// page_idx is INVALID_PAGE_IDX when the span has no page.
+typedef struct {
+    const char* name;
+    const char* category;
+    uint64_t    start_ns;
+    uint64_t    duration_ns;
+    uint32_t    page_idx;
+    uint32_t    thread_id;
+} TraceEvent;
+
+// Written only by its owning thread; head counts every event ever
+// recorded and is published after the slot is filled. A ring is handed
+// to a new thread once its owner exits.
+typedef struct TraceRing {
+    TraceEvent        events[TRACE_RING_EVENTS];
+    uint64_t          head;
+    bool              in_use;
+    struct TraceRing* next;
+} TraceRing;
+
+// Writer side of log shipping: row changes are buffered per statement
+// and appended to the log when the statement ends.
+typedef struct {
+    int       file_descriptor;
+    uint32_t  key_size;
+    uint64_t  log_length;
+    uint8_t*  buffer;
+    uint32_t  buffer_used;
+} ReplicationLog;
+
+// Follower side: a thread tails the log and applies complete records
+// under the pager latch.
+typedef struct {
+    int       file_descriptor;
+    char*     filename;
+    uint32_t  key_size;
+    uint64_t  applied_offset;
+    uint64_t  records_applied;
+    uint64_t  last_commit_time_ns;  // writer's clock, CLOCK_REALTIME
+    bool      stopped_on_error;
+    pthread_cond_t wakeup;
+    pthread_t thread;
+    bool      running;
+    bool      stop;
+} Replica;
+
+typedef struct LsmSkipNode {
+    bool                deleted;
+    uint32_t            height;
+    struct LsmSkipNode* next[];     // followed by the key and the row
+} LsmSkipNode;
+
+typedef struct {
+    LsmSkipNode* head;
+    uint32_t     height;
+    uint64_t     num_entries;
+    size_t       bytes;
+    uint64_t     random_state;
+} LsmMemtable;
+
+// An immutable sorted run: fixed-size entries (key, deleted flag, row)
+// packed into LSM_BLOCK_SIZE blocks, then the first key of every block
+// (fence pointers), a bloom filter over all keys and a footer. Fences and
+// bloom filter stay in memory while the run is open.
+typedef struct {
+    uint64_t id;
+    char*    filename;
+    int      file_descriptor;
+    uint64_t num_entries;
+    uint32_t num_blocks;
+    uint8_t* fences;
+    uint8_t* bloom;
+    uint32_t bloom_bytes;
+} LsmRun;
+
+// Level 0 holds up to LSM_L0_MAX_RUNS overlapping runs, oldest first.
+// Each deeper level is a single run, LSM_LEVEL_SIZE_RATIO times larger
+// than the one above before it is merged down. levels[0] is unused.
+typedef struct {
+    char*       db_filename;
+    uint32_t    key_size;
+    uint32_t    entry_size;
+    uint32_t    entries_per_block;
+    LsmMemtable memtable;
+    int         wal_file_descriptor;
+    uint8_t*    wal_buffer;
+    uint32_t    wal_buffer_used;
+    LsmRun*     level0[LSM_L0_MAX_RUNS];
+    uint32_t    num_level0_runs;
+    LsmRun*     levels[LSM_MAX_LEVELS + 1];
+    uint64_t    next_run_id;
+    uint8_t*    read_block;
+    uint64_t    flushes;
+    uint64_t    compactions;
+    uint64_t    bloom_skips;
+    uint64_t    block_reads;
+} Lsm;
+
+// One input of a merge: the memtable or a run, newest input first.
+typedef struct {
+    LsmSkipNode*   node;
+    LsmRun*        run;
+    uint64_t       next_entry;
+    uint8_t*       block;
+    uint32_t       loaded_block;
+    bool           valid;
+    bool           deleted;
+    const uint8_t* key;
+    const uint8_t* row;
+} LsmSource;
+
+typedef struct {
+    Lsm*      lsm;
+    LsmSource sources[LSM_L0_MAX_RUNS + LSM_MAX_LEVELS + 1];
+    uint32_t  num_sources;
+    bool      skip_deleted;
+    bool      deleted;
+    uint8_t   key[KEY_MAX_SIZE];
+    uint8_t   row[USER_ROW_SIZE];
+} LsmIterator;
+
+// Maps keys to the leaf last seen holding them. An entry is only a hint:
+// it is used if the page has not been freed since (same generation), is
+// still a leaf, and still holds the key.
+typedef struct {
+    uint8_t  key[KEY_MAX_SIZE];
+    uint32_t page_idx;              // INVALID_PAGE_IDX marks an empty slot
+    uint32_t generation;
+} HashIndexEntry;
+
+typedef struct {
+    HashIndexEntry* entries;
+    uint32_t        capacity;       // a power of two
+    uint32_t        num_entries;
+    uint32_t        key_size;
+    uint64_t        hits;
+    uint64_t        misses;
+    uint64_t        stale;
+} HashIndex;
+
+// Cache warm-up from the "<db>-hot" list written by the last close. A
+// thread loads the listed pages in sorted batches, holding the pager
+// latch for one batch at a time like the flusher.
+typedef struct {
+    char*     filename;
+    uint32_t* page_idxs;
+    uint32_t  num_pages;
+    uint32_t  pages_loaded;
+    DbPager*  db_pager;
+    pthread_t thread;
+    bool      running;
+    bool      stop;
+    bool      finished;
+} WarmUp;
+
+typedef struct DbTable {
+    DbPager*        db_pager;
+    uint32_t        root_page_idx;
+    NodeLayout      layout;
+    uint32_t        scan_threads;
+    size_t          sort_memory;
+    StatementStats* stats;
+    ReplicationLog* replication_log;
+    Replica*        replica;
+    WarmUp*         warm_up;
+    Lsm*            lsm;            // set when the database uses the LSM engine
+    HashIndex*      hash_index;     // set with --hash-index
+    Schema          schema;
+    char*           filename;
+    struct DbTable** partitions;    // set when the rows are spread over partition files
+    uint32_t        num_partitions;
+    DbOptions       partition_options;  // how the partition files are opened
 } DbTable;
 
 typedef struct {
@@ -113,4 +632,14 @@ typedef struct {
     bool     end_of_table;
 } TableCursor;
 
+// One key of a multi-key lookup. table_multi_get sorts lookups by key and
+// leaves the cell position of each key it finds.
+typedef struct {
+    uint8_t  key[KEY_MAX_SIZE];
+    uint32_t position;
+    uint32_t page_idx;
+    uint32_t cell_idx;
+    bool     found;
+} KeyLookup;
+
 #endif
\ No newline at end of file
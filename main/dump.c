@@ -0,0 +1,415 @@
+#include "dump.h"
+
+// Dump file layout (native byte order, like the db header):
+//   header:  magic[8] format_version:u32 key_type:u32 row_count:u64
+//   blocks:  payload_size:u32 num_rows:u32 crc32:u32 payload
+//   payload: rows of key[key_size], then each column in schema order:
+//            text as length:u16 and the characters, other types as
+//            stored in the row
+// A block with no rows ends the dump. The schema itself is not recorded:
+// a dump restores into a table created with the same columns.
+#define DUMP_HEADER_SIZE        24
+#define DUMP_BLOCK_HEADER_SIZE  12
+
+typedef struct {
+    uint64_t num_items;     // children (or rows) to place on this level
+    uint32_t num_nodes;
+    uint32_t first_page;
+    uint32_t current_node;
+    uint32_t filled;        // children (or rows) placed in current_node
+} BuildLevel;
+
+typedef struct {
+    DbTable*   table;
+    uint32_t   height;
+    BuildLevel levels[MAX_TREE_HEIGHT];
+} TreeBuilder;
+
+static uint32_t crc32_table[256];
+
+static uint32_t crc32(const uint8_t* data, size_t length) {
+    if (crc32_table[1] == 0) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++)
+                crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+            crc32_table[i] = crc;
+        }
+    }
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; i++)
+        crc = crc32_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static bool write_dump_header(FILE* file, KeyType key_type, uint64_t row_count) {
+    uint8_t header[DUMP_HEADER_SIZE];
+    uint32_t format_version = DUMP_FORMAT_VERSION, type = key_type;
+    memcpy(header, DUMP_MAGIC, 8);
+    memcpy(header + 8, &format_version, sizeof(uint32_t));
+    memcpy(header + 12, &type, sizeof(uint32_t));
+    memcpy(header + 16, &row_count, sizeof(uint64_t));
+    return fseeko(file, 0, SEEK_SET) == 0 && fwrite(header, DUMP_HEADER_SIZE, 1, file) == 1;
+}
+
+static bool write_dump_block(FILE* file, uint8_t* payload, uint32_t payload_size, uint32_t num_rows) {
+    uint8_t header[DUMP_BLOCK_HEADER_SIZE];
+    uint32_t checksum = crc32(payload, payload_size);
+    memcpy(header, &payload_size, sizeof(uint32_t));
+    memcpy(header + 4, &num_rows, sizeof(uint32_t));
+    memcpy(header + 8, &checksum, sizeof(uint32_t));
+    return fwrite(header, DUMP_BLOCK_HEADER_SIZE, 1, file) == 1 &&
+           (payload_size == 0 || fwrite(payload, payload_size, 1, file) == 1);
+}
+
+static uint32_t append_field(uint8_t* destination, const Column* column, const char* field) {
+    if (!column_is_text(column)) {
+        memcpy(destination, field, column->size);
+        return column->size;
+    }
+
+    uint16_t length = (uint16_t)strnlen(field, column->length);
+    memcpy(destination, &length, sizeof(uint16_t));
+    memcpy(destination + sizeof(uint16_t), field, length);
+    return sizeof(uint16_t) + length;
+}
+
+bool dump_table(DbTable* table, const char* filename) {
+    FILE* file = fopen(filename, "wb");
+    if (!file) {
+        perror(ANSI_COLOR_RED "Error opening dump file" ANSI_COLOR_RESET);
+        return false;
+    }
+
+    Schema* schema = &table->schema;
+    uint32_t key_size = table->layout.key_size;
+    uint32_t max_row_size = key_size + SCHEMA_MAX_COLUMNS * sizeof(uint16_t) + ROW_PAYLOAD_SIZE;
+    uint8_t* block = malloc(DUMP_BLOCK_SIZE);
+    uint32_t block_size = 0, block_rows = 0;
+    uint64_t row_count = 0;
+    bool ok = write_dump_header(file, table->layout.key_type, 0);
+
+    TableCursor* cursor = table_start(table);
+    while (ok && !(cursor->end_of_table)) {
+        if (block_size + max_row_size > DUMP_BLOCK_SIZE) {
+            ok = write_dump_block(file, block, block_size, block_rows);
+            block_size = block_rows = 0;
+        }
+
+        const char* row = cursor_value(cursor);
+        memcpy(block + block_size, cursor_key(cursor), key_size);
+        block_size += key_size;
+        for (uint32_t i = 0; i < schema->num_columns; i++)
+            block_size += append_field(block + block_size, &schema->columns[i], row + schema->columns[i].offset);
+        block_rows++;
+        row_count++;
+        cursor_advance(cursor);
+    }
+    free(cursor);
+
+    if (ok && block_rows > 0)
+        ok = write_dump_block(file, block, block_size, block_rows);
+    ok = ok && write_dump_block(file, block, 0, 0) && write_dump_header(file, table->layout.key_type, row_count);
+    ok = (fclose(file) == 0) && ok;
+    free(block);
+
+    if (!ok) {
+        printf(ANSI_COLOR_RED "Error writing dump file '%s'.\n" ANSI_COLOR_RESET, filename);
+        return false;
+    }
+    printf(ANSI_COLOR_YELLOW "Dumped %" PRIu64 " rows to '%s'.\n" ANSI_COLOR_RESET, row_count, filename);
+    return true;
+}
+
+static uint32_t items_in_node(BuildLevel* level, uint32_t node_idx) {
+    return (uint32_t)(level->num_items / level->num_nodes + (node_idx < level->num_items % level->num_nodes));
+}
+
+static uint32_t level_page(TreeBuilder* builder, uint32_t level_idx, uint32_t node_idx) {
+    if (level_idx == builder->height - 1)
+        return builder->table->root_page_idx;
+    return builder->levels[level_idx].first_page + node_idx;
+}
+
+// Sizes every level up front: rows (and children) are spread evenly, so
+// every node is at least half full. Nodes of one level get consecutive
+// pages past the end of the file (free pages are left alone), and the
+// single top node is the existing root page.
+static bool plan_tree(TreeBuilder* builder, uint64_t row_count) {
+    NodeLayout* layout = &builder->table->layout;
+    uint64_t items = row_count;
+    uint64_t capacity = layout->leaf_node_max_cells;
+    uint32_t next_page = builder->table->db_pager->num_pages;
+
+    builder->height = 0;
+    do {
+        if (builder->height == MAX_TREE_HEIGHT)
+            return false;
+        BuildLevel* level = &builder->levels[builder->height++];
+        uint64_t num_nodes = (items + capacity - 1) / capacity;
+        if (num_nodes > UINT32_MAX - next_page)
+            return false;
+
+        level->num_items = items;
+        level->num_nodes = (uint32_t)num_nodes;
+        level->first_page = next_page;
+        level->current_node = 0;
+        level->filled = 0;
+        if (num_nodes > 1)
+            next_page += (uint32_t)num_nodes;
+
+        items = num_nodes;
+        capacity = (uint64_t)layout->internal_node_max_keys + 1;
+    } while (items > 1);
+
+    return true;
+}
+
+static uint32_t parent_page(TreeBuilder* builder, uint32_t level_idx) {
+    if (level_idx + 1 >= builder->height)
+        return 0;
+    return level_page(builder, level_idx + 1, builder->levels[level_idx + 1].current_node);
+}
+
+// Appends a finished child to its parent on level_idx; a parent that is
+// now complete is in turn appended one level up.
+static void builder_add_child(TreeBuilder* builder, uint32_t level_idx, uint32_t child_page_idx, const uint8_t* child_max_key) {
+    if (level_idx >= builder->height)
+        return;
+
+    DbTable* table = builder->table;
+    BuildLevel* level = &builder->levels[level_idx];
+    uint32_t page_idx = level_page(builder, level_idx, level->current_node);
+    void* node = get_page_for_write(table->db_pager, page_idx);
+    if (level->filled == 0) {
+        initialize_internal_node(node);
+        set_node_root(node, level_idx == builder->height - 1);
+        *node_parent(node) = parent_page(builder, level_idx);
+    }
+
+    *node_parent(get_page_for_write(table->db_pager, child_page_idx)) = page_idx;
+    uint32_t num_children = items_in_node(level, level->current_node);
+    if (level->filled + 1 < num_children) {
+        *internal_node_num_keys(node) = level->filled + 1;
+        *internal_node_cell(table, node, level->filled) = child_page_idx;
+        memcpy(internal_node_key(table, node, level->filled), child_max_key, table->layout.key_size);
+    }
+    else
+        *internal_node_right_child(node) = child_page_idx;
+
+    if (++level->filled == num_children) {
+        level->current_node++;
+        level->filled = 0;
+        builder_add_child(builder, level_idx + 1, page_idx, child_max_key);
+    }
+}
+
+static void builder_add_row(TreeBuilder* builder, const uint8_t* key, UserRow* row) {
+    DbTable* table = builder->table;
+    BuildLevel* leaves = &builder->levels[0];
+    uint32_t page_idx = level_page(builder, 0, leaves->current_node);
+    void* node = get_page_for_write(table->db_pager, page_idx);
+    if (leaves->filled == 0) {
+        initialize_leaf_node(node);
+        set_node_root(node, builder->height == 1);
+        *node_parent(node) = parent_page(builder, 0);
+    }
+
+    memcpy(leaf_node_key(table, node, leaves->filled), key, table->layout.key_size);
+    *leaf_node_flags(table, node, leaves->filled) = 0;
+    serialize_user_row(row, leaf_node_value(table, node, leaves->filled));
+    *leaf_node_num_cells(node) = ++leaves->filled;
+
+    if (leaves->filled == items_in_node(leaves, leaves->current_node)) {
+        bool is_last = (leaves->current_node + 1 == leaves->num_nodes);
+        *leaf_node_next_leaf(node) = is_last ? 0 : level_page(builder, 0, leaves->current_node + 1);
+        leaves->current_node++;
+        leaves->filled = 0;
+        builder_add_child(builder, 1, page_idx, key);
+
+        // No page pointers are held here, so let the cache shrink and the
+        // flusher catch up.
+        pager_yield(table->db_pager);
+    }
+}
+
+static bool read_field(const uint8_t** position, const uint8_t* end, const Column* column, uint8_t* destination) {
+    if (!column_is_text(column)) {
+        if ((size_t)(end - *position) < column->size)
+            return false;
+        memcpy(destination, *position, column->size);
+        *position += column->size;
+        return true;
+    }
+
+    uint16_t length;
+    if ((size_t)(end - *position) < sizeof(uint16_t))
+        return false;
+    memcpy(&length, *position, sizeof(uint16_t));
+    *position += sizeof(uint16_t);
+    if (length > column->length || (size_t)(end - *position) < length)
+        return false;
+
+    memcpy(destination, *position, length);
+    memset(destination + length, 0, column->size - length);
+    *position += length;
+    return true;
+}
+
+static const char* restore_rows(TreeBuilder* builder, FILE* file, uint64_t row_count) {
+    DbTable* table = builder->table;
+    Schema* schema = &table->schema;
+    uint32_t key_size = table->layout.key_size;
+    uint8_t previous_key[KEY_MAX_SIZE];
+    uint64_t rows_read = 0;
+    const char* error = NULL;
+    uint8_t* block = malloc(DUMP_BLOCK_SIZE);
+
+    while (!error) {
+        uint8_t header[DUMP_BLOCK_HEADER_SIZE];
+        uint32_t payload_size, num_rows, checksum;
+        if (fread(header, DUMP_BLOCK_HEADER_SIZE, 1, file) != 1) {
+            error = "dump file is truncated";
+            break;
+        }
+        memcpy(&payload_size, header, sizeof(uint32_t));
+        memcpy(&num_rows, header + 4, sizeof(uint32_t));
+        memcpy(&checksum, header + 8, sizeof(uint32_t));
+        if (num_rows == 0)
+            break;
+        if (payload_size > DUMP_BLOCK_SIZE || fread(block, payload_size, 1, file) != 1) {
+            error = "dump file is truncated";
+            break;
+        }
+        if (crc32(block, payload_size) != checksum) {
+            error = "block checksum mismatch";
+            break;
+        }
+        if (num_rows > row_count - rows_read) {
+            error = "dump has more rows than its header declares";
+            break;
+        }
+
+        const uint8_t* position = block;
+        const uint8_t* end = block + payload_size;
+        for (uint32_t i = 0; i < num_rows; i++) {
+            UserRow row;
+            if ((size_t)(end - position) < key_size) {
+                error = "malformed row";
+                break;
+            }
+            const uint8_t* key = position;
+            position += key_size;
+            memset(row.values, 0, ROW_PAYLOAD_SIZE);
+            for (uint32_t j = 0; j < schema->num_columns && !error; j++)
+                if (!read_field(&position, end, &schema->columns[j], user_row_field(&row, &schema->columns[j])))
+                    error = "malformed row";
+            if (error)
+                break;
+            if (rows_read > 0 && compare_keys(key, previous_key, key_size) <= 0) {
+                error = "rows are not in key order";
+                break;
+            }
+
+            decode_key(table->layout.key_type, key, &row.tenant_id, &row.id);
+            builder_add_row(builder, key, &row);
+            memcpy(previous_key, key, key_size);
+            rows_read++;
+        }
+        if (!error && position != end)
+            error = "malformed block";
+    }
+
+    if (!error && rows_read != row_count)
+        error = "dump has fewer rows than its header declares";
+    free(block);
+    return error;
+}
+
+bool restore_table(DbTable* table, const char* filename) {
+    DbPager* db_pager = table->db_pager;
+    if (table->replica) {
+        printf(ANSI_COLOR_RED "Error: This database is a read-only replica.\n" ANSI_COLOR_RESET);
+        return false;
+    }
+
+    void* root = get_page(db_pager, table->root_page_idx);
+    if (get_node_type(root) != NODE_LEAF || *leaf_node_num_cells(root) != *leaf_node_num_tombstones(root)) {
+        printf(ANSI_COLOR_RED "Error: .restore needs an empty table.\n" ANSI_COLOR_RESET);
+        return false;
+    }
+
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        perror(ANSI_COLOR_RED "Error opening dump file" ANSI_COLOR_RESET);
+        return false;
+    }
+
+    uint8_t header[DUMP_HEADER_SIZE];
+    uint32_t format_version, key_type;
+    uint64_t row_count;
+    if (fread(header, DUMP_HEADER_SIZE, 1, file) != 1 || memcmp(header, DUMP_MAGIC, 8) != 0) {
+        printf(ANSI_COLOR_RED "Error: '%s' is not a dump file.\n" ANSI_COLOR_RESET, filename);
+        fclose(file);
+        return false;
+    }
+    memcpy(&format_version, header + 8, sizeof(uint32_t));
+    memcpy(&key_type, header + 12, sizeof(uint32_t));
+    memcpy(&row_count, header + 16, sizeof(uint64_t));
+    if (format_version != DUMP_FORMAT_VERSION) {
+        printf(ANSI_COLOR_RED "Unsupported dump format version %u (expected %u).\n" ANSI_COLOR_RESET, format_version, DUMP_FORMAT_VERSION);
+        fclose(file);
+        return false;
+    }
+    if (key_type != table->layout.key_type) {
+        printf(ANSI_COLOR_RED "Error: dump key type does not match this table (%s).\n" ANSI_COLOR_RESET, key_type_name(table->layout.key_type));
+        fclose(file);
+        return false;
+    }
+    if (row_count == 0) {
+        fclose(file);
+        printf(ANSI_COLOR_YELLOW "Restored 0 rows from '%s'.\n" ANSI_COLOR_RESET, filename);
+        return true;
+    }
+
+    TreeBuilder builder;
+    builder.table = table;
+    uint32_t first_new_page = db_pager->num_pages;
+    if (!plan_tree(&builder, row_count)) {
+        printf(ANSI_COLOR_RED "Error: dump is too large for this database.\n" ANSI_COLOR_RESET);
+        fclose(file);
+        return false;
+    }
+
+    pager_begin_write(db_pager);
+    const char* error = restore_rows(&builder, file, row_count);
+    if (error) {
+        // Throw away the partial tree: drop the new pages and make the
+        // root an empty leaf again.
+        pager_truncate(db_pager, first_new_page);
+        root = get_page_for_write(db_pager, table->root_page_idx);
+        initialize_leaf_node(root);
+        set_node_root(root, true);
+    }
+    pager_end_write(db_pager);
+    fclose(file);
+
+    if (error) {
+        printf(ANSI_COLOR_RED "Error restoring '%s': %s.\n" ANSI_COLOR_RESET, filename, error);
+        return false;
+    }
+
+    // Rows are only shipped once the whole restore has succeeded.
+    if (table->replication_log) {
+        TableCursor* cursor = table_start(table);
+        while (!(cursor->end_of_table)) {
+            replication_log_put(table->replication_log, cursor_key(cursor), cursor_value(cursor));
+            cursor_advance(cursor);
+        }
+        free(cursor);
+        replication_log_commit(table->replication_log);
+    }
+    printf(ANSI_COLOR_YELLOW "Restored %" PRIu64 " rows from '%s'.\n" ANSI_COLOR_RESET, row_count, filename);
+    return true;
+}
@@ -0,0 +1,14 @@
+#ifndef DB_DUMP_H
+#define DB_DUMP_H
+
+#include "common.h"
+#include "table.h"
+#include "pager.h"
+#include "row.h"
+#include "node.h"
+#include "key.h"
+
+bool dump_table(DbTable* table, const char* filename);
+bool restore_table(DbTable* table, const char* filename);
+
+#endif
@@ -1,102 +1,634 @@
 #include "execution.h"
 
-ExecuteResult execute_statement(Statement* statement, DbTable* table) {
+static bool statement_is_write(Statement* statement) {
+    switch (statement->type) {
+        case (STATEMENT_INSERT):
+        case (STATEMENT_INSERT_BATCH):
+        case (STATEMENT_DROP):
+        case (STATEMENT_DROP_RANGE):
+        case (STATEMENT_UPDATE):
+        case (STATEMENT_IMPORT):
+        case (STATEMENT_CREATE_TABLE):
+            return true;
+        default:
+            return false;
+    }
+}
+
+// The LSM engine has no cursor to seek or to modify rows under, so
+// statements that need one are refused.
+static bool lsm_supports_statement(Statement* statement) {
+    switch (statement->type) {
+        case (STATEMENT_PREFIX_SELECT):
+        case (STATEMENT_DROP_RANGE):
+            return false;
+        case (STATEMENT_SELECT):
+            return !statement->has_order;
+        case (STATEMENT_DROP):
+        case (STATEMENT_UPDATE):
+            return !statement->has_where;
+        default:
+            return true;
+    }
+}
+
+static ExecuteResult dispatch_statement(Statement* statement, DbTable* table) {
     switch (statement->type) {
         case (STATEMENT_INSERT):
             return execute_insert(statement, table);
+        case (STATEMENT_INSERT_BATCH):
+            return execute_insert_batch(statement, table);
         case (STATEMENT_SELECT):
         case (STATEMENT_SPECIFIC_SELECT):
+        case (STATEMENT_PREFIX_SELECT):
+        case (STATEMENT_MULTI_SELECT):
             return execute_select(statement, table);
         case (STATEMENT_DROP):
             return execute_drop(statement, table);
+        case (STATEMENT_DROP_RANGE):
+            return execute_drop_range(statement, table);
         case (STATEMENT_UPDATE):
             return execute_update(statement, table);
         case (STATEMENT_IMPORT):
             return execute_import(statement, table);
         case (STATEMENT_EXPORT):
             return execute_export(statement, table);
+        case (STATEMENT_CREATE_TABLE):
+            return execute_create_table(statement, table);
     }
 
     return EXECUTE_SILENT_ERROR;
 }
 
+// A statement on a partitioned table runs inside the write mode and the
+// end-of-statement work of every partition as well as the main file.
+static void begin_statement(DbTable* table, bool is_write) {
+    db_begin_access(table, is_write);
+    if (is_write)
+        pager_begin_write(table->db_pager);
+    for (uint32_t i = 0; i < table->num_partitions; i++)
+        begin_statement(table->partitions[i], is_write);
+}
+
+static void end_statement(DbTable* table, bool is_write) {
+    for (uint32_t i = 0; i < table->num_partitions; i++)
+        end_statement(table->partitions[i], is_write);
+    if (is_write)
+        pager_end_write(table->db_pager);
+    if (is_write && table->replication_log)
+        replication_log_commit(table->replication_log);
+    if (is_write && table->lsm)
+        lsm_commit(table->lsm);
+    db_end_access(table);
+    pager_end_statement(table->db_pager);
+}
+
+ExecuteResult execute_statement(Statement* statement, DbTable* table) {
+    StatementSample sample;
+    bool is_write = statement_is_write(statement);
+    if (is_write && table->replica) {
+        printf(ANSI_COLOR_RED "Error: This database is a read-only replica.\n" ANSI_COLOR_RESET);
+        return EXECUTE_SILENT_ERROR;
+    }
+    if (table_partition(table, 0)->lsm && !lsm_supports_statement(statement)) {
+        printf(ANSI_COLOR_RED "Error: This statement is not supported by the lsm engine.\n" ANSI_COLOR_RESET);
+        return EXECUTE_SILENT_ERROR;
+    }
+
+    TRACE_BEGIN(span);
+    stats_begin_statement(table, &sample);
+    begin_statement(table, is_write);
+    ExecuteResult result = dispatch_statement(statement, table);
+    end_statement(table, is_write);
+    stats_end_statement(table, &sample, statement);
+    TRACE_END(span, statement_type_name(statement->type), "statement", INVALID_PAGE_IDX);
+
+    return result;
+}
+
+// Returns why the statement's key literals do not fit the table's key
+// type, or NULL if they do.
+const char* statement_key_error(Statement* statement, DbTable* table) {
+    bool table_has_tenant = (table->layout.key_type == KEY_TYPE_TENANT_INT64);
+    if (statement->key_has_tenant == table_has_tenant)
+        return NULL;
+    if (table_has_tenant)
+        return "Table is keyed by (tenant_id, id); use {tenant_id}:{id}.";
+    return "Table is keyed by id only; tenant prefixes are not allowed.";
+}
+
+bool statement_key(Statement* statement, DbTable* table, uint64_t tenant_id, uint64_t id, uint8_t* key) {
+    const char* error = statement_key_error(statement, table);
+    if (error) {
+        printf(ANSI_COLOR_RED "Error: %s\n" ANSI_COLOR_RESET, error);
+        return false;
+    }
+
+    encode_key(table->layout.key_type, tenant_id, id, key);
+    return true;
+}
+
+// The noun to follow a row count.
+static const char* rows_noun(uint64_t count) {
+    return count == 1 ? "row" : "rows";
+}
+
+static void print_key_not_found(DbTable* table, const uint8_t* key) {
+    char key_text[KEY_LITERAL_MAX_LENGTH + 1];
+    format_key(table->layout.key_type, key, key_text, sizeof(key_text));
+    printf(ANSI_COLOR_RED "Error: Record with ID %s not found.\n" ANSI_COLOR_RESET, key_text);
+}
+
+// Keys are zero-padded to KEY_MAX_SIZE, so both key types order by memcmp.
+// Equal keys keep their statement order and the first one wins.
+static int compare_batch_rows(const void* a, const void* b) {
+    const BatchRow* row_a = a;
+    const BatchRow* row_b = b;
+    int cmp = memcmp(row_a->key, row_b->key, KEY_MAX_SIZE);
+    if (cmp != 0)
+        return cmp;
+    return (row_a->position > row_b->position) - (row_a->position < row_b->position);
+}
+
+// Each row costs a point lookup for the duplicate check; the write itself
+// only touches the memtable.
+static uint32_t lsm_insert_rows(Lsm* lsm, BatchRow* rows, uint32_t num_rows) {
+    uint32_t inserted = 0;
+    char row[USER_ROW_SIZE];
+    for (uint32_t i = 0; i < num_rows; i++) {
+        rows[i].inserted = !lsm_get(lsm, rows[i].key, NULL);
+        if (!rows[i].inserted)
+            continue;
+        serialize_user_row(&rows[i].row, row);
+        lsm_put(lsm, rows[i].key, row);
+        inserted++;
+    }
+    return inserted;
+}
+
+typedef struct {
+    BatchRow* rows;                             // grouped by partition
+    uint32_t  starts[MAX_PARTITIONS + 1];       // partition n holds rows [starts[n], starts[n + 1])
+    uint32_t  inserted[MAX_PARTITIONS];
+} PartitionedInsert;
+
+static void insert_partition_rows(DbTable* partition, uint32_t partition_idx, void* context) {
+    PartitionedInsert* insert = context;
+    uint32_t first = insert->starts[partition_idx];
+    insert->inserted[partition_idx] = insert_rows(partition, insert->rows + first, insert->starts[partition_idx + 1] - first);
+}
+
+// Splits a sorted batch into one group per partition and inserts the
+// groups on their own threads. Each group stays sorted, so the batch is
+// put back in key order afterwards.
+static uint32_t insert_partitioned_rows(DbTable* table, BatchRow* rows, uint32_t num_rows) {
+    PartitionedInsert insert;
+    bool selected[MAX_PARTITIONS] = { false };
+    uint32_t next[MAX_PARTITIONS];
+    uint32_t* row_partitions = malloc((size_t)num_rows * sizeof(uint32_t));
+    memset(insert.starts, 0, sizeof(insert.starts));
+    memset(insert.inserted, 0, sizeof(insert.inserted));
+    for (uint32_t i = 0; i < num_rows; i++) {
+        row_partitions[i] = partition_index(table, rows[i].key);
+        selected[row_partitions[i]] = true;
+        insert.starts[row_partitions[i] + 1]++;
+    }
+    for (uint32_t p = 0; p < table->num_partitions; p++)
+        insert.starts[p + 1] += insert.starts[p];
+
+    insert.rows = malloc((size_t)num_rows * sizeof(BatchRow));
+    memcpy(next, insert.starts, table->num_partitions * sizeof(uint32_t));
+    for (uint32_t i = 0; i < num_rows; i++)
+        insert.rows[next[row_partitions[i]]++] = rows[i];
+
+    partitions_run(table, selected, insert_partition_rows, &insert);
+
+    memcpy(next, insert.starts, table->num_partitions * sizeof(uint32_t));
+    for (uint32_t i = 0; i < num_rows; i++)
+        rows[i] = insert.rows[next[row_partitions[i]]++];
+    uint32_t inserted = 0;
+    for (uint32_t p = 0; p < table->num_partitions; p++)
+        inserted += insert.inserted[p];
+
+    free(insert.rows);
+    free(row_partitions);
+    return inserted;
+}
+
+// Inserts rows with encoded keys in key order. While the next key is no
+// greater than the separator bounding the current leaf it is placed with a
+// binary search of that leaf instead of a descent from the root; a split
+// sends the next row back through the root. Rows whose key already exists
+// are skipped. Returns the number of rows inserted.
+uint32_t insert_rows(DbTable* table, BatchRow* rows, uint32_t num_rows) {
+    uint32_t key_size = table->layout.key_size;
+    qsort(rows, num_rows, sizeof(BatchRow), compare_batch_rows);
+    if (table->partitions)
+        return insert_partitioned_rows(table, rows, num_rows);
+    if (table->lsm)
+        return lsm_insert_rows(table->lsm, rows, num_rows);
+
+    TableCursor cursor;
+    uint8_t upper_bound[KEY_MAX_SIZE];
+    bool in_leaf = false;
+    bool bounded = false;
+    uint32_t inserted = 0;
+    for (uint32_t i = 0; i < num_rows; i++) {
+        BatchRow* batch_row = &rows[i];
+        batch_row->inserted = false;
+        if (in_leaf && (!bounded || compare_keys(batch_row->key, upper_bound, key_size) <= 0))
+            leaf_node_seek(table, cursor.page_idx, batch_row->key, &cursor);
+        else
+            bounded = table_find_leaf(table, batch_row->key, &cursor, upper_bound);
+        in_leaf = true;
+
+        void* node = get_page(table->db_pager, cursor.page_idx);
+        if (leaf_node_has_key(table, node, cursor.cell_idx, batch_row->key))
+            continue;
+        if (*leaf_node_num_cells(node) >= table->layout.leaf_node_max_cells && *leaf_node_num_tombstones(node) == 0)
+            in_leaf = false;
+
+        leaf_node_insert(&cursor, batch_row->key, &batch_row->row);
+        if (table->replication_log) {
+            char row[USER_ROW_SIZE];
+            serialize_user_row(&batch_row->row, row);
+            replication_log_put(table->replication_log, batch_row->key, row);
+        }
+        batch_row->inserted = true;
+        inserted++;
+    }
+
+    return inserted;
+}
+
 ExecuteResult execute_insert(Statement* statement, DbTable* table) {
     UserRow* user_to_insert = &(statement->payload.user_to_insert);
-    uint32_t key_to_insert = user_to_insert->id;
-    TableCursor* cursor = table_find(table, key_to_insert);
+    BatchRow batch_row;
+    memset(batch_row.key, 0, KEY_MAX_SIZE);
+    if (!statement_key(statement, table, user_to_insert->tenant_id, user_to_insert->id, batch_row.key))
+        return EXECUTE_SILENT_ERROR;
+    batch_row.row = *user_to_insert;
+    batch_row.position = 0;
 
-    void* node = get_page(table->db_pager, cursor->page_idx);
-    uint32_t num_cells = *leaf_node_num_cells(node);
-    if (cursor->cell_idx < num_cells) {
-        uint32_t key_at_index = *leaf_node_key(node, cursor->cell_idx);
-        if (key_at_index == key_to_insert)
-            return EXECUTE_DUPLICATE_KEY;
+    if (insert_rows(table, &batch_row, 1) == 0)
+        return EXECUTE_DUPLICATE_KEY;
+    return EXECUTE_SUCCESS;
+}
+
+ExecuteResult execute_insert_batch(Statement* statement, DbTable* table) {
+    RowBatch* batch = &(statement->payload.batch);
+    for (uint32_t i = 0; i < batch->num_rows; i++) {
+        BatchRow* batch_row = &(batch->rows[i]);
+        memset(batch_row->key, 0, KEY_MAX_SIZE);
+        if (!statement_key(statement, table, batch_row->row.tenant_id, batch_row->row.id, batch_row->key))
+            return EXECUTE_SILENT_ERROR;
+        batch_row->position = i;
     }
-    leaf_node_insert(cursor, user_to_insert->id, user_to_insert);
 
-    free(cursor);
+    uint32_t inserted = insert_rows(table, batch->rows, batch->num_rows);
+    if (inserted < batch->num_rows) {
+        char key_text[KEY_LITERAL_MAX_LENGTH + 1];
+        for (uint32_t i = 0; i < batch->num_rows; i++) {
+            if (batch->rows[i].inserted)
+                continue;
+            format_key(table->layout.key_type, batch->rows[i].key, key_text, sizeof(key_text));
+            printf(ANSI_COLOR_RED "Error: Duplicate key %s, row skipped.\n" ANSI_COLOR_RESET, key_text);
+        }
+    }
+    printf(ANSI_COLOR_YELLOW "(Inserted %u of %u %s)\n" ANSI_COLOR_RESET, inserted, batch->num_rows, rows_noun(batch->num_rows));
     return EXECUTE_SUCCESS;
 }
 
+static bool print_row(DbTable* table, void* context, FILE* output, const uint8_t* key, void* row) {
+    Statement* statement = context;
+    (void)key;
+    if (statement->has_where && !predicate_matches(&statement->where, row))
+        return false;
+
+    UserRow user;
+    deserialize_user_row(row, &user);
+    write_user_row(output, &user, &table->schema, table->layout.key_type);
+    return true;
+}
+
+static void print_sorted_row(void* context, const uint8_t* key, void* row) {
+    DbTable* table = context;
+    UserRow user;
+    (void)key;
+    deserialize_user_row(row, &user);
+    print_user_row(&user, &table->schema, table->layout.key_type);
+}
+
+static bool count_row(DbTable* table, void* context, FILE* output, const uint8_t* key, void* row) {
+    Statement* statement = context;
+    (void)table;
+    (void)output;
+    (void)key;
+    return !statement->has_where || predicate_matches(&statement->where, row);
+}
+
+static bool export_row(DbTable* table, void* context, FILE* output, const uint8_t* key, void* row) {
+    Schema* schema = &table->schema;
+    char key_text[KEY_LITERAL_MAX_LENGTH + 1];
+    (void)context;
+    format_key(table->layout.key_type, key, key_text, sizeof(key_text));
+    fputs(key_text, output);
+    for (uint32_t i = 0; i < schema->num_columns; i++) {
+        fputc(',', output);
+        write_column_value(output, &schema->columns[i], (char*)row + schema->columns[i].offset);
+    }
+    fputc('\n', output);
+    return true;
+}
+
+// Copies the row stored under key into row, if row is not NULL. Returns
+// false if there is no such row.
+static bool fetch_row(DbTable* table, const uint8_t* key, void* row) {
+    table = partition_for_key(table, key);
+    if (table->lsm)
+        return lsm_get(table->lsm, key, row);
+
+    TableCursor* cursor = table_find(table, key);
+    bool found = leaf_node_has_key(table, get_page(table->db_pager, cursor->page_idx), cursor->cell_idx, key);
+    if (found && row)
+        memcpy(row, cursor_value(cursor), USER_ROW_SIZE);
+    free(cursor);
+    return found;
+}
+
 ExecuteResult execute_select(Statement* statement, DbTable* table) {
     UserRow user;
+    KeyType key_type = table->layout.key_type;
     if (statement->type == STATEMENT_SPECIFIC_SELECT) {
-        uint32_t key_to_find = statement->payload.user_to_insert.id;
+        uint8_t key_to_find[KEY_MAX_SIZE];
+        UserRow* key = &(statement->payload.user_to_insert);
+        if (!statement_key(statement, table, key->tenant_id, key->id, key_to_find))
+            return EXECUTE_SILENT_ERROR;
+
+        table = partition_for_key(table, key_to_find);
+        if (table->lsm) {
+            char row[USER_ROW_SIZE];
+            if (!lsm_get(table->lsm, key_to_find, row)) {
+                print_key_not_found(table, key_to_find);
+                return EXECUTE_SUCCESS;
+            }
+            deserialize_user_row(row, &user);
+            print_user_row(&user, &table->schema, key_type);
+            printf(ANSI_COLOR_YELLOW "(Fetched 1 row)\n" ANSI_COLOR_RESET);
+            return EXECUTE_SUCCESS;
+        }
+
         TableCursor* cursor = table_find(table, key_to_find);
         void* node = get_page(table->db_pager, cursor->page_idx);
-        uint32_t num_cells = *leaf_node_num_cells(node);
+        if (leaf_node_has_key(table, node, cursor->cell_idx, key_to_find)) {
+            deserialize_user_row(cursor_value(cursor), &user);
+            print_user_row(&user, &table->schema, key_type);
+            printf(ANSI_COLOR_YELLOW "(Fetched 1 row)\n" ANSI_COLOR_RESET);
+        }
+        else
+            print_key_not_found(table, key_to_find);
 
-        if (cursor->cell_idx < num_cells) {
-            uint32_t key_at_index = *leaf_node_key(node, cursor->cell_idx);
-            if (key_at_index == key_to_find) {
+        free(cursor);
+    }
+    else if (statement->type == STATEMENT_PREFIX_SELECT) {
+        uint8_t prefix[KEY_MAX_SIZE];
+        if (!statement_key(statement, table, statement->payload.user_to_insert.tenant_id, 0, prefix))
+            return EXECUTE_SILENT_ERROR;
+
+        // Composite keys encode the tenant first, so one tenant's rows are a
+        // contiguous key range: seek to (tenant, 0) and stop at the first
+        // key whose tenant prefix differs. Range partitions split on the
+        // tenant, so only one of them can hold the rows.
+        uint32_t first = 0, last = table_num_partitions(table);
+        if (table->partitions && table->db_pager->header.partition_width > 0) {
+            first = partition_index(table, prefix);
+            last = first + 1;
+        }
+        uint32_t row_count = 0;
+        for (uint32_t i = first; i < last; i++) {
+            TableCursor* cursor = table_seek(table_partition(table, i), prefix);
+            while (!(cursor->end_of_table) && memcmp(cursor_key(cursor), prefix, sizeof(uint64_t)) == 0) {
                 deserialize_user_row(cursor_value(cursor), &user);
-                print_user_row(&user);
-                printf(ANSI_COLOR_YELLOW "(Fetched 1 row)\n" ANSI_COLOR_RESET);
+                print_user_row(&user, &table->schema, key_type);
+                cursor_advance(cursor);
+                row_count++;
             }
-            else
-                printf(ANSI_COLOR_RED "Error: Record with ID %u not found.\n" ANSI_COLOR_RESET, key_to_find);
+            free(cursor);
         }
-        else
-            printf(ANSI_COLOR_RED "Error: Record with ID %u not found.\n" ANSI_COLOR_RESET, key_to_find);
-        
-        free(cursor);
 
+        printf(ANSI_COLOR_YELLOW "(Fetched %u %s)\n" ANSI_COLOR_RESET, row_count, rows_noun(row_count));
     }
-    else {
-        TableCursor* cursor = table_start(table);
+    else if (statement->type == STATEMENT_MULTI_SELECT) {
+        KeyList* list = &(statement->payload.key_list);
+        KeyLookup* lookups = malloc(list->num_keys * sizeof(KeyLookup));
+        for (uint32_t i = 0; i < list->num_keys; i++) {
+            memset(lookups[i].key, 0, KEY_MAX_SIZE);
+            if (!statement_key(statement, table, list->keys[i].tenant_id, list->keys[i].id, lookups[i].key)) {
+                free(lookups);
+                return EXECUTE_SILENT_ERROR;
+            }
+            lookups[i].position = i;
+        }
+
+        // Lookups come back in key order; a key listed twice prints once.
+        // LSM and partitioned lookups are made one key at a time, in the
+        // same order as the rows are printed.
+        bool batched = !table->lsm && !table->partitions;
+        if (batched)
+            table_multi_get(table, lookups, list->num_keys);
+        else
+            sort_key_lookups(lookups, list->num_keys);
         uint32_t row_count = 0;
-        while (!(cursor->end_of_table)) {
-            deserialize_user_row(cursor_value(cursor), &user);
-            print_user_row(&user);
-            cursor_advance(cursor);
+        char fetched_row[USER_ROW_SIZE];
+        for (uint32_t i = 0; i < list->num_keys; i++) {
+            if (i > 0 && memcmp(lookups[i].key, lookups[i - 1].key, KEY_MAX_SIZE) == 0)
+                continue;
+            void* row = fetched_row;
+            if (!batched) {
+                if (!fetch_row(table, lookups[i].key, statement->count_only ? NULL : fetched_row))
+                    continue;
+            }
+            else {
+                if (!lookups[i].found)
+                    continue;
+                row = leaf_node_value(table, get_page(table->db_pager, lookups[i].page_idx), lookups[i].cell_idx);
+            }
             row_count++;
+            if (statement->count_only)
+                continue;
+            deserialize_user_row(row, &user);
+            print_user_row(&user, &table->schema, key_type);
         }
+        free(lookups);
 
-        printf(ANSI_COLOR_YELLOW "(Fetched %u rows)\n" ANSI_COLOR_RESET, row_count);
-        free(cursor);
+        if (statement->count_only)
+            printf("%u\n", row_count);
+        else
+            printf(ANSI_COLOR_YELLOW "(Fetched %u %s)\n" ANSI_COLOR_RESET, row_count, rows_noun(row_count));
+    }
+    else if (statement->has_order) {
+        SortOperator sorter;
+        sort_init(&sorter, &statement->order, table->layout.key_size, table->sort_memory);
+        for (uint32_t i = 0; i < table_num_partitions(table); i++) {
+            TableCursor* cursor = table_start(table_partition(table, i));
+            while (!(cursor->end_of_table)) {
+                void* row = cursor_value(cursor);
+                if (!statement->has_where || predicate_matches(&statement->where, row))
+                    sort_add_row(&sorter, cursor_key(cursor), row);
+                cursor_advance(cursor);
+            }
+            free(cursor);
+        }
+
+        uint64_t row_count = sort_finish(&sorter, print_sorted_row, table);
+        printf(ANSI_COLOR_YELLOW "(Fetched %" PRIu64 " %s)\n" ANSI_COLOR_RESET, row_count, rows_noun(row_count));
+    }
+    else {
+        // Full and filtered scans go through the parallel scan; the
+        // predicate runs on the serialized cell and only matching rows are
+        // copied out.
+        uint64_t row_count = table_scan(table, statement->count_only ? count_row : print_row, statement, stdout);
+        if (statement->count_only)
+            printf("%" PRIu64 "\n", row_count);
+        else
+            printf(ANSI_COLOR_YELLOW "(Fetched %" PRIu64 " %s)\n" ANSI_COLOR_RESET, row_count, rows_noun(row_count));
     }
     return EXECUTE_SUCCESS;
 }
 
-ExecuteResult execute_drop(Statement* statement, DbTable* table) {
-    uint32_t key_to_delete = statement->payload.user_to_insert.id;
+// Removes the row with the given key. Returns false if there is none.
+bool delete_key(DbTable* table, const uint8_t* key_to_delete) {
+    table = partition_for_key(table, key_to_delete);
+    if (table->lsm) {
+        if (!lsm_get(table->lsm, key_to_delete, NULL))
+            return false;
+        lsm_delete(table->lsm, key_to_delete);
+        return true;
+    }
+
     TableCursor* cursor = table_find(table, key_to_delete);
     void* node = get_page(table->db_pager, cursor->page_idx);
 
-    if (cursor->cell_idx >= *leaf_node_num_cells(node) || *leaf_node_key(node, cursor->cell_idx) != key_to_delete) {
-        printf(ANSI_COLOR_RED "Error: Record with ID %u not found.\n" ANSI_COLOR_RESET, key_to_delete);
+    if (!leaf_node_has_key(table, node, cursor->cell_idx, key_to_delete)) {
         free(cursor);
-        return EXECUTE_SUCCESS;
+        return false;
     }
 
-    uint32_t page_idx_to_adjust = cursor->page_idx;
-    leaf_node_remove_cell(node, cursor->cell_idx);
-    adjust_tree_after_delete(table, page_idx_to_adjust);
+    leaf_node_delete(table, cursor->page_idx, cursor->cell_idx);
+    if (table->replication_log)
+        replication_log_delete(table->replication_log, key_to_delete);
 
     free(cursor);
+    return true;
+}
+
+// Deleting rebalances the tree under the cursor, so matching keys are
+// collected in one scan and deleted afterwards. Returns the number of
+// rows deleted from this tree.
+static uint32_t drop_matching_rows(Statement* statement, DbTable* table) {
+    uint32_t key_size = table->layout.key_size;
+    uint32_t num_keys = 0, max_keys = 64;
+    uint8_t* keys = malloc((size_t)max_keys * key_size);
+
+    TableCursor* cursor = table_start(table);
+    while (!(cursor->end_of_table)) {
+        if (predicate_matches(&statement->where, cursor_value(cursor))) {
+            if (num_keys == max_keys) {
+                max_keys *= 2;
+                keys = realloc(keys, (size_t)max_keys * key_size);
+            }
+            memcpy(keys + (size_t)num_keys * key_size, cursor_key(cursor), key_size);
+            num_keys++;
+        }
+        cursor_advance(cursor);
+    }
+    free(cursor);
+
+    for (uint32_t i = 0; i < num_keys; i++)
+        delete_key(table, keys + (size_t)i * key_size);
+    free(keys);
+    return num_keys;
+}
+
+static ExecuteResult execute_drop_where(Statement* statement, DbTable* table) {
+    uint32_t row_count = 0;
+    for (uint32_t i = 0; i < table_num_partitions(table); i++)
+        row_count += drop_matching_rows(statement, table_partition(table, i));
+
+    printf(ANSI_COLOR_YELLOW "(Deleted %u %s)\n" ANSI_COLOR_RESET, row_count, rows_noun(row_count));
+    return EXECUTE_SUCCESS;
+}
+
+ExecuteResult execute_drop(Statement* statement, DbTable* table) {
+    if (statement->has_where)
+        return execute_drop_where(statement, table);
+
+    uint8_t key_to_delete[KEY_MAX_SIZE];
+    UserRow* key = &(statement->payload.user_to_insert);
+    if (!statement_key(statement, table, key->tenant_id, key->id, key_to_delete))
+        return EXECUTE_SILENT_ERROR;
+
+    if (!delete_key(table, key_to_delete))
+        print_key_not_found(table, key_to_delete);
+
+    return EXECUTE_SUCCESS;
+}
+
+ExecuteResult execute_drop_range(Statement* statement, DbTable* table) {
+    uint8_t low[KEY_MAX_SIZE], high[KEY_MAX_SIZE];
+    KeyRange* range = &(statement->payload.key_range);
+    if (!statement_key(statement, table, range->low_tenant_id, range->low_id, low) ||
+        !statement_key(statement, table, range->high_tenant_id, range->high_id, high))
+        return EXECUTE_SILENT_ERROR;
+
+    uint32_t pages_released = 0;
+    uint64_t rows_trimmed = 0;
+    for (uint32_t i = 0; i < table_num_partitions(table); i++) {
+        uint32_t partition_pages_released;
+        rows_trimmed += table_delete_range(table_partition(table, i), low, high, &partition_pages_released);
+        pages_released += partition_pages_released;
+    }
+    if (table->replication_log)
+        replication_log_delete_range(table->replication_log, low, high);
+
+    printf(ANSI_COLOR_YELLOW "(Deleted %" PRIu64 " %s from boundary leaves, released %u %s)\n" ANSI_COLOR_RESET,
+           rows_trimmed, rows_noun(rows_trimmed), pages_released, pages_released == 1 ? "page" : "pages");
     return EXECUTE_SUCCESS;
 }
 
+typedef struct {
+    BatchRow* rows;
+    int*      line_nums;        // by position in the batch
+    uint32_t* sorted_index;     // by position in the batch: the row's index once sorted
+    uint32_t  num_rows;
+} ImportBatch;
+
+// Inserts the rows read so far and reports the lines that were skipped,
+// in file order. insert_rows only skips a row whose key already exists.
+static void flush_import_batch(DbTable* table, ImportBatch* batch, int* success_count, int* fail_count) {
+    uint32_t inserted = insert_rows(table, batch->rows, batch->num_rows);
+    *success_count += inserted;
+    *fail_count += batch->num_rows - inserted;
+    for (uint32_t i = 0; i < batch->num_rows; i++)
+        batch->sorted_index[batch->rows[i].position] = i;
+    char key_text[KEY_LITERAL_MAX_LENGTH + 1];
+    for (uint32_t i = 0; i < batch->num_rows; i++) {
+        BatchRow* batch_row = &batch->rows[batch->sorted_index[i]];
+        if (batch_row->inserted)
+            continue;
+        format_key(table->layout.key_type, batch_row->key, key_text, sizeof(key_text));
+        fprintf(stderr, ANSI_COLOR_YELLOW "Skipping line %d: Duplicate key %s.\n" ANSI_COLOR_RESET, batch->line_nums[i], key_text);
+    }
+    batch->num_rows = 0;
+
+    for (uint32_t i = 0; i < table_num_partitions(table); i++)
+        pager_yield(table_partition(table, i)->db_pager);
+}
+
+// Rows are inserted IMPORT_BATCH_ROWS at a time through insert_rows, so
+// each batch goes in key order and a partitioned table loads its
+// partitions in parallel. Of two rows with the same key the earlier line
+// wins, as if they were inserted one by one.
 ExecuteResult execute_import(Statement* statement, DbTable* table) {
     char* filename = statement->payload.filename;
     FILE* file = fopen(filename, "r");
@@ -109,6 +641,11 @@ ExecuteResult execute_import(Statement* statement, DbTable* table) {
     int line_num = 0;
     int success_count = 0;
     int fail_count = 0;
+    ImportBatch batch;
+    batch.rows = malloc(IMPORT_BATCH_ROWS * sizeof(BatchRow));
+    batch.line_nums = malloc(IMPORT_BATCH_ROWS * sizeof(int));
+    batch.sorted_index = malloc(IMPORT_BATCH_ROWS * sizeof(uint32_t));
+    batch.num_rows = 0;
 
     printf("Importing data from '%s'...\n", filename);
 
@@ -117,40 +654,39 @@ ExecuteResult execute_import(Statement* statement, DbTable* table) {
         line_buffer[strcspn(line_buffer, "\r\n")] = 0;
 
         Statement insert_statement;
-        insert_statement.type = STATEMENT_INSERT;
-
-        char username[USERNAME_MAX_LENGTH + 2];
-        char email[EMAIL_MAX_LENGTH + 2];
-        int id;
-
-        int args_assigned = sscanf(line_buffer, "%d,%32[^,],%255s", &id, username, email);
-        if (args_assigned != 3) {
-            printf("Line malformed. Skipping...\n");
+        if (parse_csv_row(line_buffer, &table->schema, &insert_statement) != PREPARE_SUCCESS) {
+            fprintf(stderr, ANSI_COLOR_RED "Error on line %d: Invalid data at column %u (%s).\n" ANSI_COLOR_RESET,
+                    line_num, insert_statement.error_position + 1, insert_statement.error_message);
+            fail_count++;
             continue;
         }
 
-        if (id < 0 || strlen(username) > USERNAME_MAX_LENGTH || strlen(email) > EMAIL_MAX_LENGTH )   {
-            fprintf(stderr, ANSI_COLOR_RED "Error on line %d: Invalid data.\n" ANSI_COLOR_RESET, line_num);
+        UserRow* user = &(insert_statement.payload.user_to_insert);
+        BatchRow* batch_row = &batch.rows[batch.num_rows];
+        memset(batch_row->key, 0, KEY_MAX_SIZE);
+        const char* key_error = statement_key_error(&insert_statement, table);
+        if (key_error) {
+            fprintf(stderr, ANSI_COLOR_RED "Error on line %d: %s\n" ANSI_COLOR_RESET, line_num, key_error);
             fail_count++;
             continue;
         }
+        encode_key(table->layout.key_type, user->tenant_id, user->id, batch_row->key);
+        batch_row->row = *user;
+        batch_row->position = batch.num_rows;
+        batch.line_nums[batch.num_rows++] = line_num;
 
-        insert_statement.payload.user_to_insert.id = id;
-        strcpy(insert_statement.payload.user_to_insert.username, username);
-        strcpy(insert_statement.payload.user_to_insert.email, email);
-
-        if (execute_insert(&insert_statement, table) == EXECUTE_SUCCESS)
-            success_count++;
-        else {
-            fprintf(stderr, ANSI_COLOR_YELLOW "Skipping line %d: Could not insert row with ID %d (likely a duplicate key).\n" ANSI_COLOR_RESET, line_num, id);
-            fail_count++;
-        }
+        if (batch.num_rows == IMPORT_BATCH_ROWS)
+            flush_import_batch(table, &batch, &success_count, &fail_count);
     }
+    flush_import_batch(table, &batch, &success_count, &fail_count);
 
+    free(batch.rows);
+    free(batch.line_nums);
+    free(batch.sorted_index);
     fclose(file);
     printf(ANSI_COLOR_GREEN "Import complete.\n" ANSI_COLOR_RESET);
-    printf(ANSI_COLOR_YELLOW "Successfully inserted: %d rows.\n" ANSI_COLOR_RESET, success_count);
-    printf(ANSI_COLOR_YELLOW "Failed or skipped: %d rows.\n" ANSI_COLOR_RESET, fail_count);
+    printf(ANSI_COLOR_YELLOW "Successfully inserted: %d %s.\n" ANSI_COLOR_RESET, success_count, rows_noun(success_count));
+    printf(ANSI_COLOR_YELLOW "Failed or skipped: %d %s.\n" ANSI_COLOR_RESET, fail_count, rows_noun(fail_count));
 
     return EXECUTE_SUCCESS;
 }
@@ -163,47 +699,92 @@ ExecuteResult execute_export(Statement* statement, DbTable* table) {
         return EXECUTE_SUCCESS;
     }
 
-    TableCursor* cursor = table_start(table);
-    uint32_t row_count = 0;
-    UserRow user;
-
-    while (!(cursor->end_of_table)) {
-        deserialize_user_row(cursor_value(cursor), &user);
-        fprintf(file, "%u,%s,%s\n", user.id, user.username, user.email);
-        cursor_advance(cursor);
-        row_count++;
-    }
-    
-    free(cursor);
+    uint64_t row_count = table_scan(table, export_row, NULL, file);
     fclose(file);
 
-    printf(ANSI_COLOR_YELLOW "Exported %u rows to '%s'.\n" ANSI_COLOR_RESET, row_count, filename);
+    printf(ANSI_COLOR_YELLOW "Exported %" PRIu64 " %s to '%s'.\n" ANSI_COLOR_RESET, row_count, rows_noun(row_count), filename);
     return EXECUTE_SUCCESS;
 }
 
+// Overwrites one field of a serialized row in place.
+static void update_row(DbTable* table, UpdatePayload* update, const uint8_t* key, void* row_location) {
+    memcpy((char*)row_location + update->field_offset, update->new_value, update->field_size);
+
+    if (table->replication_log)
+        replication_log_put(table->replication_log, key, row_location);
+}
+
 ExecuteResult execute_update(Statement* statement, DbTable* table) {
-    uint32_t id_to_update = statement->payload.update_payload.id;
-    TableCursor* cursor = table_find(table, id_to_update);
+    UpdatePayload* update = &(statement->payload.update_payload);
+    if (statement->has_where) {
+        uint32_t row_count = 0;
+        for (uint32_t i = 0; i < table_num_partitions(table); i++) {
+            DbTable* partition = table_partition(table, i);
+            TableCursor* cursor = table_start(partition);
+            while (!(cursor->end_of_table)) {
+                void* row_location = cursor_value(cursor);
+                if (predicate_matches(&statement->where, row_location)) {
+                    pager_mark_dirty(partition->db_pager, cursor->page_idx);
+                    update_row(partition, update, cursor_key(cursor), row_location);
+                    row_count++;
+                }
+                cursor_advance(cursor);
+            }
+            free(cursor);
+        }
+
+        printf(ANSI_COLOR_YELLOW "(Updated %u %s)\n" ANSI_COLOR_RESET, row_count, rows_noun(row_count));
+        return EXECUTE_SUCCESS;
+    }
+
+    uint8_t key_to_update[KEY_MAX_SIZE];
+    if (!statement_key(statement, table, update->tenant_id, update->id, key_to_update))
+        return EXECUTE_SILENT_ERROR;
+
+    table = partition_for_key(table, key_to_update);
+    if (table->lsm) {
+        char row[USER_ROW_SIZE];
+        if (!lsm_get(table->lsm, key_to_update, row)) {
+            print_key_not_found(table, key_to_update);
+            return EXECUTE_SILENT_ERROR;
+        }
+        update_row(table, update, key_to_update, row);
+        lsm_put(table->lsm, key_to_update, row);
+        return EXECUTE_SUCCESS;
+    }
+
+    TableCursor* cursor = table_find(table, key_to_update);
     void* node = get_page(table->db_pager, cursor->page_idx);
-    if (cursor->cell_idx >= *leaf_node_num_cells(node) || *leaf_node_key(node, cursor->cell_idx) != id_to_update) {
-        printf(ANSI_COLOR_RED "Error: Record with ID %u not found.\n" ANSI_COLOR_RESET, id_to_update);
+    if (!leaf_node_has_key(table, node, cursor->cell_idx, key_to_update)) {
+        print_key_not_found(table, key_to_update);
         free(cursor);
         return EXECUTE_SILENT_ERROR;
     }
 
-    void* row_location = cursor_value(cursor);
-    UserRow existing_row;
-    deserialize_user_row(row_location, &existing_row);
+    pager_mark_dirty(table->db_pager, cursor->page_idx);
+    update_row(table, update, key_to_update, cursor_value(cursor));
+    free(cursor);
+    return EXECUTE_SUCCESS;
+}
 
-    char* field = statement->payload.update_payload.field_to_update;
-    char* value = statement->payload.update_payload.new_value;
+// Replaces the schema of an empty table. The schema is written to the
+// catalog page of the main file and of every partition.
+ExecuteResult execute_create_table(Statement* statement, DbTable* table) {
+    DbPager* db_pager = table->db_pager;
+    Schema* schema = &(statement->payload.schema);
+    if (db_pager->shared || table->replication_log) {
+        printf(ANSI_COLOR_RED "Error: create table cannot be used with --shared or a replication log.\n" ANSI_COLOR_RESET);
+        return EXECUTE_SILENT_ERROR;
+    }
+    if (!table_is_empty(table)) {
+        printf(ANSI_COLOR_RED "Error: create table needs an empty table.\n" ANSI_COLOR_RESET);
+        return EXECUTE_SILENT_ERROR;
+    }
 
-    if (strcmp(field, "username") == 0)
-        strcpy(existing_row.username, value);
-    else if (strcmp(field, "email") == 0)
-        strcpy(existing_row.email, value);
+    for (uint32_t i = 0; i < table->num_partitions; i++)
+        table_write_schema(table->partitions[i], schema);
+    table_write_schema(table, schema);
 
-    serialize_user_row(&existing_row, row_location);
-    free(cursor);
+    printf(ANSI_COLOR_YELLOW "Created table %s (%u columns).\n" ANSI_COLOR_RESET, schema->name, schema->num_columns);
     return EXECUTE_SUCCESS;
-}
\ No newline at end of file
+}
@@ -5,13 +5,26 @@
 #include "table.h"
 #include "statement.h"
 #include "node.h"
+#include "key.h"
+#include "stats.h"
+#include "predicate.h"
+#include "scan.h"
+#include "sort.h"
+#include "replication.h"
 
+const char*   statement_key_error(Statement* statement, DbTable* table);
+bool          statement_key(Statement* statement, DbTable* table, uint64_t tenant_id, uint64_t id, uint8_t* key);
+bool          delete_key(DbTable* table, const uint8_t* key_to_delete);
 ExecuteResult execute_statement(Statement* statement, DbTable* table);
+uint32_t      insert_rows(DbTable* table, BatchRow* rows, uint32_t num_rows);
 ExecuteResult execute_insert(Statement* statement, DbTable* table);
+ExecuteResult execute_insert_batch(Statement* statement, DbTable* table);
 ExecuteResult execute_select(Statement* statement, DbTable* table);
 ExecuteResult execute_drop(Statement* statement, DbTable* table);
+ExecuteResult execute_drop_range(Statement* statement, DbTable* table);
 ExecuteResult execute_import(Statement* statement, DbTable* table);
 ExecuteResult execute_export(Statement* statement, DbTable* table);
 ExecuteResult execute_update(Statement* statement, DbTable* table);
+ExecuteResult execute_create_table(Statement* statement, DbTable* table);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include "hash_index.h"
+
+// Open addressing with linear probing. Entries are filled as point
+// lookups find their keys, so the index holds the keys actually queried.
+
+static uint64_t hash_key(const uint8_t* key, uint32_t key_size) {
+    uint64_t hash = 0;
+    for (uint32_t offset = 0; offset < key_size; offset += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, key + offset, sizeof(uint64_t));
+        hash ^= word;
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ull;
+        hash ^= hash >> 33;
+    }
+    return hash;
+}
+
+static HashIndexEntry* allocate_entries(uint32_t capacity) {
+    HashIndexEntry* entries = malloc((size_t)capacity * sizeof(HashIndexEntry));
+    if (!entries) {
+        printf(ANSI_COLOR_RED "Out of memory growing the hash index to %u slots\n" ANSI_COLOR_RESET, capacity);
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < capacity; i++)
+        entries[i].page_idx = INVALID_PAGE_IDX;
+    return entries;
+}
+
+HashIndex* hash_index_open(uint32_t key_size) {
+    HashIndex* index = calloc(1, sizeof(HashIndex));
+    index->capacity = HASH_INDEX_INITIAL_CAPACITY;
+    index->entries = allocate_entries(index->capacity);
+    index->key_size = key_size;
+    return index;
+}
+
+void hash_index_close(HashIndex* index) {
+    free(index->entries);
+    free(index);
+}
+
+// Returns the key's slot, or the empty slot that ends its probe sequence.
+static uint32_t find_slot(HashIndex* index, const uint8_t* key) {
+    uint32_t mask = index->capacity - 1;
+    uint32_t slot = (uint32_t)hash_key(key, index->key_size) & mask;
+    while (index->entries[slot].page_idx != INVALID_PAGE_IDX &&
+           memcmp(index->entries[slot].key, key, index->key_size) != 0)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+static void grow(HashIndex* index) {
+    HashIndexEntry* old_entries = index->entries;
+    uint32_t old_capacity = index->capacity;
+    index->capacity *= 2;
+    index->entries = allocate_entries(index->capacity);
+    for (uint32_t i = 0; i < old_capacity; i++)
+        if (old_entries[i].page_idx != INVALID_PAGE_IDX)
+            index->entries[find_slot(index, old_entries[i].key)] = old_entries[i];
+    free(old_entries);
+}
+
+// Returns the leaf last recorded for the key, or INVALID_PAGE_IDX if
+// there is none or the page has been freed since.
+uint32_t hash_index_lookup(HashIndex* index, DbPager* db_pager, const uint8_t* key) {
+    HashIndexEntry* entry = &index->entries[find_slot(index, key)];
+    if (entry->page_idx == INVALID_PAGE_IDX)
+        return INVALID_PAGE_IDX;
+    if (entry->page_idx >= db_pager->num_pages || entry->generation != db_pager->page_generations[entry->page_idx])
+        return INVALID_PAGE_IDX;
+    return entry->page_idx;
+}
+
+void hash_index_store(HashIndex* index, DbPager* db_pager, const uint8_t* key, uint32_t page_idx) {
+    if ((uint64_t)(index->num_entries + 1) * 100 > (uint64_t)index->capacity * HASH_INDEX_MAX_LOAD_PERCENT)
+        grow(index);
+
+    HashIndexEntry* entry = &index->entries[find_slot(index, key)];
+    if (entry->page_idx == INVALID_PAGE_IDX) {
+        memset(entry->key, 0, KEY_MAX_SIZE);
+        memcpy(entry->key, key, index->key_size);
+        index->num_entries++;
+    }
+    entry->page_idx = page_idx;
+    entry->generation = db_pager->page_generations[page_idx];
+}
+
+// Backward-shift deletion: later entries of the probe run move up into
+// the hole, so lookups never need tombstones.
+void hash_index_remove(HashIndex* index, const uint8_t* key) {
+    uint32_t mask = index->capacity - 1;
+    uint32_t hole = find_slot(index, key);
+    if (index->entries[hole].page_idx == INVALID_PAGE_IDX)
+        return;
+
+    for (uint32_t slot = (hole + 1) & mask; index->entries[slot].page_idx != INVALID_PAGE_IDX; slot = (slot + 1) & mask) {
+        uint32_t home = (uint32_t)hash_key(index->entries[slot].key, index->key_size) & mask;
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+            index->entries[hole] = index->entries[slot];
+            hole = slot;
+        }
+    }
+    index->entries[hole].page_idx = INVALID_PAGE_IDX;
+    index->num_entries--;
+}
+
+void print_hash_index_status(DbTable* table) {
+    HashIndex* index = table->hash_index;
+    if (!index) {
+        printf("Hash index is off.\n");
+        return;
+    }
+
+    printf("Hash index: %u keys in %u slots (%zu KB)\n", index->num_entries, index->capacity,
+           (size_t)index->capacity * sizeof(HashIndexEntry) / 1024);
+    printf("Hits: %" PRIu64 ", misses: %" PRIu64 ", stale: %" PRIu64 "\n", index->hits, index->misses, index->stale);
+}
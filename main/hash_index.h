@@ -0,0 +1,16 @@
+#ifndef DB_HASH_INDEX_H
+#define DB_HASH_INDEX_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "common.h"
+#include "key.h"
+
+HashIndex* hash_index_open(uint32_t key_size);
+void       hash_index_close(HashIndex* index);
+uint32_t   hash_index_lookup(HashIndex* index, DbPager* pager, const uint8_t* key);
+void       hash_index_store(HashIndex* index, DbPager* pager, const uint8_t* key, uint32_t page_idx);
+void       hash_index_remove(HashIndex* index, const uint8_t* key);
+void       print_hash_index_status(DbTable* table);
+
+#endif
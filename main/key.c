@@ -0,0 +1,74 @@
+#include "key.h"
+
+static void store_be64(uint8_t* destination, uint64_t value) {
+    for (int i = 7; i >= 0; i--) {
+        destination[i] = (uint8_t)(value & 0xff);
+        value >>= 8;
+    }
+}
+
+static uint64_t load_be64(const uint8_t* source) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++)
+        value = (value << 8) | source[i];
+    return value;
+}
+
+uint32_t key_type_size(KeyType key_type) {
+    switch (key_type) {
+        case KEY_TYPE_INT64:
+            return sizeof(uint64_t);
+        case KEY_TYPE_TENANT_INT64:
+            return 2 * sizeof(uint64_t);
+    }
+    return 0;
+}
+
+const char* key_type_name(KeyType key_type) {
+    switch (key_type) {
+        case KEY_TYPE_INT64:
+            return "int64";
+        case KEY_TYPE_TENANT_INT64:
+            return "tenant";
+    }
+    return "unknown";
+}
+
+bool parse_key_type(const char* name, KeyType* key_type) {
+    if (strcmp(name, "int64") == 0)
+        *key_type = KEY_TYPE_INT64;
+    else if (strcmp(name, "tenant") == 0)
+        *key_type = KEY_TYPE_TENANT_INT64;
+    else
+        return false;
+    return true;
+}
+
+void encode_key(KeyType key_type, uint64_t tenant_id, uint64_t id, uint8_t* destination) {
+    if (key_type == KEY_TYPE_TENANT_INT64) {
+        store_be64(destination, tenant_id);
+        store_be64(destination + sizeof(uint64_t), id);
+    }
+    else
+        store_be64(destination, id);
+}
+
+void decode_key(KeyType key_type, const uint8_t* source, uint64_t* tenant_id, uint64_t* id) {
+    if (key_type == KEY_TYPE_TENANT_INT64) {
+        *tenant_id = load_be64(source);
+        *id = load_be64(source + sizeof(uint64_t));
+    }
+    else {
+        *tenant_id = 0;
+        *id = load_be64(source);
+    }
+}
+
+void format_key(KeyType key_type, const uint8_t* key, char* destination, size_t size) {
+    uint64_t tenant_id, id;
+    decode_key(key_type, key, &tenant_id, &id);
+    if (key_type == KEY_TYPE_TENANT_INT64)
+        snprintf(destination, size, "%" PRIu64 ":%" PRIu64, tenant_id, id);
+    else
+        snprintf(destination, size, "%" PRIu64, id);
+}
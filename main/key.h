@@ -0,0 +1,19 @@
+#ifndef DB_KEY_H
+#define DB_KEY_H
+
+#include "common.h"
+
+uint32_t    key_type_size(KeyType key_type);
+const char* key_type_name(KeyType key_type);
+bool        parse_key_type(const char* name, KeyType* key_type);
+void        encode_key(KeyType key_type, uint64_t tenant_id, uint64_t id, uint8_t* destination);
+void        decode_key(KeyType key_type, const uint8_t* source, uint64_t* tenant_id, uint64_t* id);
+void        format_key(KeyType key_type, const uint8_t* key, char* destination, size_t size);
+
+// Keys are stored big-endian so that byte order equals numeric order and
+// every comparison in the tree is a single memcmp.
+static inline int compare_keys(const uint8_t* a, const uint8_t* b, uint32_t key_size) {
+    return memcmp(a, b, key_size);
+}
+
+#endif
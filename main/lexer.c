@@ -0,0 +1,137 @@
+#include "lexer.h"
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool is_identifier_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || is_digit(c) || c == '_';
+}
+
+void lexer_init(Lexer* lexer, const char* input) {
+    lexer->input = input;
+    lexer->position = input;
+}
+
+uint32_t lexer_offset(Lexer* lexer, const char* at) {
+    return (uint32_t)(at - lexer->input);
+}
+
+void lexer_skip_whitespace(Lexer* lexer) {
+    while (is_space(*lexer->position))
+        lexer->position++;
+}
+
+bool lexer_at_end(Lexer* lexer) {
+    lexer_skip_whitespace(lexer);
+    return *lexer->position == '\0';
+}
+
+bool lexer_accept_char(Lexer* lexer, char c) {
+    lexer_skip_whitespace(lexer);
+    if (*lexer->position != c)
+        return false;
+    lexer->position++;
+    return true;
+}
+
+bool lexer_accept_keyword(Lexer* lexer, const char* keyword) {
+    lexer_skip_whitespace(lexer);
+    const char* p = lexer->position;
+    while (*keyword && *p == *keyword) {
+        p++;
+        keyword++;
+    }
+    if (*keyword != '\0' || is_identifier_char(*p))
+        return false;
+
+    lexer->position = p;
+    return true;
+}
+
+Token lexer_scan_word(Lexer* lexer, const char* delimiters) {
+    lexer_skip_whitespace(lexer);
+    Token token = { lexer->position, 0 };
+    const char* p = lexer->position;
+    while (*p && !is_space(*p) && !(delimiters && strchr(delimiters, *p)))
+        p++;
+
+    token.length = (uint32_t)(p - token.start);
+    lexer->position = p;
+    return token;
+}
+
+// Scans a CSV field: everything up to the separator or the end of the
+// line, so a field may hold spaces. Only the whitespace around it is
+// dropped.
+Token lexer_scan_field(Lexer* lexer, char separator) {
+    lexer_skip_whitespace(lexer);
+    Token token = { lexer->position, 0 };
+    const char* p = lexer->position;
+    while (*p && *p != separator)
+        p++;
+    lexer->position = p;
+
+    while (p > token.start && is_space(p[-1]))
+        p--;
+    token.length = (uint32_t)(p - token.start);
+    return token;
+}
+
+Token lexer_scan_identifier(Lexer* lexer) {
+    lexer_skip_whitespace(lexer);
+    Token token = { lexer->position, 0 };
+    const char* p = lexer->position;
+    while (is_identifier_char(*p))
+        p++;
+
+    token.length = (uint32_t)(p - token.start);
+    lexer->position = p;
+    return token;
+}
+
+bool lexer_scan_uint64(Lexer* lexer, uint64_t* value) {
+    lexer_skip_whitespace(lexer);
+    const char* p = lexer->position;
+    if (!is_digit(*p))
+        return false;
+
+    uint64_t result = 0;
+    while (is_digit(*p)) {
+        uint64_t digit = (uint64_t)(*p - '0');
+        if (result > (UINT64_MAX - digit) / 10)
+            return false;
+        result = result * 10 + digit;
+        p++;
+    }
+    if (is_identifier_char(*p))
+        return false;
+
+    *value = result;
+    lexer->position = p;
+    return true;
+}
+
+bool lexer_scan_quoted(Lexer* lexer, Token* token) {
+    lexer_skip_whitespace(lexer);
+    const char* p = lexer->position;
+    if (*p != '\'')
+        return false;
+
+    const char* close = strchr(p + 1, '\'');
+    if (!close)
+        return false;
+
+    token->start = p + 1;
+    token->length = (uint32_t)(close - token->start);
+    lexer->position = close + 1;
+    return true;
+}
+
+bool token_equals(Token token, const char* text) {
+    return strlen(text) == token.length && memcmp(token.start, text, token.length) == 0;
+}
@@ -0,0 +1,29 @@
+#ifndef DB_LEXER_H
+#define DB_LEXER_H
+
+#include "common.h"
+
+typedef struct {
+    const char* start;
+    uint32_t    length;
+} Token;
+
+typedef struct {
+    const char* input;
+    const char* position;
+} Lexer;
+
+void     lexer_init(Lexer* lexer, const char* input);
+uint32_t lexer_offset(Lexer* lexer, const char* at);
+void     lexer_skip_whitespace(Lexer* lexer);
+bool     lexer_at_end(Lexer* lexer);
+bool     lexer_accept_char(Lexer* lexer, char c);
+bool     lexer_accept_keyword(Lexer* lexer, const char* keyword);
+Token    lexer_scan_word(Lexer* lexer, const char* delimiters);
+Token    lexer_scan_field(Lexer* lexer, char separator);
+Token    lexer_scan_identifier(Lexer* lexer);
+bool     lexer_scan_uint64(Lexer* lexer, uint64_t* value);
+bool     lexer_scan_quoted(Lexer* lexer, Token* token);
+bool     token_equals(Token token, const char* text);
+
+#endif
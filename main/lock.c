@@ -0,0 +1,153 @@
+#include "lock.h"
+#include "pager.h"
+
+// Lock protocol, all on single bytes of the db file past its data:
+//   PROCESS  held for the life of the process: exclusively by a normal
+//            process, shared by --shared processes, so the two modes
+//            never mix on one database.
+//   WRITER   held exclusively for a writing statement; one writer at a time.
+//   READER   shared by every statement that reads pages, and taken
+//            exclusively by a writer only while it writes its pages back.
+// Readers therefore run in parallel with a writer's statement and only
+// wait for its commit.
+
+static bool set_lock(int fd, short type, off_t offset, bool wait) {
+    struct flock lock = { .l_type = type, .l_whence = SEEK_SET, .l_start = offset, .l_len = 1 };
+    while (fcntl(fd, wait ? F_SETLKW : F_SETLK, &lock) == -1) {
+        if (errno != EINTR)
+            return false;
+    }
+    return true;
+}
+
+static void lock_or_exit(int fd, short type, off_t offset) {
+    if (!set_lock(fd, type, offset, true)) {
+        printf(ANSI_COLOR_RED "Error locking db file: %d\n" ANSI_COLOR_RESET, errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void map_shared_region(DbPager* db_pager, const char* db_filename) {
+    size_t name_length = strlen(db_filename) + sizeof(SHM_FILE_SUFFIX);
+    char* shm_filename = malloc(name_length);
+    snprintf(shm_filename, name_length, "%s" SHM_FILE_SUFFIX, db_filename);
+
+    int fd = open(shm_filename, O_RDWR | O_CREAT, S_IWUSR | S_IRUSR);
+    if (fd == -1) {
+        printf(ANSI_COLOR_RED "Unable to open shared-memory file '%s'\n" ANSI_COLOR_RESET, shm_filename);
+        exit(EXIT_FAILURE);
+    }
+    free(shm_filename);
+
+    // A new file reads as zeros, which is a valid empty region. Growing it
+    // is idempotent, so racing processes need no extra coordination.
+    struct stat shm_stat;
+    if (fstat(fd, &shm_stat) != 0 ||
+        ((size_t)shm_stat.st_size < sizeof(SharedRegion) && ftruncate(fd, sizeof(SharedRegion)) != 0)) {
+        printf(ANSI_COLOR_RED "Unable to size shared-memory file\n" ANSI_COLOR_RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    void* region = mmap(NULL, sizeof(SharedRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        printf(ANSI_COLOR_RED "Unable to map shared-memory file\n" ANSI_COLOR_RESET);
+        exit(EXIT_FAILURE);
+    }
+    db_pager->shm = region;
+}
+
+void lock_open(DbPager* db_pager, const char* db_filename, bool shared) {
+    db_pager->shared = shared;
+    db_pager->holds_write_lock = false;
+    db_pager->shm = NULL;
+    db_pager->seen_change_counter = 0;
+    if (db_pager->in_memory)
+        return;
+
+    if (!set_lock(db_pager->file_descriptor, shared ? F_RDLCK : F_WRLCK, LOCK_PROCESS_OFFSET, false)) {
+        if (shared)
+            printf(ANSI_COLOR_RED "Database is open in another process without --shared.\n" ANSI_COLOR_RESET);
+        else
+            printf(ANSI_COLOR_RED "Database is locked by another process (use --shared in every process to share it).\n" ANSI_COLOR_RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    if (shared) {
+        map_shared_region(db_pager, db_filename);
+        db_pager->seen_change_counter = __atomic_load_n(&db_pager->shm->change_counter, __ATOMIC_ACQUIRE);
+    }
+}
+
+void lock_close(DbPager* db_pager) {
+    if (db_pager->shm)
+        munmap(db_pager->shm, sizeof(SharedRegion));
+    db_pager->shm = NULL;
+}
+
+// Drops every cached page another process has rewritten since this one
+// last looked, then re-reads the header and the file length.
+static void lock_refresh(DbPager* db_pager) {
+    uint64_t change_counter = __atomic_load_n(&db_pager->shm->change_counter, __ATOMIC_ACQUIRE);
+    if (change_counter == db_pager->seen_change_counter)
+        return;
+
+    for (uint32_t page_idx = 0; page_idx < db_pager->num_page_slots; page_idx++) {
+        if (db_pager->pages[page_idx] != NULL &&
+            db_pager->shm->page_versions[page_idx % SHM_PAGE_SLOTS] > db_pager->seen_change_counter)
+            pager_drop_page(db_pager, page_idx);
+    }
+    pager_drop_page(db_pager, DB_HEADER_PAGE_IDX);
+
+    struct stat db_stat;
+    if (fstat(db_pager->file_descriptor, &db_stat) != 0) {
+        printf(ANSI_COLOR_RED "Error reading db file size: %d\n" ANSI_COLOR_RESET, errno);
+        exit(EXIT_FAILURE);
+    }
+    db_pager->file_length = (uint64_t)db_stat.st_size;
+    db_pager->num_pages = (uint32_t)(db_pager->file_length / db_pager->page_size);
+    if (!deserialize_db_header(get_page(db_pager, DB_HEADER_PAGE_IDX), &db_pager->header)) {
+        printf(ANSI_COLOR_RED "Db header was corrupted by another process.\n" ANSI_COLOR_RESET);
+        exit(EXIT_FAILURE);
+    }
+    db_pager->seen_change_counter = change_counter;
+}
+
+void lock_begin_read(DbPager* db_pager) {
+    lock_or_exit(db_pager->file_descriptor, F_RDLCK, LOCK_READER_OFFSET);
+    lock_refresh(db_pager);
+}
+
+void lock_begin_write(DbPager* db_pager) {
+    lock_or_exit(db_pager->file_descriptor, F_WRLCK, LOCK_WRITER_OFFSET);
+    db_pager->holds_write_lock = true;
+    lock_refresh(db_pager);
+}
+
+// Commits a writer's pages: waits for running readers, stamps the pages
+// with the next change counter and writes them back.
+static void lock_commit(DbPager* db_pager) {
+    if (db_pager->num_dirty_pages == 0 && !pager_header_changed(db_pager))
+        return;
+
+    lock_or_exit(db_pager->file_descriptor, F_WRLCK, LOCK_READER_OFFSET);
+    uint64_t change_counter = db_pager->shm->change_counter + 1;
+    for (uint32_t page_idx = 0; page_idx < db_pager->num_page_slots; page_idx++) {
+        if (db_pager->dirty_bitmap[page_idx / 8] & (1u << (page_idx % 8)))
+            db_pager->shm->page_versions[page_idx % SHM_PAGE_SLOTS] = change_counter;
+    }
+    db_pager->shm->page_versions[DB_HEADER_PAGE_IDX] = change_counter;
+
+    pager_flush_dirty(db_pager, 0);
+    __atomic_store_n(&db_pager->shm->change_counter, change_counter, __ATOMIC_RELEASE);
+    db_pager->seen_change_counter = change_counter;
+}
+
+void lock_end(DbPager* db_pager) {
+    if (db_pager->holds_write_lock) {
+        lock_commit(db_pager);
+        db_pager->holds_write_lock = false;
+        set_lock(db_pager->file_descriptor, F_UNLCK, LOCK_WRITER_OFFSET, false);
+    }
+    set_lock(db_pager->file_descriptor, F_UNLCK, LOCK_READER_OFFSET, false);
+}
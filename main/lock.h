@@ -0,0 +1,18 @@
+#ifndef DB_LOCK_H
+#define DB_LOCK_H
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "common.h"
+
+void lock_open(DbPager* pager, const char* db_filename, bool shared);
+void lock_close(DbPager* pager);
+void lock_begin_read(DbPager* pager);
+void lock_begin_write(DbPager* pager);
+void lock_end(DbPager* pager);
+
+#endif
@@ -0,0 +1,871 @@
+#include "lsm.h"
+
+// Write-optimized storage: writes go to a skiplist memtable and a
+// write-ahead log; a full memtable is written out as a sorted run and
+// runs are merged down a leveled tree. Reads check the memtable, then
+// level 0 newest first, then each deeper level; bloom filters skip runs
+// that cannot hold the key and fence pointers find the one block to read.
+//
+// Run layout: blocks of entries (key, deleted:u8, row[USER_ROW_SIZE]),
+// fences[num_blocks][key_size], bloom[bloom_bytes], then the footer
+//   magic[8] version:u32 key_size:u32 num_entries:u64 num_blocks:u32 bloom_bytes:u32
+// Manifest: magic[8] version:u32 key_size:u32 next_run_id:u64
+//   num_level0_runs:u32 level0_ids[LSM_L0_MAX_RUNS]:u64 level_ids[LSM_MAX_LEVELS]:u64
+// WAL: PUT, DELETE and COMMIT records as in the replication log, without
+// a header or timestamps. Replay stops at the last COMMIT.
+
+#define LSM_MANIFEST_SIZE (24 + sizeof(uint32_t) + (LSM_L0_MAX_RUNS + LSM_MAX_LEVELS) * sizeof(uint64_t))
+
+const char* storage_engine_name(StorageEngine engine) {
+    switch (engine) {
+        case STORAGE_ENGINE_BTREE:
+            return "btree";
+        case STORAGE_ENGINE_LSM:
+            return "lsm";
+    }
+    return "unknown";
+}
+
+bool parse_storage_engine(const char* name, StorageEngine* engine) {
+    if (strcmp(name, "btree") == 0)
+        *engine = STORAGE_ENGINE_BTREE;
+    else if (strcmp(name, "lsm") == 0)
+        *engine = STORAGE_ENGINE_LSM;
+    else
+        return false;
+    return true;
+}
+
+static char* lsm_filename(Lsm* lsm, const char* suffix, uint64_t run_id) {
+    size_t name_length = strlen(lsm->db_filename) + strlen(suffix) + 24;
+    char* filename = malloc(name_length);
+    if (run_id == 0)
+        snprintf(filename, name_length, "%s%s", lsm->db_filename, suffix);
+    else
+        snprintf(filename, name_length, "%s%s%llu", lsm->db_filename, suffix, (unsigned long long)run_id);
+    return filename;
+}
+
+static void lsm_io_error(const char* action, const char* filename) {
+    printf(ANSI_COLOR_RED "Error %s '%s': %d\n" ANSI_COLOR_RESET, action, filename, errno);
+    exit(EXIT_FAILURE);
+}
+
+static uint8_t* skip_node_key(LsmSkipNode* node) {
+    return (uint8_t*)(node->next + node->height);
+}
+
+static uint8_t* skip_node_row(Lsm* lsm, LsmSkipNode* node) {
+    return skip_node_key(node) + lsm->key_size;
+}
+
+static size_t skip_node_size(Lsm* lsm, uint32_t height) {
+    return sizeof(LsmSkipNode) + height * sizeof(LsmSkipNode*) + lsm->key_size + USER_ROW_SIZE;
+}
+
+static LsmSkipNode* skip_node_new(Lsm* lsm, uint32_t height) {
+    LsmSkipNode* node = calloc(1, skip_node_size(lsm, height));
+    node->height = height;
+    return node;
+}
+
+// Each level up is taken with probability 1/4.
+static uint32_t skip_random_height(LsmMemtable* memtable) {
+    uint32_t height = 1;
+    while (height < LSM_SKIPLIST_MAX_HEIGHT) {
+        memtable->random_state ^= memtable->random_state << 13;
+        memtable->random_state ^= memtable->random_state >> 7;
+        memtable->random_state ^= memtable->random_state << 17;
+        if ((memtable->random_state & 3) != 0)
+            break;
+        height++;
+    }
+    return height;
+}
+
+static void memtable_init(Lsm* lsm) {
+    lsm->memtable.head = skip_node_new(lsm, LSM_SKIPLIST_MAX_HEIGHT);
+    lsm->memtable.height = 1;
+    lsm->memtable.num_entries = 0;
+    lsm->memtable.bytes = 0;
+    lsm->memtable.random_state = 0x9E3779B97F4A7C15ull;
+}
+
+static void memtable_free(Lsm* lsm) {
+    LsmSkipNode* node = lsm->memtable.head;
+    while (node) {
+        LsmSkipNode* next = node->next[0];
+        free(node);
+        node = next;
+    }
+    lsm->memtable.head = NULL;
+}
+
+static LsmSkipNode* memtable_find(Lsm* lsm, const uint8_t* key) {
+    LsmSkipNode* node = lsm->memtable.head;
+    for (int level = (int)lsm->memtable.height - 1; level >= 0; level--)
+        while (node->next[level] && compare_keys(skip_node_key(node->next[level]), key, lsm->key_size) < 0)
+            node = node->next[level];
+
+    node = node->next[0];
+    return node && compare_keys(skip_node_key(node), key, lsm->key_size) == 0 ? node : NULL;
+}
+
+// Inserts or overwrites the key's entry. A NULL row records a deletion.
+static void memtable_upsert(Lsm* lsm, const uint8_t* key, const void* row) {
+    LsmMemtable* memtable = &lsm->memtable;
+    LsmSkipNode* update[LSM_SKIPLIST_MAX_HEIGHT];
+    LsmSkipNode* node = memtable->head;
+    for (int level = (int)memtable->height - 1; level >= 0; level--) {
+        while (node->next[level] && compare_keys(skip_node_key(node->next[level]), key, lsm->key_size) < 0)
+            node = node->next[level];
+        update[level] = node;
+    }
+
+    node = node->next[0];
+    if (!node || compare_keys(skip_node_key(node), key, lsm->key_size) != 0) {
+        uint32_t height = skip_random_height(memtable);
+        for (uint32_t level = memtable->height; level < height; level++)
+            update[level] = memtable->head;
+        if (height > memtable->height)
+            memtable->height = height;
+
+        node = skip_node_new(lsm, height);
+        memcpy(skip_node_key(node), key, lsm->key_size);
+        for (uint32_t level = 0; level < height; level++) {
+            node->next[level] = update[level]->next[level];
+            update[level]->next[level] = node;
+        }
+        memtable->num_entries++;
+        memtable->bytes += skip_node_size(lsm, height);
+    }
+
+    node->deleted = row == NULL;
+    if (row)
+        memcpy(skip_node_row(lsm, node), row, USER_ROW_SIZE);
+    else
+        memset(skip_node_row(lsm, node), 0, USER_ROW_SIZE);
+}
+
+static uint64_t key_hash(const uint8_t* key, uint32_t key_size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (uint32_t i = 0; i < key_size; i++) {
+        hash ^= key[i];
+        hash *= 1099511628211ull;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// Probes are derived from one hash by double hashing.
+static void bloom_add(uint8_t* bloom, uint32_t bloom_bytes, const uint8_t* key, uint32_t key_size) {
+    uint64_t hash = key_hash(key, key_size);
+    uint64_t step = (hash >> 32) | 1;
+    uint64_t num_bits = (uint64_t)bloom_bytes * 8;
+    for (uint32_t i = 0; i < LSM_BLOOM_HASHES; i++) {
+        uint64_t bit = (hash + i * step) % num_bits;
+        bloom[bit / 8] |= (uint8_t)(1u << (bit % 8));
+    }
+}
+
+static bool bloom_may_contain(LsmRun* run, const uint8_t* key, uint32_t key_size) {
+    uint64_t hash = key_hash(key, key_size);
+    uint64_t step = (hash >> 32) | 1;
+    uint64_t num_bits = (uint64_t)run->bloom_bytes * 8;
+    for (uint32_t i = 0; i < LSM_BLOOM_HASHES; i++) {
+        uint64_t bit = (hash + i * step) % num_bits;
+        if ((run->bloom[bit / 8] & (1u << (bit % 8))) == 0)
+            return false;
+    }
+    return true;
+}
+
+static off_t block_offset(uint32_t block_idx) {
+    return (off_t)block_idx * LSM_BLOCK_SIZE;
+}
+
+static uint64_t run_bytes(Lsm* lsm, LsmRun* run) {
+    return run ? run->num_entries * lsm->entry_size : 0;
+}
+
+static void read_run_block(Lsm* lsm, LsmRun* run, uint32_t block_idx, uint8_t* block) {
+    if (pread(run->file_descriptor, block, LSM_BLOCK_SIZE, block_offset(block_idx)) != LSM_BLOCK_SIZE)
+        lsm_io_error("reading run", run->filename);
+    lsm->block_reads++;
+}
+
+static void write_fully(int fd, const void* buffer, size_t size, off_t offset, const char* filename) {
+    if (pwrite(fd, buffer, size, offset) != (ssize_t)size)
+        lsm_io_error("writing", filename);
+}
+
+typedef struct {
+    Lsm*     lsm;
+    LsmRun*  run;
+    uint8_t* block;
+    uint32_t block_entries;
+    uint32_t max_blocks;
+} LsmRunWriter;
+
+// Fences and bloom filter are sized for max_entries up front.
+static void run_writer_open(Lsm* lsm, LsmRunWriter* writer, uint64_t max_entries) {
+    LsmRun* run = calloc(1, sizeof(LsmRun));
+    run->id = lsm->next_run_id++;
+    run->filename = lsm_filename(lsm, LSM_RUN_SUFFIX, run->id);
+    run->file_descriptor = open(run->filename, O_RDWR | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR);
+    if (run->file_descriptor == -1)
+        lsm_io_error("creating run", run->filename);
+
+    writer->max_blocks = (uint32_t)((max_entries + lsm->entries_per_block - 1) / lsm->entries_per_block);
+    run->fences = malloc((size_t)writer->max_blocks * lsm->key_size + 1);
+    uint64_t bloom_bytes = (max_entries * LSM_BLOOM_BITS_PER_KEY + 7) / 8;
+    run->bloom_bytes = bloom_bytes < 8 ? 8 : (uint32_t)bloom_bytes;
+    run->bloom = calloc(run->bloom_bytes, 1);
+
+    writer->lsm = lsm;
+    writer->run = run;
+    writer->block = calloc(LSM_BLOCK_SIZE, 1);
+    writer->block_entries = 0;
+}
+
+static void run_writer_flush_block(LsmRunWriter* writer) {
+    LsmRun* run = writer->run;
+    memset(writer->block + writer->block_entries * writer->lsm->entry_size, 0,
+           LSM_BLOCK_SIZE - writer->block_entries * writer->lsm->entry_size);
+    write_fully(run->file_descriptor, writer->block, LSM_BLOCK_SIZE, block_offset(run->num_blocks), run->filename);
+    run->num_blocks++;
+    writer->block_entries = 0;
+}
+
+static void run_writer_add(LsmRunWriter* writer, const uint8_t* key, bool deleted, const uint8_t* row) {
+    Lsm* lsm = writer->lsm;
+    LsmRun* run = writer->run;
+    uint8_t* entry = writer->block + writer->block_entries * lsm->entry_size;
+    memcpy(entry, key, lsm->key_size);
+    entry[lsm->key_size] = deleted;
+    memcpy(entry + lsm->key_size + 1, row, USER_ROW_SIZE);
+
+    if (writer->block_entries == 0)
+        memcpy(run->fences + (size_t)run->num_blocks * lsm->key_size, key, lsm->key_size);
+    bloom_add(run->bloom, run->bloom_bytes, key, lsm->key_size);
+    run->num_entries++;
+    if (++writer->block_entries == lsm->entries_per_block)
+        run_writer_flush_block(writer);
+}
+
+// Syncs the finished run. An empty run is removed and NULL returned.
+static LsmRun* run_writer_finish(LsmRunWriter* writer) {
+    Lsm* lsm = writer->lsm;
+    LsmRun* run = writer->run;
+    if (writer->block_entries > 0)
+        run_writer_flush_block(writer);
+    free(writer->block);
+
+    if (run->num_entries == 0) {
+        close(run->file_descriptor);
+        unlink(run->filename);
+        free(run->fences);
+        free(run->bloom);
+        free(run->filename);
+        free(run);
+        return NULL;
+    }
+
+    off_t offset = block_offset(run->num_blocks);
+    size_t fences_size = (size_t)run->num_blocks * lsm->key_size;
+    write_fully(run->file_descriptor, run->fences, fences_size, offset, run->filename);
+    offset += (off_t)fences_size;
+    write_fully(run->file_descriptor, run->bloom, run->bloom_bytes, offset, run->filename);
+    offset += run->bloom_bytes;
+
+    uint8_t footer[LSM_RUN_FOOTER_SIZE];
+    uint32_t version = LSM_FORMAT_VERSION;
+    memcpy(footer, LSM_RUN_MAGIC, 8);
+    memcpy(footer + 8, &version, sizeof(uint32_t));
+    memcpy(footer + 12, &lsm->key_size, sizeof(uint32_t));
+    memcpy(footer + 16, &run->num_entries, sizeof(uint64_t));
+    memcpy(footer + 24, &run->num_blocks, sizeof(uint32_t));
+    memcpy(footer + 28, &run->bloom_bytes, sizeof(uint32_t));
+    write_fully(run->file_descriptor, footer, LSM_RUN_FOOTER_SIZE, offset, run->filename);
+    if (fsync(run->file_descriptor) != 0)
+        lsm_io_error("syncing run", run->filename);
+    return run;
+}
+
+static LsmRun* run_open(Lsm* lsm, uint64_t run_id) {
+    LsmRun* run = calloc(1, sizeof(LsmRun));
+    run->id = run_id;
+    run->filename = lsm_filename(lsm, LSM_RUN_SUFFIX, run_id);
+    run->file_descriptor = open(run->filename, O_RDONLY);
+    if (run->file_descriptor == -1)
+        lsm_io_error("opening run", run->filename);
+
+    struct stat run_stat;
+    uint8_t footer[LSM_RUN_FOOTER_SIZE];
+    uint32_t version, key_size;
+    if (fstat(run->file_descriptor, &run_stat) != 0 || run_stat.st_size < LSM_RUN_FOOTER_SIZE ||
+        pread(run->file_descriptor, footer, LSM_RUN_FOOTER_SIZE, run_stat.st_size - LSM_RUN_FOOTER_SIZE) !=
+            LSM_RUN_FOOTER_SIZE ||
+        memcmp(footer, LSM_RUN_MAGIC, 8) != 0) {
+        printf(ANSI_COLOR_RED "'%s' is not a sorted run.\n" ANSI_COLOR_RESET, run->filename);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(&version, footer + 8, sizeof(uint32_t));
+    memcpy(&key_size, footer + 12, sizeof(uint32_t));
+    memcpy(&run->num_entries, footer + 16, sizeof(uint64_t));
+    memcpy(&run->num_blocks, footer + 24, sizeof(uint32_t));
+    memcpy(&run->bloom_bytes, footer + 28, sizeof(uint32_t));
+    size_t fences_size = (size_t)run->num_blocks * lsm->key_size;
+    if (version != LSM_FORMAT_VERSION || key_size != lsm->key_size ||
+        (uint64_t)run_stat.st_size != (uint64_t)block_offset(run->num_blocks) + fences_size + run->bloom_bytes + LSM_RUN_FOOTER_SIZE) {
+        printf(ANSI_COLOR_RED "Sorted run '%s' is damaged or from another version.\n" ANSI_COLOR_RESET, run->filename);
+        exit(EXIT_FAILURE);
+    }
+
+    run->fences = malloc(fences_size + 1);
+    run->bloom = malloc(run->bloom_bytes);
+    off_t offset = block_offset(run->num_blocks);
+    if (pread(run->file_descriptor, run->fences, fences_size, offset) != (ssize_t)fences_size ||
+        pread(run->file_descriptor, run->bloom, run->bloom_bytes, offset + (off_t)fences_size) != (ssize_t)run->bloom_bytes)
+        lsm_io_error("reading run", run->filename);
+    return run;
+}
+
+static void run_close(LsmRun* run, bool remove) {
+    close(run->file_descriptor);
+    if (remove)
+        unlink(run->filename);
+    free(run->fences);
+    free(run->bloom);
+    free(run->filename);
+    free(run);
+}
+
+// Looks the key up in one run. Returns true if the run has an entry for
+// it, live or deleted.
+static bool run_get(Lsm* lsm, LsmRun* run, const uint8_t* key, bool* deleted, void* row) {
+    if (!bloom_may_contain(run, key, lsm->key_size)) {
+        lsm->bloom_skips++;
+        return false;
+    }
+
+    // The last block whose first key is <= key.
+    uint32_t low = 0, high = run->num_blocks;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (compare_keys(run->fences + (size_t)middle * lsm->key_size, key, lsm->key_size) <= 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if (low == 0)
+        return false;
+    uint32_t block_idx = low - 1;
+    read_run_block(lsm, run, block_idx, lsm->read_block);
+
+    uint64_t first_entry = (uint64_t)block_idx * lsm->entries_per_block;
+    uint32_t num_entries = run->num_entries - first_entry < lsm->entries_per_block
+                               ? (uint32_t)(run->num_entries - first_entry)
+                               : lsm->entries_per_block;
+    low = 0;
+    high = num_entries;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        uint8_t* entry = lsm->read_block + middle * lsm->entry_size;
+        int comparison = compare_keys(entry, key, lsm->key_size);
+        if (comparison == 0) {
+            *deleted = entry[lsm->key_size];
+            if (row && !*deleted)
+                memcpy(row, entry + lsm->key_size + 1, USER_ROW_SIZE);
+            return true;
+        }
+        if (comparison < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return false;
+}
+
+static void source_load(Lsm* lsm, LsmSource* source) {
+    if (source->run == NULL) {
+        source->valid = source->node != NULL;
+        if (source->valid) {
+            source->key = skip_node_key(source->node);
+            source->row = skip_node_row(lsm, source->node);
+            source->deleted = source->node->deleted;
+        }
+        return;
+    }
+
+    source->valid = source->next_entry < source->run->num_entries;
+    if (!source->valid)
+        return;
+    uint32_t block_idx = (uint32_t)(source->next_entry / lsm->entries_per_block);
+    if (block_idx != source->loaded_block) {
+        read_run_block(lsm, source->run, block_idx, source->block);
+        source->loaded_block = block_idx;
+    }
+    uint8_t* entry = source->block + (source->next_entry % lsm->entries_per_block) * lsm->entry_size;
+    source->key = entry;
+    source->deleted = entry[lsm->key_size];
+    source->row = entry + lsm->key_size + 1;
+}
+
+static void source_advance(Lsm* lsm, LsmSource* source) {
+    if (source->run == NULL)
+        source->node = source->node->next[0];
+    else
+        source->next_entry++;
+    source_load(lsm, source);
+}
+
+static void iterator_init(Lsm* lsm, LsmIterator* iterator, bool skip_deleted) {
+    iterator->lsm = lsm;
+    iterator->num_sources = 0;
+    iterator->skip_deleted = skip_deleted;
+}
+
+static void iterator_add_memtable(LsmIterator* iterator) {
+    LsmSource* source = &iterator->sources[iterator->num_sources++];
+    source->run = NULL;
+    source->block = NULL;
+    source->node = iterator->lsm->memtable.head->next[0];
+    source_load(iterator->lsm, source);
+}
+
+static void iterator_add_run(LsmIterator* iterator, LsmRun* run) {
+    LsmSource* source = &iterator->sources[iterator->num_sources++];
+    source->run = run;
+    source->node = NULL;
+    source->next_entry = 0;
+    source->block = malloc(LSM_BLOCK_SIZE);
+    source->loaded_block = UINT32_MAX;
+    source_load(iterator->lsm, source);
+}
+
+// Sources are added newest first: the memtable, level 0 newest to oldest,
+// then the deeper levels.
+void lsm_iterator_open(Lsm* lsm, LsmIterator* iterator) {
+    iterator_init(lsm, iterator, true);
+    iterator_add_memtable(iterator);
+    for (uint32_t i = lsm->num_level0_runs; i > 0; i--)
+        iterator_add_run(iterator, lsm->level0[i - 1]);
+    for (uint32_t level = 1; level <= LSM_MAX_LEVELS; level++)
+        if (lsm->levels[level])
+            iterator_add_run(iterator, lsm->levels[level]);
+}
+
+// Steps to the next key in order. Where several sources hold the key the
+// newest one wins and the others are skipped past it.
+bool lsm_iterator_next(LsmIterator* iterator) {
+    Lsm* lsm = iterator->lsm;
+    while (true) {
+        LsmSource* winner = NULL;
+        for (uint32_t i = 0; i < iterator->num_sources; i++) {
+            LsmSource* source = &iterator->sources[i];
+            if (source->valid && (!winner || compare_keys(source->key, winner->key, lsm->key_size) < 0))
+                winner = source;
+        }
+        if (!winner)
+            return false;
+
+        memcpy(iterator->key, winner->key, lsm->key_size);
+        memcpy(iterator->row, winner->row, USER_ROW_SIZE);
+        iterator->deleted = winner->deleted;
+        for (uint32_t i = 0; i < iterator->num_sources; i++) {
+            LsmSource* source = &iterator->sources[i];
+            if (source->valid && compare_keys(source->key, iterator->key, lsm->key_size) == 0)
+                source_advance(lsm, source);
+        }
+
+        if (!iterator->deleted || !iterator->skip_deleted)
+            return true;
+    }
+}
+
+void lsm_iterator_close(LsmIterator* iterator) {
+    for (uint32_t i = 0; i < iterator->num_sources; i++)
+        free(iterator->sources[i].block);
+    iterator->num_sources = 0;
+}
+
+static void write_manifest(Lsm* lsm) {
+    uint8_t manifest[LSM_MANIFEST_SIZE];
+    uint32_t version = LSM_FORMAT_VERSION;
+    memset(manifest, 0, LSM_MANIFEST_SIZE);
+    memcpy(manifest, LSM_MANIFEST_MAGIC, 8);
+    memcpy(manifest + 8, &version, sizeof(uint32_t));
+    memcpy(manifest + 12, &lsm->key_size, sizeof(uint32_t));
+    memcpy(manifest + 16, &lsm->next_run_id, sizeof(uint64_t));
+    memcpy(manifest + 24, &lsm->num_level0_runs, sizeof(uint32_t));
+    uint8_t* ids = manifest + 24 + sizeof(uint32_t);
+    for (uint32_t i = 0; i < lsm->num_level0_runs; i++)
+        memcpy(ids + i * sizeof(uint64_t), &lsm->level0[i]->id, sizeof(uint64_t));
+    ids += LSM_L0_MAX_RUNS * sizeof(uint64_t);
+    for (uint32_t level = 1; level <= LSM_MAX_LEVELS; level++)
+        if (lsm->levels[level])
+            memcpy(ids + (level - 1) * sizeof(uint64_t), &lsm->levels[level]->id, sizeof(uint64_t));
+
+    // Renamed into place once synced, so a crash leaves one whole manifest.
+    char* filename = lsm_filename(lsm, LSM_MANIFEST_SUFFIX, 0);
+    char* temporary_filename = lsm_filename(lsm, LSM_MANIFEST_SUFFIX ".tmp", 0);
+    int fd = open(temporary_filename, O_WRONLY | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR);
+    if (fd == -1)
+        lsm_io_error("creating", temporary_filename);
+    write_fully(fd, manifest, LSM_MANIFEST_SIZE, 0, temporary_filename);
+    if (fsync(fd) != 0)
+        lsm_io_error("syncing", temporary_filename);
+    close(fd);
+    if (rename(temporary_filename, filename) != 0)
+        lsm_io_error("renaming", temporary_filename);
+    free(temporary_filename);
+    free(filename);
+}
+
+// A missing manifest means a new database.
+static void read_manifest(Lsm* lsm) {
+    char* filename = lsm_filename(lsm, LSM_MANIFEST_SUFFIX, 0);
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        free(filename);
+        return;
+    }
+
+    uint8_t manifest[LSM_MANIFEST_SIZE];
+    uint32_t version, key_size;
+    if (read(fd, manifest, LSM_MANIFEST_SIZE) != LSM_MANIFEST_SIZE || memcmp(manifest, LSM_MANIFEST_MAGIC, 8) != 0) {
+        printf(ANSI_COLOR_RED "'%s' is not an LSM manifest.\n" ANSI_COLOR_RESET, filename);
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    memcpy(&version, manifest + 8, sizeof(uint32_t));
+    memcpy(&key_size, manifest + 12, sizeof(uint32_t));
+    memcpy(&lsm->next_run_id, manifest + 16, sizeof(uint64_t));
+    memcpy(&lsm->num_level0_runs, manifest + 24, sizeof(uint32_t));
+    if (version != LSM_FORMAT_VERSION || key_size != lsm->key_size || lsm->num_level0_runs > LSM_L0_MAX_RUNS) {
+        printf(ANSI_COLOR_RED "Unsupported LSM manifest '%s'.\n" ANSI_COLOR_RESET, filename);
+        exit(EXIT_FAILURE);
+    }
+
+    uint8_t* ids = manifest + 24 + sizeof(uint32_t);
+    uint64_t run_id;
+    for (uint32_t i = 0; i < lsm->num_level0_runs; i++) {
+        memcpy(&run_id, ids + i * sizeof(uint64_t), sizeof(uint64_t));
+        lsm->level0[i] = run_open(lsm, run_id);
+    }
+    ids += LSM_L0_MAX_RUNS * sizeof(uint64_t);
+    for (uint32_t level = 1; level <= LSM_MAX_LEVELS; level++) {
+        memcpy(&run_id, ids + (level - 1) * sizeof(uint64_t), sizeof(uint64_t));
+        if (run_id != 0)
+            lsm->levels[level] = run_open(lsm, run_id);
+    }
+    free(filename);
+}
+
+static void wal_write_buffer(Lsm* lsm) {
+    uint32_t written = 0;
+    while (written < lsm->wal_buffer_used) {
+        ssize_t result = write(lsm->wal_file_descriptor, lsm->wal_buffer + written, lsm->wal_buffer_used - written);
+        if (result == -1) {
+            if (errno == EINTR)
+                continue;
+            printf(ANSI_COLOR_RED "Error writing write-ahead log: %d\n" ANSI_COLOR_RESET, errno);
+            exit(EXIT_FAILURE);
+        }
+        written += (uint32_t)result;
+    }
+    lsm->wal_buffer_used = 0;
+}
+
+static void wal_append(Lsm* lsm, LogRecordType type, const uint8_t* key, const void* row) {
+    uint32_t size = 1 + (key ? lsm->key_size : 0) + (row ? USER_ROW_SIZE : 0);
+    if (lsm->wal_buffer_used + size > LSM_WAL_BUFFER_SIZE)
+        wal_write_buffer(lsm);
+
+    uint8_t* record = lsm->wal_buffer + lsm->wal_buffer_used;
+    record[0] = (uint8_t)type;
+    if (key)
+        memcpy(record + 1, key, lsm->key_size);
+    if (row)
+        memcpy(record + 1 + lsm->key_size, row, USER_ROW_SIZE);
+    lsm->wal_buffer_used += size;
+}
+
+// Rebuilds the memtable from the statements committed since the last
+// flush. Records after the last COMMIT belong to a statement that never
+// finished and are dropped.
+static void wal_replay(Lsm* lsm, const char* filename) {
+    struct stat wal_stat;
+    if (fstat(lsm->wal_file_descriptor, &wal_stat) != 0)
+        lsm_io_error("reading", filename);
+    if (wal_stat.st_size == 0)
+        return;
+
+    uint8_t* log = malloc((size_t)wal_stat.st_size);
+    if (pread(lsm->wal_file_descriptor, log, (size_t)wal_stat.st_size, 0) != wal_stat.st_size)
+        lsm_io_error("reading", filename);
+
+    uint64_t length = (uint64_t)wal_stat.st_size, committed = 0;
+    for (uint64_t position = 0; position < length;) {
+        LogRecordType type = (LogRecordType)log[position];
+        uint64_t size = type == LOG_RECORD_PUT      ? 1 + lsm->key_size + USER_ROW_SIZE
+                        : type == LOG_RECORD_DELETE ? 1 + lsm->key_size
+                        : type == LOG_RECORD_COMMIT ? 1
+                                                    : 0;
+        if (size == 0 || position + size > length)
+            break;
+        position += size;
+        if (type == LOG_RECORD_COMMIT)
+            committed = position;
+    }
+
+    for (uint64_t position = 0; position < committed;) {
+        LogRecordType type = (LogRecordType)log[position];
+        const uint8_t* key = log + position + 1;
+        if (type == LOG_RECORD_PUT) {
+            memtable_upsert(lsm, key, key + lsm->key_size);
+            position += 1 + lsm->key_size + USER_ROW_SIZE;
+        } else if (type == LOG_RECORD_DELETE) {
+            memtable_upsert(lsm, key, NULL);
+            position += 1 + lsm->key_size;
+        } else {
+            position += 1;
+        }
+    }
+    free(log);
+
+    if (committed < length) {
+        printf(ANSI_COLOR_RED "Discarding %llu bytes of unfinished writes from '%s'.\n" ANSI_COLOR_RESET,
+               (unsigned long long)(length - committed), filename);
+        if (ftruncate(lsm->wal_file_descriptor, (off_t)committed) != 0)
+            lsm_io_error("truncating", filename);
+    }
+}
+
+static uint64_t level_limit_bytes(uint32_t level) {
+    uint64_t limit = (uint64_t)LSM_MEMTABLE_BYTES * LSM_L0_MAX_RUNS;
+    for (uint32_t i = 1; i < level; i++)
+        limit *= LSM_LEVEL_SIZE_RATIO;
+    return limit;
+}
+
+// Deletions can be forgotten once nothing older lies below.
+static bool levels_empty_below(Lsm* lsm, uint32_t level) {
+    for (uint32_t below = level + 1; below <= LSM_MAX_LEVELS; below++)
+        if (lsm->levels[below])
+            return false;
+    return true;
+}
+
+static LsmRun* write_run(Lsm* lsm, LsmIterator* iterator, uint64_t max_entries) {
+    LsmRunWriter writer;
+    run_writer_open(lsm, &writer, max_entries);
+    while (lsm_iterator_next(iterator))
+        run_writer_add(&writer, iterator->key, iterator->deleted, iterator->row);
+    lsm_iterator_close(iterator);
+    return run_writer_finish(&writer);
+}
+
+// Merges the inputs, newest first, into one run.
+static LsmRun* merge_runs(Lsm* lsm, LsmRun** inputs, uint32_t num_inputs, bool drop_deleted) {
+    LsmIterator iterator;
+    iterator_init(lsm, &iterator, drop_deleted);
+    uint64_t max_entries = 0;
+    for (uint32_t i = 0; i < num_inputs; i++) {
+        iterator_add_run(&iterator, inputs[i]);
+        max_entries += inputs[i]->num_entries;
+    }
+    return write_run(lsm, &iterator, max_entries);
+}
+
+// Called once the merged run has taken the inputs' place in the levels:
+// the manifest is written before the inputs are removed.
+static void retire_runs(Lsm* lsm, LsmRun** inputs, uint32_t num_inputs) {
+    write_manifest(lsm);
+    for (uint32_t i = 0; i < num_inputs; i++)
+        run_close(inputs[i], true);
+    lsm->compactions++;
+}
+
+// Level 0 is merged into level 1 once it holds LSM_L0_MAX_RUNS runs; a
+// deeper level is merged into the next once it outgrows its limit.
+static void maybe_compact(Lsm* lsm) {
+    LsmRun* inputs[LSM_L0_MAX_RUNS + 1];
+    if (lsm->num_level0_runs >= LSM_L0_MAX_RUNS) {
+        uint32_t num_inputs = 0;
+        for (uint32_t i = lsm->num_level0_runs; i > 0; i--)
+            inputs[num_inputs++] = lsm->level0[i - 1];
+        if (lsm->levels[1])
+            inputs[num_inputs++] = lsm->levels[1];
+        LsmRun* run = merge_runs(lsm, inputs, num_inputs, levels_empty_below(lsm, 1));
+        lsm->num_level0_runs = 0;
+        lsm->levels[1] = run;
+        retire_runs(lsm, inputs, num_inputs);
+    }
+
+    for (uint32_t level = 1; level < LSM_MAX_LEVELS; level++) {
+        if (run_bytes(lsm, lsm->levels[level]) <= level_limit_bytes(level))
+            continue;
+        uint32_t num_inputs = 0;
+        inputs[num_inputs++] = lsm->levels[level];
+        if (lsm->levels[level + 1])
+            inputs[num_inputs++] = lsm->levels[level + 1];
+        LsmRun* run = merge_runs(lsm, inputs, num_inputs, levels_empty_below(lsm, level + 1));
+        lsm->levels[level] = NULL;
+        lsm->levels[level + 1] = run;
+        retire_runs(lsm, inputs, num_inputs);
+    }
+}
+
+// Writes the memtable out as a level 0 run. The log is truncated once the
+// run is in the manifest; buffered log records are covered by the run.
+static void flush_memtable(Lsm* lsm) {
+    if (lsm->memtable.num_entries == 0)
+        return;
+
+    LsmIterator iterator;
+    iterator_init(lsm, &iterator, lsm->num_level0_runs == 0 && levels_empty_below(lsm, 0));
+    iterator_add_memtable(&iterator);
+    LsmRun* run = write_run(lsm, &iterator, lsm->memtable.num_entries);
+    if (run)
+        lsm->level0[lsm->num_level0_runs++] = run;
+    write_manifest(lsm);
+
+    lsm->wal_buffer_used = 0;
+    if (ftruncate(lsm->wal_file_descriptor, 0) != 0) {
+        printf(ANSI_COLOR_RED "Error truncating write-ahead log: %d\n" ANSI_COLOR_RESET, errno);
+        exit(EXIT_FAILURE);
+    }
+    memtable_free(lsm);
+    memtable_init(lsm);
+    lsm->flushes++;
+    maybe_compact(lsm);
+}
+
+Lsm* lsm_open(const char* db_filename, uint32_t key_size) {
+    Lsm* lsm = calloc(1, sizeof(Lsm));
+    lsm->db_filename = strdup(db_filename);
+    lsm->key_size = key_size;
+    lsm->entry_size = key_size + 1 + USER_ROW_SIZE;
+    lsm->entries_per_block = LSM_BLOCK_SIZE / lsm->entry_size;
+    lsm->next_run_id = 1;
+    lsm->read_block = malloc(LSM_BLOCK_SIZE);
+    lsm->wal_buffer = malloc(LSM_WAL_BUFFER_SIZE);
+    memtable_init(lsm);
+    read_manifest(lsm);
+
+    char* wal_filename = lsm_filename(lsm, LSM_WAL_SUFFIX, 0);
+    lsm->wal_file_descriptor = open(wal_filename, O_RDWR | O_CREAT | O_APPEND, S_IWUSR | S_IRUSR);
+    if (lsm->wal_file_descriptor == -1)
+        lsm_io_error("opening", wal_filename);
+    wal_replay(lsm, wal_filename);
+    free(wal_filename);
+    return lsm;
+}
+
+// The memtable is flushed so the next open has no log to replay.
+void lsm_close(Lsm* lsm) {
+    flush_memtable(lsm);
+    for (uint32_t i = 0; i < lsm->num_level0_runs; i++)
+        run_close(lsm->level0[i], false);
+    for (uint32_t level = 1; level <= LSM_MAX_LEVELS; level++)
+        if (lsm->levels[level])
+            run_close(lsm->levels[level], false);
+    close(lsm->wal_file_descriptor);
+    memtable_free(lsm);
+    free(lsm->wal_buffer);
+    free(lsm->read_block);
+    free(lsm->db_filename);
+    free(lsm);
+}
+
+// Copies the key's row into row, when not NULL. Returns false if the key
+// has no live row.
+bool lsm_get(Lsm* lsm, const uint8_t* key, void* row) {
+    LsmSkipNode* node = memtable_find(lsm, key);
+    if (node) {
+        if (row && !node->deleted)
+            memcpy(row, skip_node_row(lsm, node), USER_ROW_SIZE);
+        return !node->deleted;
+    }
+
+    bool deleted;
+    for (uint32_t i = lsm->num_level0_runs; i > 0; i--)
+        if (run_get(lsm, lsm->level0[i - 1], key, &deleted, row))
+            return !deleted;
+    for (uint32_t level = 1; level <= LSM_MAX_LEVELS; level++)
+        if (lsm->levels[level] && run_get(lsm, lsm->levels[level], key, &deleted, row))
+            return !deleted;
+    return false;
+}
+
+// A full memtable is flushed straight away, even mid-statement, so a
+// large import never holds more than LSM_MEMTABLE_BYTES in memory.
+void lsm_put(Lsm* lsm, const uint8_t* key, const void* row) {
+    memtable_upsert(lsm, key, row);
+    wal_append(lsm, LOG_RECORD_PUT, key, row);
+    if (lsm->memtable.bytes >= LSM_MEMTABLE_BYTES)
+        flush_memtable(lsm);
+}
+
+void lsm_delete(Lsm* lsm, const uint8_t* key) {
+    memtable_upsert(lsm, key, NULL);
+    wal_append(lsm, LOG_RECORD_DELETE, key, NULL);
+    if (lsm->memtable.bytes >= LSM_MEMTABLE_BYTES)
+        flush_memtable(lsm);
+}
+
+// Ends a write statement: its log records and a COMMIT go to the log.
+void lsm_commit(Lsm* lsm) {
+    if (lsm->wal_buffer_used == 0)
+        return;
+    wal_append(lsm, LOG_RECORD_COMMIT, NULL, NULL);
+    wal_write_buffer(lsm);
+}
+
+// Flushes the memtable and merges every run into one on the deepest
+// level in use, dropping deleted keys.
+void lsm_compact(Lsm* lsm) {
+    lsm_commit(lsm);
+    flush_memtable(lsm);
+
+    LsmRun* inputs[LSM_L0_MAX_RUNS + LSM_MAX_LEVELS];
+    uint32_t num_inputs = 0, deepest = 1;
+    for (uint32_t i = lsm->num_level0_runs; i > 0; i--)
+        inputs[num_inputs++] = lsm->level0[i - 1];
+    for (uint32_t level = 1; level <= LSM_MAX_LEVELS; level++) {
+        if (lsm->levels[level]) {
+            inputs[num_inputs++] = lsm->levels[level];
+            deepest = level;
+        }
+    }
+    if (num_inputs == 0)
+        return;
+
+    LsmRun* run = merge_runs(lsm, inputs, num_inputs, true);
+    lsm->num_level0_runs = 0;
+    for (uint32_t level = 1; level <= LSM_MAX_LEVELS; level++)
+        lsm->levels[level] = NULL;
+    lsm->levels[deepest] = run;
+    retire_runs(lsm, inputs, num_inputs);
+}
+
+void print_lsm_status(DbTable* table) {
+    Lsm* lsm = table->lsm;
+    printf("Memtable: %llu entries, %zu bytes\n", (unsigned long long)lsm->memtable.num_entries, lsm->memtable.bytes);
+    for (uint32_t i = 0; i < lsm->num_level0_runs; i++)
+        printf("Level 0: run %llu, %llu entries in %u blocks\n", (unsigned long long)lsm->level0[i]->id,
+               (unsigned long long)lsm->level0[i]->num_entries, lsm->level0[i]->num_blocks);
+    for (uint32_t level = 1; level <= LSM_MAX_LEVELS; level++) {
+        LsmRun* run = lsm->levels[level];
+        if (run)
+            printf("Level %u: run %llu, %llu entries in %u blocks\n", level, (unsigned long long)run->id,
+                   (unsigned long long)run->num_entries, run->num_blocks);
+    }
+    printf("Flushes: %llu, compactions: %llu, bloom filter skips: %llu, block reads: %llu\n",
+           (unsigned long long)lsm->flushes, (unsigned long long)lsm->compactions,
+           (unsigned long long)lsm->bloom_skips, (unsigned long long)lsm->block_reads);
+}
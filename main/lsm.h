@@ -0,0 +1,28 @@
+#ifndef DB_LSM_H
+#define DB_LSM_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "common.h"
+#include "key.h"
+
+const char* storage_engine_name(StorageEngine engine);
+bool        parse_storage_engine(const char* name, StorageEngine* engine);
+
+Lsm*  lsm_open(const char* db_filename, uint32_t key_size);
+void  lsm_close(Lsm* lsm);
+bool  lsm_get(Lsm* lsm, const uint8_t* key, void* row);
+void  lsm_put(Lsm* lsm, const uint8_t* key, const void* row);
+void  lsm_delete(Lsm* lsm, const uint8_t* key);
+void  lsm_commit(Lsm* lsm);
+void  lsm_compact(Lsm* lsm);
+void  lsm_iterator_open(Lsm* lsm, LsmIterator* iterator);
+bool  lsm_iterator_next(LsmIterator* iterator);
+void  lsm_iterator_close(LsmIterator* iterator);
+void  print_lsm_status(DbTable* table);
+
+#endif
@@ -6,6 +6,9 @@
 #include "statement.h"
 #include "execution.h"
 #include "table.h"
+#include "pager.h"
+#include "key.h"
+#include "scan.h"
 #include "common.h"
 
 int main(int argc, char* argv[]) {
@@ -14,15 +17,149 @@ int main(int argc, char* argv[]) {
         exit(EXIT_FAILURE);
     }
 
+    DbOptions options = {
+        .key_type = KEY_TYPE_INT64,
+        .engine = STORAGE_ENGINE_BTREE,
+        .page_size = DEFAULT_PAGE_SIZE,
+        .dirty_ratio_percent = DEFAULT_DIRTY_RATIO_PERCENT,
+        .dirty_limit_percent = DEFAULT_DIRTY_LIMIT_PERCENT,
+        .flush_interval_ms = DEFAULT_FLUSH_INTERVAL_MS,
+        .scan_threads = default_scan_threads(),
+        .sort_memory_mb = DEFAULT_SORT_MEMORY_MB,
+        .cache_size_mb = DEFAULT_CACHE_SIZE_MB,
+        .huge_pages = false,
+        .direct_io = false,
+        .shared = false,
+        .warm_cache = false,
+        .hash_index = false,
+        .num_partitions = 0,
+        .partition_width = 0,
+        .replication_log = NULL,
+        .replica_of = NULL
+    };
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--key") == 0 && i + 1 < argc) {
+            if (!parse_key_type(argv[++i], &options.key_type)) {
+                printf(ANSI_COLOR_RED "Unknown key type '%s' (expected int64 or tenant).\n" ANSI_COLOR_RESET, argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            if (!parse_storage_engine(argv[++i], &options.engine)) {
+                printf(ANSI_COLOR_RED "Unknown storage engine '%s' (expected btree or lsm).\n" ANSI_COLOR_RESET, argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(argv[i], "--page-size") == 0 && i + 1 < argc) {
+            options.page_size = (uint32_t)strtoul(argv[++i], NULL, 10);
+            if (!is_valid_page_size(options.page_size)) {
+                printf(ANSI_COLOR_RED "Page size must be a power of two between %d and %d.\n" ANSI_COLOR_RESET, MIN_PAGE_SIZE, MAX_PAGE_SIZE);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(argv[i], "--dirty-ratio") == 0 && i + 1 < argc)
+            options.dirty_ratio_percent = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--dirty-limit") == 0 && i + 1 < argc)
+            options.dirty_limit_percent = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--flush-interval") == 0 && i + 1 < argc)
+            options.flush_interval_ms = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--scan-threads") == 0 && i + 1 < argc) {
+            options.scan_threads = (uint32_t)strtoul(argv[++i], NULL, 10);
+            if (options.scan_threads < 1 || options.scan_threads > MAX_SCAN_THREADS) {
+                printf(ANSI_COLOR_RED "Scan threads must be between 1 and %d.\n" ANSI_COLOR_RESET, MAX_SCAN_THREADS);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(argv[i], "--sort-memory") == 0 && i + 1 < argc) {
+            options.sort_memory_mb = (uint32_t)strtoul(argv[++i], NULL, 10);
+            if (options.sort_memory_mb < 1) {
+                printf(ANSI_COLOR_RED "Sort memory must be at least 1 MB.\n" ANSI_COLOR_RESET);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc)
+            options.cache_size_mb = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--huge-pages") == 0)
+            options.huge_pages = true;
+        else if (strcmp(argv[i], "--direct-io") == 0)
+            options.direct_io = true;
+        else if (strcmp(argv[i], "--shared") == 0)
+            options.shared = true;
+        else if (strcmp(argv[i], "--warm-cache") == 0)
+            options.warm_cache = true;
+        else if (strcmp(argv[i], "--hash-index") == 0)
+            options.hash_index = true;
+        else if (strcmp(argv[i], "--partitions") == 0 && i + 1 < argc) {
+            options.num_partitions = (uint32_t)strtoul(argv[++i], NULL, 10);
+            if (options.num_partitions < 2 || options.num_partitions > MAX_PARTITIONS) {
+                printf(ANSI_COLOR_RED "Partitions must be between 2 and %d.\n" ANSI_COLOR_RESET, MAX_PARTITIONS);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(argv[i], "--partition-width") == 0 && i + 1 < argc) {
+            options.partition_width = strtoull(argv[++i], NULL, 10);
+            if (options.partition_width == 0) {
+                printf(ANSI_COLOR_RED "Partition width must be at least 1.\n" ANSI_COLOR_RESET);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(argv[i], "--replication-log") == 0 && i + 1 < argc)
+            options.replication_log = argv[++i];
+        else if (strcmp(argv[i], "--replica-of") == 0 && i + 1 < argc)
+            options.replica_of = argv[++i];
+        else {
+            printf(ANSI_COLOR_RED "Unrecognized option '%s'.\n" ANSI_COLOR_RESET, argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (options.dirty_ratio_percent == 0 || options.dirty_ratio_percent > options.dirty_limit_percent || options.dirty_limit_percent > 100) {
+        printf(ANSI_COLOR_RED "Dirty ratio and limit must satisfy 0 < ratio <= limit <= 100.\n" ANSI_COLOR_RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    if (options.replication_log && options.replica_of) {
+        printf(ANSI_COLOR_RED "A replica cannot write a replication log of its own.\n" ANSI_COLOR_RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    if (options.warm_cache && options.shared) {
+        printf(ANSI_COLOR_RED "--warm-cache cannot be used with --shared.\n" ANSI_COLOR_RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    // Other processes free and reuse pages without this one's generations.
+    if (options.hash_index && options.shared) {
+        printf(ANSI_COLOR_RED "--hash-index cannot be used with --shared.\n" ANSI_COLOR_RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    if (options.partition_width > 0 && options.num_partitions == 0) {
+        printf(ANSI_COLOR_RED "--partition-width needs --partitions.\n" ANSI_COLOR_RESET);
+        exit(EXIT_FAILURE);
+    }
+
     char* db_filename = argv[1];
-    DbTable* db_table = db_open(db_filename);
+    if (strcmp(db_filename, IN_MEMORY_DB_NAME) == 0 && (options.shared || options.direct_io || options.warm_cache)) {
+        printf(ANSI_COLOR_RED "--shared, --direct-io and --warm-cache need a database file.\n" ANSI_COLOR_RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    if (options.num_partitions > 0 && (options.shared || options.replication_log || options.replica_of || strcmp(db_filename, IN_MEMORY_DB_NAME) == 0)) {
+        printf(ANSI_COLOR_RED "--partitions cannot be used with --shared, :memory: or replication.\n" ANSI_COLOR_RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    DbTable* db_table = db_open(db_filename, &options);
 
     printf(ANSI_COLOR_GREEN "Use .commands for help\n" ANSI_COLOR_RESET);
 
     InputBuffer* input_buffer = new_input_buffer();
     while (true) {
         print_prompt();
+        db_unlatch(db_table);
         read_input(input_buffer);
+        db_latch(db_table);
 
         if (input_buffer->buffer[0] == '.') {
             switch (do_meta_command(input_buffer, db_table)) {
@@ -35,17 +172,20 @@ int main(int argc, char* argv[]) {
         }
 
         Statement statement;
-        switch (prepare_statement(input_buffer, &statement)) {
+        switch (prepare_statement(input_buffer, &db_table->schema, &statement)) {
             case PREPARE_SUCCESS:
                 break;
             case PREPARE_NEGATIVE_ID:
                 printf(ANSI_COLOR_RED "ID must be positive.\n" ANSI_COLOR_RESET);
+                print_prepare_error(input_buffer, &statement);
                 continue;
             case PREPARE_STRING_TOO_LONG:
                 printf(ANSI_COLOR_RED "String is too long.\n" ANSI_COLOR_RESET);
+                print_prepare_error(input_buffer, &statement);
                 continue;
             case PREPARE_SYNTAX_ERROR:
                 printf(ANSI_COLOR_RED "Syntax Error. Could not parse statement.\n" ANSI_COLOR_RESET);
+                print_prepare_error(input_buffer, &statement);
                 continue;
             case PREPARE_UNRECOGNIZED_STATEMENT:
                 printf(ANSI_COLOR_RED "Unrecognized keyword at start of '%s'.\n" ANSI_COLOR_RESET, input_buffer->buffer);
@@ -62,5 +202,6 @@ int main(int argc, char* argv[]) {
             case EXECUTE_SILENT_ERROR:
                 break;
         }
+        release_statement(&statement);
     }
 }
\ No newline at end of file
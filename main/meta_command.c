@@ -1,5 +1,283 @@
 #include "meta_command.h"
 
+static MetaCommandResult do_timer_command(InputBuffer* input_buffer, DbTable* table) {
+    Lexer lexer;
+    lexer_init(&lexer, input_buffer->buffer + 6);
+    Token token = lexer_scan_identifier(&lexer);
+    if (token_equals(token, "on") && lexer_at_end(&lexer))
+        table->stats->timer_enabled = true;
+    else if (token_equals(token, "off") && lexer_at_end(&lexer))
+        table->stats->timer_enabled = false;
+    else
+        printf(ANSI_COLOR_RED "Usage: .timer on|off\n" ANSI_COLOR_RESET);
+
+    return META_COMMAND_SUCCESS;
+}
+
+static MetaCommandResult do_slowlog_command(InputBuffer* input_buffer, DbTable* table) {
+    Lexer lexer;
+    lexer_init(&lexer, input_buffer->buffer + 8);
+    if (lexer_accept_keyword(&lexer, "off") && lexer_at_end(&lexer)) {
+        stats_close_slow_log(table->stats);
+        return META_COMMAND_SUCCESS;
+    }
+
+    Token token;
+    uint64_t threshold_ms = 0;
+    char filename[FILENAME_MAX_LENGTH + 1];
+    lexer_init(&lexer, input_buffer->buffer + 8);
+    lexer_skip_whitespace(&lexer);
+    if (!lexer_scan_quoted(&lexer, &token) || token.length == 0 || token.length > FILENAME_MAX_LENGTH ||
+        (!lexer_at_end(&lexer) && !lexer_scan_uint64(&lexer, &threshold_ms)) || !lexer_at_end(&lexer)) {
+        printf(ANSI_COLOR_RED "Usage: .slowlog '{file.log}' [threshold_ms] | .slowlog off\n" ANSI_COLOR_RESET);
+        return META_COMMAND_SUCCESS;
+    }
+
+    memcpy(filename, token.start, token.length);
+    filename[token.length] = '\0';
+    if (!stats_open_slow_log(table->stats, filename, threshold_ms))
+        printf(ANSI_COLOR_RED "Unable to open slow log '%s'\n" ANSI_COLOR_RESET, filename);
+
+    return META_COMMAND_SUCCESS;
+}
+
+// .trace start turns tracing on; .trace stop writes what was recorded
+// since then to a Chrome trace-event JSON file.
+static MetaCommandResult do_trace_command(InputBuffer* input_buffer) {
+#ifdef DB_TRACE
+    Lexer lexer;
+    Token token;
+    uint64_t num_events;
+    bool overwritten;
+    char filename[FILENAME_MAX_LENGTH + 1];
+    lexer_init(&lexer, input_buffer->buffer + 6);
+    if (lexer_at_end(&lexer)) {
+        print_trace_status();
+        return META_COMMAND_SUCCESS;
+    }
+    if (lexer_accept_keyword(&lexer, "start") && lexer_at_end(&lexer)) {
+        bool restarted = trace_running();
+        trace_start();
+        printf(ANSI_COLOR_YELLOW "Tracing %s; .trace stop '{file.json}' writes the events.\n" ANSI_COLOR_RESET,
+               restarted ? "restarted, earlier events dropped" : "started");
+        return META_COMMAND_SUCCESS;
+    }
+
+    lexer_init(&lexer, input_buffer->buffer + 6);
+    bool stop = lexer_accept_keyword(&lexer, "stop");
+    lexer_skip_whitespace(&lexer);
+    if (!stop || !lexer_scan_quoted(&lexer, &token) || token.length == 0 || token.length > FILENAME_MAX_LENGTH || !lexer_at_end(&lexer)) {
+        printf(ANSI_COLOR_RED "Usage: .trace [start | stop '{file.json}']\n" ANSI_COLOR_RESET);
+        return META_COMMAND_SUCCESS;
+    }
+    if (!trace_running()) {
+        printf(ANSI_COLOR_RED "Error: Tracing is not running; use .trace start.\n" ANSI_COLOR_RESET);
+        return META_COMMAND_SUCCESS;
+    }
+
+    memcpy(filename, token.start, token.length);
+    filename[token.length] = '\0';
+    if (!trace_stop(filename, &num_events, &overwritten))
+        printf(ANSI_COLOR_RED "Unable to write trace '%s'\n" ANSI_COLOR_RESET, filename);
+    else {
+        printf("Wrote %" PRIu64 " trace events to '%s'\n", num_events, filename);
+        if (overwritten)
+            printf(ANSI_COLOR_YELLOW "Some threads recorded more than %u events; their oldest were overwritten.\n" ANSI_COLOR_RESET,
+                   TRACE_RING_EVENTS);
+    }
+#else
+    (void)input_buffer;
+    printf(ANSI_COLOR_RED "Tracing is compiled out (built with TRACE=0), so nothing is recorded; rebuild with make TRACE=1.\n" ANSI_COLOR_RESET);
+#endif
+    return META_COMMAND_SUCCESS;
+}
+
+static MetaCommandResult do_histogram_command(InputBuffer* input_buffer, DbTable* table) {
+    Lexer lexer;
+    lexer_init(&lexer, input_buffer->buffer + 10);
+    if (lexer_at_end(&lexer))
+        stats_print_histograms(table->stats);
+    else if (lexer_accept_keyword(&lexer, "reset") && lexer_at_end(&lexer))
+        stats_reset_histograms(table->stats);
+    else
+        printf(ANSI_COLOR_RED "Usage: .histogram [reset]\n" ANSI_COLOR_RESET);
+
+    return META_COMMAND_SUCCESS;
+}
+
+// Reads the single quoted file name argument of .dump and .restore.
+static bool scan_filename_argument(const char* arguments, char* filename) {
+    Lexer lexer;
+    Token token;
+    lexer_init(&lexer, arguments);
+    if (!lexer_scan_quoted(&lexer, &token) || token.length == 0 || token.length > FILENAME_MAX_LENGTH ||
+        !lexer_at_end(&lexer))
+        return false;
+
+    memcpy(filename, token.start, token.length);
+    filename[token.length] = '\0';
+    return true;
+}
+
+// Commands that work on B-tree pages have nothing to work on in an LSM
+// database.
+static bool refused_by_lsm(DbTable* table, const char* command) {
+    if (!table_partition(table, 0)->lsm)
+        return false;
+    printf(ANSI_COLOR_RED "Error: %s is not supported by the lsm engine.\n" ANSI_COLOR_RESET, command);
+    return true;
+}
+
+// Commands that copy a single database file.
+static bool refused_by_partitions(DbTable* table, const char* command) {
+    if (!table->partitions)
+        return false;
+    printf(ANSI_COLOR_RED "Error: %s is not supported on a partitioned database.\n" ANSI_COLOR_RESET, command);
+    return true;
+}
+
+// Runs a per-tree command on the table, or on each partition in turn.
+static void for_each_partition(DbTable* table, void (*command)(DbTable* table)) {
+    if (!table->partitions) {
+        command(table);
+        return;
+    }
+    for (uint32_t i = 0; i < table->num_partitions; i++) {
+        printf("Partition %u:\n", i);
+        command(table->partitions[i]);
+    }
+}
+
+static MetaCommandResult do_dump_command(InputBuffer* input_buffer, DbTable* table) {
+    char filename[FILENAME_MAX_LENGTH + 1];
+    if (refused_by_lsm(table, ".dump") || refused_by_partitions(table, ".dump"))
+        return META_COMMAND_SUCCESS;
+    if (!scan_filename_argument(input_buffer->buffer + 5, filename))
+        printf(ANSI_COLOR_RED "Usage: .dump '{file}'\n" ANSI_COLOR_RESET);
+    else {
+        db_begin_access(table, false);
+        dump_table(table, filename);
+        db_end_access(table);
+    }
+
+    return META_COMMAND_SUCCESS;
+}
+
+static MetaCommandResult do_restore_command(InputBuffer* input_buffer, DbTable* table) {
+    char filename[FILENAME_MAX_LENGTH + 1];
+    if (refused_by_lsm(table, ".restore") || refused_by_partitions(table, ".restore"))
+        return META_COMMAND_SUCCESS;
+    if (!scan_filename_argument(input_buffer->buffer + 8, filename))
+        printf(ANSI_COLOR_RED "Usage: .restore '{file}'\n" ANSI_COLOR_RESET);
+    else {
+        db_begin_access(table, true);
+        restore_table(table, filename);
+        db_end_access(table);
+        pager_end_statement(table->db_pager);
+    }
+
+    return META_COMMAND_SUCCESS;
+}
+
+static MetaCommandResult do_snapshot_command(InputBuffer* input_buffer, DbTable* table) {
+    char filename[FILENAME_MAX_LENGTH + 1];
+    if (refused_by_lsm(table, ".snapshot") || refused_by_partitions(table, ".snapshot"))
+        return META_COMMAND_SUCCESS;
+    if (!scan_filename_argument(input_buffer->buffer + 9, filename)) {
+        printf(ANSI_COLOR_RED "Usage: .snapshot '{file}'\n" ANSI_COLOR_RESET);
+        return META_COMMAND_SUCCESS;
+    }
+
+    db_begin_access(table, false);
+    table->db_pager->header.root_page_idx = table->root_page_idx;
+    if (pager_snapshot(table->db_pager, filename))
+        printf(ANSI_COLOR_YELLOW "Wrote %u pages to '%s'.\n" ANSI_COLOR_RESET, table->db_pager->num_pages, filename);
+    db_end_access(table);
+    return META_COMMAND_SUCCESS;
+}
+
+static void compact_tree(DbTable* table) {
+    if (table->lsm) {
+        lsm_compact(table->lsm);
+        printf(ANSI_COLOR_YELLOW "Merged all runs into one.\n" ANSI_COLOR_RESET);
+        return;
+    }
+
+    db_begin_access(table, true);
+    pager_begin_write(table->db_pager);
+    uint64_t removed = table_compact(table);
+    pager_end_write(table->db_pager);
+    db_end_access(table);
+    pager_end_statement(table->db_pager);
+
+    printf(ANSI_COLOR_YELLOW "Removed %" PRIu64 " deleted rows.\n" ANSI_COLOR_RESET, removed);
+}
+
+static MetaCommandResult do_compact_command(DbTable* table) {
+    if (table->replica)
+        printf(ANSI_COLOR_RED "Error: This database is a read-only replica.\n" ANSI_COLOR_RESET);
+    else
+        for_each_partition(table, compact_tree);
+    return META_COMMAND_SUCCESS;
+}
+
+static void print_btree(DbTable* table) {
+    printf("Tree:\n");
+    db_begin_access(table, false);
+    print_tree(table, table->root_page_idx, 0);
+    db_end_access(table);
+}
+
+static bool count_every_row(DbTable* table, void* context, FILE* output, const uint8_t* key, void* row) {
+    (void)table;
+    (void)context;
+    (void)output;
+    (void)key;
+    (void)row;
+    return true;
+}
+
+static void print_partition_status(DbTable* table) {
+    uint64_t width = table->db_pager->header.partition_width;
+    const char* field = table->layout.key_type == KEY_TYPE_TENANT_INT64 ? "tenant ids" : "ids";
+    if (width == 0)
+        printf("%u partitions by key hash\n", table->num_partitions);
+    else
+        printf("%u partitions by %s, %" PRIu64 " per partition\n", table->num_partitions, field, width);
+
+    for (uint32_t i = 0; i < table->num_partitions; i++) {
+        DbTable* partition = table->partitions[i];
+        uint64_t row_count = table_scan(partition, count_every_row, NULL, NULL);
+        pager_end_statement(partition->db_pager);
+        printf("Partition %u: '%s', %" PRIu64 " rows, %u pages", i, partition->filename, row_count, partition->db_pager->num_pages);
+        if (width > 0 && i + 1 < table->num_partitions)
+            printf(", %s %" PRIu64 " to %" PRIu64, field, i * width, (i + 1) * width - 1);
+        else if (width > 0)
+            printf(", %s from %" PRIu64, field, i * width);
+        printf("\n");
+    }
+}
+
+static MetaCommandResult do_partitions_command(InputBuffer* input_buffer, DbTable* table) {
+    Lexer lexer;
+    uint64_t partition_idx;
+    lexer_init(&lexer, input_buffer->buffer + 11);
+    if (!table->partitions)
+        printf("This database is not partitioned.\n");
+    else if (lexer_at_end(&lexer))
+        print_partition_status(table);
+    else if (lexer_accept_keyword(&lexer, "truncate") && lexer_scan_uint64(&lexer, &partition_idx) && lexer_at_end(&lexer)) {
+        if (partition_idx >= table->num_partitions)
+            printf(ANSI_COLOR_RED "Error: There is no partition %" PRIu64 ".\n" ANSI_COLOR_RESET, partition_idx);
+        else if (table_truncate_partition(table, (uint32_t)partition_idx))
+            printf(ANSI_COLOR_YELLOW "Truncated partition %" PRIu64 ".\n" ANSI_COLOR_RESET, partition_idx);
+    }
+    else
+        printf(ANSI_COLOR_RED "Usage: .partitions [truncate {n}]\n" ANSI_COLOR_RESET);
+
+    return META_COMMAND_SUCCESS;
+}
+
 MetaCommandResult do_meta_command(InputBuffer* input_buffer, DbTable* table) {
     if (strncmp(input_buffer->buffer, ".exit", 5) == 0) {
         close_input_buffer(input_buffer);
@@ -7,13 +285,59 @@ MetaCommandResult do_meta_command(InputBuffer* input_buffer, DbTable* table) {
         exit(EXIT_SUCCESS);
     }
     else if (strncmp(input_buffer->buffer, ".btree", 6) == 0) {
-        printf("Tree:\n");
-        print_tree(table->db_pager, 0, 0);
+        if (!refused_by_lsm(table, ".btree"))
+            for_each_partition(table, print_btree);
+        return META_COMMAND_SUCCESS;
+    }
+    else if (strncmp(input_buffer->buffer, ".analyze", 8) == 0) {
+        if (!refused_by_lsm(table, ".analyze"))
+            for_each_partition(table, print_tree_analysis);
         return META_COMMAND_SUCCESS;
     }
     else if (strncmp(input_buffer->buffer, ".constants", 10) == 0) {
         printf("Constants:\n");
-        print_constants();
+        print_constants(table);
+        return META_COMMAND_SUCCESS;
+    }
+    else if (strncmp(input_buffer->buffer, ".timer", 6) == 0)
+        return do_timer_command(input_buffer, table);
+    else if (strncmp(input_buffer->buffer, ".trace", 6) == 0)
+        return do_trace_command(input_buffer);
+    else if (strncmp(input_buffer->buffer, ".slowlog", 8) == 0)
+        return do_slowlog_command(input_buffer, table);
+    else if (strncmp(input_buffer->buffer, ".histogram", 10) == 0)
+        return do_histogram_command(input_buffer, table);
+    else if (strncmp(input_buffer->buffer, ".dump", 5) == 0)
+        return do_dump_command(input_buffer, table);
+    else if (strncmp(input_buffer->buffer, ".restore", 8) == 0)
+        return do_restore_command(input_buffer, table);
+    else if (strncmp(input_buffer->buffer, ".snapshot", 9) == 0)
+        return do_snapshot_command(input_buffer, table);
+    else if (strncmp(input_buffer->buffer, ".compact", 8) == 0)
+        return do_compact_command(table);
+    else if (strncmp(input_buffer->buffer, ".index", 6) == 0) {
+        for_each_partition(table, print_hash_index_status);
+        return META_COMMAND_SUCCESS;
+    }
+    else if (strncmp(input_buffer->buffer, ".lsm", 4) == 0) {
+        if (table_partition(table, 0)->lsm)
+            for_each_partition(table, print_lsm_status);
+        else
+            printf("This database uses the btree engine.\n");
+        return META_COMMAND_SUCCESS;
+    }
+    else if (strncmp(input_buffer->buffer, ".partitions", 11) == 0)
+        return do_partitions_command(input_buffer, table);
+    else if (strncmp(input_buffer->buffer, ".schema", 7) == 0) {
+        print_schema(&table->schema);
+        return META_COMMAND_SUCCESS;
+    }
+    else if (strncmp(input_buffer->buffer, ".replication", 12) == 0) {
+        print_replication_status(table);
+        return META_COMMAND_SUCCESS;
+    }
+    else if (strncmp(input_buffer->buffer, ".warmup", 7) == 0) {
+        for_each_partition(table, print_warmup_status);
         return META_COMMAND_SUCCESS;
     }
     else if (strncmp(input_buffer->buffer, ".commands", 9) == 0) {
@@ -25,28 +349,60 @@ MetaCommandResult do_meta_command(InputBuffer* input_buffer, DbTable* table) {
         return META_COMMAND_UNRECOGNIZED_COMMAND;
 }
 
-void print_constants() {
-    printf("USER_ROW_SIZE: %d\n", USER_ROW_SIZE);
-    printf("COMMON_NODE_HEADER_SIZE: %d\n", COMMON_NODE_HEADER_SIZE);
-    printf("LEAF_NODE_HEADER_SIZE: %d\n", LEAF_NODE_HEADER_SIZE);
-    printf("LEAF_NODE_CELL_SIZE: %d\n", LEAF_NODE_CELL_SIZE);
-    printf("LEAF_NODE_SPACE_FOR_CELLS: %d\n", LEAF_NODE_SPACE_FOR_CELLS);
-    printf("LEAF_NODE_MAX_CELLS: %d\n", LEAF_NODE_MAX_CELLS);
-    printf("INTERNAL_NODE_MAX_KEYS: %d\n", INTERNAL_NODE_MAX_KEYS);
+void print_constants(DbTable* table) {
+    NodeLayout* layout = &table->layout;
+    printf("ENGINE: %s\n", storage_engine_name(table_partition(table, 0)->lsm ? STORAGE_ENGINE_LSM : STORAGE_ENGINE_BTREE));
+    printf("PARTITIONS: %u\n", table_num_partitions(table));
+    printf("PAGE_SIZE: %u\n", layout->page_size);
+    printf("KEY_TYPE: %s\n", key_type_name(layout->key_type));
+    printf("KEY_SIZE: %u\n", layout->key_size);
+    printf("USER_ROW_SIZE: %zu\n", USER_ROW_SIZE);
+    printf("ROW_PAYLOAD_SIZE: %zu\n", ROW_PAYLOAD_SIZE);
+    printf("COMMON_NODE_HEADER_SIZE: %zu\n", COMMON_NODE_HEADER_SIZE);
+    printf("LEAF_NODE_HEADER_SIZE: %zu\n", LEAF_NODE_HEADER_SIZE);
+    printf("LEAF_NODE_CELL_SIZE: %u\n", layout->leaf_node_cell_size);
+    printf("LEAF_NODE_SPACE_FOR_CELLS: %u\n", layout->leaf_node_space_for_cells);
+    printf("LEAF_NODE_MAX_CELLS: %u\n", layout->leaf_node_max_cells);
+    printf("INTERNAL_NODE_MAX_KEYS: %u\n", layout->internal_node_max_keys);
 }
 
 void print_commands() {
-    printf("insert {num} {name} {email}\n");
+    printf("create table {name} ({column} int32|int64|double|bool|fixed({n})|varchar({n}), ...)\n");
+    printf("insert {num} {value} ...\n");
+    printf("insert values ({num}, {value}, ...), ...\n");
     printf("select\n");
     printf("select {id}\n");
-    printf("update {id} set {param}={value}\n");
+    printf("select [count] where id in ({id}, ...)\n");
+    printf("select {tenant_id}:*\n");
+    printf("select count [where {condition}]\n");
+    printf("select [where {condition}] order by {column} [asc|desc] [limit {n}]\n");
+    printf("select where {column} = '{value}' | {column} like '{pattern}' [and|or ...]\n");
+    printf("update {id} set {column}={value}\n");
+    printf("update where {condition} set {column}={value}\n");
     printf("drop {id}\n");
+    printf("drop where {condition}\n");
+    printf("drop where id between {low} and {high}\n");
     printf("import '{file.csv}'\n");
     printf("export '{file.csv}'\n");
+    printf(".analyze\n");
     printf(".btree\n");
     printf(".commands\n");
+    printf(".compact\n");
     printf(".constants\n");
+    printf(".dump '{file}'\n");
     printf(".exit\n");
+    printf(".histogram [reset]\n");
+    printf(".index\n");
+    printf(".lsm\n");
+    printf(".partitions [truncate {n}]\n");
+    printf(".replication\n");
+    printf(".restore '{file}'\n");
+    printf(".schema\n");
+    printf(".slowlog '{file.log}' [threshold_ms] | .slowlog off\n");
+    printf(".snapshot '{file}'\n");
+    printf(".timer on|off\n");
+    printf(".trace [start | stop '{file.json}']\n");
+    printf(".warmup\n");
 }
 
 void indent(uint32_t level) {
@@ -54,18 +410,23 @@ void indent(uint32_t level) {
         printf("  ");
 }
 
-void print_tree(DbPager* db_pager, uint32_t page_idx, uint32_t indentation_level) {
-    void* node = get_page(db_pager, page_idx);
+void print_tree(DbTable* table, uint32_t page_idx, uint32_t indentation_level) {
+    void* node = get_page(table->db_pager, page_idx);
     uint32_t num_keys, child_page_idx;
+    char key_text[KEY_LITERAL_MAX_LENGTH + 1];
 
     switch (get_node_type(node)) {
         case (NODE_LEAF):
             num_keys = *leaf_node_num_cells(node);
             indent(indentation_level);
-            printf("- leaf (size %d)\n", num_keys);
+            if (*leaf_node_num_tombstones(node) > 0)
+                printf("- leaf (size %d, %u deleted)\n", num_keys, *leaf_node_num_tombstones(node));
+            else
+                printf("- leaf (size %d)\n", num_keys);
             for (uint32_t i = 0; i < num_keys; i++) {
                 indent(indentation_level + 1);
-                printf("- %d\n", *leaf_node_key(node, i));
+                format_key(table->layout.key_type, leaf_node_key(table, node, i), key_text, sizeof(key_text));
+                printf(leaf_node_is_tombstone(table, node, i) ? "- %s (deleted)\n" : "- %s\n", key_text);
             }
             break;
         case (NODE_INTERNAL):
@@ -74,16 +435,17 @@ void print_tree(DbPager* db_pager, uint32_t page_idx, uint32_t indentation_level
             printf("- internal (size %d)\n", num_keys);
 
             for (uint32_t i = 0; i < num_keys; i++) {
-                child_page_idx = *internal_node_child(node, i);
-                print_tree(db_pager, child_page_idx, indentation_level + 1);
+                child_page_idx = *internal_node_child(table, node, i);
+                print_tree(table, child_page_idx, indentation_level + 1);
 
                 indent(indentation_level + 1);
-                printf("- key %d\n", *internal_node_key(node, i));
+                format_key(table->layout.key_type, internal_node_key(table, node, i), key_text, sizeof(key_text));
+                printf("- key %s\n", key_text);
             }
             
             child_page_idx = *internal_node_right_child(node);
             if (child_page_idx != INVALID_PAGE_IDX)
-                print_tree(db_pager, child_page_idx, indentation_level + 1);
+                print_tree(table, child_page_idx, indentation_level + 1);
             break;
     }
 }
\ No newline at end of file
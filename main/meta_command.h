@@ -5,12 +5,18 @@
 #include "input.h"
 #include "table.h"
 #include "pager.h"
+#include "key.h"
+#include "lexer.h"
+#include "stats.h"
+#include "dump.h"
+#include "scan.h"
+#include "analyze.h"
 
 MetaCommandResult do_meta_command(InputBuffer* input_buffer, DbTable* table);
 
-void print_constants();
+void print_constants(DbTable* table);
 void print_commands();
 void indent(uint32_t level);
-void print_tree(DbPager* pager, uint32_t page_idx, uint32_t indentation_level);
+void print_tree(DbTable* table, uint32_t page_idx, uint32_t indentation_level);
 
 #endif
\ No newline at end of file
@@ -1,5 +1,22 @@
 #include "node.h"
 
+void initialize_node_layout(NodeLayout* layout, KeyType key_type, uint32_t page_size) {
+    layout->key_type = key_type;
+    layout->key_size = key_type_size(key_type);
+    layout->page_size = page_size;
+
+    layout->leaf_node_space_for_cells = page_size - LEAF_NODE_HEADER_SIZE;
+    layout->leaf_node_cell_size = layout->key_size + LEAF_NODE_FLAGS_SIZE + LEAF_NODE_VALUE_SIZE;
+    layout->leaf_node_max_cells = layout->leaf_node_space_for_cells / layout->leaf_node_cell_size;
+    layout->leaf_node_right_split_count = (layout->leaf_node_max_cells + 1) / 2;
+    layout->leaf_node_left_split_count = (layout->leaf_node_max_cells + 1) - layout->leaf_node_right_split_count;
+    layout->leaf_node_min_cells = layout->leaf_node_left_split_count - 1;
+
+    layout->internal_node_cell_size = INTERNAL_NODE_CHILD_SIZE + layout->key_size;
+    layout->internal_node_max_keys = (page_size - INTERNAL_NODE_HEADER_SIZE) / layout->internal_node_cell_size;
+    layout->internal_node_min_keys = layout->internal_node_max_keys / 2;
+}
+
 NodeType get_node_type(void* node) {
     uint8_t value = *((uint8_t*)((char*)node + NODE_TYPE_OFFSET));
     return (NodeType)value;
@@ -24,12 +41,12 @@ uint32_t* node_parent(void* node) {
     return (uint32_t*)((uint8_t*)node + PARENT_POINTER_OFFSET);
 }
 
-uint32_t get_node_max_key(DbPager* db_pager, void* node) {
+uint8_t* get_node_max_key(DbTable* table, void* node) {
     if (get_node_type(node) == NODE_LEAF)
-        return *leaf_node_key(node, *leaf_node_num_cells(node) - 1);
-    void* right_child = get_page(db_pager, *internal_node_right_child(node));
+        return leaf_node_key(table, node, *leaf_node_num_cells(node) - 1);
+    void* right_child = get_page(table->db_pager, *internal_node_right_child(node));
 
-    return get_node_max_key(db_pager, right_child);
+    return get_node_max_key(table, right_child);
 }
 
 uint32_t* leaf_node_num_cells(void* node) {
@@ -40,16 +57,35 @@ uint32_t* leaf_node_next_leaf(void* node) {
     return (uint32_t*)((uint8_t*)node + LEAF_NODE_NEXT_LEAF_OFFSET);
 }
 
-void* leaf_node_cell(void* node, uint32_t cell_idx) {
-    return (uint8_t*)node + LEAF_NODE_HEADER_SIZE + cell_idx * LEAF_NODE_CELL_SIZE;
+uint32_t* leaf_node_num_tombstones(void* node) {
+    return (uint32_t*)((uint8_t*)node + LEAF_NODE_NUM_TOMBSTONES_OFFSET);
+}
+
+void* leaf_node_cell(DbTable* table, void* node, uint32_t cell_idx) {
+    return (uint8_t*)node + LEAF_NODE_HEADER_SIZE + cell_idx * table->layout.leaf_node_cell_size;
+}
+
+uint8_t* leaf_node_key(DbTable* table, void* node, uint32_t cell_idx) {
+    return (uint8_t*)leaf_node_cell(table, node, cell_idx) + LEAF_NODE_KEY_OFFSET;
 }
 
-uint32_t* leaf_node_key(void* node, uint32_t cell_idx) {
-    return (uint32_t*)leaf_node_cell(node, cell_idx);
+uint8_t* leaf_node_flags(DbTable* table, void* node, uint32_t cell_idx) {
+    return (uint8_t*)leaf_node_cell(table, node, cell_idx) + table->layout.key_size;
 }
 
-void* leaf_node_value(void* node, uint32_t cell_idx) {
-    return (uint8_t*)leaf_node_cell(node, cell_idx) + LEAF_NODE_KEY_SIZE;
+void* leaf_node_value(DbTable* table, void* node, uint32_t cell_idx) {
+    return (uint8_t*)leaf_node_cell(table, node, cell_idx) + table->layout.key_size + LEAF_NODE_FLAGS_SIZE;
+}
+
+bool leaf_node_is_tombstone(DbTable* table, void* node, uint32_t cell_idx) {
+    return *leaf_node_flags(table, node, cell_idx) & LEAF_CELL_TOMBSTONE;
+}
+
+// True if cell_idx holds a live row with exactly this key.
+bool leaf_node_has_key(DbTable* table, void* node, uint32_t cell_idx, const uint8_t* key) {
+    return cell_idx < *leaf_node_num_cells(node) &&
+           compare_keys(leaf_node_key(table, node, cell_idx), key, table->layout.key_size) == 0 &&
+           !leaf_node_is_tombstone(table, node, cell_idx);
 }
 
 void initialize_leaf_node(void* node) {
@@ -57,30 +93,60 @@ void initialize_leaf_node(void* node) {
     set_node_root(node, false);
     *leaf_node_num_cells(node) = 0;
     *leaf_node_next_leaf(node) = 0;
+    *leaf_node_num_tombstones(node) = 0;
     *node_parent(node) = 0;
 }
 
-void leaf_node_insert(TableCursor* cursor, uint32_t key, UserRow* value) {
-    void* node = get_page(cursor->table->db_pager, cursor->page_idx);
+void leaf_node_insert(TableCursor* cursor, const uint8_t* key, UserRow* value) {
+    DbTable* table = cursor->table;
+    void* node = get_page_for_write(table->db_pager, cursor->page_idx);
     uint32_t num_cells = *leaf_node_num_cells(node);
-    if (num_cells >= LEAF_NODE_MAX_CELLS) {
+
+    // A row with the same key is overwritten; a deleted one is brought back.
+    if (cursor->cell_idx < num_cells &&
+        compare_keys(leaf_node_key(table, node, cursor->cell_idx), key, table->layout.key_size) == 0) {
+        if (leaf_node_is_tombstone(table, node, cursor->cell_idx)) {
+            *leaf_node_flags(table, node, cursor->cell_idx) = 0;
+            (*leaf_node_num_tombstones(node))--;
+        }
+        serialize_user_row(value, leaf_node_value(table, node, cursor->cell_idx));
+        return;
+    }
+
+    // A full leaf holding deleted rows makes room by compacting instead
+    // of splitting.
+    if (num_cells >= table->layout.leaf_node_max_cells && *leaf_node_num_tombstones(node) > 0) {
+        leaf_node_compact(table, node);
+        TableCursor* repositioned = leaf_node_find(table, cursor->page_idx, key);
+        cursor->cell_idx = repositioned->cell_idx;
+        free(repositioned);
+        num_cells = *leaf_node_num_cells(node);
+    }
+    if (num_cells >= table->layout.leaf_node_max_cells) {
         leaf_node_split_and_insert(cursor, key, value);
         return;
     }
 
     if (cursor->cell_idx < num_cells)
         for (uint32_t i = num_cells; i > cursor->cell_idx; i--)
-            memcpy(leaf_node_cell(node, i), leaf_node_cell(node, i - 1), LEAF_NODE_CELL_SIZE);
+            memcpy(leaf_node_cell(table, node, i), leaf_node_cell(table, node, i - 1), table->layout.leaf_node_cell_size);
 
     *(leaf_node_num_cells(node)) += 1;
-    *(leaf_node_key(node, cursor->cell_idx)) = key;
-    serialize_user_row(value, leaf_node_value(node, cursor->cell_idx));
+    memcpy(leaf_node_key(table, node, cursor->cell_idx), key, table->layout.key_size);
+    *leaf_node_flags(table, node, cursor->cell_idx) = 0;
+    serialize_user_row(value, leaf_node_value(table, node, cursor->cell_idx));
 }
 
-void leaf_node_split_and_insert(TableCursor* cursor, uint32_t key, UserRow* value) {
-    void* old_node = get_page(cursor->table->db_pager, cursor->page_idx);
-    uint32_t new_page_idx = get_unused_page_num(cursor->table->db_pager);
-    void* new_node = get_page(cursor->table->db_pager, new_page_idx);
+void leaf_node_split_and_insert(TableCursor* cursor, const uint8_t* key, UserRow* value) {
+    TRACE_BEGIN(span);
+    DbTable* table = cursor->table;
+    NodeLayout* layout = &table->layout;
+    void* old_node = get_page_for_write(table->db_pager, cursor->page_idx);
+    uint8_t old_max[KEY_MAX_SIZE];
+    memcpy(old_max, get_node_max_key(table, old_node), layout->key_size);
+
+    uint32_t new_page_idx = get_unused_page_num(table->db_pager);
+    void* new_node = get_page_for_write(table->db_pager, new_page_idx);
 
     if (!new_node) {
         fprintf(stderr, "FATAL: new_node is NULL!\n");
@@ -92,51 +158,47 @@ void leaf_node_split_and_insert(TableCursor* cursor, uint32_t key, UserRow* valu
     *leaf_node_next_leaf(new_node) = *leaf_node_next_leaf(old_node);
     *leaf_node_next_leaf(old_node) = new_page_idx;
 
-    UserRow temp_rows[LEAF_NODE_MAX_CELLS + 1];
-    uint32_t temp_keys[LEAF_NODE_MAX_CELLS + 1];
+    uint32_t cell_size = layout->leaf_node_cell_size;
+    uint8_t* temp_cells = malloc((size_t)(layout->leaf_node_max_cells + 1) * cell_size);
 
     uint32_t old_num_cells = *leaf_node_num_cells(old_node);
     for (uint32_t i = 0, j = 0; i < old_num_cells; i++, j++) {
         if (j == cursor->cell_idx)
             j++;
-        deserialize_user_row(leaf_node_value(old_node, i), &temp_rows[j]);
-        temp_keys[j] = *leaf_node_key(old_node, i);
+        memcpy(temp_cells + j * cell_size, leaf_node_cell(table, old_node, i), cell_size);
     }
 
-    temp_rows[cursor->cell_idx] = *value;
-    temp_keys[cursor->cell_idx] = key;
+    uint8_t* inserted_cell = temp_cells + cursor->cell_idx * cell_size;
+    memcpy(inserted_cell + LEAF_NODE_KEY_OFFSET, key, layout->key_size);
+    inserted_cell[layout->key_size] = 0;
+    serialize_user_row(value, inserted_cell + layout->key_size + LEAF_NODE_FLAGS_SIZE);
 
-    *leaf_node_num_cells(old_node) = 0;
-    for (uint32_t i = 0; i < LEAF_NODE_LEFT_SPLIT_COUNT; i++) {
-        *(leaf_node_key(old_node, i)) = temp_keys[i];
-        serialize_user_row(&temp_rows[i], leaf_node_value(old_node, i));
-        (*leaf_node_num_cells(old_node))++;
-    }
+    memcpy(leaf_node_cell(table, old_node, 0), temp_cells, layout->leaf_node_left_split_count * cell_size);
+    *leaf_node_num_cells(old_node) = layout->leaf_node_left_split_count;
 
-    *leaf_node_num_cells(new_node) = 0;
-    for (uint32_t i = 0; i < LEAF_NODE_RIGHT_SPLIT_COUNT; i++) {
-        uint32_t idx = i + LEAF_NODE_LEFT_SPLIT_COUNT;
-        *(leaf_node_key(new_node, i)) = temp_keys[idx];
-        serialize_user_row(&temp_rows[idx], leaf_node_value(new_node, i));
-        (*leaf_node_num_cells(new_node))++;
-    }
+    memcpy(leaf_node_cell(table, new_node, 0), temp_cells + layout->leaf_node_left_split_count * cell_size,
+           layout->leaf_node_right_split_count * cell_size);
+    *leaf_node_num_cells(new_node) = layout->leaf_node_right_split_count;
+    free(temp_cells);
 
     if (is_node_root(old_node))
-        create_new_root(cursor->table, new_page_idx);
+        create_new_root(table, new_page_idx);
     else {
-        void* parent = get_page(cursor->table->db_pager, *node_parent(old_node));
-        uint32_t old_max = get_node_max_key(cursor->table->db_pager, old_node);
-        uint32_t new_max = get_node_max_key(cursor->table->db_pager, new_node);
-        update_internal_node_key(parent, old_max, new_max);
-        internal_node_insert(cursor->table, *node_parent(old_node), new_page_idx);
+        uint32_t parent_page_idx = *node_parent(old_node);
+        void* parent = get_page_for_write(table->db_pager, parent_page_idx);
+        update_internal_node_key(table, parent, old_max, get_node_max_key(table, old_node));
+        internal_node_insert(table, parent_page_idx, new_page_idx);
     }
+    TRACE_END(span, "leaf_split", "btree", cursor->page_idx);
 }
 
-TableCursor* leaf_node_find(DbTable* table, uint32_t page_idx, uint32_t key) {
+// Positions a caller-owned cursor at key, or at the cell it would be
+// inserted at.
+void leaf_node_seek(DbTable* table, uint32_t page_idx, const uint8_t* key, TableCursor* cursor) {
     void* node = get_page(table->db_pager, page_idx);
     uint32_t num_cells = *leaf_node_num_cells(node);
+    uint32_t key_size = table->layout.key_size;
 
-    TableCursor* cursor = malloc(sizeof(TableCursor));
     cursor->table = table;
     cursor->page_idx = page_idx;
     cursor->end_of_table = false;
@@ -145,18 +207,23 @@ TableCursor* leaf_node_find(DbTable* table, uint32_t page_idx, uint32_t key) {
     uint32_t one_past_max_index = num_cells;
     while (one_past_max_index != min_index) {
         uint32_t index = (min_index + one_past_max_index) / 2;
-        uint32_t key_at_index = *leaf_node_key(node, index);
-        if (key == key_at_index) {
+        int cmp = compare_keys(key, leaf_node_key(table, node, index), key_size);
+        if (cmp == 0) {
             cursor->cell_idx = index;
-            return cursor;
+            return;
         }
-        if (key < key_at_index)
+        if (cmp < 0)
             one_past_max_index = index;
         else
             min_index = index + 1;
     }
 
     cursor->cell_idx = min_index;
+}
+
+TableCursor* leaf_node_find(DbTable* table, uint32_t page_idx, const uint8_t* key) {
+    TableCursor* cursor = malloc(sizeof(TableCursor));
+    leaf_node_seek(table, page_idx, key, cursor);
     return cursor;
 }
 
@@ -168,11 +235,11 @@ uint32_t* internal_node_right_child(void* node) {
     return (uint32_t*)((uint8_t*)node + INTERNAL_NODE_RIGHT_CHILD_OFFSET);
 }
 
-uint32_t* internal_node_cell(void* node, uint32_t cell_idx) {
-    return (uint32_t*)((uint8_t*)node + INTERNAL_NODE_HEADER_SIZE + cell_idx * INTERNAL_NODE_CELL_SIZE);
+uint32_t* internal_node_cell(DbTable* table, void* node, uint32_t cell_idx) {
+    return (uint32_t*)((uint8_t*)node + INTERNAL_NODE_HEADER_SIZE + cell_idx * table->layout.internal_node_cell_size);
 }
 
-uint32_t* internal_node_child(void* node, uint32_t child_num) {
+uint32_t* internal_node_child(DbTable* table, void* node, uint32_t child_num) {
     uint32_t num_keys = *internal_node_num_keys(node);
     if (child_num > num_keys) {
         printf(ANSI_COLOR_RED "Tried to access child_num %d > num_keys %d\n" ANSI_COLOR_RESET, child_num, num_keys);
@@ -187,7 +254,7 @@ uint32_t* internal_node_child(void* node, uint32_t child_num) {
         return right_child;
     }
     else {
-        uint32_t* child = internal_node_cell(node, child_num);
+        uint32_t* child = internal_node_cell(table, node, child_num);
         if (*child == INVALID_PAGE_IDX) {
             printf(ANSI_COLOR_RED "Tried to access child %d of node, but was invalid page\n" ANSI_COLOR_RESET, child_num);
             exit(EXIT_FAILURE);
@@ -196,8 +263,8 @@ uint32_t* internal_node_child(void* node, uint32_t child_num) {
     }
 }
 
-uint32_t* internal_node_key(void* node, uint32_t key_num) {
-    return (uint32_t*)((uint8_t*)internal_node_cell(node, key_num) + INTERNAL_NODE_CHILD_SIZE);
+uint8_t* internal_node_key(DbTable* table, void* node, uint32_t key_num) {
+    return (uint8_t*)internal_node_cell(table, node, key_num) + INTERNAL_NODE_CHILD_SIZE;
 }
 
 void initialize_internal_node(void* node) {
@@ -208,15 +275,15 @@ void initialize_internal_node(void* node) {
     *node_parent(node) = 0;
 }
 
-uint32_t internal_node_find_child(void* node, uint32_t key) {
+uint32_t internal_node_find_child(DbTable* table, void* node, const uint8_t* key) {
     uint32_t num_keys = *internal_node_num_keys(node);
+    uint32_t key_size = table->layout.key_size;
 
     uint32_t min_index = 0;
     uint32_t max_index = num_keys;
     while (min_index != max_index) {
         uint32_t index = (min_index + max_index) / 2;
-        uint32_t key_to_right = *internal_node_key(node, index);
-        if (key_to_right >= key)
+        if (compare_keys(internal_node_key(table, node, index), key, key_size) >= 0)
             max_index = index;
         else
             min_index = index + 1;
@@ -225,18 +292,21 @@ uint32_t internal_node_find_child(void* node, uint32_t key) {
     return min_index;
 }
 
-void update_internal_node_key(void* node, uint32_t old_key, uint32_t new_key) {
-    uint32_t old_child_index = internal_node_find_child(node, old_key);
-    *internal_node_key(node, old_child_index) = new_key;
+void update_internal_node_key(DbTable* table, void* node, const uint8_t* old_key, const uint8_t* new_key) {
+    uint32_t old_child_index = internal_node_find_child(table, node, old_key);
+    if (old_child_index < *internal_node_num_keys(node))
+        memmove(internal_node_key(table, node, old_child_index), new_key, table->layout.key_size);
 }
 
 void internal_node_insert(DbTable* table, uint32_t parent_page_idx, uint32_t child_page_idx) {
-    void* parent = get_page(table->db_pager, parent_page_idx);
+    NodeLayout* layout = &table->layout;
+    void* parent = get_page_for_write(table->db_pager, parent_page_idx);
     void* child = get_page(table->db_pager, child_page_idx);
-    uint32_t child_max_key = get_node_max_key(table->db_pager, child);
-    uint32_t index = internal_node_find_child(parent, child_max_key);
+    uint8_t child_max_key[KEY_MAX_SIZE];
+    memcpy(child_max_key, get_node_max_key(table, child), layout->key_size);
+    uint32_t index = internal_node_find_child(table, parent, child_max_key);
     uint32_t original_num_keys = *internal_node_num_keys(parent);
-    if (original_num_keys >= INTERNAL_NODE_MAX_KEYS) {
+    if (original_num_keys >= layout->internal_node_max_keys) {
         internal_node_split_and_insert(table, parent_page_idx, child_page_idx);
         return;
     }
@@ -248,30 +318,34 @@ void internal_node_insert(DbTable* table, uint32_t parent_page_idx, uint32_t chi
     }
 
     void* right_child = get_page(table->db_pager, right_child_page_idx);
+    uint8_t* right_child_max_key = get_node_max_key(table, right_child);
     *internal_node_num_keys(parent) = original_num_keys + 1;
-    if (child_max_key > get_node_max_key(table->db_pager, right_child)) {
-        *internal_node_child(parent, original_num_keys) = right_child_page_idx;
-        *internal_node_key(parent, original_num_keys) =
-            get_node_max_key(table->db_pager, right_child);
+    if (compare_keys(child_max_key, right_child_max_key, layout->key_size) > 0) {
+        *internal_node_child(table, parent, original_num_keys) = right_child_page_idx;
+        memcpy(internal_node_key(table, parent, original_num_keys), right_child_max_key, layout->key_size);
         *internal_node_right_child(parent) = child_page_idx;
     }
     else {
         for (uint32_t i = original_num_keys; i > index; i--) {
-            void* destination = internal_node_cell(parent, i);
-            void* source = internal_node_cell(parent, i - 1);
-            memcpy(destination, source, INTERNAL_NODE_CELL_SIZE);
+            void* destination = internal_node_cell(table, parent, i);
+            void* source = internal_node_cell(table, parent, i - 1);
+            memcpy(destination, source, layout->internal_node_cell_size);
         }
-        *internal_node_child(parent, index) = child_page_idx;
-        *internal_node_key(parent, index) = child_max_key;
+        *internal_node_child(table, parent, index) = child_page_idx;
+        memcpy(internal_node_key(table, parent, index), child_max_key, layout->key_size);
     }
 }
 
 void internal_node_split_and_insert(DbTable* table, uint32_t parent_page_idx, uint32_t child_page_idx) {
+    TRACE_BEGIN(span);
+    NodeLayout* layout = &table->layout;
     uint32_t old_page_idx = parent_page_idx;
-    void* old_node = get_page(table->db_pager, parent_page_idx);
-    uint32_t old_max_key = get_node_max_key(table->db_pager, old_node);
-    void* child = get_page(table->db_pager, child_page_idx); 
-    uint32_t child_max_key = get_node_max_key(table->db_pager, child);
+    void* old_node = get_page_for_write(table->db_pager, parent_page_idx);
+    uint8_t old_max_key[KEY_MAX_SIZE];
+    memcpy(old_max_key, get_node_max_key(table, old_node), layout->key_size);
+    void* child = get_page_for_write(table->db_pager, child_page_idx);
+    uint8_t child_max_key[KEY_MAX_SIZE];
+    memcpy(child_max_key, get_node_max_key(table, child), layout->key_size);
     uint32_t new_page_idx = get_unused_page_num(table->db_pager);
     uint32_t splitting_root = is_node_root(old_node);
 
@@ -279,49 +353,51 @@ void internal_node_split_and_insert(DbTable* table, uint32_t parent_page_idx, ui
     void* new_node;
     if (splitting_root) {
         create_new_root(table, new_page_idx);
-        parent = get_page(table->db_pager, table->root_page_idx);
-        old_page_idx = *internal_node_child(parent, 0);
-        old_node = get_page(table->db_pager, old_page_idx);
+        parent = get_page_for_write(table->db_pager, table->root_page_idx);
+        old_page_idx = *internal_node_child(table, parent, 0);
+        old_node = get_page_for_write(table->db_pager, old_page_idx);
     }
     else {
-        parent = get_page(table->db_pager, *node_parent(old_node));
-        new_node = get_page(table->db_pager, new_page_idx);
+        parent = get_page_for_write(table->db_pager, *node_parent(old_node));
+        new_node = get_page_for_write(table->db_pager, new_page_idx);
         initialize_internal_node(new_node);
     }
-    
+
     uint32_t* old_num_keys = internal_node_num_keys(old_node);
     uint32_t cur_page_num = *internal_node_right_child(old_node);
-    void* cur = get_page(table->db_pager, cur_page_num);
+    void* cur = get_page_for_write(table->db_pager, cur_page_num);
 
     internal_node_insert(table, new_page_idx, cur_page_num);
     *node_parent(cur) = new_page_idx;
     *internal_node_right_child(old_node) = INVALID_PAGE_IDX;
-    for (uint32_t i = INTERNAL_NODE_MAX_KEYS - 1; i > INTERNAL_NODE_MAX_KEYS / 2; i--) {
-        cur_page_num = *internal_node_child(old_node, i);
-        cur = get_page(table->db_pager, cur_page_num);
+    for (uint32_t i = layout->internal_node_max_keys - 1; i > layout->internal_node_max_keys / 2; i--) {
+        cur_page_num = *internal_node_child(table, old_node, i);
+        cur = get_page_for_write(table->db_pager, cur_page_num);
         internal_node_insert(table, new_page_idx, cur_page_num);
         *node_parent(cur) = new_page_idx;
         (*old_num_keys)--;
     }
 
-    *internal_node_right_child(old_node) = *internal_node_child(old_node, (*old_num_keys)--);
-    uint32_t max_after_split = get_node_max_key(table->db_pager, old_node);
-    uint32_t destination_page_num = child_max_key < max_after_split ? old_page_idx : new_page_idx;
+    *internal_node_right_child(old_node) = *internal_node_child(table, old_node, *old_num_keys - 1);
+    (*old_num_keys)--;
+    uint32_t destination_page_num =
+        compare_keys(child_max_key, get_node_max_key(table, old_node), layout->key_size) < 0 ? old_page_idx : new_page_idx;
 
     internal_node_insert(table, destination_page_num, child_page_idx);
     *node_parent(child) = destination_page_num;
-    update_internal_node_key(parent, old_max_key, get_node_max_key(table->db_pager, old_node));
+    update_internal_node_key(table, parent, old_max_key, get_node_max_key(table, old_node));
     if (!splitting_root) {
         internal_node_insert(table, *node_parent(old_node), new_page_idx);
         *node_parent(new_node) = *node_parent(old_node);
     }
+    TRACE_END(span, "internal_split", "btree", parent_page_idx);
 }
 
-TableCursor* internal_node_find(DbTable* table, uint32_t page_idx, uint32_t key) {
+TableCursor* internal_node_find(DbTable* table, uint32_t page_idx, const uint8_t* key) {
     void* node = get_page(table->db_pager, page_idx);
 
-    uint32_t child_index = internal_node_find_child(node, key);
-    uint32_t child_num = *internal_node_child(node, child_index);
+    uint32_t child_index = internal_node_find_child(table, node, key);
+    uint32_t child_num = *internal_node_child(table, node, child_index);
     void* child = get_page(table->db_pager, child_num);
     switch (get_node_type(child)) {
         case NODE_LEAF:
@@ -334,49 +410,71 @@ TableCursor* internal_node_find(DbTable* table, uint32_t page_idx, uint32_t key)
 }
 
 void create_new_root(DbTable* table, uint32_t right_child_page_idx) {
-    void* root = get_page(table->db_pager, table->root_page_idx);
-    void* right_child = get_page(table->db_pager, right_child_page_idx);
+    void* root = get_page_for_write(table->db_pager, table->root_page_idx);
+    void* right_child = get_page_for_write(table->db_pager, right_child_page_idx);
     uint32_t left_child_page_idx = get_unused_page_num(table->db_pager);
-    void* left_child = get_page(table->db_pager, left_child_page_idx);
+    void* left_child = get_page_for_write(table->db_pager, left_child_page_idx);
     if (get_node_type(root) == NODE_INTERNAL) {
         initialize_internal_node(right_child);
         initialize_internal_node(left_child);
     }
 
-    memcpy(left_child, root, PAGE_SIZE_BYTES);
+    memcpy(left_child, root, table->layout.page_size);
     set_node_root(left_child, false);
     if (get_node_type(left_child) == NODE_INTERNAL) {
         void* child;
         for (uint32_t i = 0; i < *internal_node_num_keys(left_child); i++) {
-            child = get_page(table->db_pager, *internal_node_child(left_child, i));
+            child = get_page_for_write(table->db_pager, *internal_node_child(table, left_child, i));
             *node_parent(child) = left_child_page_idx;
         }
-        child = get_page(table->db_pager, *internal_node_right_child(left_child));
+        child = get_page_for_write(table->db_pager, *internal_node_right_child(left_child));
         *node_parent(child) = left_child_page_idx;
     }
 
     initialize_internal_node(root);
     set_node_root(root, true);
     *internal_node_num_keys(root) = 1;
-    *internal_node_child(root, 0) = left_child_page_idx;
-    uint32_t left_child_max_key = get_node_max_key(table->db_pager, left_child);
-    *internal_node_key(root, 0) = left_child_max_key;
+    *internal_node_child(table, root, 0) = left_child_page_idx;
+    memcpy(internal_node_key(table, root, 0), get_node_max_key(table, left_child), table->layout.key_size);
     *internal_node_right_child(root) = right_child_page_idx;
     *node_parent(left_child) = table->root_page_idx;
     *node_parent(right_child) = table->root_page_idx;
 }
 
-void leaf_node_remove_cell(void* node, uint32_t cell_idx) {
+// Squeezes the tombstoned cells out of a leaf in one pass.
+void leaf_node_compact(DbTable* table, void* node) {
     uint32_t num_cells = *leaf_node_num_cells(node);
-    for (uint32_t i = cell_idx; i < num_cells - 1; i++)
-        memcpy(leaf_node_cell(node, i), leaf_node_cell(node, i + 1), LEAF_NODE_CELL_SIZE);
-    (*leaf_node_num_cells(node))--;
+    uint32_t num_live = 0;
+    for (uint32_t i = 0; i < num_cells; i++) {
+        if (leaf_node_is_tombstone(table, node, i))
+            continue;
+        if (num_live != i)
+            memcpy(leaf_node_cell(table, node, num_live), leaf_node_cell(table, node, i), table->layout.leaf_node_cell_size);
+        num_live++;
+    }
+
+    *leaf_node_num_cells(node) = num_live;
+    *leaf_node_num_tombstones(node) = 0;
+}
+
+// Deletes by setting the cell's tombstone bit. Cells are only shifted,
+// and the tree only rebalanced, once LEAF_GARBAGE_PERCENT of the leaf
+// is dead, so most deletes cost no more than the lookup.
+void leaf_node_delete(DbTable* table, uint32_t page_idx, uint32_t cell_idx) {
+    void* node = get_page_for_write(table->db_pager, page_idx);
+    *leaf_node_flags(table, node, cell_idx) |= LEAF_CELL_TOMBSTONE;
+    uint32_t num_tombstones = ++(*leaf_node_num_tombstones(node));
+
+    if ((uint64_t)num_tombstones * 100 >= (uint64_t)*leaf_node_num_cells(node) * LEAF_GARBAGE_PERCENT) {
+        leaf_node_compact(table, node);
+        adjust_tree_after_delete(table, page_idx);
+    }
 }
 
-uint32_t get_node_child_index(void* parent_node, uint32_t child_page_idx) {
+uint32_t get_node_child_index(DbTable* table, void* parent_node, uint32_t child_page_idx) {
     uint32_t num_keys = *internal_node_num_keys(parent_node);
     for (uint32_t i = 0; i < num_keys; i++)
-        if (*internal_node_child(parent_node, i) == child_page_idx)
+        if (*internal_node_child(table, parent_node, i) == child_page_idx)
             return i;
 
     if (*internal_node_right_child(parent_node) == child_page_idx)
@@ -386,17 +484,20 @@ uint32_t get_node_child_index(void* parent_node, uint32_t child_page_idx) {
 }
 
 void merge_nodes(DbTable* table, uint32_t parent_page_idx, uint32_t node_page_idx, uint32_t sibling_page_idx) {
-    void* parent_node = get_page(table->db_pager, parent_page_idx);
-    void* node = get_page(table->db_pager, node_page_idx);
-    void* sibling_node = get_page(table->db_pager, sibling_page_idx);
-    uint32_t sibling_child_index_in_parent = get_node_child_index(parent_node, sibling_page_idx);
+    TRACE_BEGIN(span);
+    NodeLayout* layout = &table->layout;
+    void* parent_node = get_page_for_write(table->db_pager, parent_page_idx);
+    void* node = get_page_for_write(table->db_pager, node_page_idx);
+    void* sibling_node = get_page_for_write(table->db_pager, sibling_page_idx);
+    uint32_t sibling_child_index_in_parent = get_node_child_index(table, parent_node, sibling_page_idx);
 
     if (get_node_type(node) == NODE_LEAF) {
         uint32_t node_num_cells = *leaf_node_num_cells(node);
         uint32_t sibling_num_cells = *leaf_node_num_cells(sibling_node);
 
-        memcpy(leaf_node_cell(node, node_num_cells), leaf_node_cell(sibling_node, 0), sibling_num_cells * LEAF_NODE_CELL_SIZE);
+        memcpy(leaf_node_cell(table, node, node_num_cells), leaf_node_cell(table, sibling_node, 0), sibling_num_cells * layout->leaf_node_cell_size);
         *leaf_node_num_cells(node) += sibling_num_cells;
+        *leaf_node_num_tombstones(node) += *leaf_node_num_tombstones(sibling_node);
 
         *leaf_node_next_leaf(node) = *leaf_node_next_leaf(sibling_node);
     }
@@ -404,104 +505,177 @@ void merge_nodes(DbTable* table, uint32_t parent_page_idx, uint32_t node_page_id
         uint32_t node_num_keys = *internal_node_num_keys(node);
         uint32_t sibling_num_keys = *internal_node_num_keys(sibling_node);
 
-        uint32_t key_from_parent = *internal_node_key(parent_node, sibling_child_index_in_parent - 1);
-        *internal_node_key(node, node_num_keys) = key_from_parent;
-        
-        memcpy(internal_node_cell(node, node_num_keys + 1), internal_node_cell(sibling_node, 0), sibling_num_keys * INTERNAL_NODE_CELL_SIZE);
+        *internal_node_cell(table, node, node_num_keys) = *internal_node_right_child(node);
+        memcpy(internal_node_key(table, node, node_num_keys), get_node_max_key(table, node), layout->key_size);
+
+        memcpy(internal_node_cell(table, node, node_num_keys + 1), internal_node_cell(table, sibling_node, 0), sibling_num_keys * layout->internal_node_cell_size);
         *internal_node_right_child(node) = *internal_node_right_child(sibling_node);
         *internal_node_num_keys(node) += sibling_num_keys + 1;
 
         uint32_t total_keys = *internal_node_num_keys(node);
         for(uint32_t i = node_num_keys + 1; i < total_keys + 1; i++) {
-            uint32_t child_page_idx = *internal_node_child(node, i);
-            void* child = get_page(table->db_pager, child_page_idx);
+            uint32_t child_page_idx = *internal_node_child(table, node, i);
+            void* child = get_page_for_write(table->db_pager, child_page_idx);
             *node_parent(child) = node_page_idx;
         }
     }
 
     uint32_t num_parent_keys = *internal_node_num_keys(parent_node);
     for (uint32_t i = sibling_child_index_in_parent - 1; i < num_parent_keys - 1; i++)
-        memcpy(internal_node_cell(parent_node, i), internal_node_cell(parent_node, i + 1), INTERNAL_NODE_CELL_SIZE);
+        memcpy(internal_node_cell(table, parent_node, i), internal_node_cell(table, parent_node, i + 1), layout->internal_node_cell_size);
 
     if (sibling_child_index_in_parent == num_parent_keys)
-        *internal_node_right_child(parent_node) = *internal_node_child(parent_node, num_parent_keys - 1);
+        *internal_node_right_child(parent_node) = *internal_node_child(table, parent_node, num_parent_keys - 1);
+    else
+        *internal_node_child(table, parent_node, sibling_child_index_in_parent - 1) = node_page_idx;
     *internal_node_num_keys(parent_node) -= 1;
-    
+
     uint32_t parent_of_parent_idx = *node_parent(parent_node);
-    if (parent_of_parent_idx != 0) {
-        void* parent_of_parent = get_page(table->db_pager, parent_of_parent_idx);
-        uint32_t old_max = *internal_node_key(parent_of_parent, get_node_child_index(parent_of_parent, parent_page_idx));
-        uint32_t new_max = get_node_max_key(table->db_pager, parent_node);
-        update_internal_node_key(parent_of_parent, old_max, new_max);
+    if (!is_node_root(parent_node)) {
+        void* parent_of_parent = get_page_for_write(table->db_pager, parent_of_parent_idx);
+        uint32_t parent_index = get_node_child_index(table, parent_of_parent, parent_page_idx);
+        if (parent_index < *internal_node_num_keys(parent_of_parent))
+            memcpy(internal_node_key(table, parent_of_parent, parent_index), get_node_max_key(table, parent_node), layout->key_size);
     }
 
+    pager_free_page(table->db_pager, sibling_page_idx);
     adjust_tree_after_delete(table, parent_page_idx);
+    TRACE_END(span, "merge_nodes", "btree", node_page_idx);
+}
+
+static void move_tombstone_count(DbTable* table, void* node, uint32_t cell_idx, void* sibling_node) {
+    if (leaf_node_is_tombstone(table, node, cell_idx)) {
+        (*leaf_node_num_tombstones(node))++;
+        (*leaf_node_num_tombstones(sibling_node))--;
+    }
 }
 
 void redistribute_cells(DbTable* table, uint32_t parent_page_idx, uint32_t node_page_idx, uint32_t sibling_page_idx) {
-    void* parent_node = get_page(table->db_pager, parent_page_idx);
-    void* node = get_page(table->db_pager, node_page_idx);
-    void* sibling_node = get_page(table->db_pager, sibling_page_idx);
-    uint32_t node_child_index = get_node_child_index(parent_node, node_page_idx);
+    NodeLayout* layout = &table->layout;
+    void* parent_node = get_page_for_write(table->db_pager, parent_page_idx);
+    void* node = get_page_for_write(table->db_pager, node_page_idx);
+    void* sibling_node = get_page_for_write(table->db_pager, sibling_page_idx);
+    uint32_t node_child_index = get_node_child_index(table, parent_node, node_page_idx);
 
-    if (node_child_index < get_node_child_index(parent_node, sibling_page_idx)) {
+    if (node_child_index < get_node_child_index(table, parent_node, sibling_page_idx)) {
         uint32_t num_cells_node = *leaf_node_num_cells(node);
-        memcpy(leaf_node_cell(node, num_cells_node), leaf_node_cell(sibling_node, 0), LEAF_NODE_CELL_SIZE);
+        memcpy(leaf_node_cell(table, node, num_cells_node), leaf_node_cell(table, sibling_node, 0), layout->leaf_node_cell_size);
         (*leaf_node_num_cells(node))++;
+        move_tombstone_count(table, node, num_cells_node, sibling_node);
 
         uint32_t num_cells_sibling = *leaf_node_num_cells(sibling_node);
         for (uint32_t i = 0; i < num_cells_sibling - 1; i++)
-            memcpy(leaf_node_cell(sibling_node, i), leaf_node_cell(sibling_node, i + 1), LEAF_NODE_CELL_SIZE);
+            memcpy(leaf_node_cell(table, sibling_node, i), leaf_node_cell(table, sibling_node, i + 1), layout->leaf_node_cell_size);
         (*leaf_node_num_cells(sibling_node))--;
 
-        *internal_node_key(parent_node, node_child_index) = *leaf_node_key(node, num_cells_node);
+        memcpy(internal_node_key(table, parent_node, node_child_index), leaf_node_key(table, node, num_cells_node), layout->key_size);
     }
     else {
         for (uint32_t i = *leaf_node_num_cells(node); i > 0; i--)
-            memcpy(leaf_node_cell(node, i), leaf_node_cell(node, i - 1), LEAF_NODE_CELL_SIZE);
+            memcpy(leaf_node_cell(table, node, i), leaf_node_cell(table, node, i - 1), layout->leaf_node_cell_size);
 
         uint32_t num_cells_sibling = *leaf_node_num_cells(sibling_node);
-        memcpy(leaf_node_cell(node, 0), leaf_node_cell(sibling_node, num_cells_sibling - 1), LEAF_NODE_CELL_SIZE);
+        memcpy(leaf_node_cell(table, node, 0), leaf_node_cell(table, sibling_node, num_cells_sibling - 1), layout->leaf_node_cell_size);
         (*leaf_node_num_cells(node))++;
+        move_tombstone_count(table, node, 0, sibling_node);
         (*leaf_node_num_cells(sibling_node))--;
 
-        *internal_node_key(parent_node, node_child_index - 1) = *leaf_node_key(sibling_node, *leaf_node_num_cells(sibling_node) - 1);
+        memcpy(internal_node_key(table, parent_node, node_child_index - 1),
+               leaf_node_key(table, sibling_node, *leaf_node_num_cells(sibling_node) - 1), layout->key_size);
     }
 }
 
-void adjust_tree_after_delete(DbTable* table, uint32_t page_idx) {
+// Moves one child between two internal siblings through their parent,
+// like redistribute_cells does for leaves. Separators are upper bounds of
+// the subtree on their left, so the parent's key for the left node moves
+// down with the child it bounded and the moved child's key moves up.
+void redistribute_children(DbTable* table, uint32_t parent_page_idx, uint32_t node_page_idx, uint32_t sibling_page_idx) {
+    NodeLayout* layout = &table->layout;
+    void* parent_node = get_page_for_write(table->db_pager, parent_page_idx);
+    void* node = get_page_for_write(table->db_pager, node_page_idx);
+    void* sibling_node = get_page_for_write(table->db_pager, sibling_page_idx);
+    uint32_t node_child_index = get_node_child_index(table, parent_node, node_page_idx);
+    uint32_t num_keys_node = *internal_node_num_keys(node);
+    uint32_t num_keys_sibling = *internal_node_num_keys(sibling_node);
+    uint32_t moved_page_idx;
+
+    if (node_child_index < get_node_child_index(table, parent_node, sibling_page_idx)) {
+        *internal_node_cell(table, node, num_keys_node) = *internal_node_right_child(node);
+        memcpy(internal_node_key(table, node, num_keys_node), internal_node_key(table, parent_node, node_child_index), layout->key_size);
+        moved_page_idx = *internal_node_child(table, sibling_node, 0);
+        *internal_node_right_child(node) = moved_page_idx;
+        memcpy(internal_node_key(table, parent_node, node_child_index), internal_node_key(table, sibling_node, 0), layout->key_size);
+
+        memmove(internal_node_cell(table, sibling_node, 0), internal_node_cell(table, sibling_node, 1),
+                (size_t)(num_keys_sibling - 1) * layout->internal_node_cell_size);
+    }
+    else {
+        memmove(internal_node_cell(table, node, 1), internal_node_cell(table, node, 0), (size_t)num_keys_node * layout->internal_node_cell_size);
+        moved_page_idx = *internal_node_right_child(sibling_node);
+        *internal_node_cell(table, node, 0) = moved_page_idx;
+        memcpy(internal_node_key(table, node, 0), internal_node_key(table, parent_node, node_child_index - 1), layout->key_size);
+
+        memcpy(internal_node_key(table, parent_node, node_child_index - 1), internal_node_key(table, sibling_node, num_keys_sibling - 1), layout->key_size);
+        *internal_node_right_child(sibling_node) = *internal_node_cell(table, sibling_node, num_keys_sibling - 1);
+    }
+    (*internal_node_num_keys(node))++;
+    (*internal_node_num_keys(sibling_node))--;
+    *node_parent(get_page_for_write(table->db_pager, moved_page_idx)) = node_page_idx;
+}
+
+// Brings a node back to its minimum size, borrowing from a sibling one
+// entry at a time (a range delete can leave it far below) and merging
+// with it once the sibling has none to spare. Returns true if it merged,
+// which frees one of the two pages.
+bool adjust_tree_after_delete(DbTable* table, uint32_t page_idx) {
     void* node = get_page(table->db_pager, page_idx);
-    uint32_t num_cells = (get_node_type(node) == NODE_LEAF) ? *leaf_node_num_cells(node) : *internal_node_num_keys(node);
-    uint32_t min_cells = (get_node_type(node) == NODE_LEAF) ? LEAF_NODE_MIN_CELLS : INTERNAL_NODE_MIN_KEYS;
+    bool is_leaf = (get_node_type(node) == NODE_LEAF);
+    uint32_t num_cells = is_leaf ? *leaf_node_num_cells(node) : *internal_node_num_keys(node);
+    uint32_t min_cells = is_leaf ? table->layout.leaf_node_min_cells : table->layout.internal_node_min_keys;
 
     if (is_node_root(node)) {
         handle_root_shrink(table);
-        return;
+        return false;
     }
     if (num_cells >= min_cells)
-        return;
+        return false;
 
+    // Only underfull nodes are traced; every delete passes through here.
+    TRACE_BEGIN(span);
     uint32_t parent_page_idx = *node_parent(node);
     void* parent_node = get_page(table->db_pager, parent_page_idx);
-    uint32_t child_index = get_node_child_index(parent_node, page_idx);
+    if (*internal_node_num_keys(parent_node) == 0) {
+        TRACE_END(span, "rebalance", "btree", page_idx);
+        return false;
+    }
+    uint32_t child_index = get_node_child_index(table, parent_node, page_idx);
 
     uint32_t sibling_page_idx;
     if (child_index == *internal_node_num_keys(parent_node))
-        sibling_page_idx = *internal_node_child(parent_node, child_index - 1);
+        sibling_page_idx = *internal_node_child(table, parent_node, child_index - 1);
     else
-        sibling_page_idx = *internal_node_child(parent_node, child_index + 1);
+        sibling_page_idx = *internal_node_child(table, parent_node, child_index + 1);
 
     void* sibling_node = get_page(table->db_pager, sibling_page_idx);
-    uint32_t sibling_num_cells = (get_node_type(sibling_node) == NODE_LEAF) ? *leaf_node_num_cells(sibling_node) : *internal_node_num_keys(sibling_node);
-    
-    if (sibling_num_cells > min_cells)
-        redistribute_cells(table, parent_page_idx, page_idx, sibling_page_idx);
-    else {
-        if (child_index > get_node_child_index(parent_node, sibling_page_idx))
-            merge_nodes(table, parent_page_idx, sibling_page_idx, page_idx);
+    uint32_t sibling_num_cells = is_leaf ? *leaf_node_num_cells(sibling_node) : *internal_node_num_keys(sibling_node);
+
+    for (; num_cells < min_cells && sibling_num_cells > min_cells; num_cells++, sibling_num_cells--) {
+        if (is_leaf)
+            redistribute_cells(table, parent_page_idx, page_idx, sibling_page_idx);
         else
-            merge_nodes(table, parent_page_idx, page_idx, sibling_page_idx);
+            redistribute_children(table, parent_page_idx, page_idx, sibling_page_idx);
+    }
+    if (num_cells >= min_cells) {
+        TRACE_END(span, "rebalance", "btree", page_idx);
+        return false;
     }
+
+    if (child_index > get_node_child_index(table, parent_node, sibling_page_idx))
+        merge_nodes(table, parent_page_idx, sibling_page_idx, page_idx);
+    else
+        merge_nodes(table, parent_page_idx, page_idx, sibling_page_idx);
+    TRACE_END(span, "rebalance", "btree", page_idx);
+    return true;
 }
 
 void handle_root_shrink(DbTable* table) {
@@ -509,11 +683,13 @@ void handle_root_shrink(DbTable* table) {
     void* root_node = get_page(table->db_pager, root_page_idx);
 
     if (get_node_type(root_node) == NODE_INTERNAL && *internal_node_num_keys(root_node) == 0) {
-        uint32_t new_root_page_idx = *internal_node_child(root_node, 0);
-        void* new_root_node = get_page(table->db_pager, new_root_page_idx);
+        uint32_t new_root_page_idx = *internal_node_child(table, root_node, 0);
+        void* new_root_node = get_page_for_write(table->db_pager, new_root_page_idx);
 
         table->root_page_idx = new_root_page_idx;
+        table->db_pager->header.root_page_idx = new_root_page_idx;
         set_node_root(new_root_node, true);
         *node_parent(new_root_node) = 0;
+        pager_free_page(table->db_pager, root_page_idx);
     }
-}
\ No newline at end of file
+}
@@ -1,35 +1,405 @@
 #include "pager.h"
 
-DbPager* pager_open(const char* db_filename) {
-    int fd = open(db_filename,
+static off_t page_offset(DbPager* db_pager, uint32_t page_idx) {
+    return (off_t)page_idx * db_pager->page_size;
+}
+
+static size_t bitmap_size(uint32_t num_page_slots) {
+    return ((size_t)num_page_slots + 7) / 8;
+}
+
+static bool bitmap_test(uint8_t* bitmap, uint32_t idx) {
+    return bitmap[idx / 8] & (1u << (idx % 8));
+}
+
+static void bitmap_set(uint8_t* bitmap, uint32_t idx) {
+    bitmap[idx / 8] |= (uint8_t)(1u << (idx % 8));
+}
+
+static void bitmap_clear(uint8_t* bitmap, uint32_t idx) {
+    bitmap[idx / 8] &= (uint8_t)~(1u << (idx % 8));
+}
+
+static bool page_is_dirty(DbPager* db_pager, uint32_t page_idx) {
+    return bitmap_test(db_pager->dirty_bitmap, page_idx);
+}
+
+static void clear_page_dirty(DbPager* db_pager, uint32_t page_idx) {
+    if (page_is_dirty(db_pager, page_idx)) {
+        bitmap_clear(db_pager->dirty_bitmap, page_idx);
+        db_pager->num_dirty_pages--;
+    }
+}
+
+// True when at least a batch of pages is dirty and the dirty pages make
+// up more than `percent` of the cache.
+static bool pager_over_dirty_share(DbPager* db_pager, uint32_t percent) {
+    return db_pager->num_dirty_pages >= FLUSHER_BATCH_PAGES &&
+           (uint64_t)db_pager->num_dirty_pages * 100 > (uint64_t)db_pager->num_cached_pages * percent;
+}
+
+static uint32_t pager_dirty_target(DbPager* db_pager) {
+    return (uint32_t)((uint64_t)db_pager->num_cached_pages * db_pager->dirty_ratio_percent / 200);
+}
+
+bool pager_header_changed(DbPager* db_pager) {
+    char header_bytes[HEADER_SIZE];
+    serialize_db_header(&db_pager->header, header_bytes);
+    return memcmp(get_page(db_pager, DB_HEADER_PAGE_IDX), header_bytes, HEADER_SIZE) != 0;
+}
+
+// Re-serializes the header into page 0 and marks it dirty if it changed.
+static void pager_sync_header(DbPager* db_pager) {
+    if (pager_header_changed(db_pager)) {
+        serialize_db_header(&db_pager->header, get_page(db_pager, DB_HEADER_PAGE_IDX));
+        pager_mark_dirty(db_pager, DB_HEADER_PAGE_IDX);
+    }
+}
+
+// Writes up to FLUSHER_BATCH_PAGES dirty pages, in page order, starting
+// at *next_page_idx. Returns the number of pages written.
+static uint32_t pager_flush_dirty_batch(DbPager* db_pager, uint32_t* next_page_idx) {
+    uint32_t written = 0;
+    uint32_t page_idx = *next_page_idx;
+    for (; page_idx < db_pager->num_page_slots && written < FLUSHER_BATCH_PAGES; page_idx++) {
+        if (db_pager->dirty_bitmap[page_idx / 8] == 0) {
+            page_idx |= 7;
+            continue;
+        }
+        if (!page_is_dirty(db_pager, page_idx))
+            continue;
+
+        pager_flush(db_pager, page_idx);
+        clear_page_dirty(db_pager, page_idx);
+        written++;
+    }
+
+    *next_page_idx = page_idx;
+    return written;
+}
+
+void pager_flush_dirty(DbPager* db_pager, uint32_t target) {
+    uint32_t next_page_idx = 0;
+    pager_sync_header(db_pager);
+    while (db_pager->num_dirty_pages > target && pager_flush_dirty_batch(db_pager, &next_page_idx) > 0)
+        ;
+}
+
+// Sleeps until the dirty share passes the background ratio or the flush
+// interval elapses, then trickles dirty pages out in page order. The
+// latch is dropped between batches so the REPL is never blocked for
+// more than one batch.
+static void* pager_flusher_main(void* argument) {
+    DbPager* db_pager = argument;
+    pthread_mutex_lock(&db_pager->latch);
+
+    while (!db_pager->flusher_stop) {
+        if (!pager_over_dirty_share(db_pager, db_pager->dirty_ratio_percent)) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += db_pager->flush_interval_ms / 1000;
+            deadline.tv_nsec += (long)(db_pager->flush_interval_ms % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&db_pager->flusher_wakeup, &db_pager->latch, &deadline);
+            if (db_pager->flusher_stop)
+                break;
+        }
+
+        uint32_t target = pager_over_dirty_share(db_pager, db_pager->dirty_ratio_percent) ? pager_dirty_target(db_pager) : 0;
+        uint32_t next_page_idx = 0;
+        bool wrote = false;
+        pager_sync_header(db_pager);
+        while (!db_pager->flusher_stop && db_pager->num_dirty_pages > target) {
+            if (pager_flush_dirty_batch(db_pager, &next_page_idx) == 0)
+                break;
+            wrote = true;
+            pthread_mutex_unlock(&db_pager->latch);
+            pthread_mutex_lock(&db_pager->latch);
+        }
+
+        if (wrote) {
+            pthread_mutex_unlock(&db_pager->latch);
+            fdatasync(db_pager->file_descriptor);
+            pthread_mutex_lock(&db_pager->latch);
+        }
+    }
+
+    pthread_mutex_unlock(&db_pager->latch);
+    return NULL;
+}
+
+// Maps the frame arena. With huge_pages the arena is aligned to a huge
+// page and the kernel is asked to back it with transparent huge pages.
+static void pager_init_arena(DbPager* db_pager, DbOptions* options) {
+    uint64_t capacity = ((uint64_t)options->cache_size_mb << 20) / db_pager->page_size;
+    if (capacity < MIN_CACHE_PAGES)
+        capacity = MIN_CACHE_PAGES;
+    if (capacity > UINT32_MAX / 2)
+        capacity = UINT32_MAX / 2;
+    db_pager->cache_capacity = (uint32_t)capacity;
+
+    size_t frames_length = (size_t)capacity * db_pager->page_size;
+    size_t alignment = options->huge_pages ? HUGE_PAGE_SIZE : DIRECT_IO_ALIGNMENT;
+    db_pager->arena_length = frames_length + (options->huge_pages ? HUGE_PAGE_SIZE : 0);
+    db_pager->arena = mmap(NULL, db_pager->arena_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (db_pager->arena == MAP_FAILED) {
+        printf(ANSI_COLOR_RED "Unable to allocate a %zu byte page cache\n" ANSI_COLOR_RESET, frames_length);
+        exit(EXIT_FAILURE);
+    }
+
+    uintptr_t start = ((uintptr_t)db_pager->arena + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    db_pager->frames = (char*)start;
+    if (options->huge_pages && madvise(db_pager->frames, frames_length, MADV_HUGEPAGE) != 0)
+        printf(ANSI_COLOR_YELLOW "Transparent huge pages are not available: %s\n" ANSI_COLOR_RESET, strerror(errno));
+
+    // Hand out low frames first so a small database touches little memory.
+    db_pager->free_frames = malloc((size_t)capacity * sizeof(uint32_t));
+    db_pager->num_free_frames = db_pager->cache_capacity;
+    for (uint32_t i = 0; i < db_pager->cache_capacity; i++)
+        db_pager->free_frames[i] = db_pager->cache_capacity - 1 - i;
+}
+
+static bool frame_in_arena(DbPager* db_pager, void* frame) {
+    return (char*)frame >= db_pager->frames &&
+           (char*)frame < db_pager->frames + (size_t)db_pager->cache_capacity * db_pager->page_size;
+}
+
+static void* pager_alloc_frame(DbPager* db_pager) {
+    void* frame;
+    if (db_pager->num_free_frames > 0)
+        frame = db_pager->frames + (size_t)db_pager->free_frames[--db_pager->num_free_frames] * db_pager->page_size;
+    else {
+        frame = aligned_alloc(DIRECT_IO_ALIGNMENT, db_pager->page_size);
+        if (!frame) {
+            printf(ANSI_COLOR_RED "Out of memory allocating a page frame\n" ANSI_COLOR_RESET);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    memset(frame, 0, db_pager->page_size);
+    return frame;
+}
+
+static void pager_free_frame(DbPager* db_pager, void* frame) {
+    if (frame_in_arena(db_pager, frame))
+        db_pager->free_frames[db_pager->num_free_frames++] = (uint32_t)(((char*)frame - db_pager->frames) / db_pager->page_size);
+    else
+        free(frame);
+}
+
+bool is_valid_page_size(uint32_t page_size) {
+    return page_size >= MIN_PAGE_SIZE && page_size <= MAX_PAGE_SIZE && (page_size & (page_size - 1)) == 0;
+}
+
+void serialize_db_header(DbHeader* source, void* destination) {
+    memset(destination, 0, HEADER_SIZE);
+    memcpy((char*)destination + HEADER_MAGIC_OFFSET, DB_HEADER_MAGIC, HEADER_MAGIC_SIZE);
+    memcpy((char*)destination + HEADER_FORMAT_VERSION_OFFSET, &(source->format_version), HEADER_FORMAT_VERSION_SIZE);
+    memcpy((char*)destination + HEADER_PAGE_NUMBER_WIDTH_OFFSET, &(source->page_number_width), HEADER_PAGE_NUMBER_WIDTH_SIZE);
+    memcpy((char*)destination + HEADER_ROOT_PAGE_OFFSET, &(source->root_page_idx), HEADER_ROOT_PAGE_SIZE);
+    memcpy((char*)destination + HEADER_KEY_TYPE_OFFSET, &(source->key_type), HEADER_KEY_TYPE_SIZE);
+    memcpy((char*)destination + HEADER_PAGE_SIZE_OFFSET, &(source->page_size), HEADER_PAGE_SIZE_SIZE);
+    memcpy((char*)destination + HEADER_REPLICA_OFFSET_OFFSET, &(source->replica_log_offset), HEADER_REPLICA_OFFSET_SIZE);
+    memcpy((char*)destination + HEADER_FREE_LIST_HEAD_OFFSET, &(source->free_list_head), HEADER_FREE_LIST_HEAD_SIZE);
+    memcpy((char*)destination + HEADER_NUM_FREE_PAGES_OFFSET, &(source->num_free_pages), HEADER_NUM_FREE_PAGES_SIZE);
+    memcpy((char*)destination + HEADER_ENGINE_OFFSET, &(source->engine), HEADER_ENGINE_SIZE);
+    memcpy((char*)destination + HEADER_CATALOG_PAGE_OFFSET, &(source->catalog_page_idx), HEADER_CATALOG_PAGE_SIZE);
+    memcpy((char*)destination + HEADER_NUM_PARTITIONS_OFFSET, &(source->num_partitions), HEADER_NUM_PARTITIONS_SIZE);
+    memcpy((char*)destination + HEADER_PARTITION_WIDTH_OFFSET, &(source->partition_width), HEADER_PARTITION_WIDTH_SIZE);
+}
+
+bool deserialize_db_header(void* source, DbHeader* destination) {
+    if (memcmp((char*)source + HEADER_MAGIC_OFFSET, DB_HEADER_MAGIC, HEADER_MAGIC_SIZE) != 0)
+        return false;
+
+    memcpy(&(destination->format_version), (char*)source + HEADER_FORMAT_VERSION_OFFSET, HEADER_FORMAT_VERSION_SIZE);
+    memcpy(&(destination->page_number_width), (char*)source + HEADER_PAGE_NUMBER_WIDTH_OFFSET, HEADER_PAGE_NUMBER_WIDTH_SIZE);
+    memcpy(&(destination->root_page_idx), (char*)source + HEADER_ROOT_PAGE_OFFSET, HEADER_ROOT_PAGE_SIZE);
+    memcpy(&(destination->key_type), (char*)source + HEADER_KEY_TYPE_OFFSET, HEADER_KEY_TYPE_SIZE);
+    memcpy(&(destination->page_size), (char*)source + HEADER_PAGE_SIZE_OFFSET, HEADER_PAGE_SIZE_SIZE);
+    memcpy(&(destination->replica_log_offset), (char*)source + HEADER_REPLICA_OFFSET_OFFSET, HEADER_REPLICA_OFFSET_SIZE);
+    memcpy(&(destination->free_list_head), (char*)source + HEADER_FREE_LIST_HEAD_OFFSET, HEADER_FREE_LIST_HEAD_SIZE);
+    memcpy(&(destination->num_free_pages), (char*)source + HEADER_NUM_FREE_PAGES_OFFSET, HEADER_NUM_FREE_PAGES_SIZE);
+    memcpy(&(destination->engine), (char*)source + HEADER_ENGINE_OFFSET, HEADER_ENGINE_SIZE);
+    memcpy(&(destination->catalog_page_idx), (char*)source + HEADER_CATALOG_PAGE_OFFSET, HEADER_CATALOG_PAGE_SIZE);
+    memcpy(&(destination->num_partitions), (char*)source + HEADER_NUM_PARTITIONS_OFFSET, HEADER_NUM_PARTITIONS_SIZE);
+    memcpy(&(destination->partition_width), (char*)source + HEADER_PARTITION_WIDTH_OFFSET, HEADER_PARTITION_WIDTH_SIZE);
+
+    // Fields appended after the file's version take their defaults.
+    if (destination->format_version < DB_VERSION_KEY_TYPE)
+        destination->key_type = KEY_TYPE_INT64;
+    if (destination->format_version < DB_VERSION_PAGE_SIZE) {
+        destination->page_size = DEFAULT_PAGE_SIZE;
+        destination->replica_log_offset = 0;
+    }
+    if (destination->format_version < DB_VERSION_TOMBSTONES) {
+        destination->free_list_head = 0;
+        destination->num_free_pages = 0;
+        destination->engine = STORAGE_ENGINE_BTREE;
+        destination->catalog_page_idx = 0;
+        destination->num_partitions = 0;
+        destination->partition_width = 0;
+    }
+    return true;
+}
+
+static void pager_read_header(DbPager* db_pager) {
+    // O_DIRECT reads need an aligned buffer and a whole number of blocks.
+    void* header_bytes = aligned_alloc(DIRECT_IO_ALIGNMENT, MIN_PAGE_SIZE);
+    ssize_t bytes_read = pread(db_pager->file_descriptor, header_bytes, MIN_PAGE_SIZE, 0);
+    bool valid = bytes_read >= (ssize_t)HEADER_SIZE && deserialize_db_header(header_bytes, &db_pager->header);
+    free(header_bytes);
+    if (!valid) {
+        printf(ANSI_COLOR_RED "Db file has no valid header. Corrupt file.\n" ANSI_COLOR_RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    if (db_pager->header.format_version > DB_FORMAT_VERSION) {
+        printf(ANSI_COLOR_RED "Db format version %u is newer than this build supports (%u).\n" ANSI_COLOR_RESET,
+               db_pager->header.format_version, DB_FORMAT_VERSION);
+        exit(EXIT_FAILURE);
+    }
+
+    // db_open upgrades older files before the pager sees them.
+    if (db_pager->header.format_version < DB_VERSION_TOMBSTONES) {
+        printf(ANSI_COLOR_RED "Db format version %u predates version %u and was not upgraded.\n" ANSI_COLOR_RESET,
+               db_pager->header.format_version, DB_VERSION_TOMBSTONES);
+        exit(EXIT_FAILURE);
+    }
+
+    if (db_pager->header.page_number_width != DB_PAGE_NUMBER_WIDTH) {
+        printf(ANSI_COLOR_RED "Unsupported page number width %u (expected %zu).\n" ANSI_COLOR_RESET,
+               db_pager->header.page_number_width, DB_PAGE_NUMBER_WIDTH);
+        exit(EXIT_FAILURE);
+    }
+
+    if (db_pager->header.key_type > KEY_TYPE_TENANT_INT64) {
+        printf(ANSI_COLOR_RED "Unsupported key type %u.\n" ANSI_COLOR_RESET, db_pager->header.key_type);
+        exit(EXIT_FAILURE);
+    }
+
+    if (!is_valid_page_size(db_pager->header.page_size)) {
+        printf(ANSI_COLOR_RED "Unsupported page size %u.\n" ANSI_COLOR_RESET, db_pager->header.page_size);
+        exit(EXIT_FAILURE);
+    }
+
+    if (db_pager->header.num_partitions > MAX_PARTITIONS) {
+        printf(ANSI_COLOR_RED "Unsupported partition count %u.\n" ANSI_COLOR_RESET, db_pager->header.num_partitions);
+        exit(EXIT_FAILURE);
+    }
+}
+
+DbPager* pager_open(const char* db_filename, DbOptions* options) {
+    bool in_memory = strcmp(db_filename, IN_MEMORY_DB_NAME) == 0;
+    int fd = in_memory ? -1 : open(db_filename,
                     O_RDWR |      // Read/Write mode
-                        O_CREAT,  // Create file if it does not exist
+                        O_CREAT | // Create file if it does not exist
+                        (options->direct_io ? O_DIRECT : 0), // Bypass the OS page cache
                     S_IWUSR |     // User write permission
                         S_IRUSR   // User read permission
                     );
-    if (fd == -1) {
-        printf(ANSI_COLOR_RED "Unable to open file\n" ANSI_COLOR_RESET);
+    if (fd == -1 && !in_memory) {
+        if (options->direct_io && errno == EINVAL)
+            printf(ANSI_COLOR_RED "Unable to open file: the file system does not support O_DIRECT\n" ANSI_COLOR_RESET);
+        else
+            printf(ANSI_COLOR_RED "Unable to open file\n" ANSI_COLOR_RESET);
         exit(EXIT_FAILURE);
     }
 
-    off_t file_length = lseek(fd, 0, SEEK_END);
     DbPager* db_pager = malloc(sizeof(DbPager));
     db_pager->file_descriptor = fd;
+    db_pager->in_memory = in_memory;
+    lock_open(db_pager, db_filename, options->shared);
+    off_t file_length = in_memory ? 0 : lseek(fd, 0, SEEK_END);
     db_pager->file_length = file_length;
-    db_pager->num_pages = (file_length / PAGE_SIZE_BYTES);
-    if (file_length % PAGE_SIZE_BYTES != 0) {
-        printf(ANSI_COLOR_RED "Db file is not a whole number of pages. Corrupt file.\n" ANSI_COLOR_RESET);
-        exit(EXIT_FAILURE);
+    db_pager->num_pages = 0;
+    db_pager->pages_read = 0;
+    db_pager->pages_written = 0;
+    db_pager->pages_dirtied = 0;
+    db_pager->num_page_slots = INITIAL_PAGE_SLOTS;
+    db_pager->pages = calloc(db_pager->num_page_slots, sizeof(void*));
+    db_pager->dirty_bitmap = calloc(bitmap_size(db_pager->num_page_slots), 1);
+    db_pager->referenced_bitmap = calloc(bitmap_size(db_pager->num_page_slots), 1);
+    db_pager->hit_counts = calloc(db_pager->num_page_slots, sizeof(uint16_t));
+    db_pager->page_generations = calloc(db_pager->num_page_slots, sizeof(uint32_t));
+    db_pager->clock_hand = 0;
+    db_pager->num_cached_pages = 0;
+    db_pager->num_dirty_pages = 0;
+    db_pager->dirty_ratio_percent = options->dirty_ratio_percent;
+    db_pager->dirty_limit_percent = options->dirty_limit_percent;
+    // Shared databases write pages back only when a statement commits.
+    db_pager->flush_interval_ms = (options->shared || in_memory) ? 0 : options->flush_interval_ms;
+
+    pthread_condattr_t condattr;
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&db_pager->flusher_wakeup, &condattr);
+    pthread_condattr_destroy(&condattr);
+    pthread_mutex_init(&db_pager->latch, NULL);
+    pthread_mutex_init(&db_pager->page_table_lock, NULL);
+    pthread_mutex_lock(&db_pager->latch);
+    db_pager->shared_read = false;
+
+    if (file_length == 0) {
+        db_pager->header.format_version = DB_FORMAT_VERSION;
+        db_pager->header.page_number_width = DB_PAGE_NUMBER_WIDTH;
+        db_pager->header.root_page_idx = INVALID_PAGE_IDX;
+        db_pager->header.key_type = options->key_type;
+        db_pager->header.page_size = options->page_size;
+        db_pager->header.replica_log_offset = 0;
+        db_pager->header.free_list_head = 0;
+        db_pager->header.num_free_pages = 0;
+        db_pager->header.engine = options->engine;
+        db_pager->header.catalog_page_idx = 0;
+        db_pager->header.num_partitions = options->num_partitions;
+        db_pager->header.partition_width = options->partition_width;
+        db_pager->page_size = options->page_size;
+    }
+    else {
+        pager_read_header(db_pager);
+        db_pager->page_size = db_pager->header.page_size;
+        db_pager->num_pages = (file_length / db_pager->page_size);
+        if (file_length % db_pager->page_size != 0) {
+            printf(ANSI_COLOR_RED "Db file is not a whole number of pages. Corrupt file.\n" ANSI_COLOR_RESET);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    pager_init_arena(db_pager, options);
+    if (file_length == 0)
+        get_page(db_pager, DB_HEADER_PAGE_IDX);
+
+    db_pager->flusher_stop = false;
+    db_pager->flusher_running = false;
+    if (db_pager->flush_interval_ms > 0) {
+        if (pthread_create(&db_pager->flusher_thread, NULL, pager_flusher_main, db_pager) != 0) {
+            printf(ANSI_COLOR_RED "Unable to start the background flusher\n" ANSI_COLOR_RESET);
+            exit(EXIT_FAILURE);
+        }
+        db_pager->flusher_running = true;
     }
 
-    for (uint32_t i = 0; i < MAX_PAGES; i++)
-        db_pager->pages[i] = NULL;
     return db_pager;
 }
 
+void pager_stop_flusher(DbPager* db_pager) {
+    if (!db_pager->flusher_running)
+        return;
+
+    db_pager->flusher_stop = true;
+    pthread_cond_signal(&db_pager->flusher_wakeup);
+    pthread_mutex_unlock(&db_pager->latch);
+    pthread_join(db_pager->flusher_thread, NULL);
+    pthread_mutex_lock(&db_pager->latch);
+    db_pager->flusher_running = false;
+}
+
 void pager_flush(DbPager* db_pager, uint32_t page_idx) {
-    if (page_idx >= MAX_PAGES) {
-        fprintf(stderr, "Tried to flush page number out of bounds: %d\n", page_idx);
+    if (page_idx >= db_pager->num_page_slots) {
+        fprintf(stderr, "Tried to flush page number out of bounds: %u\n", page_idx);
         exit(1);
     }
 
@@ -38,49 +408,533 @@ void pager_flush(DbPager* db_pager, uint32_t page_idx) {
         exit(EXIT_FAILURE);
     }
 
-    off_t offset = lseek(db_pager->file_descriptor, page_idx * PAGE_SIZE_BYTES, SEEK_SET);
-    if (offset == -1) {
-        printf(ANSI_COLOR_RED "Error seeking: %d\n" ANSI_COLOR_RESET, errno);
+    TRACE_BEGIN(span);
+    ssize_t bytes_written = pwrite(db_pager->file_descriptor, db_pager->pages[page_idx], db_pager->page_size, page_offset(db_pager, page_idx));
+    if (bytes_written == -1) {
+        printf(ANSI_COLOR_RED "Error writing: %d\n" ANSI_COLOR_RESET, errno);
+        exit(EXIT_FAILURE);
+    }
+    db_pager->pages_written++;
+
+    // Pages past the old end of file can now be evicted and read back.
+    uint64_t page_end = (uint64_t)page_offset(db_pager, page_idx) + db_pager->page_size;
+    if (page_end > db_pager->file_length)
+        db_pager->file_length = page_end;
+    TRACE_END(span, "page_write", "io", page_idx);
+}
+
+static void pager_grow_page_slots(DbPager* db_pager, uint32_t page_idx) {
+    uint32_t new_num_slots = db_pager->num_page_slots;
+    while (new_num_slots <= page_idx)
+        new_num_slots = (new_num_slots > UINT32_MAX / 2) ? UINT32_MAX : new_num_slots * 2;
+
+    void** pages = realloc(db_pager->pages, (size_t)new_num_slots * sizeof(void*));
+    if (!pages) {
+        printf(ANSI_COLOR_RED "Out of memory growing page table to %u slots\n" ANSI_COLOR_RESET, new_num_slots);
         exit(EXIT_FAILURE);
     }
 
-    ssize_t bytes_written = write(db_pager->file_descriptor, db_pager->pages[page_idx], PAGE_SIZE_BYTES);
-    if (bytes_written == -1) {
-        printf(ANSI_COLOR_RED "Error writing: %d\n" ANSI_COLOR_RESET, errno);
+    memset(pages + db_pager->num_page_slots, 0, (size_t)(new_num_slots - db_pager->num_page_slots) * sizeof(void*));
+
+    uint8_t* dirty_bitmap = realloc(db_pager->dirty_bitmap, bitmap_size(new_num_slots));
+    if (!dirty_bitmap) {
+        printf(ANSI_COLOR_RED "Out of memory growing page table to %u slots\n" ANSI_COLOR_RESET, new_num_slots);
+        exit(EXIT_FAILURE);
+    }
+
+    uint8_t* referenced_bitmap = realloc(db_pager->referenced_bitmap, bitmap_size(new_num_slots));
+    if (!referenced_bitmap) {
+        printf(ANSI_COLOR_RED "Out of memory growing page table to %u slots\n" ANSI_COLOR_RESET, new_num_slots);
+        exit(EXIT_FAILURE);
+    }
+
+    uint16_t* hit_counts = realloc(db_pager->hit_counts, (size_t)new_num_slots * sizeof(uint16_t));
+    if (!hit_counts) {
+        printf(ANSI_COLOR_RED "Out of memory growing page table to %u slots\n" ANSI_COLOR_RESET, new_num_slots);
         exit(EXIT_FAILURE);
     }
+
+    memset(hit_counts + db_pager->num_page_slots, 0, (size_t)(new_num_slots - db_pager->num_page_slots) * sizeof(uint16_t));
+    db_pager->hit_counts = hit_counts;
+
+    uint32_t* page_generations = realloc(db_pager->page_generations, (size_t)new_num_slots * sizeof(uint32_t));
+    if (!page_generations) {
+        printf(ANSI_COLOR_RED "Out of memory growing page table to %u slots\n" ANSI_COLOR_RESET, new_num_slots);
+        exit(EXIT_FAILURE);
+    }
+
+    memset(page_generations + db_pager->num_page_slots, 0, (size_t)(new_num_slots - db_pager->num_page_slots) * sizeof(uint32_t));
+    db_pager->page_generations = page_generations;
+
+    size_t old_bitmap_size = bitmap_size(db_pager->num_page_slots);
+    memset(dirty_bitmap + old_bitmap_size, 0, bitmap_size(new_num_slots) - old_bitmap_size);
+    memset(referenced_bitmap + old_bitmap_size, 0, bitmap_size(new_num_slots) - old_bitmap_size);
+    db_pager->dirty_bitmap = dirty_bitmap;
+    db_pager->referenced_bitmap = referenced_bitmap;
+    db_pager->pages = pages;
+    db_pager->num_page_slots = new_num_slots;
+}
+
+static void* pager_load_page(DbPager* db_pager, uint32_t page_idx) {
+    TRACE_BEGIN(span);
+    bool on_disk = false;
+    void* page = pager_alloc_frame(db_pager);
+    uint64_t num_pages = db_pager->file_length / db_pager->page_size;
+    if (db_pager->file_length % db_pager->page_size)
+        num_pages++;
+
+    if (!db_pager->in_memory && page_idx <= num_pages) {
+        ssize_t bytes_read = pread(db_pager->file_descriptor, page, db_pager->page_size, page_offset(db_pager, page_idx));
+        if (bytes_read == -1) {
+            printf(ANSI_COLOR_RED "Error reading file: %d\n" ANSI_COLOR_RESET, errno);
+            exit(EXIT_FAILURE);
+        }
+        if (bytes_read > 0) {
+            db_pager->pages_read++;
+            on_disk = true;
+        }
+    }
+
+    db_pager->num_cached_pages++;
+    if (!on_disk)
+        pager_mark_dirty(db_pager, page_idx);
+
+    if (page_idx >= db_pager->num_pages)
+        db_pager->num_pages = page_idx + 1;
+
+    TRACE_END(span, "page_read", "io", page_idx);
+    return page;
+}
+
+static int compare_page_idx(const void* a, const void* b) {
+    uint32_t page_a = *(const uint32_t*)a;
+    uint32_t page_b = *(const uint32_t*)b;
+    return (page_a > page_b) - (page_a < page_b);
+}
+
+static void pager_read_ahead(DbPager* db_pager, uint32_t first_page_idx, uint32_t num_pages) {
+    if (num_pages == 0 || db_pager->in_memory)
+        return;
+    posix_fadvise(db_pager->file_descriptor, page_offset(db_pager, first_page_idx),
+                  (off_t)num_pages * db_pager->page_size, POSIX_FADV_WILLNEED);
+}
+
+// Hints that the given pages are about to be read; sorts page_idxs in
+// place. Cached frames get their header and middle cache lines (where a
+// binary search starts) prefetched. The rest are handed to the kernel as
+// WILLNEED read-ahead, one call per run of consecutive pages, so their
+// reads overlap instead of each get_page waiting on its own.
+void pager_prefetch(DbPager* db_pager, uint32_t* page_idxs, uint32_t count) {
+    qsort(page_idxs, count, sizeof(uint32_t), compare_page_idx);
+
+    uint32_t run_start = 0, run_length = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t page_idx = page_idxs[i];
+        if (page_idx < db_pager->num_page_slots && db_pager->pages[page_idx]) {
+            char* frame = db_pager->pages[page_idx];
+            __builtin_prefetch(frame);
+            __builtin_prefetch(frame + db_pager->page_size / 2);
+            continue;
+        }
+        if (run_length > 0 && page_idx <= run_start + run_length) {
+            run_length = page_idx - run_start + 1;
+            continue;
+        }
+        pager_read_ahead(db_pager, run_start, run_length);
+        run_start = page_idx;
+        run_length = 1;
+    }
+    pager_read_ahead(db_pager, run_start, run_length);
+}
+
+// Reads the listed pages, sorted by page number, into free cache frames
+// with one preadv per run of consecutive pages. Pages already cached or
+// past the end of the file are skipped, and loading stops once the cache
+// is at capacity. Returns the number of pages loaded.
+uint32_t pager_load_pages(DbPager* db_pager, const uint32_t* page_idxs, uint32_t count) {
+    uint64_t file_pages = db_pager->file_length / db_pager->page_size;
+    if (count > 0 && file_pages > 0) {
+        uint32_t last_page_idx = page_idxs[count - 1] < file_pages ? page_idxs[count - 1] : (uint32_t)(file_pages - 1);
+        if (last_page_idx >= db_pager->num_page_slots)
+            pager_grow_page_slots(db_pager, last_page_idx);
+    }
+
+    struct iovec iov[PAGER_READ_RUN_PAGES];
+    uint32_t loaded = 0;
+    uint32_t i = 0;
+    while (i < count && db_pager->num_cached_pages < db_pager->cache_capacity) {
+        uint32_t run_start = page_idxs[i];
+        uint32_t run_length = 0;
+        while (i < count && run_length < PAGER_READ_RUN_PAGES && page_idxs[i] == run_start + run_length &&
+               page_idxs[i] < file_pages && db_pager->pages[page_idxs[i]] == NULL &&
+               db_pager->num_cached_pages + run_length < db_pager->cache_capacity) {
+            iov[run_length].iov_base = pager_alloc_frame(db_pager);
+            iov[run_length].iov_len = db_pager->page_size;
+            run_length++;
+            i++;
+        }
+        if (run_length == 0) {
+            i++;
+            continue;
+        }
+
+        ssize_t bytes_read = preadv(db_pager->file_descriptor, iov, (int)run_length, page_offset(db_pager, run_start));
+        if (bytes_read != (ssize_t)run_length * db_pager->page_size) {
+            printf(ANSI_COLOR_RED "Error reading file: %d\n" ANSI_COLOR_RESET, bytes_read == -1 ? errno : 0);
+            exit(EXIT_FAILURE);
+        }
+        for (uint32_t k = 0; k < run_length; k++) {
+            db_pager->pages[run_start + k] = iov[k].iov_base;
+            bitmap_set(db_pager->referenced_bitmap, run_start + k);
+        }
+        db_pager->num_cached_pages += run_length;
+        db_pager->pages_read += run_length;
+        loaded += run_length;
+    }
+
+    return loaded;
+}
+
+// Writes every page, the header re-serialized, to a new file that opens as
+// an ordinary database. Cached pages are copied from memory and the rest
+// read from the database file, so the cache is left as it was. The copy
+// goes to "<file>.tmp" and is renamed into place once synced.
+bool pager_snapshot(DbPager* db_pager, const char* filename) {
+    struct stat target_stat, db_stat;
+    if (!db_pager->in_memory && stat(filename, &target_stat) == 0 && fstat(db_pager->file_descriptor, &db_stat) == 0 &&
+        target_stat.st_dev == db_stat.st_dev && target_stat.st_ino == db_stat.st_ino) {
+        printf(ANSI_COLOR_RED "Error: cannot snapshot a database onto itself.\n" ANSI_COLOR_RESET);
+        return false;
+    }
+
+    size_t name_length = strlen(filename) + sizeof(".tmp");
+    char* temporary_filename = malloc(name_length);
+    snprintf(temporary_filename, name_length, "%s.tmp", filename);
+    int fd = open(temporary_filename, O_WRONLY | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR);
+    if (fd == -1) {
+        printf(ANSI_COLOR_RED "Error: unable to create '%s'.\n" ANSI_COLOR_RESET, temporary_filename);
+        free(temporary_filename);
+        return false;
+    }
+
+    pager_sync_header(db_pager);
+    void* buffer = aligned_alloc(DIRECT_IO_ALIGNMENT, db_pager->page_size);
+    bool ok = true;
+    for (uint32_t page_idx = 0; ok && page_idx < db_pager->num_pages; page_idx++) {
+        void* page = page_idx < db_pager->num_page_slots ? db_pager->pages[page_idx] : NULL;
+        if (page == NULL) {
+            // Only free pages are missing from an in-memory database.
+            memset(buffer, 0, db_pager->page_size);
+            if (!db_pager->in_memory &&
+                pread(db_pager->file_descriptor, buffer, db_pager->page_size, page_offset(db_pager, page_idx)) == -1)
+                ok = false;
+            page = buffer;
+        }
+        if (ok && pwrite(fd, page, db_pager->page_size, page_offset(db_pager, page_idx)) != (ssize_t)db_pager->page_size)
+            ok = false;
+    }
+    free(buffer);
+
+    if (fsync(fd) != 0)
+        ok = false;
+    close(fd);
+    if (ok && rename(temporary_filename, filename) != 0)
+        ok = false;
+    if (!ok) {
+        printf(ANSI_COLOR_RED "Error writing snapshot '%s': %d\n" ANSI_COLOR_RESET, filename, errno);
+        unlink(temporary_filename);
+    }
+    free(temporary_filename);
+    return ok;
+}
+
+// Lookup used by concurrent scan workers. The page table cannot grow
+// while shared_read is set, so a hit is a single atomic load and only
+// misses take the lock.
+static void* get_page_shared(DbPager* db_pager, uint32_t page_idx) {
+    if (page_idx >= db_pager->num_page_slots) {
+        printf(ANSI_COLOR_RED "Tried to fetch page %u past the end of the file during a scan\n" ANSI_COLOR_RESET, page_idx);
+        exit(EXIT_FAILURE);
+    }
+
+    void* page = __atomic_load_n(&db_pager->pages[page_idx], __ATOMIC_ACQUIRE);
+    if (page)
+        return page;
+
+    pthread_mutex_lock(&db_pager->page_table_lock);
+    page = db_pager->pages[page_idx];
+    if (!page) {
+        page = pager_load_page(db_pager, page_idx);
+        __atomic_store_n(&db_pager->pages[page_idx], page, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&db_pager->page_table_lock);
+
+    return page;
 }
 
 void* get_page(DbPager* db_pager, uint32_t page_idx) {
-    if (page_idx >= MAX_PAGES) {
-        printf(ANSI_COLOR_RED "Tried to fetch page number out of bounds. %d > %d\n" ANSI_COLOR_RESET, page_idx, MAX_PAGES);
+    if (page_idx == INVALID_PAGE_IDX) {
+        printf(ANSI_COLOR_RED "Tried to fetch invalid page number %u\n" ANSI_COLOR_RESET, page_idx);
         exit(EXIT_FAILURE);
     }
 
-    if (db_pager->pages[page_idx] == NULL) {
-        void* page = malloc(PAGE_SIZE_BYTES);
-        uint32_t num_pages = db_pager->file_length / PAGE_SIZE_BYTES;
-        if (db_pager->file_length % PAGE_SIZE_BYTES)
-            num_pages++;
-
-        if (page_idx <= num_pages) {
-            lseek(db_pager->file_descriptor, page_idx * PAGE_SIZE_BYTES, SEEK_SET);
-            ssize_t bytes_read = read(db_pager->file_descriptor, page, PAGE_SIZE_BYTES);
-            if (bytes_read == -1) {
-                printf(ANSI_COLOR_RED "Error reading file: %d\n" ANSI_COLOR_RESET, errno);
-                exit(EXIT_FAILURE);
-            }
+    if (db_pager->shared_read)
+        return get_page_shared(db_pager, page_idx);
+
+    if (page_idx >= db_pager->num_page_slots)
+        pager_grow_page_slots(db_pager, page_idx);
+
+    if (db_pager->pages[page_idx] == NULL)
+        db_pager->pages[page_idx] = pager_load_page(db_pager, page_idx);
+
+    bitmap_set(db_pager->referenced_bitmap, page_idx);
+    if (db_pager->hit_counts[page_idx] < UINT16_MAX)
+        db_pager->hit_counts[page_idx]++;
+
+    return db_pager->pages[page_idx];
+}
+
+// Fetches a page the caller is about to change. Pages fetched with
+// get_page are treated as read-only and are not marked dirty.
+void* get_page_for_write(DbPager* db_pager, uint32_t page_idx) {
+    void* page = get_page(db_pager, page_idx);
+    pager_mark_dirty(db_pager, page_idx);
+    return page;
+}
+
+// Read-only statements call this before handing the pager to worker
+// threads; the page table is sized for every page in the file so that
+// it never has to be reallocated under them.
+void pager_begin_shared_read(DbPager* db_pager) {
+    if (db_pager->num_pages > 0 && db_pager->num_pages - 1 >= db_pager->num_page_slots)
+        pager_grow_page_slots(db_pager, db_pager->num_pages - 1);
+    db_pager->shared_read = true;
+}
+
+void pager_end_shared_read(DbPager* db_pager) {
+    db_pager->shared_read = false;
+}
+
+// CLOCK eviction down to the cache capacity. Only called between
+// statements, when nobody holds a page pointer; dirty victims are
+// written back first, or skipped on a shared database until the
+// statement commits. The header page is never evicted.
+static void pager_evict(DbPager* db_pager) {
+    // An in-memory database has nowhere to write pages back to.
+    if (db_pager->in_memory)
+        return;
+    uint64_t steps = 0, max_steps = 2 * (uint64_t)db_pager->num_page_slots;
+    while (db_pager->num_cached_pages > db_pager->cache_capacity && steps++ < max_steps) {
+        uint32_t page_idx = db_pager->clock_hand;
+        db_pager->clock_hand = (db_pager->clock_hand + 1) % db_pager->num_page_slots;
+        if (db_pager->pages[page_idx] == NULL || page_idx == DB_HEADER_PAGE_IDX)
+            continue;
+        if (bitmap_test(db_pager->referenced_bitmap, page_idx)) {
+            bitmap_clear(db_pager->referenced_bitmap, page_idx);
+            continue;
+        }
+
+        if (page_is_dirty(db_pager, page_idx)) {
+            if (db_pager->shared)
+                continue;
+            pager_flush(db_pager, page_idx);
+            clear_page_dirty(db_pager, page_idx);
+        }
+        pager_free_frame(db_pager, db_pager->pages[page_idx]);
+        db_pager->pages[page_idx] = NULL;
+        db_pager->num_cached_pages--;
+    }
+}
+
+void pager_end_statement(DbPager* db_pager) {
+    pager_evict(db_pager);
+}
+
+// Drops every page from num_pages on, cached or not. Used to discard the
+// pages of a failed bulk operation.
+void pager_truncate(DbPager* db_pager, uint32_t num_pages) {
+    for (uint32_t i = num_pages; i < db_pager->num_page_slots; i++) {
+        if (db_pager->pages[i] != NULL) {
+            clear_page_dirty(db_pager, i);
+            pager_free_frame(db_pager, db_pager->pages[i]);
+            db_pager->pages[i] = NULL;
+            db_pager->num_cached_pages--;
+        }
+    }
+
+    db_pager->num_pages = num_pages;
+    if (db_pager->file_length > (uint64_t)page_offset(db_pager, num_pages)) {
+        db_pager->file_length = page_offset(db_pager, num_pages);
+        if (ftruncate(db_pager->file_descriptor, db_pager->file_length) != 0) {
+            printf(ANSI_COLOR_RED "Error truncating db file.\n" ANSI_COLOR_RESET);
+            exit(EXIT_FAILURE);
         }
+    }
+}
 
-        db_pager->pages[page_idx] = page;
+// Forgets a cached page, so the next get_page reads it from disk again.
+void pager_drop_page(DbPager* db_pager, uint32_t page_idx) {
+    if (page_idx >= db_pager->num_page_slots || db_pager->pages[page_idx] == NULL)
+        return;
+
+    clear_page_dirty(db_pager, page_idx);
+    bitmap_clear(db_pager->referenced_bitmap, page_idx);
+    db_pager->hit_counts[page_idx] = 0;
+    pager_free_frame(db_pager, db_pager->pages[page_idx]);
+    db_pager->pages[page_idx] = NULL;
+    db_pager->num_cached_pages--;
+}
+
+void pager_free_pages(DbPager* db_pager) {
+    for (uint32_t i = 0; i < db_pager->num_page_slots; i++) {
+        if (db_pager->pages[i] != NULL) {
+            pager_free_frame(db_pager, db_pager->pages[i]);
+            db_pager->pages[i] = NULL;
+        }
+    }
+    db_pager->num_cached_pages = 0;
+
+    munmap(db_pager->arena, db_pager->arena_length);
+    free(db_pager->free_frames);
+    free(db_pager->referenced_bitmap);
+    free(db_pager->hit_counts);
+    free(db_pager->page_generations);
+    free(db_pager->dirty_bitmap);
+    free(db_pager->pages);
+}
 
-        if (page_idx >= db_pager->num_pages)
-            db_pager->num_pages = page_idx + 1;
+void pager_mark_dirty(DbPager* db_pager, uint32_t page_idx) {
+    if (!db_pager->in_memory && !page_is_dirty(db_pager, page_idx)) {
+        bitmap_set(db_pager->dirty_bitmap, page_idx);
+        db_pager->num_dirty_pages++;
+        db_pager->pages_dirtied++;
     }
+}
+
+void pager_latch(DbPager* db_pager) {
+    pthread_mutex_lock(&db_pager->latch);
+}
+
+void pager_unlatch(DbPager* db_pager) {
+    pthread_mutex_unlock(&db_pager->latch);
+}
+
+// A writer that finds the dirty share at the hard limit is throttled:
+// it writes pages back itself until the share is under the background
+// ratio again.
+void pager_begin_write(DbPager* db_pager) {
+    // A file from an older version whose pages this build reads as they
+    // are is stamped with the current version by its first write.
+    db_pager->header.format_version = DB_FORMAT_VERSION;
+    if (!db_pager->shared && pager_over_dirty_share(db_pager, db_pager->dirty_limit_percent))
+        pager_flush_dirty(db_pager, pager_dirty_target(db_pager));
+}
+
+void pager_end_write(DbPager* db_pager) {
+    if (db_pager->flusher_running && pager_over_dirty_share(db_pager, db_pager->dirty_ratio_percent))
+        pthread_cond_signal(&db_pager->flusher_wakeup);
+}
+
+// Lets the flusher run, and the cache shrink, in the middle of a long
+// write (e.g. an import).
+// Callers must not hold page pointers across a yield.
+void pager_yield(DbPager* db_pager) {
+    pager_end_write(db_pager);
+    pager_evict(db_pager);
+    pager_unlatch(db_pager);
+    pager_latch(db_pager);
+    pager_begin_write(db_pager);
+}
+
+static uint32_t* free_trunk_next(void* trunk) {
+    return (uint32_t*)((uint8_t*)trunk + FREE_TRUNK_NEXT_OFFSET);
+}
+
+static uint32_t* free_trunk_count(void* trunk) {
+    return (uint32_t*)((uint8_t*)trunk + FREE_TRUNK_COUNT_OFFSET);
+}
 
+static uint32_t* free_trunk_entry(void* trunk, uint32_t entry_idx) {
+    return (uint32_t*)((uint8_t*)trunk + FREE_TRUNK_HEADER_SIZE) + entry_idx;
+}
+
+// Gives a page that is not cached a zeroed, dirty frame without reading
+// it from disk.
+static void* pager_zero_page(DbPager* db_pager, uint32_t page_idx) {
+    if (page_idx >= db_pager->num_page_slots)
+        pager_grow_page_slots(db_pager, page_idx);
+    db_pager->pages[page_idx] = pager_alloc_frame(db_pager);
+    db_pager->num_cached_pages++;
+    bitmap_set(db_pager->referenced_bitmap, page_idx);
+    pager_mark_dirty(db_pager, page_idx);
     return db_pager->pages[page_idx];
 }
 
+// Puts a page no longer reachable from the tree on the free list. Its
+// cached copy is dropped unwritten. If it becomes the new head trunk it
+// starts from a zeroed frame, so releasing a page never reads it and
+// none of its old bytes survive in the trunk.
+void pager_free_page(DbPager* db_pager, uint32_t page_idx) {
+    pager_drop_page(db_pager, page_idx);
+    if (page_idx < db_pager->num_page_slots)
+        db_pager->page_generations[page_idx]++;
+
+    uint32_t trunk_capacity = (db_pager->page_size - FREE_TRUNK_HEADER_SIZE) / sizeof(uint32_t);
+    uint32_t head = db_pager->header.free_list_head;
+    void* trunk = head != 0 ? get_page(db_pager, head) : NULL;
+    if (trunk && *free_trunk_count(trunk) < trunk_capacity) {
+        *free_trunk_entry(trunk, (*free_trunk_count(trunk))++) = page_idx;
+        pager_mark_dirty(db_pager, head);
+    }
+    else {
+        // The freed page becomes the new head trunk.
+        trunk = pager_zero_page(db_pager, page_idx);
+        *free_trunk_next(trunk) = head;
+        *free_trunk_count(trunk) = 0;
+        db_pager->header.free_list_head = page_idx;
+    }
+    db_pager->header.num_free_pages++;
+}
+
+// Marks every page on the free list, trunk pages included, as
+// PAGE_USE_FREE in page_use and returns how many were found. A list
+// that loops or points past the end of the file is cut short there.
+uint32_t pager_mark_free_pages(DbPager* db_pager, uint8_t* page_use) {
+    uint32_t num_found = 0;
+    uint32_t trunk_capacity = (db_pager->page_size - FREE_TRUNK_HEADER_SIZE) / sizeof(uint32_t);
+    for (uint32_t trunk_idx = db_pager->header.free_list_head;
+         trunk_idx != 0 && trunk_idx < db_pager->num_pages && page_use[trunk_idx] != PAGE_USE_FREE;) {
+        void* trunk = get_page(db_pager, trunk_idx);
+        page_use[trunk_idx] = PAGE_USE_FREE;
+        num_found++;
+        uint32_t count = *free_trunk_count(trunk) < trunk_capacity ? *free_trunk_count(trunk) : trunk_capacity;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t page_idx = *free_trunk_entry(trunk, i);
+            if (page_idx != 0 && page_idx < db_pager->num_pages && page_use[page_idx] != PAGE_USE_FREE) {
+                page_use[page_idx] = PAGE_USE_FREE;
+                num_found++;
+            }
+        }
+        trunk_idx = *free_trunk_next(trunk);
+    }
+    return num_found;
+}
+
+// Reuses a free page if there is one, else the page past the end of the
+// file. The caller initializes it.
 uint32_t get_unused_page_num(DbPager* db_pager) {
-    return db_pager->num_pages;
-}
\ No newline at end of file
+    uint32_t head = db_pager->header.free_list_head;
+    if (head == 0)
+        return db_pager->num_pages;
+
+    void* trunk = get_page(db_pager, head);
+    uint32_t page_idx = head;
+    if (*free_trunk_count(trunk) > 0) {
+        page_idx = *free_trunk_entry(trunk, --(*free_trunk_count(trunk)));
+        pager_mark_dirty(db_pager, head);
+    }
+    else
+        db_pager->header.free_list_head = *free_trunk_next(trunk);
+    db_pager->header.num_free_pages--;
+    return page_idx;
+}
@@ -1,15 +1,47 @@
 #ifndef DB_PAGER_H
 #define DB_PAGER_H
 
+#include <errno.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include "common.h"
+#include "lock.h"
+#include "trace.h"
 
-DbPager*  pager_open(const char* db_filename);
+bool      is_valid_page_size(uint32_t page_size);
+void      serialize_db_header(DbHeader* source, void* destination);
+bool      deserialize_db_header(void* source, DbHeader* destination);
+
+DbPager*  pager_open(const char* db_filename, DbOptions* options);
+void      pager_stop_flusher(DbPager* pager);
 void      pager_flush(DbPager* pager, uint32_t page_idx);
+void      pager_flush_dirty(DbPager* pager, uint32_t target);
+void      pager_mark_dirty(DbPager* pager, uint32_t page_idx);
+void      pager_latch(DbPager* pager);
+void      pager_unlatch(DbPager* pager);
+void      pager_begin_write(DbPager* pager);
+void      pager_end_write(DbPager* pager);
+void      pager_yield(DbPager* pager);
+void      pager_end_statement(DbPager* pager);
+void      pager_truncate(DbPager* pager, uint32_t num_pages);
+void      pager_drop_page(DbPager* pager, uint32_t page_idx);
+void      pager_free_page(DbPager* pager, uint32_t page_idx);
+bool      pager_header_changed(DbPager* pager);
+void      pager_free_pages(DbPager* pager);
+void      pager_begin_shared_read(DbPager* pager);
+void      pager_end_shared_read(DbPager* pager);
+uint32_t  pager_load_pages(DbPager* pager, const uint32_t* page_idxs, uint32_t count);
+void      pager_prefetch(DbPager* pager, uint32_t* page_idxs, uint32_t count);
+bool      pager_snapshot(DbPager* pager, const char* filename);
 void*     get_page(DbPager* pager, uint32_t page_idx);
+void*     get_page_for_write(DbPager* pager, uint32_t page_idx);
 uint32_t  get_unused_page_num(DbPager* pager);
+uint32_t  pager_mark_free_pages(DbPager* pager, uint8_t* page_use);
 
 #endif
\ No newline at end of file
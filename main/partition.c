@@ -0,0 +1,94 @@
+#include "partition.h"
+
+typedef struct {
+    DbTable*      partition;
+    uint32_t      partition_idx;
+    PartitionTask task;
+    void*         context;
+    pthread_t     thread;
+} PartitionWorker;
+
+char* partition_filename(const char* db_filename, uint32_t partition_idx) {
+    size_t name_length = strlen(db_filename) + strlen(PARTITION_FILE_SUFFIX) + 12;
+    char* filename = malloc(name_length);
+    snprintf(filename, name_length, "%s%s%u", db_filename, PARTITION_FILE_SUFFIX, partition_idx);
+    return filename;
+}
+
+static uint64_t mix64(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+// Range partitions split the leading key field (the tenant for composite
+// keys) into runs of partition_width values, the last partition taking
+// everything above; partitions then follow key order. Otherwise the
+// whole key is hashed.
+uint32_t partition_index(DbTable* table, const uint8_t* key) {
+    uint64_t tenant_id, id;
+    uint64_t width = table->db_pager->header.partition_width;
+    decode_key(table->layout.key_type, key, &tenant_id, &id);
+    if (width == 0)
+        return (uint32_t)(mix64(mix64(tenant_id) ^ id) % table->num_partitions);
+
+    uint64_t leading = (table->layout.key_type == KEY_TYPE_TENANT_INT64) ? tenant_id : id;
+    uint64_t partition_idx = leading / width;
+    return partition_idx < table->num_partitions ? (uint32_t)partition_idx : table->num_partitions - 1;
+}
+
+// The tree holding key: the partition it routes to, or the table itself.
+DbTable* partition_for_key(DbTable* table, const uint8_t* key) {
+    if (!table->partitions)
+        return table;
+    return table->partitions[partition_index(table, key)];
+}
+
+// An unpartitioned table is its own single partition, so callers can
+// loop over partitions either way.
+uint32_t table_num_partitions(DbTable* table) {
+    return table->partitions ? table->num_partitions : 1;
+}
+
+DbTable* table_partition(DbTable* table, uint32_t partition_idx) {
+    return table->partitions ? table->partitions[partition_idx] : table;
+}
+
+static void* partition_worker_main(void* argument) {
+    PartitionWorker* worker = argument;
+    worker->task(worker->partition, worker->partition_idx, worker->context);
+    return NULL;
+}
+
+// Runs task on every selected partition (all of them if selected is
+// NULL), one thread each. A lone partition runs on the caller's thread.
+void partitions_run(DbTable* table, const bool* selected, PartitionTask task, void* context) {
+    PartitionWorker workers[MAX_PARTITIONS];
+    uint32_t num_workers = 0;
+    for (uint32_t i = 0; i < table_num_partitions(table); i++) {
+        if (selected && !selected[i])
+            continue;
+        workers[num_workers++] = (PartitionWorker){
+            .partition = table_partition(table, i),
+            .partition_idx = i,
+            .task = task,
+            .context = context
+        };
+    }
+
+    if (num_workers == 1) {
+        partition_worker_main(&workers[0]);
+        return;
+    }
+    for (uint32_t i = 0; i < num_workers; i++) {
+        if (pthread_create(&workers[i].thread, NULL, partition_worker_main, &workers[i]) != 0) {
+            printf(ANSI_COLOR_RED "Unable to start partition worker\n" ANSI_COLOR_RESET);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (uint32_t i = 0; i < num_workers; i++)
+        pthread_join(workers[i].thread, NULL);
+}
@@ -0,0 +1,19 @@
+#ifndef DB_PARTITION_H
+#define DB_PARTITION_H
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "common.h"
+#include "key.h"
+
+// Runs on one partition, possibly on its own thread.
+typedef void (*PartitionTask)(DbTable* partition, uint32_t partition_idx, void* context);
+
+char*    partition_filename(const char* db_filename, uint32_t partition_idx);
+uint32_t partition_index(DbTable* table, const uint8_t* key);
+DbTable* partition_for_key(DbTable* table, const uint8_t* key);
+uint32_t table_num_partitions(DbTable* table);
+DbTable* table_partition(DbTable* table, uint32_t partition_idx);
+void     partitions_run(DbTable* table, const bool* selected, PartitionTask task, void* context);
+
+#endif
@@ -0,0 +1,50 @@
+#include "predicate.h"
+
+// Text fields are NUL-padded char arrays inside the serialized row (a
+// fixed column may fill its field), so equality and prefix matches never
+// need the field length: a pattern has no NUL bytes, so a successful
+// memcmp already proves the field is at least that long.
+static bool match_field(const PredicateNode* node, const char* field) {
+    size_t length;
+    double field_value, value;
+    switch (node->match) {
+        case (MATCH_EQUALS):
+            return node->pattern_length <= node->field_size &&
+                   memcmp(field, node->pattern, node->pattern_length) == 0 &&
+                   (node->pattern_length == node->field_size || field[node->pattern_length] == '\0');
+        case (MATCH_PREFIX):
+            return node->pattern_length <= node->field_size &&
+                   memcmp(field, node->pattern, node->pattern_length) == 0;
+        case (MATCH_SUFFIX):
+            length = strnlen(field, node->field_size);
+            return length >= node->pattern_length &&
+                   memcmp(field + length - node->pattern_length, node->pattern, node->pattern_length) == 0;
+        case (MATCH_CONTAINS):
+            length = strnlen(field, node->field_size);
+            return memmem(field, length, node->pattern, node->pattern_length) != NULL;
+        case (MATCH_VALUE):
+            return memcmp(field, node->value, node->field_size) == 0;
+        case (MATCH_DOUBLE):
+            memcpy(&field_value, field, sizeof(double));
+            memcpy(&value, node->value, sizeof(double));
+            return field_value == value;
+    }
+    return false;
+}
+
+static bool evaluate_node(const Predicate* predicate, uint32_t node_idx, const char* row) {
+    const PredicateNode* node = &predicate->nodes[node_idx];
+    switch (node->type) {
+        case (PREDICATE_AND):
+            return evaluate_node(predicate, node->left, row) && evaluate_node(predicate, node->right, row);
+        case (PREDICATE_OR):
+            return evaluate_node(predicate, node->left, row) || evaluate_node(predicate, node->right, row);
+        case (PREDICATE_MATCH):
+            return match_field(node, row + node->field_offset);
+    }
+    return false;
+}
+
+bool predicate_matches(const Predicate* predicate, const void* row) {
+    return evaluate_node(predicate, predicate->root, row);
+}
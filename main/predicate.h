@@ -0,0 +1,32 @@
+#ifndef DB_PREDICATE_H
+#define DB_PREDICATE_H
+
+#include "common.h"
+
+#define PREDICATE_MAX_NODES 16
+
+// One node of a WHERE expression. AND/OR nodes refer to their operands
+// by index; MATCH nodes compare one serialized field against a pattern
+// that points into the statement text, or, for numeric and bool columns,
+// against the encoded value.
+typedef struct {
+    PredicateNodeType type;
+    uint32_t          left;
+    uint32_t          right;
+    uint32_t          field_offset;
+    uint32_t          field_size;
+    MatchKind         match;
+    const char*       pattern;
+    uint32_t          pattern_length;
+    uint8_t           value[sizeof(uint64_t)];
+} PredicateNode;
+
+typedef struct {
+    uint32_t      num_nodes;
+    uint32_t      root;
+    PredicateNode nodes[PREDICATE_MAX_NODES];
+} Predicate;
+
+bool predicate_matches(const Predicate* predicate, const void* row);
+
+#endif
@@ -0,0 +1,356 @@
+#include "replication.h"
+#include "execution.h"
+
+// Log layout: magic[8] version:u32 key_type:u32, then records
+//   PUT    type:u8 key[key_size] row[USER_ROW_SIZE]
+//   DELETE type:u8 key[key_size]
+//   COMMIT type:u8 time_ns:u64
+//   DELETE_RANGE type:u8 low[key_size] high[key_size]
+// A COMMIT ends every statement, and is also written whenever a long
+// statement spills its buffer, so replicas can measure lag mid-import.
+// Records are logical and absolute (a PUT carries the whole row), so
+// replaying any suffix of the log over a copy of the writer's database
+// converges to the writer's state.
+
+static uint32_t record_size(LogRecordType type, uint32_t key_size) {
+    switch (type) {
+        case (LOG_RECORD_PUT):
+            return 1 + key_size + USER_ROW_SIZE;
+        case (LOG_RECORD_DELETE):
+            return 1 + key_size;
+        case (LOG_RECORD_COMMIT):
+            return 1 + sizeof(uint64_t);
+        case (LOG_RECORD_DELETE_RANGE):
+            return 1 + 2 * key_size;
+    }
+    return 0;
+}
+
+static uint64_t realtime_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+// Opens the log and checks (or, for a new log, writes) its header.
+// Returns the log's key type, or exits on a bad log.
+static int open_log_file(const char* filename, int flags, KeyType* key_type, bool create) {
+    int fd = open(filename, flags, S_IWUSR | S_IRUSR);
+    if (fd == -1) {
+        printf(ANSI_COLOR_RED "Unable to open replication log '%s'\n" ANSI_COLOR_RESET, filename);
+        exit(EXIT_FAILURE);
+    }
+
+    uint8_t header[REPLICATION_LOG_HEADER_SIZE];
+    uint32_t version = REPLICATION_LOG_VERSION, type = *key_type;
+    ssize_t bytes_read = pread(fd, header, REPLICATION_LOG_HEADER_SIZE, 0);
+    if (bytes_read == 0 && create) {
+        memcpy(header, REPLICATION_LOG_MAGIC, 8);
+        memcpy(header + 8, &version, sizeof(uint32_t));
+        memcpy(header + 12, &type, sizeof(uint32_t));
+        if (write(fd, header, REPLICATION_LOG_HEADER_SIZE) != REPLICATION_LOG_HEADER_SIZE) {
+            printf(ANSI_COLOR_RED "Error writing replication log header.\n" ANSI_COLOR_RESET);
+            exit(EXIT_FAILURE);
+        }
+        return fd;
+    }
+
+    if (bytes_read != REPLICATION_LOG_HEADER_SIZE || memcmp(header, REPLICATION_LOG_MAGIC, 8) != 0) {
+        printf(ANSI_COLOR_RED "'%s' is not a replication log.\n" ANSI_COLOR_RESET, filename);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(&version, header + 8, sizeof(uint32_t));
+    memcpy(&type, header + 12, sizeof(uint32_t));
+    if (version != REPLICATION_LOG_VERSION || type > KEY_TYPE_TENANT_INT64) {
+        printf(ANSI_COLOR_RED "Unsupported replication log version %u.\n" ANSI_COLOR_RESET, version);
+        exit(EXIT_FAILURE);
+    }
+    if (create && type != *key_type) {
+        printf(ANSI_COLOR_RED "Replication log '%s' is for %s keys, the table uses %s keys.\n" ANSI_COLOR_RESET,
+               filename, key_type_name((KeyType)type), key_type_name(*key_type));
+        exit(EXIT_FAILURE);
+    }
+
+    *key_type = (KeyType)type;
+    return fd;
+}
+
+ReplicationLog* replication_log_open(const char* filename, KeyType key_type) {
+    ReplicationLog* log = malloc(sizeof(ReplicationLog));
+    log->file_descriptor = open_log_file(filename, O_RDWR | O_CREAT | O_APPEND, &key_type, true);
+    log->key_size = key_type_size(key_type);
+    log->log_length = (uint64_t)lseek(log->file_descriptor, 0, SEEK_END);
+    log->buffer = malloc(REPLICATION_BUFFER_SIZE);
+    log->buffer_used = 0;
+    return log;
+}
+
+static void replication_log_write_buffer(ReplicationLog* log) {
+    uint32_t written = 0;
+    while (written < log->buffer_used) {
+        ssize_t result = write(log->file_descriptor, log->buffer + written, log->buffer_used - written);
+        if (result == -1) {
+            if (errno == EINTR)
+                continue;
+            printf(ANSI_COLOR_RED "Error writing replication log: %d\n" ANSI_COLOR_RESET, errno);
+            exit(EXIT_FAILURE);
+        }
+        written += (uint32_t)result;
+    }
+
+    log->log_length += log->buffer_used;
+    log->buffer_used = 0;
+}
+
+static void replication_log_append_commit(ReplicationLog* log) {
+    uint64_t now = realtime_ns();
+    log->buffer[log->buffer_used] = (uint8_t)LOG_RECORD_COMMIT;
+    memcpy(log->buffer + log->buffer_used + 1, &now, sizeof(uint64_t));
+    log->buffer_used += record_size(LOG_RECORD_COMMIT, log->key_size);
+}
+
+// Room is always left for the COMMIT that closes the buffer.
+static uint8_t* replication_log_reserve(ReplicationLog* log, LogRecordType type) {
+    uint32_t size = record_size(type, log->key_size);
+    if (log->buffer_used + size + record_size(LOG_RECORD_COMMIT, log->key_size) > REPLICATION_BUFFER_SIZE) {
+        replication_log_append_commit(log);
+        replication_log_write_buffer(log);
+    }
+
+    uint8_t* record = log->buffer + log->buffer_used;
+    log->buffer_used += size;
+    record[0] = (uint8_t)type;
+    return record + 1;
+}
+
+void replication_log_put(ReplicationLog* log, const uint8_t* key, const void* row) {
+    uint8_t* record = replication_log_reserve(log, LOG_RECORD_PUT);
+    memcpy(record, key, log->key_size);
+    memcpy(record + log->key_size, row, USER_ROW_SIZE);
+}
+
+void replication_log_delete(ReplicationLog* log, const uint8_t* key) {
+    memcpy(replication_log_reserve(log, LOG_RECORD_DELETE), key, log->key_size);
+}
+
+void replication_log_delete_range(ReplicationLog* log, const uint8_t* low, const uint8_t* high) {
+    uint8_t* record = replication_log_reserve(log, LOG_RECORD_DELETE_RANGE);
+    memcpy(record, low, log->key_size);
+    memcpy(record + log->key_size, high, log->key_size);
+}
+
+// Ends a statement: the buffered records and a timestamped COMMIT go
+// out in as few writes as possible.
+void replication_log_commit(ReplicationLog* log) {
+    replication_log_append_commit(log);
+    replication_log_write_buffer(log);
+}
+
+void replication_log_close(ReplicationLog* log) {
+    if (log->buffer_used > 0)
+        replication_log_commit(log);
+    close(log->file_descriptor);
+    free(log->buffer);
+    free(log);
+}
+
+Replica* replica_open(const char* filename, KeyType* key_type) {
+    Replica* replica = malloc(sizeof(Replica));
+    replica->file_descriptor = open_log_file(filename, O_RDONLY, key_type, false);
+    replica->filename = strdup(filename);
+    replica->key_size = key_type_size(*key_type);
+    replica->applied_offset = REPLICATION_LOG_HEADER_SIZE;
+    replica->records_applied = 0;
+    replica->last_commit_time_ns = 0;
+    replica->stopped_on_error = false;
+    replica->running = false;
+    replica->stop = false;
+
+    pthread_condattr_t condattr;
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&replica->wakeup, &condattr);
+    pthread_condattr_destroy(&condattr);
+    return replica;
+}
+
+// leaf_node_insert overwrites a row that already has this key.
+static void apply_put(DbTable* table, const uint8_t* key, const uint8_t* row) {
+    UserRow user_row;
+    deserialize_user_row((void*)row, &user_row);
+    TableCursor* cursor = table_find(table, key);
+    leaf_node_insert(cursor, key, &user_row);
+    free(cursor);
+}
+
+// Applies the complete records in data[0, length). Returns the number of
+// bytes consumed; a trailing partial record is left for the next read.
+static uint32_t replica_apply(Replica* replica, DbTable* table, const uint8_t* data, uint32_t length) {
+    uint32_t position = 0;
+    while (position < length) {
+        LogRecordType type = (LogRecordType)data[position];
+        uint32_t size = record_size(type, replica->key_size);
+        if (size == 0) {
+            printf(ANSI_COLOR_RED "Replication log '%s' is corrupt at offset %" PRIu64 "; replica stopped.\n" ANSI_COLOR_RESET,
+                   replica->filename, replica->applied_offset + position);
+            replica->stopped_on_error = true;
+            break;
+        }
+        if (length - position < size)
+            break;
+
+        const uint8_t* body = data + position + 1;
+        if (type == LOG_RECORD_PUT)
+            apply_put(table, body, body + replica->key_size);
+        else if (type == LOG_RECORD_DELETE)
+            delete_key(table, body);
+        else if (type == LOG_RECORD_DELETE_RANGE) {
+            uint32_t pages_released;
+            table_delete_range(table, body, body + replica->key_size, &pages_released);
+        }
+        else
+            memcpy(&replica->last_commit_time_ns, body, sizeof(uint64_t));
+
+        replica->records_applied++;
+        position += size;
+    }
+
+    return position;
+}
+
+typedef struct {
+    Replica* replica;
+    DbTable* table;
+} ReplicaThread;
+
+// Reads new log bytes without the latch, then applies whole records
+// under it, as one writing statement per read. Sleeps for the poll
+// interval whenever it has caught up.
+static void* replica_main(void* argument) {
+    ReplicaThread* thread = argument;
+    Replica* replica = thread->replica;
+    DbTable* table = thread->table;
+    DbPager* db_pager = table->db_pager;
+    uint8_t* data = malloc(REPLICA_READ_SIZE);
+
+    pthread_mutex_lock(&db_pager->latch);
+    while (!replica->stop && !replica->stopped_on_error) {
+        uint64_t offset = replica->applied_offset;
+        pthread_mutex_unlock(&db_pager->latch);
+        ssize_t bytes_read = pread(replica->file_descriptor, data, REPLICA_READ_SIZE, (off_t)offset);
+        pthread_mutex_lock(&db_pager->latch);
+        if (replica->stop)
+            break;
+
+        uint32_t consumed = 0;
+        if (bytes_read > 0) {
+            db_begin_access(table, true);
+            pager_begin_write(db_pager);
+            consumed = replica_apply(replica, table, data, (uint32_t)bytes_read);
+            pager_end_write(db_pager);
+            replica->applied_offset += consumed;
+            db_pager->header.replica_log_offset = replica->applied_offset;
+            db_end_access(table);
+            pager_end_statement(db_pager);
+        }
+        if (consumed > 0)
+            continue;
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_nsec += (long)REPLICA_POLL_INTERVAL_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&replica->wakeup, &db_pager->latch, &deadline);
+    }
+    pthread_mutex_unlock(&db_pager->latch);
+
+    free(data);
+    free(thread);
+    return NULL;
+}
+
+// Resumes from the offset recorded in the database header. A database
+// that was never a replica starts at the beginning of the log.
+void replica_start(Replica* replica, DbTable* table) {
+    uint64_t offset = table->db_pager->header.replica_log_offset;
+    struct stat log_stat;
+    fstat(replica->file_descriptor, &log_stat);
+    if (offset > (uint64_t)log_stat.st_size) {
+        printf(ANSI_COLOR_RED "Replica has applied %" PRIu64 " bytes but '%s' is only %" PRIu64 " bytes long; was the log replaced?\n" ANSI_COLOR_RESET,
+               offset, replica->filename, (uint64_t)log_stat.st_size);
+        exit(EXIT_FAILURE);
+    }
+    if (offset > REPLICATION_LOG_HEADER_SIZE)
+        replica->applied_offset = offset;
+
+    ReplicaThread* thread = malloc(sizeof(ReplicaThread));
+    thread->replica = replica;
+    thread->table = table;
+    if (pthread_create(&replica->thread, NULL, replica_main, thread) != 0) {
+        printf(ANSI_COLOR_RED "Unable to start the replica thread\n" ANSI_COLOR_RESET);
+        exit(EXIT_FAILURE);
+    }
+    replica->running = true;
+}
+
+// Joins the thread applying the log before db_close flushes the pages
+// and stores the applied offset in the header. Called with the latch
+// held, so stop is never set halfway through applying a read, and the
+// offset matches the rows written; the wakeup ends a poll early and the
+// latch is released for the join so the thread can take it to exit.
+void replica_stop(Replica* replica, DbPager* db_pager) {
+    if (!replica->running)
+        return;
+
+    replica->stop = true;
+    pthread_cond_signal(&replica->wakeup);
+    pthread_mutex_unlock(&db_pager->latch);
+    pthread_join(replica->thread, NULL);
+    pthread_mutex_lock(&db_pager->latch);
+    replica->running = false;
+}
+
+void replica_close(Replica* replica) {
+    close(replica->file_descriptor);
+    pthread_cond_destroy(&replica->wakeup);
+    free(replica->filename);
+    free(replica);
+}
+
+void print_replication_status(DbTable* table) {
+    if (table->replication_log) {
+        printf("Role: writer\n");
+        printf("Log bytes written: %" PRIu64 "\n", table->replication_log->log_length);
+        return;
+    }
+    if (!table->replica) {
+        printf("Replication is off.\n");
+        return;
+    }
+
+    Replica* replica = table->replica;
+    struct stat log_stat;
+    fstat(replica->file_descriptor, &log_stat);
+    uint64_t log_length = (uint64_t)log_stat.st_size;
+    uint64_t bytes_behind = log_length > replica->applied_offset ? log_length - replica->applied_offset : 0;
+
+    printf("Role: replica of '%s'%s\n", replica->filename, replica->stopped_on_error ? " (stopped)" : "");
+    printf("Applied: %" PRIu64 " of %" PRIu64 " log bytes (%" PRIu64 " records this session)\n",
+           replica->applied_offset, log_length, replica->records_applied);
+    printf("Bytes behind: %" PRIu64 "\n", bytes_behind);
+
+    // Lag is the age of the last applied commit while there is more log
+    // to apply, and zero once the replica has caught up.
+    if (bytes_behind == 0)
+        printf("Lag: 0 ms\n");
+    else if (replica->last_commit_time_ns == 0)
+        printf("Lag: unknown (no commit applied yet)\n");
+    else {
+        uint64_t now = realtime_ns();
+        uint64_t lag = now > replica->last_commit_time_ns ? now - replica->last_commit_time_ns : 0;
+        printf("Lag: %" PRIu64 " ms\n", lag / 1000000);
+    }
+}
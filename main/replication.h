@@ -0,0 +1,27 @@
+#ifndef DB_REPLICATION_H
+#define DB_REPLICATION_H
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "common.h"
+#include "key.h"
+
+ReplicationLog* replication_log_open(const char* filename, KeyType key_type);
+void            replication_log_put(ReplicationLog* log, const uint8_t* key, const void* row);
+void            replication_log_delete(ReplicationLog* log, const uint8_t* key);
+void            replication_log_delete_range(ReplicationLog* log, const uint8_t* low, const uint8_t* high);
+void            replication_log_commit(ReplicationLog* log);
+void            replication_log_close(ReplicationLog* log);
+
+Replica*        replica_open(const char* filename, KeyType* key_type);
+void            replica_start(Replica* replica, DbTable* table);
+void            replica_stop(Replica* replica, DbPager* pager);
+void            replica_close(Replica* replica);
+
+void            print_replication_status(DbTable* table);
+
+#endif
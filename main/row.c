@@ -1,17 +1,29 @@
 #include "row.h"
 
 void serialize_user_row(UserRow* source, void* destination) {
+    memcpy((char*)destination + TENANT_ID_FIELD_OFFSET, &(source->tenant_id), TENANT_ID_FIELD_SIZE);
     memcpy((char*)destination + ID_FIELD_OFFSET, &(source->id), ID_FIELD_SIZE);
-    memcpy((char*)destination + USERNAME_FIELD_OFFSET, &(source->username), USERNAME_FIELD_SIZE);
-    memcpy((char*)destination + EMAIL_FIELD_OFFSET, &(source->email), EMAIL_FIELD_SIZE);
+    memcpy((char*)destination + ROW_PAYLOAD_OFFSET, &(source->values), VALUES_FIELD_SIZE);
 }
 
 void deserialize_user_row(void* source, UserRow* destination) {
+    memcpy(&(destination->tenant_id), (char*)source + TENANT_ID_FIELD_OFFSET, TENANT_ID_FIELD_SIZE);
     memcpy(&(destination->id), (char*)source + ID_FIELD_OFFSET, ID_FIELD_SIZE);
-    memcpy(&(destination->username), (char*)source + USERNAME_FIELD_OFFSET, USERNAME_FIELD_SIZE);
-    memcpy(&(destination->email), (char*)source + EMAIL_FIELD_OFFSET, EMAIL_FIELD_SIZE);
+    memcpy(&(destination->values), (char*)source + ROW_PAYLOAD_OFFSET, VALUES_FIELD_SIZE);
 }
 
-void print_user_row(UserRow* user) {
-    printf("(%d, %s, %s)\n", user->id, user->username, user->email);
-}
\ No newline at end of file
+void print_user_row(UserRow* user, const Schema* schema, KeyType key_type) {
+    write_user_row(stdout, user, schema, key_type);
+}
+
+void write_user_row(FILE* file, UserRow* user, const Schema* schema, KeyType key_type) {
+    if (key_type == KEY_TYPE_TENANT_INT64)
+        fprintf(file, "(%" PRIu64 ":%" PRIu64, user->tenant_id, user->id);
+    else
+        fprintf(file, "(%" PRIu64, user->id);
+    for (uint32_t i = 0; i < schema->num_columns; i++) {
+        fputs(", ", file);
+        write_column_value(file, &schema->columns[i], user_row_field(user, &schema->columns[i]));
+    }
+    fputs(")\n", file);
+}
@@ -2,25 +2,66 @@
 #define DB_ROW_H
 
 #include "common.h"
+#include "schema.h"
 
-#define ID_FIELD_SIZE       size_of_attribute(UserRow, id)
-#define USERNAME_FIELD_SIZE size_of_attribute(UserRow, username)
-#define EMAIL_FIELD_SIZE    size_of_attribute(UserRow, email)
+#define TENANT_ID_FIELD_SIZE    size_of_attribute(UserRow, tenant_id)
+#define ID_FIELD_SIZE           size_of_attribute(UserRow, id)
+#define VALUES_FIELD_SIZE       size_of_attribute(UserRow, values)
 
+// values holds the columns already encoded as they are stored, so
+// serializing a row is a copy of the key fields and the payload.
 typedef struct {
-    uint32_t id;
-    char     username[USERNAME_MAX_LENGTH + 1];
-    char     email[EMAIL_MAX_LENGTH + 1];
+    uint64_t tenant_id;
+    uint64_t id;
+    uint8_t  values[ROW_PAYLOAD_SIZE];
 } UserRow;
 
+#define user_row_field(row, column) ((row)->values + (column)->offset - ROW_PAYLOAD_OFFSET)
+
+// The new value is encoded when the statement is prepared and copied over
+// the field when it runs.
 typedef struct {
-    uint32_t id;
-    char     field_to_update[USERNAME_MAX_LENGTH];
-    char     new_value[EMAIL_MAX_LENGTH + 1];
+    uint64_t tenant_id;
+    uint64_t id;
+    uint32_t field_offset;
+    uint32_t field_size;
+    uint8_t  new_value[ROW_PAYLOAD_SIZE];
 } UpdatePayload;
 
+typedef struct {
+    uint64_t low_tenant_id;
+    uint64_t low_id;
+    uint64_t high_tenant_id;
+    uint64_t high_id;
+} KeyRange;
+
+typedef struct {
+    uint64_t tenant_id;
+    uint64_t id;
+} KeyLiteral;
+
+typedef struct {
+    KeyLiteral* keys;
+    uint32_t    num_keys;
+} KeyList;
+
+// One row of a multi-row insert. insert_rows sorts a batch by key, so
+// position keeps the order the rows were written in.
+typedef struct {
+    uint8_t  key[KEY_MAX_SIZE];
+    UserRow  row;
+    uint32_t position;
+    bool     inserted;      // false when the key already existed
+} BatchRow;
+
+typedef struct {
+    BatchRow* rows;
+    uint32_t  num_rows;
+} RowBatch;
+
 void serialize_user_row(UserRow* source, void* destination);
 void deserialize_user_row(void* source, UserRow* destination);
-void print_user_row(UserRow* user);
+void print_user_row(UserRow* user, const Schema* schema, KeyType key_type);
+void write_user_row(FILE* file, UserRow* user, const Schema* schema, KeyType key_type);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,347 @@
+#include "scan.h"
+
+// A run of the leaf chain of one tree, or a whole LSM tree.
+typedef struct {
+    DbTable* table;
+    uint32_t first_leaf;
+    uint32_t stop_leaf;
+    char*    output;
+    size_t   output_size;
+    uint64_t row_count;
+    bool     done;
+} ScanRange;
+
+// Workers claim ranges in order under the lock. While output is buffered
+// a worker may not claim a range more than max_ahead past the first one
+// not yet written, which caps the buffers waiting for the writer.
+typedef struct {
+    ScanRowFunction function;
+    void*           context;
+    bool            buffer_output;
+    ScanRange*      ranges;
+    uint32_t        num_ranges;
+    uint32_t        next_range;
+    uint32_t        num_written;
+    uint32_t        max_ahead;
+    pthread_mutex_t lock;
+    pthread_cond_t  range_done;
+    pthread_cond_t  range_written;
+} ScanJob;
+
+uint32_t default_scan_threads() {
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_cpus < 1)
+        return 1;
+    return num_cpus > MAX_SCAN_THREADS ? MAX_SCAN_THREADS : (uint32_t)num_cpus;
+}
+
+// Walks the leaf chain from first_leaf up to (not including) stop_leaf.
+static uint64_t scan_leaves(DbTable* table, uint32_t first_leaf, uint32_t stop_leaf, ScanRowFunction function, void* context, FILE* output) {
+    uint64_t row_count = 0;
+    uint32_t page_idx = first_leaf;
+    while (page_idx != 0 && page_idx != stop_leaf) {
+        void* node = get_page(table->db_pager, page_idx);
+        uint32_t num_cells = *leaf_node_num_cells(node);
+        for (uint32_t cell_idx = 0; cell_idx < num_cells; cell_idx++) {
+            if (leaf_node_is_tombstone(table, node, cell_idx))
+                continue;
+            if (function(table, context, output, leaf_node_key(table, node, cell_idx), leaf_node_value(table, node, cell_idx)))
+                row_count++;
+        }
+        page_idx = *leaf_node_next_leaf(node);
+    }
+
+    return row_count;
+}
+
+static uint32_t leftmost_leaf(DbTable* table, uint32_t page_idx) {
+    void* node = get_page(table->db_pager, page_idx);
+    while (get_node_type(node) == NODE_INTERNAL) {
+        page_idx = *internal_node_num_keys(node) > 0 ? *internal_node_child(table, node, 0) : *internal_node_right_child(node);
+        node = get_page(table->db_pager, page_idx);
+    }
+    return page_idx;
+}
+
+// Expands the tree level by level until there are at least `target`
+// subtrees (or the leaves are reached). Every subtree covers the key
+// range between two separator keys of its parent, and its leaves are a
+// contiguous run of the leaf chain.
+static uint32_t* collect_subtrees(DbTable* table, uint32_t target, uint32_t* num_subtrees) {
+    uint32_t count = 1;
+    uint32_t* subtrees = malloc(sizeof(uint32_t));
+    subtrees[0] = table->root_page_idx;
+
+    while (count < target && get_node_type(get_page(table->db_pager, subtrees[0])) == NODE_INTERNAL) {
+        uint32_t next_count = 0;
+        for (uint32_t i = 0; i < count; i++)
+            next_count += *internal_node_num_keys(get_page(table->db_pager, subtrees[i])) + 1;
+
+        uint32_t* children = malloc((size_t)next_count * sizeof(uint32_t));
+        uint32_t child_count = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            void* node = get_page(table->db_pager, subtrees[i]);
+            uint32_t num_keys = *internal_node_num_keys(node);
+            for (uint32_t j = 0; j < num_keys; j++)
+                children[child_count++] = *internal_node_child(table, node, j);
+            if (*internal_node_right_child(node) != INVALID_PAGE_IDX)
+                children[child_count++] = *internal_node_right_child(node);
+        }
+
+        free(subtrees);
+        subtrees = children;
+        count = child_count;
+    }
+
+    *num_subtrees = count;
+    return subtrees;
+}
+
+// LSM tables are scanned on one thread, merging the memtable and runs.
+static uint64_t lsm_scan(DbTable* table, ScanRowFunction function, void* context, FILE* output) {
+    LsmIterator iterator;
+    uint64_t row_count = 0;
+    lsm_iterator_open(table->lsm, &iterator);
+    while (lsm_iterator_next(&iterator))
+        if (function(table, context, output, iterator.key, iterator.row))
+            row_count++;
+    lsm_iterator_close(&iterator);
+    return row_count;
+}
+
+static uint64_t scan_range(ScanJob* job, ScanRange* range, FILE* output) {
+    if (range->table->lsm)
+        return lsm_scan(range->table, job->function, job->context, output);
+    return scan_leaves(range->table, range->first_leaf, range->stop_leaf, job->function, job->context, output);
+}
+
+// Returns the next range to scan, or NULL when every range is taken.
+static ScanRange* claim_range(ScanJob* job) {
+    pthread_mutex_lock(&job->lock);
+    while (job->buffer_output && job->next_range < job->num_ranges && job->next_range >= job->num_written + job->max_ahead)
+        pthread_cond_wait(&job->range_written, &job->lock);
+    ScanRange* range = job->next_range < job->num_ranges ? &job->ranges[job->next_range++] : NULL;
+    pthread_mutex_unlock(&job->lock);
+    return range;
+}
+
+static void* scan_worker_main(void* argument) {
+    ScanJob* job = argument;
+    ScanRange* range;
+    while ((range = claim_range(job)) != NULL) {
+        FILE* output = job->buffer_output ? open_memstream(&range->output, &range->output_size) : NULL;
+        range->row_count = scan_range(job, range, output);
+        if (output)
+            fclose(output);
+
+        pthread_mutex_lock(&job->lock);
+        range->done = true;
+        pthread_cond_signal(&job->range_done);
+        pthread_mutex_unlock(&job->lock);
+    }
+    return NULL;
+}
+
+// Writes each range's buffer as soon as it and every range before it
+// are done, so output starts with the first range rather than the last.
+static void write_ranges_in_order(ScanJob* job, FILE* output) {
+    for (uint32_t i = 0; i < job->num_ranges; i++) {
+        ScanRange* range = &job->ranges[i];
+        pthread_mutex_lock(&job->lock);
+        while (!range->done)
+            pthread_cond_wait(&job->range_done, &job->lock);
+        pthread_mutex_unlock(&job->lock);
+
+        if (range->output) {
+            fwrite(range->output, 1, range->output_size, output);
+            free(range->output);
+            range->output = NULL;
+        }
+
+        pthread_mutex_lock(&job->lock);
+        job->num_written = i + 1;
+        pthread_cond_broadcast(&job->range_written);
+        pthread_mutex_unlock(&job->lock);
+    }
+}
+
+// One partition's rows in key order, for merging hash partitions.
+typedef struct {
+    DbTable*       table;
+    TableCursor*   cursor;
+    LsmIterator    iterator;
+    bool           started;
+    const uint8_t* key;
+    void*          row;
+} PartitionStream;
+
+// Moves to the partition's next row. Returns false at its end.
+static bool stream_next(PartitionStream* stream) {
+    if (stream->table->lsm) {
+        if (!lsm_iterator_next(&stream->iterator))
+            return false;
+        stream->key = stream->iterator.key;
+        stream->row = stream->iterator.row;
+        return true;
+    }
+
+    if (stream->started)
+        cursor_advance(stream->cursor);
+    stream->started = true;
+    if (stream->cursor->end_of_table)
+        return false;
+    stream->key = cursor_key(stream->cursor);
+    stream->row = cursor_value(stream->cursor);
+    return true;
+}
+
+static void stream_sift_down(PartitionStream* streams, uint32_t* heap, uint32_t heap_size, uint32_t idx, uint32_t key_size) {
+    while (true) {
+        uint32_t smallest = idx, left = 2 * idx + 1, right = 2 * idx + 2;
+        if (left < heap_size && compare_keys(streams[heap[left]].key, streams[heap[smallest]].key, key_size) < 0)
+            smallest = left;
+        if (right < heap_size && compare_keys(streams[heap[right]].key, streams[heap[smallest]].key, key_size) < 0)
+            smallest = right;
+        if (smallest == idx)
+            return;
+        uint32_t swap = heap[idx];
+        heap[idx] = heap[smallest];
+        heap[smallest] = swap;
+        idx = smallest;
+    }
+}
+
+// Hash partitions each hold keys from the whole key space, so their
+// output cannot simply be concatenated. It is merged on the calling
+// thread instead, with a min-heap of partitions keyed by each
+// partition's current row.
+static uint64_t merge_partition_scans(DbTable* table, ScanRowFunction function, void* context, FILE* output) {
+    uint32_t num_partitions = table->num_partitions;
+    uint32_t key_size = table->layout.key_size;
+    PartitionStream* streams = calloc(num_partitions, sizeof(PartitionStream));
+    uint32_t* heap = malloc((size_t)num_partitions * sizeof(uint32_t));
+    uint32_t heap_size = 0;
+
+    for (uint32_t i = 0; i < num_partitions; i++) {
+        PartitionStream* stream = &streams[i];
+        stream->table = table->partitions[i];
+        if (stream->table->lsm)
+            lsm_iterator_open(stream->table->lsm, &stream->iterator);
+        else
+            stream->cursor = table_start(stream->table);
+        if (stream_next(stream))
+            heap[heap_size++] = i;
+    }
+    for (uint32_t i = heap_size / 2; i-- > 0;)
+        stream_sift_down(streams, heap, heap_size, i, key_size);
+
+    uint64_t row_count = 0;
+    while (heap_size > 0) {
+        PartitionStream* stream = &streams[heap[0]];
+        if (function(stream->table, context, output, stream->key, stream->row))
+            row_count++;
+        if (!stream_next(stream))
+            heap[0] = heap[--heap_size];
+        stream_sift_down(streams, heap, heap_size, 0, key_size);
+    }
+
+    for (uint32_t i = 0; i < num_partitions; i++) {
+        if (streams[i].table->lsm)
+            lsm_iterator_close(&streams[i].iterator);
+        else
+            free(streams[i].cursor);
+    }
+    free(heap);
+    free(streams);
+    return row_count;
+}
+
+// Appends up to `target` leaf ranges covering one tree, in key order.
+static void add_scan_ranges(ScanJob* job, DbTable* table, uint32_t target) {
+    uint32_t num_subtrees = 1;
+    uint32_t* subtrees = NULL;
+    if (!table->lsm && target > 1)
+        subtrees = collect_subtrees(table, target, &num_subtrees);
+
+    uint32_t count = num_subtrees < target ? num_subtrees : target;
+    job->ranges = realloc(job->ranges, (size_t)(job->num_ranges + count) * sizeof(ScanRange));
+    ScanRange* ranges = job->ranges + job->num_ranges;
+    memset(ranges, 0, (size_t)count * sizeof(ScanRange));
+    for (uint32_t i = 0; i < count; i++) {
+        ranges[i].table = table;
+        if (!table->lsm)
+            ranges[i].first_leaf = leftmost_leaf(table, subtrees ? subtrees[(uint64_t)i * num_subtrees / count] : table->root_page_idx);
+    }
+    for (uint32_t i = 0; i + 1 < count; i++)
+        ranges[i].stop_leaf = ranges[i + 1].first_leaf;
+    job->num_ranges += count;
+    free(subtrees);
+}
+
+// Runs `function` over every row. Large tables are split into leaf
+// ranges that are scanned by table->scan_threads workers; a partitioned
+// table contributes ranges from every partition to the same workers.
+// Each range's output is buffered and written to `output` in key order
+// while later ranges are still being scanned. Output from hash
+// partitions is merged by key instead, on one thread.
+uint64_t table_scan(DbTable* table, ScanRowFunction function, void* context, FILE* output) {
+    if (output && table->partitions && table->db_pager->header.partition_width == 0)
+        return merge_partition_scans(table, function, context, output);
+
+    uint32_t num_threads = table->scan_threads;
+    uint32_t num_trees = table_num_partitions(table);
+    uint32_t target = num_threads > 1 ? num_threads * SCAN_RANGES_PER_THREAD / num_trees : 1;
+    if (target == 0)
+        target = 1;
+
+    ScanJob job = {
+        .function = function,
+        .context = context,
+        .buffer_output = (output != NULL),
+        .ranges = NULL,
+        .num_ranges = 0,
+        .next_range = 0,
+        .num_written = 0
+    };
+    for (uint32_t i = 0; i < num_trees; i++)
+        add_scan_ranges(&job, table_partition(table, i), target);
+
+    if (job.num_ranges == 1) {
+        uint64_t row_count = scan_range(&job, &job.ranges[0], output);
+        free(job.ranges);
+        return row_count;
+    }
+
+    if (num_threads > job.num_ranges)
+        num_threads = job.num_ranges;
+    job.max_ahead = num_threads * SCAN_RANGES_AHEAD_PER_THREAD;
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.range_done, NULL);
+    pthread_cond_init(&job.range_written, NULL);
+
+    pthread_t threads[MAX_SCAN_THREADS];
+    for (uint32_t i = 0; i < num_trees; i++)
+        pager_begin_shared_read(table_partition(table, i)->db_pager);
+    for (uint32_t i = 0; i < num_threads; i++) {
+        if (pthread_create(&threads[i], NULL, scan_worker_main, &job) != 0) {
+            printf(ANSI_COLOR_RED "Unable to start scan worker\n" ANSI_COLOR_RESET);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (job.buffer_output)
+        write_ranges_in_order(&job, output);
+    for (uint32_t i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+    for (uint32_t i = 0; i < num_trees; i++)
+        pager_end_shared_read(table_partition(table, i)->db_pager);
+
+    uint64_t row_count = 0;
+    for (uint32_t i = 0; i < job.num_ranges; i++)
+        row_count += job.ranges[i].row_count;
+    pthread_cond_destroy(&job.range_written);
+    pthread_cond_destroy(&job.range_done);
+    pthread_mutex_destroy(&job.lock);
+    free(job.ranges);
+
+    return row_count;
+}
@@ -0,0 +1,18 @@
+#ifndef DB_SCAN_H
+#define DB_SCAN_H
+
+#include <pthread.h>
+#include "common.h"
+#include "pager.h"
+#include "node.h"
+#include "partition.h"
+
+// Called once per row, possibly from several threads at once. Output
+// written to `output` is emitted in key order. Returns true if the row
+// counts towards the scan's result.
+typedef bool (*ScanRowFunction)(DbTable* table, void* context, FILE* output, const uint8_t* key, void* row);
+
+uint32_t default_scan_threads();
+uint64_t table_scan(DbTable* table, ScanRowFunction function, void* context, FILE* output);
+
+#endif
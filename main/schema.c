@@ -0,0 +1,291 @@
+#include "schema.h"
+
+const char* column_type_name(ColumnType type) {
+    switch (type) {
+        case COLUMN_INT32:
+            return "int32";
+        case COLUMN_INT64:
+            return "int64";
+        case COLUMN_DOUBLE:
+            return "double";
+        case COLUMN_BOOL:
+            return "bool";
+        case COLUMN_FIXED:
+            return "fixed";
+        case COLUMN_VARCHAR:
+            return "varchar";
+    }
+    return "unknown";
+}
+
+// Parse error for a value that does not fit the column's type.
+const char* column_type_error(ColumnType type) {
+    switch (type) {
+        case COLUMN_INT32:
+            return "expected a 32-bit integer";
+        case COLUMN_INT64:
+            return "expected a 64-bit integer";
+        case COLUMN_DOUBLE:
+            return "expected a number";
+        case COLUMN_BOOL:
+            return "expected true or false";
+        case COLUMN_FIXED:
+        case COLUMN_VARCHAR:
+            return "value is too long for its column";
+    }
+    return "invalid value";
+}
+
+bool column_is_text(const Column* column) {
+    return column->type == COLUMN_FIXED || column->type == COLUMN_VARCHAR;
+}
+
+static uint32_t column_size(ColumnType type, uint32_t length) {
+    switch (type) {
+        case COLUMN_INT32:
+            return sizeof(int32_t);
+        case COLUMN_INT64:
+            return sizeof(int64_t);
+        case COLUMN_DOUBLE:
+            return sizeof(double);
+        case COLUMN_BOOL:
+            return sizeof(uint8_t);
+        case COLUMN_FIXED:
+            return length;
+        case COLUMN_VARCHAR:
+            return length + 1;
+    }
+    return 0;
+}
+
+void schema_init(Schema* schema, const char* name, uint32_t name_length) {
+    memset(schema, 0, sizeof(Schema));
+    memcpy(schema->name, name, name_length);
+}
+
+// Appends a column after the last one. Returns NULL, or why the column
+// cannot be added.
+const char* schema_add_column(Schema* schema, const char* name, uint32_t name_length, ColumnType type, uint32_t length) {
+    if (schema->num_columns == SCHEMA_MAX_COLUMNS)
+        return "too many columns";
+    if (name_length == 0 || name_length > COLUMN_NAME_MAX_LENGTH)
+        return "column names are 1 to 32 characters";
+    if ((name_length == 2 && memcmp(name, "id", 2) == 0) || (name_length == 9 && memcmp(name, "tenant_id", 9) == 0))
+        return "id and tenant_id are the key, not columns";
+    if (schema_find_column(schema, name, name_length))
+        return "duplicate column name";
+    if ((type == COLUMN_FIXED || type == COLUMN_VARCHAR) && (length == 0 || length >= ROW_PAYLOAD_SIZE))
+        return "text columns need a length of 1 to 288";
+
+    uint32_t offset = ROW_PAYLOAD_OFFSET;
+    if (schema->num_columns > 0) {
+        Column* last = &schema->columns[schema->num_columns - 1];
+        offset = last->offset + last->size;
+    }
+    uint32_t size = column_size(type, length);
+    if (offset + size > USER_ROW_SIZE)
+        return "columns do not fit in a row";
+
+    Column* column = &schema->columns[schema->num_columns++];
+    memcpy(column->name, name, name_length);
+    column->name[name_length] = '\0';
+    column->type = type;
+    column->length = (type == COLUMN_FIXED || type == COLUMN_VARCHAR) ? length : 0;
+    column->offset = offset;
+    column->size = size;
+    return NULL;
+}
+
+void schema_init_default(Schema* schema) {
+    schema_init(schema, DEFAULT_TABLE_NAME, strlen(DEFAULT_TABLE_NAME));
+    schema_add_column(schema, "username", 8, COLUMN_VARCHAR, USERNAME_MAX_LENGTH);
+    schema_add_column(schema, "email", 5, COLUMN_VARCHAR, EMAIL_MAX_LENGTH);
+}
+
+const Column* schema_find_column(const Schema* schema, const char* name, uint32_t name_length) {
+    for (uint32_t i = 0; i < schema->num_columns; i++) {
+        const Column* column = &schema->columns[i];
+        if (strlen(column->name) == name_length && memcmp(column->name, name, name_length) == 0)
+            return column;
+    }
+    return NULL;
+}
+
+void serialize_schema(const Schema* schema, void* destination) {
+    uint8_t* page = destination;
+    uint32_t version = CATALOG_VERSION;
+    memset(page, 0, CATALOG_HEADER_SIZE + SCHEMA_MAX_COLUMNS * CATALOG_COLUMN_SIZE);
+    memcpy(page, CATALOG_MAGIC, 8);
+    memcpy(page + 8, &version, sizeof(uint32_t));
+    memcpy(page + 12, &schema->num_columns, sizeof(uint32_t));
+    memcpy(page + 16, schema->name, strlen(schema->name));
+
+    for (uint32_t i = 0; i < schema->num_columns; i++) {
+        const Column* column = &schema->columns[i];
+        uint8_t* entry = page + CATALOG_HEADER_SIZE + i * CATALOG_COLUMN_SIZE;
+        uint32_t type = column->type;
+        memcpy(entry, column->name, strlen(column->name));
+        memcpy(entry + COLUMN_NAME_MAX_LENGTH, &type, sizeof(uint32_t));
+        memcpy(entry + COLUMN_NAME_MAX_LENGTH + sizeof(uint32_t), &column->length, sizeof(uint32_t));
+    }
+}
+
+// Rebuilds the offsets from the stored column list, rejecting anything
+// serialize_schema could not have written.
+bool deserialize_schema(const void* source, Schema* destination) {
+    const uint8_t* page = source;
+    uint32_t version, num_columns;
+    if (memcmp(page, CATALOG_MAGIC, 8) != 0)
+        return false;
+    memcpy(&version, page + 8, sizeof(uint32_t));
+    memcpy(&num_columns, page + 12, sizeof(uint32_t));
+    if (version != CATALOG_VERSION || num_columns == 0 || num_columns > SCHEMA_MAX_COLUMNS)
+        return false;
+
+    schema_init(destination, (const char*)page + 16, (uint32_t)strnlen((const char*)page + 16, TABLE_NAME_MAX_LENGTH));
+    for (uint32_t i = 0; i < num_columns; i++) {
+        const uint8_t* entry = page + CATALOG_HEADER_SIZE + i * CATALOG_COLUMN_SIZE;
+        uint32_t type, length;
+        memcpy(&type, entry + COLUMN_NAME_MAX_LENGTH, sizeof(uint32_t));
+        memcpy(&length, entry + COLUMN_NAME_MAX_LENGTH + sizeof(uint32_t), sizeof(uint32_t));
+        if (type > COLUMN_VARCHAR)
+            return false;
+        uint32_t name_length = (uint32_t)strnlen((const char*)entry, COLUMN_NAME_MAX_LENGTH);
+        if (schema_add_column(destination, (const char*)entry, name_length, (ColumnType)type, length))
+            return false;
+    }
+    return true;
+}
+
+// Encodes one value into its field of a serialized row. Text is copied
+// and zero-padded; numbers must use the whole token and fit the type.
+bool encode_column_value(const Column* column, const char* text, uint32_t length, void* field) {
+    char buffer[32];
+    char* end;
+    long long integer;
+    double number;
+    int32_t value32;
+    int64_t value64;
+    uint8_t flag;
+
+    if (column_is_text(column)) {
+        if (length > column->length)
+            return false;
+        memset(field, 0, column->size);
+        memcpy(field, text, length);
+        return true;
+    }
+
+    if (length == 0 || length >= sizeof(buffer))
+        return false;
+    memcpy(buffer, text, length);
+    buffer[length] = '\0';
+    errno = 0;
+    switch (column->type) {
+        case COLUMN_INT32:
+            integer = strtoll(buffer, &end, 10);
+            if (*end != '\0' || errno != 0 || integer < INT32_MIN || integer > INT32_MAX)
+                return false;
+            value32 = (int32_t)integer;
+            memcpy(field, &value32, sizeof(int32_t));
+            return true;
+        case COLUMN_INT64:
+            integer = strtoll(buffer, &end, 10);
+            if (*end != '\0' || errno != 0)
+                return false;
+            value64 = (int64_t)integer;
+            memcpy(field, &value64, sizeof(int64_t));
+            return true;
+        case COLUMN_DOUBLE:
+            number = strtod(buffer, &end);
+            if (*end != '\0' || errno != 0 || isnan(number))
+                return false;
+            if (number == 0)
+                number = 0;     // -0 would not match 0 byte for byte
+            memcpy(field, &number, sizeof(double));
+            return true;
+        case COLUMN_BOOL:
+            if (strcmp(buffer, "true") == 0 || strcmp(buffer, "1") == 0)
+                flag = 1;
+            else if (strcmp(buffer, "false") == 0 || strcmp(buffer, "0") == 0)
+                flag = 0;
+            else
+                return false;
+            memcpy(field, &flag, sizeof(uint8_t));
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Doubles are printed with the fewest digits that read back exactly.
+void write_column_value(FILE* file, const Column* column, const void* field) {
+    int32_t value32;
+    int64_t value64;
+    double number;
+    char text[32];
+
+    switch (column->type) {
+        case COLUMN_INT32:
+            memcpy(&value32, field, sizeof(int32_t));
+            fprintf(file, "%" PRId32, value32);
+            break;
+        case COLUMN_INT64:
+            memcpy(&value64, field, sizeof(int64_t));
+            fprintf(file, "%" PRId64, value64);
+            break;
+        case COLUMN_DOUBLE:
+            memcpy(&number, field, sizeof(double));
+            snprintf(text, sizeof(text), "%.15g", number);
+            if (strtod(text, NULL) != number)
+                snprintf(text, sizeof(text), "%.17g", number);
+            fputs(text, file);
+            break;
+        case COLUMN_BOOL:
+            fputs(*(const uint8_t*)field ? "true" : "false", file);
+            break;
+        case COLUMN_FIXED:
+        case COLUMN_VARCHAR:
+            fwrite(field, 1, strnlen(field, column->length), file);
+            break;
+    }
+}
+
+// Orders two fields of the same column; text compares like strcmp.
+int compare_column_values(ColumnType type, uint32_t size, const void* a, const void* b) {
+    int32_t a32, b32;
+    int64_t a64, b64;
+    double a_number, b_number;
+
+    switch (type) {
+        case COLUMN_INT32:
+            memcpy(&a32, a, sizeof(int32_t));
+            memcpy(&b32, b, sizeof(int32_t));
+            return (a32 > b32) - (a32 < b32);
+        case COLUMN_INT64:
+            memcpy(&a64, a, sizeof(int64_t));
+            memcpy(&b64, b, sizeof(int64_t));
+            return (a64 > b64) - (a64 < b64);
+        case COLUMN_DOUBLE:
+            memcpy(&a_number, a, sizeof(double));
+            memcpy(&b_number, b, sizeof(double));
+            return (a_number > b_number) - (a_number < b_number);
+        case COLUMN_BOOL:
+            return memcmp(a, b, sizeof(uint8_t));
+        case COLUMN_FIXED:
+        case COLUMN_VARCHAR:
+            return strncmp(a, b, size);
+    }
+    return 0;
+}
+
+void print_schema(const Schema* schema) {
+    printf("create table %s (", schema->name);
+    for (uint32_t i = 0; i < schema->num_columns; i++) {
+        const Column* column = &schema->columns[i];
+        printf(i == 0 ? "%s %s" : ", %s %s", column->name, column_type_name(column->type));
+        if (column_is_text(column))
+            printf("(%u)", column->length);
+    }
+    printf(")\n");
+}
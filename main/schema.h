@@ -0,0 +1,23 @@
+#ifndef DB_SCHEMA_H
+#define DB_SCHEMA_H
+
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+#include "common.h"
+
+const char*   column_type_name(ColumnType type);
+const char*   column_type_error(ColumnType type);
+bool          column_is_text(const Column* column);
+void          schema_init(Schema* schema, const char* name, uint32_t name_length);
+const char*   schema_add_column(Schema* schema, const char* name, uint32_t name_length, ColumnType type, uint32_t length);
+void          schema_init_default(Schema* schema);
+const Column* schema_find_column(const Schema* schema, const char* name, uint32_t name_length);
+void          serialize_schema(const Schema* schema, void* destination);
+bool          deserialize_schema(const void* source, Schema* destination);
+bool          encode_column_value(const Column* column, const char* text, uint32_t length, void* field);
+void          write_column_value(FILE* file, const Column* column, const void* field);
+int           compare_column_values(ColumnType type, uint32_t size, const void* a, const void* b);
+void          print_schema(const Schema* schema);
+
+#endif
@@ -0,0 +1,183 @@
+#include "sort.h"
+
+// A record is the row's primary key followed by the serialized row.
+// Ties on the sort field are broken by primary key, so output is
+// deterministic whether or not the sort spilled.
+static int compare_records(const void* a, const void* b, void* argument) {
+    SortOperator* sorter = argument;
+    const char* field_a = (const char*)a + sorter->key_size + sorter->order.field_offset;
+    const char* field_b = (const char*)b + sorter->key_size + sorter->order.field_offset;
+    int result = compare_column_values(sorter->order.field_type, sorter->order.field_size, field_a, field_b);
+    if (result != 0)
+        return sorter->order.descending ? -result : result;
+    return memcmp(a, b, sorter->key_size);
+}
+
+static uint8_t* record_at(SortOperator* sorter, size_t idx) {
+    return sorter->records + idx * sorter->record_size;
+}
+
+static void swap_records(SortOperator* sorter, size_t i, size_t j, uint8_t* scratch) {
+    memcpy(scratch, record_at(sorter, i), sorter->record_size);
+    memcpy(record_at(sorter, i), record_at(sorter, j), sorter->record_size);
+    memcpy(record_at(sorter, j), scratch, sorter->record_size);
+}
+
+// Max-heap on compare_records: the root is the row that would be emitted
+// last, i.e. the first to be displaced by a better one.
+static void heap_sift_down(SortOperator* sorter, size_t idx, uint8_t* scratch) {
+    while (true) {
+        size_t largest = idx, left = 2 * idx + 1, right = 2 * idx + 2;
+        if (left < sorter->num_records && compare_records(record_at(sorter, left), record_at(sorter, largest), sorter) > 0)
+            largest = left;
+        if (right < sorter->num_records && compare_records(record_at(sorter, right), record_at(sorter, largest), sorter) > 0)
+            largest = right;
+        if (largest == idx)
+            return;
+        swap_records(sorter, idx, largest, scratch);
+        idx = largest;
+    }
+}
+
+static void heap_sift_up(SortOperator* sorter, size_t idx, uint8_t* scratch) {
+    while (idx > 0) {
+        size_t parent = (idx - 1) / 2;
+        if (compare_records(record_at(sorter, idx), record_at(sorter, parent), sorter) <= 0)
+            return;
+        swap_records(sorter, idx, parent, scratch);
+        idx = parent;
+    }
+}
+
+static void spill_run(SortOperator* sorter) {
+    qsort_r(sorter->records, sorter->num_records, sorter->record_size, compare_records, sorter);
+
+    FILE* run = tmpfile();
+    if (!run || fwrite(sorter->records, sorter->record_size, sorter->num_records, run) != sorter->num_records) {
+        printf(ANSI_COLOR_RED "Error writing sort run to a temporary file\n" ANSI_COLOR_RESET);
+        exit(EXIT_FAILURE);
+    }
+    rewind(run);
+
+    sorter->runs = realloc(sorter->runs, (size_t)(sorter->num_runs + 1) * sizeof(FILE*));
+    sorter->runs[sorter->num_runs++] = run;
+    sorter->num_records = 0;
+}
+
+void sort_init(SortOperator* sorter, OrderBy* order, uint32_t key_size, size_t memory_budget) {
+    sorter->order = *order;
+    sorter->key_size = key_size;
+    sorter->record_size = key_size + USER_ROW_SIZE;
+    sorter->max_records = memory_budget / sorter->record_size;
+    if (sorter->max_records < 2)
+        sorter->max_records = 2;
+
+    sorter->use_heap = order->limit != NO_LIMIT && order->limit <= sorter->max_records;
+    if (sorter->use_heap)
+        sorter->max_records = order->limit;
+
+    sorter->records = malloc((sorter->max_records + 1) * sorter->record_size);
+    sorter->num_records = 0;
+    sorter->runs = NULL;
+    sorter->num_runs = 0;
+}
+
+void sort_add_row(SortOperator* sorter, const uint8_t* key, const void* row) {
+    if (sorter->max_records == 0)
+        return;
+
+    // The slot past the end doubles as scratch space for heap swaps.
+    uint8_t* scratch = record_at(sorter, sorter->max_records);
+    if (sorter->use_heap && sorter->num_records == sorter->max_records) {
+        memcpy(scratch, key, sorter->key_size);
+        memcpy(scratch + sorter->key_size, row, USER_ROW_SIZE);
+        if (compare_records(scratch, record_at(sorter, 0), sorter) >= 0)
+            return;
+        memcpy(record_at(sorter, 0), scratch, sorter->record_size);
+        heap_sift_down(sorter, 0, scratch);
+        return;
+    }
+
+    if (!sorter->use_heap && sorter->num_records == sorter->max_records)
+        spill_run(sorter);
+
+    uint8_t* record = record_at(sorter, sorter->num_records++);
+    memcpy(record, key, sorter->key_size);
+    memcpy(record + sorter->key_size, row, USER_ROW_SIZE);
+    if (sorter->use_heap)
+        heap_sift_up(sorter, sorter->num_records - 1, scratch);
+}
+
+static uint8_t* run_head(SortOperator* sorter, uint8_t* heads, uint32_t run) {
+    return heads + (size_t)run * sorter->record_size;
+}
+
+static void merge_sift_down(SortOperator* sorter, uint8_t* heads, uint32_t* heap, uint32_t heap_size, uint32_t idx) {
+    while (true) {
+        uint32_t smallest = idx, left = 2 * idx + 1, right = 2 * idx + 2;
+        if (left < heap_size && compare_records(run_head(sorter, heads, heap[left]), run_head(sorter, heads, heap[smallest]), sorter) < 0)
+            smallest = left;
+        if (right < heap_size && compare_records(run_head(sorter, heads, heap[right]), run_head(sorter, heads, heap[smallest]), sorter) < 0)
+            smallest = right;
+        if (smallest == idx)
+            return;
+        uint32_t swap = heap[idx];
+        heap[idx] = heap[smallest];
+        heap[smallest] = swap;
+        idx = smallest;
+    }
+}
+
+// Merges the spilled runs with a min-heap of run indexes keyed by each
+// run's current record.
+static uint64_t merge_runs(SortOperator* sorter, SortRowFunction function, void* context) {
+    uint32_t num_runs = sorter->num_runs;
+    uint8_t* heads = malloc((size_t)num_runs * sorter->record_size);
+    uint32_t* heap = malloc((size_t)num_runs * sizeof(uint32_t));
+    uint32_t heap_size = 0;
+
+    for (uint32_t run = 0; run < num_runs; run++) {
+        if (fread(run_head(sorter, heads, run), sorter->record_size, 1, sorter->runs[run]) == 1)
+            heap[heap_size++] = run;
+    }
+    for (uint32_t i = heap_size / 2; i-- > 0;)
+        merge_sift_down(sorter, heads, heap, heap_size, i);
+
+    uint64_t row_count = 0;
+    while (heap_size > 0 && row_count < sorter->order.limit) {
+        uint8_t* record = run_head(sorter, heads, heap[0]);
+        function(context, record, record + sorter->key_size);
+        row_count++;
+
+        if (fread(record, sorter->record_size, 1, sorter->runs[heap[0]]) != 1)
+            heap[0] = heap[--heap_size];
+        merge_sift_down(sorter, heads, heap, heap_size, 0);
+    }
+
+    free(heap);
+    free(heads);
+    return row_count;
+}
+
+uint64_t sort_finish(SortOperator* sorter, SortRowFunction function, void* context) {
+    uint64_t row_count = 0;
+    if (sorter->num_runs > 0) {
+        if (sorter->num_records > 0)
+            spill_run(sorter);
+        row_count = merge_runs(sorter, function, context);
+    }
+    else {
+        qsort_r(sorter->records, sorter->num_records, sorter->record_size, compare_records, sorter);
+        for (size_t i = 0; i < sorter->num_records && row_count < sorter->order.limit; i++) {
+            uint8_t* record = record_at(sorter, i);
+            function(context, record, record + sorter->key_size);
+            row_count++;
+        }
+    }
+
+    for (uint32_t run = 0; run < sorter->num_runs; run++)
+        fclose(sorter->runs[run]);
+    free(sorter->runs);
+    free(sorter->records);
+    return row_count;
+}
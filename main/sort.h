@@ -0,0 +1,39 @@
+#ifndef DB_SORT_H
+#define DB_SORT_H
+
+#include <stdlib.h>
+#include "common.h"
+#include "schema.h"
+
+#define NO_LIMIT UINT64_MAX
+
+typedef struct {
+    uint32_t   field_offset;
+    uint32_t   field_size;
+    ColumnType field_type;
+    bool       descending;
+    uint64_t   limit;
+} OrderBy;
+
+// Emits rows ordered by one field. With a limit that fits in the memory
+// budget it keeps a bounded heap of the best rows; otherwise it sorts
+// budget-sized runs, spills them to temp files and merges them.
+typedef struct {
+    OrderBy  order;
+    uint32_t key_size;
+    size_t   record_size;
+    uint8_t* records;
+    size_t   num_records;
+    size_t   max_records;
+    bool     use_heap;
+    FILE**   runs;
+    uint32_t num_runs;
+} SortOperator;
+
+typedef void (*SortRowFunction)(void* context, const uint8_t* key, void* row);
+
+void     sort_init(SortOperator* sorter, OrderBy* order, uint32_t key_size, size_t memory_budget);
+void     sort_add_row(SortOperator* sorter, const uint8_t* key, const void* row);
+uint64_t sort_finish(SortOperator* sorter, SortRowFunction function, void* context);
+
+#endif
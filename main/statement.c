@@ -1,153 +1,629 @@
 #include "statement.h"
 
-PrepareResult prepare_statement(InputBuffer* input_buffer, Statement* statement) {
-    if (strncmp(input_buffer->buffer, "insert", 6) == 0)
-        return prepare_insert(input_buffer, statement);
-    
-    if (strncmp(input_buffer->buffer, "select", 6) == 0) {
-        int id;
-        int args_assigned = sscanf(input_buffer->buffer, "select %d", &id);
-
-        if (args_assigned == 1) {
-            if (id < 0)
-                return PREPARE_NEGATIVE_ID;
-            statement->type = STATEMENT_SPECIFIC_SELECT;
-            statement->payload.user_to_insert.id = id;
-
-            char extra[2];
-            if (sscanf(input_buffer->buffer, "select %d %1s", &id, extra) == 2)
-                return PREPARE_SYNTAX_ERROR;
-
-            return PREPARE_SUCCESS;
-        }
-        else {
-            char extra[2];
-            if (sscanf(input_buffer->buffer, "select %1s", extra) == 1)
-                return PREPARE_SYNTAX_ERROR;
+static PrepareResult prepare_error(Lexer* lexer, Statement* statement, const char* at, PrepareResult result, const char* message) {
+    statement->error_position = lexer_offset(lexer, at);
+    statement->error_message = message;
+    return result;
+}
 
-            statement->type = STATEMENT_SELECT;
-            return PREPARE_SUCCESS;
-        }
+static PrepareResult expect_end(Lexer* lexer, Statement* statement) {
+    if (!lexer_at_end(lexer))
+        return prepare_error(lexer, statement, lexer->position, PREPARE_SYNTAX_ERROR, "unexpected input after statement");
+    return PREPARE_SUCCESS;
+}
+
+static PrepareResult parse_id(Lexer* lexer, Statement* statement, uint64_t* value) {
+    lexer_skip_whitespace(lexer);
+    const char* at = lexer->position;
+    if (*at == '-')
+        return prepare_error(lexer, statement, at, PREPARE_NEGATIVE_ID, "id must be non-negative");
+    if (!lexer_scan_uint64(lexer, value))
+        return prepare_error(lexer, statement, at, PREPARE_SYNTAX_ERROR, "expected a 64-bit id");
+    return PREPARE_SUCCESS;
+}
+
+// Parses `{id}`, `{tenant_id}:{id}` and, when is_prefix is non-NULL,
+// `{tenant_id}:*`.
+static PrepareResult parse_key(Lexer* lexer, Statement* statement, uint64_t* tenant_id, uint64_t* id, bool* is_prefix) {
+    uint64_t first;
+    PrepareResult result = parse_id(lexer, statement, &first);
+    if (result != PREPARE_SUCCESS)
+        return result;
+
+    statement->key_has_tenant = (*lexer->position == ':');
+    if (!statement->key_has_tenant) {
+        *tenant_id = 0;
+        *id = first;
+        return PREPARE_SUCCESS;
     }
 
-    if (strncmp(input_buffer->buffer, "drop", 4) == 0)
-        return prepare_drop(input_buffer, statement);
+    lexer->position++;
+    *tenant_id = first;
+    if (is_prefix && *lexer->position == '*') {
+        lexer->position++;
+        *is_prefix = true;
+        *id = 0;
+        return PREPARE_SUCCESS;
+    }
+    if (*lexer->position == ' ')
+        return prepare_error(lexer, statement, lexer->position, PREPARE_SYNTAX_ERROR, "expected an id after ':'");
 
-    if (strncmp(input_buffer->buffer, "update", 6) == 0)
-        return prepare_update(input_buffer, statement);
+    return parse_id(lexer, statement, id);
+}
 
-    if (strncmp(input_buffer->buffer, "import", 6) == 0)
-        return prepare_import(input_buffer, statement);
+// Encodes one scanned column value straight into its field.
+static PrepareResult parse_value(Lexer* lexer, Statement* statement, Token token, const Column* column, void* field) {
+    if (token.length == 0)
+        return prepare_error(lexer, statement, token.start, PREPARE_SYNTAX_ERROR, "expected a value for every column");
+    if (!encode_column_value(column, token.start, token.length, field))
+        return prepare_error(lexer, statement, token.start, column_is_text(column) ? PREPARE_STRING_TOO_LONG : PREPARE_SYNTAX_ERROR,
+                             column_type_error(column->type));
+    return PREPARE_SUCCESS;
+}
 
-    if (strncmp(input_buffer->buffer, "export", 6) == 0)
-        return prepare_export(input_buffer, statement);
+// Parses a value for every column of the schema, in order. Values are
+// separated by whitespace, or by separator when it is not '\0'. A value
+// ends at whitespace or one of delimiters, or, for CSV fields, only at
+// the separator.
+static PrepareResult parse_values(Lexer* lexer, Statement* statement, char separator, const char* delimiters, bool csv, UserRow* row) {
+    const Schema* schema = statement->schema;
+    const Column* last = &schema->columns[schema->num_columns - 1];
+    uint32_t used = last->offset + last->size - ROW_PAYLOAD_OFFSET;
+    memset(row->values + used, 0, ROW_PAYLOAD_SIZE - used);
 
-    return PREPARE_UNRECOGNIZED_STATEMENT;
+    for (uint32_t i = 0; i < schema->num_columns; i++) {
+        const Column* column = &schema->columns[i];
+        if (separator != '\0' && !lexer_accept_char(lexer, separator))
+            return prepare_error(lexer, statement, lexer->position, PREPARE_SYNTAX_ERROR, "expected ','");
+        Token token = csv ? lexer_scan_field(lexer, separator) : lexer_scan_word(lexer, delimiters);
+        PrepareResult result = parse_value(lexer, statement, token, column, user_row_field(row, column));
+        if (result != PREPARE_SUCCESS)
+            return result;
+    }
+    return PREPARE_SUCCESS;
 }
 
-PrepareResult prepare_insert(InputBuffer* input_buffer, Statement* statement) {
-    statement->type = STATEMENT_INSERT;
+static PrepareResult parse_filename(Lexer* lexer, Statement* statement, const char* message) {
+    Token token;
+    lexer_skip_whitespace(lexer);
+    const char* at = lexer->position;
+    if (!lexer_scan_quoted(lexer, &token) || token.length == 0)
+        return prepare_error(lexer, statement, at, PREPARE_SYNTAX_ERROR, message);
+    if (token.length > FILENAME_MAX_LENGTH)
+        return prepare_error(lexer, statement, token.start, PREPARE_STRING_TOO_LONG, "filename is too long");
+
+    memcpy(statement->payload.filename, token.start, token.length);
+    statement->payload.filename[token.length] = '\0';
+    return expect_end(lexer, statement);
+}
 
-    char username[USERNAME_MAX_LENGTH + 2];
-    char email[EMAIL_MAX_LENGTH + 2];
-    int id;
-
-    int chars_consumed = 0;
-    int args_assigned = sscanf(input_buffer->buffer, "insert %d %40s %260s %n", &id, username, email, &chars_consumed);
-    if (args_assigned != 3)
-        return PREPARE_SYNTAX_ERROR;
-
-    if (id < 0)
-        return PREPARE_NEGATIVE_ID;
-    if (strlen(username) > USERNAME_MAX_LENGTH)
-        return PREPARE_STRING_TOO_LONG;
-    if (strlen(email) > EMAIL_MAX_LENGTH )
-            return PREPARE_STRING_TOO_LONG;
-
-    statement->payload.user_to_insert.id = id;
-    strcpy(statement->payload.user_to_insert.username, username);
-    strcpy(statement->payload.user_to_insert.email, email);
+static PrepareResult parse_or_expression(Lexer* lexer, Statement* statement, uint32_t* node_idx);
+
+static PrepareResult new_predicate_node(Lexer* lexer, Statement* statement, PredicateNodeType type, uint32_t* node_idx) {
+    Predicate* where = &statement->where;
+    if (where->num_nodes == PREDICATE_MAX_NODES)
+        return prepare_error(lexer, statement, lexer->position, PREPARE_SYNTAX_ERROR, "too many conditions in where clause");
+
+    *node_idx = where->num_nodes++;
+    where->nodes[*node_idx].type = type;
     return PREPARE_SUCCESS;
 }
 
-PrepareResult prepare_drop(InputBuffer* input_buffer, Statement* statement) {
-    statement->type = STATEMENT_DROP;
-    int id;
-    int args_assigned = sscanf(input_buffer->buffer, "drop %d", &id);
-    if (args_assigned != 1)
-        return PREPARE_SYNTAX_ERROR;
-    if (id < 0)
-        return PREPARE_NEGATIVE_ID;
-
-    statement->payload.user_to_insert.id = id;
+// `like` patterns may start and/or end with '%'; a '%' anywhere else is
+// rejected rather than silently matched literally.
+static PrepareResult parse_like_pattern(Lexer* lexer, Statement* statement, Token token, PredicateNode* node) {
+    const char* pattern = token.start;
+    uint32_t length = token.length;
+    bool leading = length > 0 && pattern[0] == '%';
+    if (leading) {
+        pattern++;
+        length--;
+    }
+    bool trailing = length > 0 && pattern[length - 1] == '%';
+    if (trailing)
+        length--;
+    if (memchr(pattern, '%', length))
+        return prepare_error(lexer, statement, token.start, PREPARE_SYNTAX_ERROR, "only 'prefix%', '%suffix' and '%infix%' patterns are supported");
+
+    node->pattern = pattern;
+    node->pattern_length = length;
+    if (leading && trailing)
+        node->match = MATCH_CONTAINS;
+    else if (leading)
+        node->match = length == 0 ? MATCH_CONTAINS : MATCH_SUFFIX;
+    else if (trailing)
+        node->match = MATCH_PREFIX;
+    else
+        node->match = MATCH_EQUALS;
     return PREPARE_SUCCESS;
 }
 
-PrepareResult prepare_import(InputBuffer* input_buffer, Statement* statement) {
-    statement->type = STATEMENT_IMPORT;
-    char filename[FILENAME_MAX_LENGTH + 2];
-    int args_assigned = sscanf(input_buffer->buffer, "import '%255[^']'", filename);
-
-    if (args_assigned != 1) {
-        args_assigned = sscanf(input_buffer->buffer, "import %s", filename);
-        if (args_assigned == 1)
-            printf(ANSI_COLOR_RED "Syntax Error: Filename must be enclosed in single quotes (e.g., import 'file.csv').\n" ANSI_COLOR_RESET);
-        return PREPARE_SYNTAX_ERROR;
+static PrepareResult parse_column(Lexer* lexer, Statement* statement, const Column** column, const char* message) {
+    Token name = lexer_scan_identifier(lexer);
+    *column = schema_find_column(statement->schema, name.start, name.length);
+    if (!*column)
+        return prepare_error(lexer, statement, name.start, PREPARE_SYNTAX_ERROR, message);
+    return PREPARE_SUCCESS;
+}
+
+static PrepareResult parse_condition(Lexer* lexer, Statement* statement, uint32_t* node_idx) {
+    if (lexer_accept_char(lexer, '(')) {
+        PrepareResult result = parse_or_expression(lexer, statement, node_idx);
+        if (result != PREPARE_SUCCESS)
+            return result;
+        if (!lexer_accept_char(lexer, ')'))
+            return prepare_error(lexer, statement, lexer->position, PREPARE_SYNTAX_ERROR, "expected ')'");
+        return PREPARE_SUCCESS;
+    }
+
+    const Column* column;
+    PrepareResult result = parse_column(lexer, statement, &column, "expected a column name");
+    if (result != PREPARE_SUCCESS)
+        return result;
+
+    bool is_like;
+    lexer_skip_whitespace(lexer);
+    const char* at = lexer->position;
+    if (lexer_accept_char(lexer, '='))
+        is_like = false;
+    else if (lexer_accept_keyword(lexer, "like"))
+        is_like = true;
+    else
+        return prepare_error(lexer, statement, at, PREPARE_SYNTAX_ERROR, "expected '=' or 'like'");
+    if (is_like && !column_is_text(column))
+        return prepare_error(lexer, statement, at, PREPARE_SYNTAX_ERROR, "'like' needs a fixed or varchar column");
+
+    // Text values must be quoted; other values may be.
+    Token value;
+    lexer_skip_whitespace(lexer);
+    at = lexer->position;
+    if (!lexer_scan_quoted(lexer, &value)) {
+        if (column_is_text(column))
+            return prepare_error(lexer, statement, at, PREPARE_SYNTAX_ERROR, "expected a quoted value (e.g., 'x')");
+        value = lexer_scan_word(lexer, ")");
     }
 
-    if (strlen(filename) > FILENAME_MAX_LENGTH)
-        return PREPARE_STRING_TOO_LONG;
+    result = new_predicate_node(lexer, statement, PREDICATE_MATCH, node_idx);
+    if (result != PREPARE_SUCCESS)
+        return result;
+
+    PredicateNode* node = &statement->where.nodes[*node_idx];
+    node->field_offset = column->offset;
+    node->field_size = column->size;
+    if (is_like)
+        return parse_like_pattern(lexer, statement, value, node);
+    if (!column_is_text(column)) {
+        node->match = column->type == COLUMN_DOUBLE ? MATCH_DOUBLE : MATCH_VALUE;
+        if (!encode_column_value(column, value.start, value.length, node->value))
+            return prepare_error(lexer, statement, at, PREPARE_SYNTAX_ERROR, column_type_error(column->type));
+        return PREPARE_SUCCESS;
+    }
 
-    strcpy(statement->payload.filename, filename);
+    node->match = MATCH_EQUALS;
+    node->pattern = value.start;
+    node->pattern_length = value.length;
     return PREPARE_SUCCESS;
 }
 
-PrepareResult prepare_export(InputBuffer* input_buffer, Statement* statement) {
-    statement->type = STATEMENT_EXPORT;
-    char filename[FILENAME_MAX_LENGTH + 2];
-    int args_assigned = sscanf(input_buffer->buffer, "export '%255[^']'", filename);
-    
-    if (args_assigned != 1) {
-        args_assigned = sscanf(input_buffer->buffer, "export %s", filename);
-        if (args_assigned == 1)
-            printf(ANSI_COLOR_RED "Syntax Error: Filename must be enclosed in single quotes (e.g., export 'file.csv').\n" ANSI_COLOR_RESET);
-        return PREPARE_SYNTAX_ERROR;
+static PrepareResult parse_and_expression(Lexer* lexer, Statement* statement, uint32_t* node_idx) {
+    PrepareResult result = parse_condition(lexer, statement, node_idx);
+    while (result == PREPARE_SUCCESS && lexer_accept_keyword(lexer, "and")) {
+        uint32_t left = *node_idx, right;
+        result = parse_condition(lexer, statement, &right);
+        if (result == PREPARE_SUCCESS)
+            result = new_predicate_node(lexer, statement, PREDICATE_AND, node_idx);
+        if (result == PREPARE_SUCCESS) {
+            statement->where.nodes[*node_idx].left = left;
+            statement->where.nodes[*node_idx].right = right;
+        }
+    }
+    return result;
+}
+
+static PrepareResult parse_or_expression(Lexer* lexer, Statement* statement, uint32_t* node_idx) {
+    PrepareResult result = parse_and_expression(lexer, statement, node_idx);
+    while (result == PREPARE_SUCCESS && lexer_accept_keyword(lexer, "or")) {
+        uint32_t left = *node_idx, right;
+        result = parse_and_expression(lexer, statement, &right);
+        if (result == PREPARE_SUCCESS)
+            result = new_predicate_node(lexer, statement, PREDICATE_OR, node_idx);
+        if (result == PREPARE_SUCCESS) {
+            statement->where.nodes[*node_idx].left = left;
+            statement->where.nodes[*node_idx].right = right;
+        }
     }
+    return result;
+}
+
+// Parses `where {condition} [and|or {condition}]...` where a condition is
+// `{column} = '{value}'`, `{column} like '{pattern}'` or a parenthesized
+// expression. `and` binds tighter than `or`.
+static PrepareResult parse_where(Lexer* lexer, Statement* statement) {
+    statement->has_where = true;
+    statement->where.num_nodes = 0;
+    return parse_or_expression(lexer, statement, &statement->where.root);
+}
+
+// Parses `by {column} [asc|desc] [limit {n}]` after `order`.
+static PrepareResult parse_order_by(Lexer* lexer, Statement* statement) {
+    OrderBy* order = &statement->order;
+    statement->has_order = true;
+    lexer_skip_whitespace(lexer);
+    if (!lexer_accept_keyword(lexer, "by"))
+        return prepare_error(lexer, statement, lexer->position, PREPARE_SYNTAX_ERROR, "expected 'by' after 'order'");
 
-    if (strlen(filename) > FILENAME_MAX_LENGTH)
-        return PREPARE_STRING_TOO_LONG;
+    const Column* column;
+    PrepareResult result = parse_column(lexer, statement, &column, "expected a column to sort on");
+    if (result != PREPARE_SUCCESS)
+        return result;
+    order->field_offset = column->offset;
+    order->field_size = column->size;
+    order->field_type = column->type;
 
-    strcpy(statement->payload.filename, filename);
+    order->descending = false;
+    if (lexer_accept_keyword(lexer, "desc"))
+        order->descending = true;
+    else
+        lexer_accept_keyword(lexer, "asc");
+
+    order->limit = NO_LIMIT;
+    if (lexer_accept_keyword(lexer, "limit")) {
+        lexer_skip_whitespace(lexer);
+        const char* at = lexer->position;
+        if (!lexer_scan_uint64(lexer, &order->limit))
+            return prepare_error(lexer, statement, at, PREPARE_SYNTAX_ERROR, "expected a row count after 'limit'");
+    }
     return PREPARE_SUCCESS;
 }
 
-PrepareResult prepare_update(InputBuffer* input_buffer, Statement* statement) {
-    statement->type = STATEMENT_UPDATE;
+PrepareResult prepare_statement(InputBuffer* input_buffer, const Schema* schema, Statement* statement) {
+    Lexer lexer;
+    lexer_init(&lexer, input_buffer->buffer);
+    statement->text = input_buffer->buffer;
+    statement->schema = schema;
+    statement->count_only = false;
+    statement->has_where = false;
+    statement->has_order = false;
+    statement->error_message = NULL;
+    statement->error_position = 0;
+
+    if (lexer_accept_keyword(&lexer, "insert"))
+        return prepare_insert(&lexer, statement);
+    if (lexer_accept_keyword(&lexer, "select"))
+        return prepare_select(&lexer, statement);
+    if (lexer_accept_keyword(&lexer, "drop"))
+        return prepare_drop(&lexer, statement);
+    if (lexer_accept_keyword(&lexer, "update"))
+        return prepare_update(&lexer, statement);
+    if (lexer_accept_keyword(&lexer, "import"))
+        return prepare_import(&lexer, statement);
+    if (lexer_accept_keyword(&lexer, "export"))
+        return prepare_export(&lexer, statement);
+    if (lexer_accept_keyword(&lexer, "create"))
+        return prepare_create_table(&lexer, statement);
+
+    return PREPARE_UNRECOGNIZED_STATEMENT;
+}
+
+// `where id in ({key}, ...)`; the keys go into a heap array that
+// release_statement frees after execution.
+static PrepareResult prepare_select_keys(Lexer* lexer, Statement* statement) {
+    statement->type = STATEMENT_MULTI_SELECT;
+    KeyList* list = &(statement->payload.key_list);
+    list->keys = NULL;
+    list->num_keys = 0;
 
-    int id;
-    char field[USERNAME_MAX_LENGTH + 2];
-    char value[EMAIL_MAX_LENGTH + 2];
-    int args_assigned = sscanf(input_buffer->buffer, "update %d set %32[a-zA-Z]=%256[^ \n]", &id, field, value);
+    if (!lexer_accept_keyword(lexer, "in"))
+        return prepare_error(lexer, statement, lexer->position, PREPARE_SYNTAX_ERROR, "expected 'in' after 'id'");
+    if (!lexer_accept_char(lexer, '('))
+        return prepare_error(lexer, statement, lexer->position, PREPARE_SYNTAX_ERROR, "expected '(' to start the key list");
 
-    if (args_assigned != 3)
-        return PREPARE_SYNTAX_ERROR;
-    if (id < 0)
-        return PREPARE_NEGATIVE_ID;
+    uint32_t capacity = 0;
+    bool first_has_tenant = false;
+    PrepareResult result;
+    do {
+        if (list->num_keys == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            list->keys = realloc(list->keys, capacity * sizeof(KeyLiteral));
+        }
+        lexer_skip_whitespace(lexer);
+        const char* at = lexer->position;
+        KeyLiteral* key = &(list->keys[list->num_keys]);
+        result = parse_key(lexer, statement, &(key->tenant_id), &(key->id), NULL);
+        if (result != PREPARE_SUCCESS)
+            break;
+        if (list->num_keys == 0)
+            first_has_tenant = statement->key_has_tenant;
+        else if (statement->key_has_tenant != first_has_tenant) {
+            result = prepare_error(lexer, statement, at, PREPARE_SYNTAX_ERROR, "all keys must have the same form");
+            break;
+        }
+        list->num_keys++;
+    } while (lexer_accept_char(lexer, ','));
 
-    if (strcmp(field, "username") != 0 && strcmp(field, "email") != 0) {
-        printf(ANSI_COLOR_RED "Unrecognized field '%s' for update.\n" ANSI_COLOR_RESET, field);
-        printf(ANSI_COLOR_RED "Only fields 'username' & 'email' can be updated\n" ANSI_COLOR_RESET);
-        return PREPARE_SYNTAX_ERROR;
+    if (result == PREPARE_SUCCESS && !lexer_accept_char(lexer, ')'))
+        result = prepare_error(lexer, statement, lexer->position, PREPARE_SYNTAX_ERROR, "expected ')' to end the key list");
+    if (result == PREPARE_SUCCESS)
+        result = expect_end(lexer, statement);
+    if (result != PREPARE_SUCCESS)
+        release_statement(statement);
+    return result;
+}
+
+PrepareResult prepare_select(Lexer* lexer, Statement* statement) {
+    statement->type = STATEMENT_SELECT;
+    statement->count_only = lexer_accept_keyword(lexer, "count");
+    if (lexer_at_end(lexer))
+        return PREPARE_SUCCESS;
+
+    PrepareResult result;
+    bool is_scan = false;
+    if (lexer_accept_keyword(lexer, "where")) {
+        if (lexer_accept_keyword(lexer, "id"))
+            return prepare_select_keys(lexer, statement);
+        result = parse_where(lexer, statement);
+        if (result != PREPARE_SUCCESS)
+            return result;
+        is_scan = true;
+    }
+    if (!statement->count_only && lexer_accept_keyword(lexer, "order")) {
+        result = parse_order_by(lexer, statement);
+        if (result != PREPARE_SUCCESS)
+            return result;
+        is_scan = true;
     }
+    if (is_scan)
+        return expect_end(lexer, statement);
 
-    if (strcmp(field, "username") == 0 && strlen(value) > USERNAME_MAX_LENGTH)
-        return PREPARE_STRING_TOO_LONG;
-    if (strcmp(field, "email") == 0 && strlen(value) > EMAIL_MAX_LENGTH)
-        return PREPARE_STRING_TOO_LONG;
+    if (statement->count_only)
+        return prepare_error(lexer, statement, lexer->position, PREPARE_SYNTAX_ERROR, "expected 'where' or end of statement after 'count'");
+
+    UserRow* key = &(statement->payload.user_to_insert);
+    bool is_prefix = false;
+    result = parse_key(lexer, statement, &(key->tenant_id), &(key->id), &is_prefix);
+    if (result != PREPARE_SUCCESS)
+        return result;
+
+    statement->type = is_prefix ? STATEMENT_PREFIX_SELECT : STATEMENT_SPECIFIC_SELECT;
+    return expect_end(lexer, statement);
+}
 
-    statement->payload.update_payload.id = id;
-    strcpy(statement->payload.update_payload.field_to_update, field);
-    strcpy(statement->payload.update_payload.new_value, value);
+// One `({key}, {value}, ...)` tuple of `insert values`.
+static PrepareResult parse_row_tuple(Lexer* lexer, Statement* statement, UserRow* row) {
+    if (!lexer_accept_char(lexer, '('))
+        return prepare_error(lexer, statement, lexer->position, PREPARE_SYNTAX_ERROR, "expected '(' to start a row");
+    PrepareResult result = parse_key(lexer, statement, &(row->tenant_id), &(row->id), NULL);
+    if (result != PREPARE_SUCCESS)
+        return result;
 
+    result = parse_values(lexer, statement, ',', ",)", false, row);
+    if (result != PREPARE_SUCCESS)
+        return result;
+    if (!lexer_accept_char(lexer, ')'))
+        return prepare_error(lexer, statement, lexer->position, PREPARE_SYNTAX_ERROR, "expected ')' to end the row");
     return PREPARE_SUCCESS;
-}
\ No newline at end of file
+}
+
+// `insert values (..), (..), ...`. The rows are collected into a heap
+// array that release_statement frees after execution.
+static PrepareResult prepare_insert_values(Lexer* lexer, Statement* statement) {
+    statement->type = STATEMENT_INSERT_BATCH;
+    RowBatch* batch = &(statement->payload.batch);
+    batch->rows = NULL;
+    batch->num_rows = 0;
+
+    uint32_t capacity = 0;
+    bool first_has_tenant = false;
+    PrepareResult result;
+    do {
+        if (batch->num_rows == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            batch->rows = realloc(batch->rows, capacity * sizeof(BatchRow));
+        }
+        lexer_skip_whitespace(lexer);
+        const char* at = lexer->position;
+        result = parse_row_tuple(lexer, statement, &(batch->rows[batch->num_rows].row));
+        if (result != PREPARE_SUCCESS)
+            break;
+        if (batch->num_rows == 0)
+            first_has_tenant = statement->key_has_tenant;
+        else if (statement->key_has_tenant != first_has_tenant) {
+            result = prepare_error(lexer, statement, at, PREPARE_SYNTAX_ERROR, "all rows must have the same key form");
+            break;
+        }
+        batch->num_rows++;
+    } while (lexer_accept_char(lexer, ','));
+
+    if (result == PREPARE_SUCCESS)
+        result = expect_end(lexer, statement);
+    if (result != PREPARE_SUCCESS)
+        release_statement(statement);
+    return result;
+}
+
+PrepareResult prepare_insert(Lexer* lexer, Statement* statement) {
+    if (lexer_accept_keyword(lexer, "values"))
+        return prepare_insert_values(lexer, statement);
+
+    statement->type = STATEMENT_INSERT;
+    UserRow* row = &(statement->payload.user_to_insert);
+
+    PrepareResult result = parse_key(lexer, statement, &(row->tenant_id), &(row->id), NULL);
+    if (result != PREPARE_SUCCESS)
+        return result;
+
+    result = parse_values(lexer, statement, '\0', NULL, false, row);
+    if (result != PREPARE_SUCCESS)
+        return result;
+
+    return expect_end(lexer, statement);
+}
+
+// `drop where id between {key} and {key}`, bounds inclusive.
+static PrepareResult prepare_drop_range(Lexer* lexer, Statement* statement) {
+    statement->type = STATEMENT_DROP_RANGE;
+    KeyRange* range = &(statement->payload.key_range);
+
+    if (!lexer_accept_keyword(lexer, "between"))
+        return prepare_error(lexer, statement, lexer->position, PREPARE_SYNTAX_ERROR, "expected 'between' after 'id'");
+    PrepareResult result = parse_key(lexer, statement, &(range->low_tenant_id), &(range->low_id), NULL);
+    if (result != PREPARE_SUCCESS)
+        return result;
+    bool low_has_tenant = statement->key_has_tenant;
+
+    if (!lexer_accept_keyword(lexer, "and"))
+        return prepare_error(lexer, statement, lexer->position, PREPARE_SYNTAX_ERROR, "expected 'and' between the bounds");
+    const char* at = lexer->position;
+    result = parse_key(lexer, statement, &(range->high_tenant_id), &(range->high_id), NULL);
+    if (result != PREPARE_SUCCESS)
+        return result;
+    if (statement->key_has_tenant != low_has_tenant)
+        return prepare_error(lexer, statement, at, PREPARE_SYNTAX_ERROR, "both bounds must have the same key form");
+
+    return expect_end(lexer, statement);
+}
+
+PrepareResult prepare_drop(Lexer* lexer, Statement* statement) {
+    statement->type = STATEMENT_DROP;
+    UserRow* key = &(statement->payload.user_to_insert);
+
+    if (lexer_accept_keyword(lexer, "where")) {
+        if (lexer_accept_keyword(lexer, "id"))
+            return prepare_drop_range(lexer, statement);
+        PrepareResult result = parse_where(lexer, statement);
+        if (result != PREPARE_SUCCESS)
+            return result;
+        return expect_end(lexer, statement);
+    }
+
+    PrepareResult result = parse_key(lexer, statement, &(key->tenant_id), &(key->id), NULL);
+    if (result != PREPARE_SUCCESS)
+        return result;
+
+    return expect_end(lexer, statement);
+}
+
+PrepareResult prepare_import(Lexer* lexer, Statement* statement) {
+    statement->type = STATEMENT_IMPORT;
+    return parse_filename(lexer, statement, "filename must be enclosed in single quotes (e.g., import 'file.csv')");
+}
+
+PrepareResult prepare_export(Lexer* lexer, Statement* statement) {
+    statement->type = STATEMENT_EXPORT;
+    return parse_filename(lexer, statement, "filename must be enclosed in single quotes (e.g., export 'file.csv')");
+}
+
+// `create table {name} ({column} {type}, ...)` where a type is int32,
+// int64, double, bool, fixed({n}) or varchar({n}).
+PrepareResult prepare_create_table(Lexer* lexer, Statement* statement) {
+    statement->type = STATEMENT_CREATE_TABLE;
+    Schema* schema = &(statement->payload.schema);
+    if (!lexer_accept_keyword(lexer, "table"))
+        return prepare_error(lexer, statement, lexer->position, PREPARE_SYNTAX_ERROR, "expected 'table' after 'create'");
+
+    Token name = lexer_scan_identifier(lexer);
+    if (name.length == 0 || name.length > TABLE_NAME_MAX_LENGTH)
+        return prepare_error(lexer, statement, name.start, PREPARE_SYNTAX_ERROR, "expected a table name of at most 32 characters");
+    schema_init(schema, name.start, name.length);
+    if (!lexer_accept_char(lexer, '('))
+        return prepare_error(lexer, statement, lexer->position, PREPARE_SYNTAX_ERROR, "expected '(' to start the column list");
+
+    do {
+        Token column = lexer_scan_identifier(lexer);
+        Token type_name = lexer_scan_identifier(lexer);
+        uint32_t type = COLUMN_INT32;
+        while (type <= COLUMN_VARCHAR && !token_equals(type_name, column_type_name((ColumnType)type)))
+            type++;
+        if (type > COLUMN_VARCHAR)
+            return prepare_error(lexer, statement, type_name.start, PREPARE_SYNTAX_ERROR, "expected int32, int64, double, bool, fixed(n) or varchar(n)");
+
+        uint64_t length = 0;
+        if ((type == COLUMN_FIXED || type == COLUMN_VARCHAR) &&
+            (!lexer_accept_char(lexer, '(') || !lexer_scan_uint64(lexer, &length) || length > UINT32_MAX || !lexer_accept_char(lexer, ')')))
+            return prepare_error(lexer, statement, type_name.start, PREPARE_SYNTAX_ERROR, "fixed and varchar need a length (e.g., varchar(32))");
+
+        const char* error = schema_add_column(schema, column.start, column.length, (ColumnType)type, (uint32_t)length);
+        if (error)
+            return prepare_error(lexer, statement, column.start, PREPARE_SYNTAX_ERROR, error);
+    } while (lexer_accept_char(lexer, ','));
+
+    if (!lexer_accept_char(lexer, ')'))
+        return prepare_error(lexer, statement, lexer->position, PREPARE_SYNTAX_ERROR, "expected ')' to end the column list");
+    return expect_end(lexer, statement);
+}
+
+PrepareResult prepare_update(Lexer* lexer, Statement* statement) {
+    statement->type = STATEMENT_UPDATE;
+    UpdatePayload* update = &(statement->payload.update_payload);
+
+    PrepareResult result;
+    if (lexer_accept_keyword(lexer, "where"))
+        result = parse_where(lexer, statement);
+    else
+        result = parse_key(lexer, statement, &(update->tenant_id), &(update->id), NULL);
+    if (result != PREPARE_SUCCESS)
+        return result;
+
+    lexer_skip_whitespace(lexer);
+    if (!lexer_accept_keyword(lexer, "set"))
+        return prepare_error(lexer, statement, lexer->position, PREPARE_SYNTAX_ERROR, "expected 'set'");
+
+    const Column* column;
+    result = parse_column(lexer, statement, &column, "expected a column to update");
+    if (result != PREPARE_SUCCESS)
+        return result;
+    update->field_offset = column->offset;
+    update->field_size = column->size;
+
+    const char* at = lexer->position;
+    if (!lexer_accept_char(lexer, '='))
+        return prepare_error(lexer, statement, at, PREPARE_SYNTAX_ERROR, "expected '=' after column name");
+
+    result = parse_value(lexer, statement, lexer_scan_word(lexer, NULL), column, update->new_value);
+    if (result != PREPARE_SUCCESS)
+        return result;
+
+    return expect_end(lexer, statement);
+}
+
+PrepareResult parse_csv_row(const char* line, const Schema* schema, Statement* statement) {
+    Lexer lexer;
+    lexer_init(&lexer, line);
+    UserRow* row = &(statement->payload.user_to_insert);
+    statement->type = STATEMENT_INSERT;
+    statement->text = line;
+    statement->schema = schema;
+    statement->count_only = false;
+    statement->has_where = false;
+    statement->has_order = false;
+
+    PrepareResult result = parse_key(&lexer, statement, &(row->tenant_id), &(row->id), NULL);
+    if (result != PREPARE_SUCCESS)
+        return result;
+
+    result = parse_values(&lexer, statement, ',', NULL, true, row);
+    if (result != PREPARE_SUCCESS)
+        return result;
+
+    return expect_end(&lexer, statement);
+}
+
+void release_statement(Statement* statement) {
+    if (statement->type == STATEMENT_INSERT_BATCH) {
+        free(statement->payload.batch.rows);
+        statement->payload.batch.rows = NULL;
+    }
+    else if (statement->type == STATEMENT_MULTI_SELECT) {
+        free(statement->payload.key_list.keys);
+        statement->payload.key_list.keys = NULL;
+    }
+}
+
+void print_prepare_error(InputBuffer* input_buffer, Statement* statement) {
+    if (!statement->error_message)
+        return;
+
+    printf(ANSI_COLOR_RED "%s\n" ANSI_COLOR_RESET, input_buffer->buffer);
+    printf(ANSI_COLOR_RED "%*s^ at position %u: %s\n" ANSI_COLOR_RESET,
+           (int)statement->error_position, "", statement->error_position + 1, statement->error_message);
+}
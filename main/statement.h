@@ -3,22 +3,45 @@
 
 #include "common.h"
 #include "input.h"
+#include "lexer.h"
 #include "row.h"
+#include "schema.h"
+#include "predicate.h"
+#include "sort.h"
 
 typedef struct {
     StatementType type;
+    const char*   text;
+    const Schema* schema;
+    bool          key_has_tenant;
+    const char*   error_message;
+    uint32_t      error_position;
+    bool          count_only;
+    bool          has_where;
+    Predicate     where;
+    bool          has_order;
+    OrderBy       order;
     union {
         UserRow       user_to_insert;
         char          filename[FILENAME_MAX_LENGTH + 1];
         UpdatePayload update_payload;
+        KeyRange      key_range;
+        RowBatch      batch;
+        KeyList       key_list;
+        Schema        schema;
     } payload;
 } Statement;
 
-PrepareResult prepare_statement(InputBuffer* input_buffer, Statement* statement);
-PrepareResult prepare_insert(InputBuffer* input_buffer, Statement* statement);
-PrepareResult prepare_drop(InputBuffer* input_buffer, Statement* statement);
-PrepareResult prepare_import(InputBuffer* input_buffer, Statement* statement);
-PrepareResult prepare_export(InputBuffer* input_buffer, Statement* statement);
-PrepareResult prepare_update(InputBuffer* input_buffer, Statement* statement);
+PrepareResult prepare_statement(InputBuffer* input_buffer, const Schema* schema, Statement* statement);
+PrepareResult prepare_select(Lexer* lexer, Statement* statement);
+PrepareResult prepare_insert(Lexer* lexer, Statement* statement);
+PrepareResult prepare_drop(Lexer* lexer, Statement* statement);
+PrepareResult prepare_import(Lexer* lexer, Statement* statement);
+PrepareResult prepare_export(Lexer* lexer, Statement* statement);
+PrepareResult prepare_update(Lexer* lexer, Statement* statement);
+PrepareResult prepare_create_table(Lexer* lexer, Statement* statement);
+PrepareResult parse_csv_row(const char* line, const Schema* schema, Statement* statement);
+void          release_statement(Statement* statement);
+void          print_prepare_error(InputBuffer* input_buffer, Statement* statement);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,192 @@
+#include "stats.h"
+
+static uint64_t timespec_diff_ns(struct timespec start, struct timespec end) {
+    return (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000ULL + (uint64_t)(end.tv_nsec - start.tv_nsec);
+}
+
+StatementStats* stats_open() {
+    StatementStats* stats = calloc(1, sizeof(StatementStats));
+    stats->timer_enabled = false;
+    stats->slow_log = NULL;
+    stats_reset_histograms(stats);
+    return stats;
+}
+
+void stats_close(StatementStats* stats) {
+    stats_close_slow_log(stats);
+    free(stats);
+}
+
+const char* statement_type_name(StatementType type) {
+    switch (type) {
+        case STATEMENT_INSERT:
+            return "insert";
+        case STATEMENT_INSERT_BATCH:
+            return "insert_batch";
+        case STATEMENT_SELECT:
+            return "select";
+        case STATEMENT_SPECIFIC_SELECT:
+            return "select_key";
+        case STATEMENT_PREFIX_SELECT:
+            return "select_prefix";
+        case STATEMENT_MULTI_SELECT:
+            return "select_in";
+        case STATEMENT_DROP:
+            return "drop";
+        case STATEMENT_DROP_RANGE:
+            return "drop_range";
+        case STATEMENT_IMPORT:
+            return "import";
+        case STATEMENT_EXPORT:
+            return "export";
+        case STATEMENT_UPDATE:
+            return "update";
+        case STATEMENT_CREATE_TABLE:
+            return "create_table";
+    }
+    return "unknown";
+}
+
+static uint32_t histogram_bucket(uint64_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS)
+        return (uint32_t)value;
+
+    uint32_t exponent = 63 - (uint32_t)__builtin_clzll(value);
+    if (exponent > HISTOGRAM_MAX_EXPONENT)
+        return HISTOGRAM_BUCKETS - 1;
+
+    uint32_t shift = exponent - HISTOGRAM_SUB_BUCKET_BITS;
+    uint32_t sub_bucket = (uint32_t)(value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return HISTOGRAM_SUB_BUCKETS + shift * HISTOGRAM_SUB_BUCKETS + sub_bucket;
+}
+
+static uint64_t histogram_bucket_upper_bound(uint32_t bucket) {
+    if (bucket < HISTOGRAM_SUB_BUCKETS)
+        return bucket;
+
+    uint32_t shift = (bucket - HISTOGRAM_SUB_BUCKETS) / HISTOGRAM_SUB_BUCKETS;
+    uint32_t sub_bucket = (bucket - HISTOGRAM_SUB_BUCKETS) % HISTOGRAM_SUB_BUCKETS;
+    uint64_t lower = (uint64_t)(HISTOGRAM_SUB_BUCKETS + sub_bucket) << shift;
+    return lower + ((1ULL << shift) - 1);
+}
+
+void histogram_record(LatencyHistogram* histogram, uint64_t value) {
+    histogram->counts[histogram_bucket(value)]++;
+    histogram->total_count++;
+    if (value < histogram->min_value)
+        histogram->min_value = value;
+    if (value > histogram->max_value)
+        histogram->max_value = value;
+}
+
+uint64_t histogram_percentile(LatencyHistogram* histogram, double percentile) {
+    if (histogram->total_count == 0)
+        return 0;
+
+    uint64_t target = (uint64_t)(percentile / 100.0 * (double)histogram->total_count + 0.5);
+    if (target == 0)
+        target = 1;
+
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= target) {
+            uint64_t value = histogram_bucket_upper_bound(i);
+            return value > histogram->max_value ? histogram->max_value : value;
+        }
+    }
+
+    return histogram->max_value;
+}
+
+void stats_reset_histograms(StatementStats* stats) {
+    for (uint32_t i = 0; i < NUM_STATEMENT_TYPES; i++) {
+        memset(&stats->histograms[i], 0, sizeof(LatencyHistogram));
+        stats->histograms[i].min_value = UINT64_MAX;
+    }
+}
+
+void stats_print_histograms(StatementStats* stats) {
+    printf("%-14s %10s %10s %10s %10s %10s %10s %10s\n", "statement (us)", "count", "min", "p50", "p90", "p99", "p99.9", "max");
+    for (uint32_t i = 0; i < NUM_STATEMENT_TYPES; i++) {
+        LatencyHistogram* histogram = &stats->histograms[i];
+        if (histogram->total_count == 0)
+            continue;
+
+        printf("%-14s %10" PRIu64 " %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+               statement_type_name((StatementType)i), histogram->total_count,
+               histogram->min_value / 1000.0,
+               histogram_percentile(histogram, 50.0) / 1000.0,
+               histogram_percentile(histogram, 90.0) / 1000.0,
+               histogram_percentile(histogram, 99.0) / 1000.0,
+               histogram_percentile(histogram, 99.9) / 1000.0,
+               histogram->max_value / 1000.0);
+    }
+}
+
+bool stats_open_slow_log(StatementStats* stats, const char* filename, uint64_t threshold_ms) {
+    FILE* file = fopen(filename, "a");
+    if (!file)
+        return false;
+
+    stats_close_slow_log(stats);
+    stats->slow_log = file;
+    stats->slow_threshold_ns = threshold_ms * 1000000ULL;
+    return true;
+}
+
+void stats_close_slow_log(StatementStats* stats) {
+    if (stats->slow_log) {
+        fclose(stats->slow_log);
+        stats->slow_log = NULL;
+    }
+}
+
+// Page counts of a partitioned table include every partition.
+static void table_page_counts(DbTable* table, uint64_t* pages_read, uint64_t* pages_written, uint64_t* pages_dirtied) {
+    *pages_read = table->db_pager->pages_read;
+    *pages_written = table->db_pager->pages_written;
+    *pages_dirtied = table->db_pager->pages_dirtied;
+    for (uint32_t i = 0; i < table->num_partitions; i++) {
+        *pages_read += table->partitions[i]->db_pager->pages_read;
+        *pages_written += table->partitions[i]->db_pager->pages_written;
+        *pages_dirtied += table->partitions[i]->db_pager->pages_dirtied;
+    }
+}
+
+void stats_begin_statement(DbTable* table, StatementSample* sample) {
+    table_page_counts(table, &sample->pages_read, &sample->pages_written, &sample->pages_dirtied);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &sample->cpu_start);
+    clock_gettime(CLOCK_MONOTONIC, &sample->wall_start);
+}
+
+void stats_end_statement(DbTable* table, StatementSample* sample, Statement* statement) {
+    StatementStats* stats = table->stats;
+    struct timespec wall_end, cpu_end;
+    uint64_t pages_read, pages_written, pages_dirtied;
+    clock_gettime(CLOCK_MONOTONIC, &wall_end);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+
+    uint64_t wall_ns = timespec_diff_ns(sample->wall_start, wall_end);
+    uint64_t cpu_ns = timespec_diff_ns(sample->cpu_start, cpu_end);
+    table_page_counts(table, &pages_read, &pages_written, &pages_dirtied);
+    pages_read -= sample->pages_read;
+    pages_written -= sample->pages_written;
+    pages_dirtied -= sample->pages_dirtied;
+
+    histogram_record(&stats->histograms[statement->type], wall_ns);
+
+    if (stats->timer_enabled)
+        printf("Run Time: real %.6f cpu %.6f pages read %" PRIu64 " written %" PRIu64 " dirtied %" PRIu64 "\n",
+               wall_ns / 1e9, cpu_ns / 1e9, pages_read, pages_written, pages_dirtied);
+
+    if (stats->slow_log && wall_ns >= stats->slow_threshold_ns) {
+        char timestamp[32];
+        time_t now = time(NULL);
+        strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+        fprintf(stats->slow_log, "%s type=%s real_us=%" PRIu64 " cpu_us=%" PRIu64 " pages_read=%" PRIu64 " pages_written=%" PRIu64 " pages_dirtied=%" PRIu64 " statement=\"%s\"\n",
+                timestamp, statement_type_name(statement->type), wall_ns / 1000, cpu_ns / 1000,
+                pages_read, pages_written, pages_dirtied, statement->text ? statement->text : "");
+        fflush(stats->slow_log);
+    }
+}
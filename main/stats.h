@@ -0,0 +1,30 @@
+#ifndef DB_STATS_H
+#define DB_STATS_H
+
+#include <time.h>
+#include "common.h"
+#include "statement.h"
+
+typedef struct {
+    struct timespec wall_start;
+    struct timespec cpu_start;
+    uint64_t        pages_read;
+    uint64_t        pages_written;
+    uint64_t        pages_dirtied;
+} StatementSample;
+
+StatementStats* stats_open();
+void            stats_close(StatementStats* stats);
+const char*     statement_type_name(StatementType type);
+
+void            histogram_record(LatencyHistogram* histogram, uint64_t value);
+uint64_t        histogram_percentile(LatencyHistogram* histogram, double percentile);
+void            stats_print_histograms(StatementStats* stats);
+void            stats_reset_histograms(StatementStats* stats);
+bool            stats_open_slow_log(StatementStats* stats, const char* filename, uint64_t threshold_ms);
+void            stats_close_slow_log(StatementStats* stats);
+
+void            stats_begin_statement(DbTable* table, StatementSample* sample);
+void            stats_end_statement(DbTable* table, StatementSample* sample, Statement* statement);
+
+#endif
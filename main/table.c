@@ -1,14 +1,133 @@
 #include "table.h"
 
-DbTable* db_open(const char* db_filename) {
-    DbPager* db_pager = pager_open(db_filename);
+// Writes the schema to the table's catalog page, allocating the page the
+// first time.
+void table_write_schema(DbTable* table, const Schema* schema) {
+    DbPager* db_pager = table->db_pager;
+    if (db_pager->header.catalog_page_idx == 0)
+        db_pager->header.catalog_page_idx = get_unused_page_num(db_pager);
+    serialize_schema(schema, get_page_for_write(db_pager, db_pager->header.catalog_page_idx));
+    table->schema = *schema;
+}
+
+// Opens partition n as its own database in "<db>-part-<n>", with the key
+// type, page size and engine of the main file and an equal share of the
+// page cache. A new partition file is given the table's schema.
+static DbTable* open_partition(DbTable* table, uint32_t partition_idx) {
+    char* filename = partition_filename(table->filename, partition_idx);
+    DbTable* partition = db_open(filename, &table->partition_options);
+    if (partition->layout.key_type != table->layout.key_type || partition->partitions) {
+        printf(ANSI_COLOR_RED "Partition file '%s' does not belong to this database.\n" ANSI_COLOR_RESET, filename);
+        exit(EXIT_FAILURE);
+    }
+    if (memcmp(&partition->schema, &table->schema, sizeof(Schema)) != 0) {
+        if (!table_is_empty(partition)) {
+            printf(ANSI_COLOR_RED "Partition file '%s' has a different schema.\n" ANSI_COLOR_RESET, filename);
+            exit(EXIT_FAILURE);
+        }
+        pager_begin_write(partition->db_pager);
+        table_write_schema(partition, &table->schema);
+        pager_end_write(partition->db_pager);
+    }
+    free(filename);
+    return partition;
+}
+
+static void open_partitions(DbTable* table, DbOptions* options) {
+    DbHeader* header = &table->db_pager->header;
+    DbOptions* partition_options = &table->partition_options;
+    *partition_options = *options;
+    partition_options->key_type = (KeyType)header->key_type;
+    partition_options->engine = (StorageEngine)header->engine;
+    partition_options->page_size = header->page_size;
+    partition_options->cache_size_mb = options->cache_size_mb / header->num_partitions;
+    partition_options->num_partitions = 0;
+    partition_options->partition_width = 0;
+
+    table->num_partitions = header->num_partitions;
+    table->partitions = malloc(table->num_partitions * sizeof(DbTable*));
+    for (uint32_t i = 0; i < table->num_partitions; i++)
+        table->partitions[i] = open_partition(table, i);
+}
+
+DbTable* db_open(const char* db_filename, DbOptions* options) {
+    // A replica takes its key type from the log it follows.
+    Replica* replica = NULL;
+    if (options->replica_of)
+        replica = replica_open(options->replica_of, &options->key_type);
+
+    upgrade_legacy_file(db_filename, options);
+    DbPager* db_pager = pager_open(db_filename, options);
     DbTable* table = malloc(sizeof(DbTable));
     table->db_pager = db_pager;
-    table->root_page_idx = 0;
-    if (db_pager->num_pages == 0) {
-        void* root_node = get_page(db_pager, 0);
+    // Another process may be creating the same database.
+    if (db_pager->shared)
+        lock_begin_write(db_pager);
+    initialize_node_layout(&table->layout, (KeyType)db_pager->header.key_type, db_pager->page_size);
+    if (db_pager->header.root_page_idx == INVALID_PAGE_IDX) {
+        uint32_t root_page_idx = get_unused_page_num(db_pager);
+        void* root_node = get_page_for_write(db_pager, root_page_idx);
         initialize_leaf_node(root_node);
         set_node_root(root_node, true);
+        db_pager->header.root_page_idx = root_page_idx;
+    }
+    table->root_page_idx = db_pager->header.root_page_idx;
+    // Until create table writes a catalog page the table has the default
+    // schema.
+    uint32_t catalog_page_idx = db_pager->header.catalog_page_idx;
+    if (catalog_page_idx == 0)
+        schema_init_default(&table->schema);
+    else if (catalog_page_idx >= db_pager->num_pages || !deserialize_schema(get_page(db_pager, catalog_page_idx), &table->schema)) {
+        printf(ANSI_COLOR_RED "Catalog page %u is corrupt.\n" ANSI_COLOR_RESET, catalog_page_idx);
+        exit(EXIT_FAILURE);
+    }
+    if (db_pager->shared)
+        lock_end(db_pager);
+    table->filename = strdup(db_filename);
+    table->partitions = NULL;
+    table->num_partitions = 0;
+    if (db_pager->header.num_partitions > 0) {
+        if (db_pager->shared || db_pager->in_memory || options->replication_log || replica) {
+            printf(ANSI_COLOR_RED "A partitioned database cannot be used with --shared, :memory: or replication.\n" ANSI_COLOR_RESET);
+            exit(EXIT_FAILURE);
+        }
+        open_partitions(table, options);
+    }
+    // The log carries rows only, so both ends must use the default layout.
+    if (catalog_page_idx != 0 && (options->replication_log || replica)) {
+        printf(ANSI_COLOR_RED "Replication only supports tables with the default schema.\n" ANSI_COLOR_RESET);
+        exit(EXIT_FAILURE);
+    }
+    table->stats = stats_open();
+    table->scan_threads = options->scan_threads;
+    table->sort_memory = (size_t)options->sort_memory_mb << 20;
+    table->replication_log = NULL;
+    table->replica = replica;
+    // An LSM database keeps its rows in run files beside the database
+    // file, which holds only the header and an empty root.
+    table->lsm = NULL;
+    if (db_pager->header.engine == STORAGE_ENGINE_LSM && !table->partitions) {
+        if (db_pager->shared || db_pager->in_memory || options->replication_log || replica || options->hash_index) {
+            printf(ANSI_COLOR_RED "The lsm engine cannot be used with --shared, --hash-index, :memory: or replication.\n" ANSI_COLOR_RESET);
+            exit(EXIT_FAILURE);
+        }
+        table->lsm = lsm_open(db_filename, table->layout.key_size);
+    }
+    table->hash_index = (options->hash_index && !table->partitions) ? hash_index_open(table->layout.key_size) : NULL;
+    // Shared databases skip the hot list: other processes change pages
+    // behind this one's cache.
+    table->warm_up = (db_pager->shared || db_pager->in_memory || table->lsm || table->partitions) ? NULL : warmup_open(db_filename);
+    if (table->warm_up && options->warm_cache)
+        warmup_start(table->warm_up, db_pager);
+    if (options->replication_log)
+        table->replication_log = replication_log_open(options->replication_log, table->layout.key_type);
+    if (replica) {
+        if (table->layout.key_type != options->key_type) {
+            printf(ANSI_COLOR_RED "Replica uses %s keys but '%s' is for %s keys.\n" ANSI_COLOR_RESET,
+                   key_type_name(table->layout.key_type), options->replica_of, key_type_name(options->key_type));
+            exit(EXIT_FAILURE);
+        }
+        replica_start(replica, table);
     }
 
     return table;
@@ -16,43 +135,173 @@ DbTable* db_open(const char* db_filename) {
 
 void db_close(DbTable* table) {
     DbPager* db_pager = table->db_pager;
+    for (uint32_t i = 0; i < table->num_partitions; i++)
+        db_close(table->partitions[i]);
+    free(table->partitions);
+    if (table->warm_up)
+        warmup_stop(table->warm_up, db_pager);
+    if (table->replica) {
+        replica_stop(table->replica, db_pager);
+        replica_close(table->replica);
+    }
+    if (table->replication_log)
+        replication_log_close(table->replication_log);
+    if (table->lsm)
+        lsm_close(table->lsm);
+    pager_stop_flusher(db_pager);
+    db_begin_access(table, true);
+    db_pager->header.root_page_idx = table->root_page_idx;
+    db_end_access(table);
+    if (!db_pager->in_memory)
+        pager_flush_dirty(db_pager, 0);
+    if (table->warm_up) {
+        warmup_save(table->warm_up, db_pager);
+        warmup_close(table->warm_up);
+    }
+
+    if (table->hash_index)
+        hash_index_close(table->hash_index);
+    pager_free_pages(db_pager);
+    lock_close(db_pager);
+
+    if (!db_pager->in_memory) {
+        // Other processes may have grown a shared file since.
+        off_t expected_size = (off_t)db_pager->num_pages * db_pager->page_size;
+        if (!db_pager->shared && ftruncate(db_pager->file_descriptor, expected_size) != 0) {
+            printf(ANSI_COLOR_RED "Error truncating db file.\n" ANSI_COLOR_RESET);
+            exit(EXIT_FAILURE);
+        }
 
-    uint32_t max_page_used = 0;
-    for (uint32_t i = 0; i < MAX_PAGES; i++) {
-        if (db_pager->pages[i] != NULL) {
-            pager_flush(db_pager, i);
-            free(db_pager->pages[i]);
-            db_pager->pages[i] = NULL;
-            if (i > max_page_used)
-                max_page_used = i;
+        if (close(db_pager->file_descriptor) == -1) {
+            printf(ANSI_COLOR_RED "Error closing db file.\n" ANSI_COLOR_RESET);
+            exit(EXIT_FAILURE);
         }
     }
 
-    off_t expected_size = (max_page_used + 1) * PAGE_SIZE_BYTES;
-    if (ftruncate(db_pager->file_descriptor, expected_size) != 0) {
-        printf(ANSI_COLOR_RED "Error truncating db file.\n" ANSI_COLOR_RESET);
-        exit(EXIT_FAILURE);
+    pager_unlatch(db_pager);
+    pthread_mutex_destroy(&db_pager->latch);
+    pthread_mutex_destroy(&db_pager->page_table_lock);
+    pthread_cond_destroy(&db_pager->flusher_wakeup);
+    free(db_pager);
+    stats_close(table->stats);
+    free(table->filename);
+    free(table);
+}
+
+// The REPL holds every partition's latch along with the main one between
+// reading statements.
+void db_latch(DbTable* table) {
+    pager_latch(table->db_pager);
+    for (uint32_t i = 0; i < table->num_partitions; i++)
+        pager_latch(table->partitions[i]->db_pager);
+}
+
+void db_unlatch(DbTable* table) {
+    for (uint32_t i = 0; i < table->num_partitions; i++)
+        pager_unlatch(table->partitions[i]->db_pager);
+    pager_unlatch(table->db_pager);
+}
+
+// Empties a btree partition by replacing its file with a new one, so its
+// pages go back to the file system at once.
+bool table_truncate_partition(DbTable* table, uint32_t partition_idx) {
+    DbTable* partition = table->partitions[partition_idx];
+    if (partition->lsm) {
+        printf(ANSI_COLOR_RED "Error: Truncating a partition is not supported by the lsm engine.\n" ANSI_COLOR_RESET);
+        return false;
     }
 
-    if (close(db_pager->file_descriptor) == -1) {
-        printf(ANSI_COLOR_RED "Error closing db file.\n" ANSI_COLOR_RESET);
+    char* filename = strdup(partition->filename);
+    size_t name_length = strlen(filename) + sizeof(HOT_LIST_SUFFIX);
+    char* hot_list_filename = malloc(name_length);
+    snprintf(hot_list_filename, name_length, "%s" HOT_LIST_SUFFIX, filename);
+    db_close(partition);
+    if (unlink(filename) != 0 || (unlink(hot_list_filename) != 0 && errno != ENOENT)) {
+        printf(ANSI_COLOR_RED "Error removing '%s': %d\n" ANSI_COLOR_RESET, filename, errno);
         exit(EXIT_FAILURE);
     }
+    table->partitions[partition_idx] = open_partition(table, partition_idx);
+    free(hot_list_filename);
+    free(filename);
+    return true;
+}
 
-    free(db_pager);
-    free(table);
+// On a --shared database every statement runs under the multi-process
+// locks, and picks up a root page another process may have moved.
+void db_begin_access(DbTable* table, bool write) {
+    DbPager* db_pager = table->db_pager;
+    if (!db_pager->shared)
+        return;
+
+    if (write)
+        lock_begin_write(db_pager);
+    else
+        lock_begin_read(db_pager);
+    table->root_page_idx = db_pager->header.root_page_idx;
+}
+
+void db_end_access(DbTable* table) {
+    DbPager* db_pager = table->db_pager;
+    if (!db_pager->shared)
+        return;
+
+    db_pager->header.root_page_idx = table->root_page_idx;
+    lock_end(db_pager);
+}
+
+// True if the table holds no live rows.
+bool table_is_empty(DbTable* table) {
+    for (uint32_t i = 0; i < table->num_partitions; i++)
+        if (!table_is_empty(table->partitions[i]))
+            return false;
+    if (table->partitions)
+        return true;
+    if (table->lsm) {
+        LsmIterator iterator;
+        lsm_iterator_open(table->lsm, &iterator);
+        bool empty = !lsm_iterator_next(&iterator);
+        lsm_iterator_close(&iterator);
+        return empty;
+    }
+
+    void* root = get_page(table->db_pager, table->root_page_idx);
+    return get_node_type(root) == NODE_LEAF && *leaf_node_num_cells(root) == *leaf_node_num_tombstones(root);
 }
 
 TableCursor* table_start(DbTable* table) {
-    TableCursor* cursor = table_find(table, 0);
+    uint8_t min_key[KEY_MAX_SIZE] = {0};
+    return table_seek(table, min_key);
+}
+
+// Moves the cursor forward to the first live row at or after its
+// position, following the leaf chain.
+static void cursor_skip_deleted(TableCursor* cursor) {
+    DbTable* table = cursor->table;
     void* node = get_page(table->db_pager, cursor->page_idx);
-    uint32_t num_cells = *leaf_node_num_cells(node);
-    cursor->end_of_table = (num_cells == 0);
+    while (cursor->cell_idx >= *leaf_node_num_cells(node) || leaf_node_is_tombstone(table, node, cursor->cell_idx)) {
+        if (cursor->cell_idx < *leaf_node_num_cells(node)) {
+            cursor->cell_idx++;
+            continue;
+        }
 
+        uint32_t next_page_idx = *leaf_node_next_leaf(node);
+        if (next_page_idx == 0) {
+            cursor->end_of_table = true;
+            break;
+        }
+        cursor->page_idx = next_page_idx;
+        cursor->cell_idx = 0;
+        node = get_page(table->db_pager, next_page_idx);
+    }
+}
+
+TableCursor* table_seek(DbTable* table, const uint8_t* key) {
+    TableCursor* cursor = table_find(table, key);
+    cursor_skip_deleted(cursor);
     return cursor;
 }
 
-TableCursor* table_find(DbTable* table, uint32_t key) {
+static TableCursor* table_descend(DbTable* table, const uint8_t* key) {
     uint32_t root_page_idx = table->root_page_idx;
     void* root_node = get_page(table->db_pager, root_page_idx);
 
@@ -62,25 +311,407 @@ TableCursor* table_find(DbTable* table, uint32_t key) {
         return internal_node_find(table, root_page_idx, key);
 }
 
+// With --hash-index, a key the index places in a leaf that still holds it
+// is found with one page access. Keys are unique across live leaves, so a
+// hit is exact; anything else descends from the root and refreshes the
+// entry.
+TableCursor* table_find(DbTable* table, const uint8_t* key) {
+    HashIndex* index = table->hash_index;
+    if (!index)
+        return table_descend(table, key);
+
+    uint32_t page_idx = hash_index_lookup(index, table->db_pager, key);
+    if (page_idx != INVALID_PAGE_IDX) {
+        void* node = get_page(table->db_pager, page_idx);
+        if (get_node_type(node) == NODE_LEAF) {
+            TableCursor* cursor = leaf_node_find(table, page_idx, key);
+            if (leaf_node_has_key(table, node, cursor->cell_idx, key)) {
+                index->hits++;
+                return cursor;
+            }
+            free(cursor);
+        }
+        index->stale++;
+    }
+
+    index->misses++;
+    TableCursor* cursor = table_descend(table, key);
+    if (leaf_node_has_key(table, get_page(table->db_pager, cursor->page_idx), cursor->cell_idx, key))
+        hash_index_store(index, table->db_pager, key, cursor->page_idx);
+    else
+        hash_index_remove(index, key);
+    return cursor;
+}
+
+// Like table_find but fills a caller-owned cursor and reports the
+// tightest separator above the leaf: every key up to upper_bound routes to
+// the same leaf. Returns false when the leaf is the rightmost one and no
+// bound applies.
+bool table_find_leaf(DbTable* table, const uint8_t* key, TableCursor* cursor, uint8_t* upper_bound) {
+    uint32_t key_size = table->layout.key_size;
+    uint32_t page_idx = table->root_page_idx;
+    void* node = get_page(table->db_pager, page_idx);
+    bool bounded = false;
+
+    while (get_node_type(node) == NODE_INTERNAL) {
+        uint32_t child_index = internal_node_find_child(table, node, key);
+        if (child_index < *internal_node_num_keys(node)) {
+            uint8_t* separator = internal_node_key(table, node, child_index);
+            if (!bounded || compare_keys(separator, upper_bound, key_size) < 0)
+                memcpy(upper_bound, separator, key_size);
+            bounded = true;
+        }
+        page_idx = *internal_node_child(table, node, child_index);
+        node = get_page(table->db_pager, page_idx);
+    }
+
+    leaf_node_seek(table, page_idx, key, cursor);
+    return bounded;
+}
+
+// A run of sorted lookups whose keys all route to the same node.
+typedef struct {
+    uint32_t page_idx;
+    uint32_t first;
+    uint32_t count;
+} LookupGroup;
+
+static int compare_lookups(const void* a, const void* b) {
+    const KeyLookup* lookup_a = a;
+    const KeyLookup* lookup_b = b;
+    int cmp = memcmp(lookup_a->key, lookup_b->key, KEY_MAX_SIZE);
+    if (cmp != 0)
+        return cmp;
+    return (lookup_a->position > lookup_b->position) - (lookup_a->position < lookup_b->position);
+}
+
+void sort_key_lookups(KeyLookup* lookups, uint32_t count) {
+    qsort(lookups, count, sizeof(KeyLookup), compare_lookups);
+}
+
+// Looks up many keys at once; keys are zero-padded to KEY_MAX_SIZE. The
+// sorted keys descend one level at a time as groups that share a node, so
+// each internal node is searched once per batch rather than once per key,
+// and every page of the next level is prefetched before any is read.
+// Returns the number of keys found.
+uint32_t table_multi_get(DbTable* table, KeyLookup* lookups, uint32_t count) {
+    if (count == 0)
+        return 0;
+    uint32_t key_size = table->layout.key_size;
+    qsort(lookups, count, sizeof(KeyLookup), compare_lookups);
+
+    LookupGroup* groups = malloc(count * sizeof(LookupGroup));
+    LookupGroup* next_groups = malloc(count * sizeof(LookupGroup));
+    uint32_t* page_idxs = malloc(count * sizeof(uint32_t));
+    groups[0] = (LookupGroup){ table->root_page_idx, 0, count };
+    uint32_t num_groups = 1;
+
+    while (get_node_type(get_page(table->db_pager, groups[0].page_idx)) == NODE_INTERNAL) {
+        uint32_t num_next_groups = 0;
+        for (uint32_t g = 0; g < num_groups; g++) {
+            void* node = get_page(table->db_pager, groups[g].page_idx);
+            uint32_t num_keys = *internal_node_num_keys(node);
+            uint32_t end = groups[g].first + groups[g].count;
+            uint32_t i = groups[g].first;
+            while (i < end) {
+                uint32_t child_index = internal_node_find_child(table, node, lookups[i].key);
+                uint32_t j = i + 1;
+                if (child_index < num_keys) {
+                    uint8_t* separator = internal_node_key(table, node, child_index);
+                    while (j < end && compare_keys(lookups[j].key, separator, key_size) <= 0)
+                        j++;
+                }
+                else
+                    j = end;
+                uint32_t child_page_idx = *internal_node_child(table, node, child_index);
+                page_idxs[num_next_groups] = child_page_idx;
+                next_groups[num_next_groups++] = (LookupGroup){ child_page_idx, i, j - i };
+                i = j;
+            }
+        }
+        pager_prefetch(table->db_pager, page_idxs, num_next_groups);
+
+        LookupGroup* swap = groups;
+        groups = next_groups;
+        next_groups = swap;
+        num_groups = num_next_groups;
+    }
+
+    uint32_t found = 0;
+    TableCursor cursor;
+    for (uint32_t g = 0; g < num_groups; g++) {
+        void* node = get_page(table->db_pager, groups[g].page_idx);
+        for (uint32_t i = groups[g].first; i < groups[g].first + groups[g].count; i++) {
+            KeyLookup* lookup = &lookups[i];
+            leaf_node_seek(table, groups[g].page_idx, lookup->key, &cursor);
+            lookup->page_idx = cursor.page_idx;
+            lookup->cell_idx = cursor.cell_idx;
+            lookup->found = leaf_node_has_key(table, node, cursor.cell_idx, lookup->key);
+            if (lookup->found)
+                found++;
+        }
+    }
+
+    free(groups);
+    free(next_groups);
+    free(page_idxs);
+    return found;
+}
+
 void* cursor_value(TableCursor* cursor) {
     uint32_t page_idx = cursor->page_idx;
     void* page = get_page(cursor->table->db_pager, page_idx);
 
-    return leaf_node_value(page, cursor->cell_idx);
+    return leaf_node_value(cursor->table, page, cursor->cell_idx);
+}
+
+uint8_t* cursor_key(TableCursor* cursor) {
+    void* page = get_page(cursor->table->db_pager, cursor->page_idx);
+
+    return leaf_node_key(cursor->table, page, cursor->cell_idx);
 }
 
 void cursor_advance(TableCursor* cursor) {
+    cursor->cell_idx++;
+    cursor_skip_deleted(cursor);
+}
+
+// Compacts every leaf holding deleted rows and rebalances after each.
+// Rebalancing can free the leaf or hand it tombstones from a sibling, so
+// the walk resumes from the leaf now holding the last row it compacted.
+uint64_t table_compact(DbTable* table) {
+    uint64_t removed = 0;
+    uint8_t resume_key[KEY_MAX_SIZE] = {0};
+    TableCursor* cursor = table_find(table, resume_key);
     uint32_t page_idx = cursor->page_idx;
-    void* node = get_page(cursor->table->db_pager, page_idx);
+    free(cursor);
 
-    cursor->cell_idx++;
-    if (cursor->cell_idx >= (*leaf_node_num_cells(node))) {
-        uint32_t next_page_idx = *leaf_node_next_leaf(node);
-        if (next_page_idx == 0)
-            cursor->end_of_table = true;
-        else {
-            cursor->page_idx = next_page_idx;
-            cursor->cell_idx = 0;
+    while (page_idx != 0) {
+        void* node = get_page(table->db_pager, page_idx);
+        uint32_t num_tombstones = *leaf_node_num_tombstones(node);
+        if (num_tombstones == 0) {
+            page_idx = *leaf_node_next_leaf(node);
+            continue;
+        }
+
+        pager_mark_dirty(table->db_pager, page_idx);
+        leaf_node_compact(table, node);
+        uint32_t num_cells = *leaf_node_num_cells(node);
+        if (num_cells > 0)
+            memcpy(resume_key, leaf_node_key(table, node, num_cells - 1), table->layout.key_size);
+        adjust_tree_after_delete(table, page_idx);
+        removed += num_tombstones;
+        pager_yield(table->db_pager);
+
+        cursor = table_find(table, resume_key);
+        page_idx = cursor->page_idx;
+        free(cursor);
+    }
+
+    return removed;
+}
+
+typedef struct {
+    DbTable* table;
+    uint32_t leaf_depth;
+    uint32_t left_neighbor;     // deepest untouched subtree left of the range
+    uint32_t left_leaf;         // leaf holding the rows just below the range
+    uint32_t right_leaf;        // leaf holding the rows just above the range
+    uint64_t rows_deleted;
+    uint32_t pages_released;
+} RangeDelete;
+
+static void release_page(RangeDelete* range, uint32_t page_idx) {
+    pager_free_page(range->table->db_pager, page_idx);
+    range->pages_released++;
+}
+
+// Frees a subtree lying entirely inside the range. Leaves are released
+// by number, without being read.
+static void release_subtree(RangeDelete* range, uint32_t page_idx, uint32_t depth) {
+    DbTable* table = range->table;
+    if (depth < range->leaf_depth) {
+        void* node = get_page(table->db_pager, page_idx);
+        uint32_t num_keys = *internal_node_num_keys(node);
+        for (uint32_t i = 0; i <= num_keys; i++)
+            release_subtree(range, *internal_node_child(table, node, i), depth + 1);
+    }
+    release_page(range, page_idx);
+}
+
+static uint32_t leaf_lower_bound(DbTable* table, uint32_t page_idx, const uint8_t* key) {
+    TableCursor* cursor = leaf_node_find(table, page_idx, key);
+    uint32_t cell_idx = cursor->cell_idx;
+    free(cursor);
+    return cell_idx;
+}
+
+// Cuts the cells in the range out of a boundary leaf. Returns true if the
+// leaf is left empty.
+static bool trim_leaf(RangeDelete* range, uint32_t page_idx, const uint8_t* low, const uint8_t* high) {
+    DbTable* table = range->table;
+    NodeLayout* layout = &table->layout;
+    void* node = get_page(table->db_pager, page_idx);
+    uint32_t num_cells = *leaf_node_num_cells(node);
+    uint32_t start = low ? leaf_lower_bound(table, page_idx, low) : 0;
+    uint32_t end = num_cells;
+    if (high) {
+        end = leaf_lower_bound(table, page_idx, high);
+        if (end < num_cells && compare_keys(leaf_node_key(table, node, end), high, layout->key_size) == 0)
+            end++;
+    }
+    if (end > start)
+        pager_mark_dirty(table->db_pager, page_idx);
+
+    for (uint32_t i = start; i < end; i++) {
+        if (leaf_node_is_tombstone(table, node, i))
+            (*leaf_node_num_tombstones(node))--;
+        else
+            range->rows_deleted++;
+    }
+    memmove(leaf_node_cell(table, node, start), leaf_node_cell(table, node, end), (size_t)(num_cells - end) * layout->leaf_node_cell_size);
+    *leaf_node_num_cells(node) = num_cells - (end - start);
+
+    if (low && start > 0)
+        range->left_leaf = page_idx;
+    if (high)
+        range->right_leaf = end < num_cells ? page_idx : *leaf_node_next_leaf(node);
+    return *leaf_node_num_cells(node) == 0;
+}
+
+// Deletes the range from a subtree; a NULL bound means the range runs
+// past the subtree on that side. Only children on the low and high
+// boundaries are visited, the ones between are released whole. Returns
+// true if the subtree is left empty, for the caller to release.
+static bool delete_range(RangeDelete* range, uint32_t page_idx, uint32_t depth, const uint8_t* low, const uint8_t* high) {
+    if (depth == range->leaf_depth)
+        return trim_leaf(range, page_idx, low, high);
+
+    DbTable* table = range->table;
+    void* node = get_page(table->db_pager, page_idx);
+    uint32_t num_keys = *internal_node_num_keys(node);
+    uint32_t from = low ? internal_node_find_child(table, node, low) : 0;
+    uint32_t to = high ? internal_node_find_child(table, node, high) : num_keys;
+    if (low && from > 0)
+        range->left_neighbor = *internal_node_child(table, node, from - 1);
+
+    // Children [start, end) end up removed.
+    uint32_t start = from, end = to + 1;
+    for (uint32_t i = from; i <= to; i++) {
+        uint32_t child_page_idx = *internal_node_child(table, node, i);
+        const uint8_t* child_low = (i == from) ? low : NULL;
+        const uint8_t* child_high = (i == to) ? high : NULL;
+        if (!child_low && !child_high)
+            release_subtree(range, child_page_idx, depth + 1);
+        else if (delete_range(range, child_page_idx, depth + 1, child_low, child_high))
+            release_page(range, child_page_idx);
+        else if (i == from)
+            start = from + 1;
+        else
+            end = to;
+    }
+
+    if (start >= end)
+        return false;
+    if (start == 0 && end == num_keys + 1)
+        return true;
+    pager_mark_dirty(table->db_pager, page_idx);
+    if (end <= num_keys) {
+        memmove(internal_node_cell(table, node, start), internal_node_cell(table, node, end),
+                (size_t)(num_keys - end) * table->layout.internal_node_cell_size);
+        *internal_node_num_keys(node) = num_keys - (end - start);
+    }
+    else {
+        // The right child went; the last surviving child takes its place.
+        *internal_node_right_child(node) = *internal_node_cell(table, node, start - 1);
+        *internal_node_num_keys(node) = start - 1;
+    }
+    return false;
+}
+
+static void shrink_root(DbTable* table) {
+    void* root = get_page(table->db_pager, table->root_page_idx);
+    while (get_node_type(root) == NODE_INTERNAL && *internal_node_num_keys(root) == 0) {
+        handle_root_shrink(table);
+        root = get_page(table->db_pager, table->root_page_idx);
+    }
+}
+
+// Restores minimum fill along the path to key, top-down, so that each
+// node's parent already has a sibling to offer by the time the node is
+// fixed. A merge frees a page, so the walk then restarts from the root.
+static void rebalance_path(DbTable* table, const uint8_t* key) {
+    bool merged;
+    do {
+        merged = false;
+        shrink_root(table);
+        void* node = get_page(table->db_pager, table->root_page_idx);
+        while (!merged && get_node_type(node) == NODE_INTERNAL) {
+            uint32_t child_page_idx = *internal_node_child(table, node, internal_node_find_child(table, node, key));
+            merged = adjust_tree_after_delete(table, child_page_idx);
+            node = get_page(table->db_pager, child_page_idx);
         }
+    } while (merged);
+}
+
+static void copy_last_key(DbTable* table, uint32_t page_idx, uint8_t* key) {
+    void* node = get_page(table->db_pager, page_idx);
+    memcpy(key, leaf_node_key(table, node, *leaf_node_num_cells(node) - 1), table->layout.key_size);
+}
+
+// Deletes every row with a key in [low, high]. Subtrees inside the range
+// go to the free list without their leaves being read; only the two
+// boundary leaves are trimmed and only the paths to them rebalanced, so
+// the cost follows the tree height rather than the row count. Returns
+// the number of rows trimmed from the boundary leaves.
+uint64_t table_delete_range(DbTable* table, const uint8_t* low, const uint8_t* high, uint32_t* pages_released) {
+    RangeDelete range;
+    range.table = table;
+    range.leaf_depth = 0;
+    range.left_neighbor = 0;
+    range.left_leaf = 0;
+    range.right_leaf = 0;
+    range.rows_deleted = 0;
+    range.pages_released = 0;
+    *pages_released = 0;
+    if (compare_keys(low, high, table->layout.key_size) > 0)
+        return 0;
+
+    void* node = get_page(table->db_pager, table->root_page_idx);
+    for (; get_node_type(node) == NODE_INTERNAL; range.leaf_depth++)
+        node = get_page(table->db_pager, *internal_node_child(table, node, 0));
+
+    if (delete_range(&range, table->root_page_idx, 0, low, high)) {
+        void* root = get_page_for_write(table->db_pager, table->root_page_idx);
+        initialize_leaf_node(root);
+        set_node_root(root, true);
+        *pages_released = range.pages_released;
+        return range.rows_deleted;
     }
-}
\ No newline at end of file
+
+    // Bridge the leaf chain over the released leaves.
+    if (range.left_leaf == 0 && range.left_neighbor != 0) {
+        uint32_t page_idx = range.left_neighbor;
+        for (node = get_page(table->db_pager, page_idx); get_node_type(node) == NODE_INTERNAL; node = get_page(table->db_pager, page_idx))
+            page_idx = *internal_node_right_child(node);
+        range.left_leaf = page_idx;
+    }
+    if (range.left_leaf != 0 && range.left_leaf != range.right_leaf)
+        *leaf_node_next_leaf(get_page_for_write(table->db_pager, range.left_leaf)) = range.right_leaf;
+
+    // The rows on either side of the range stay reachable by key wherever
+    // rebalancing moves them, which pins down both boundary paths.
+    uint8_t left_key[KEY_MAX_SIZE], right_key[KEY_MAX_SIZE];
+    if (range.left_leaf != 0)
+        copy_last_key(table, range.left_leaf, left_key);
+    if (range.right_leaf != 0)
+        copy_last_key(table, range.right_leaf, right_key);
+    if (range.left_leaf != 0)
+        rebalance_path(table, left_key);
+    if (range.right_leaf != 0)
+        rebalance_path(table, right_key);
+    shrink_root(table);
+
+    *pages_released = range.pages_released;
+    return range.rows_deleted;
+}
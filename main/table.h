@@ -5,14 +5,36 @@
 #include "common.h"
 #include "pager.h"
 #include "row.h"
+#include "schema.h"
 #include "node.h"
+#include "stats.h"
+#include "replication.h"
+#include "warmup.h"
+#include "lsm.h"
+#include "hash_index.h"
+#include "partition.h"
+#include "upgrade.h"
 
-DbTable*     db_open(const char* filename);
+DbTable*     db_open(const char* filename, DbOptions* options);
 void         db_close(DbTable* table);
+void         db_latch(DbTable* table);
+void         db_unlatch(DbTable* table);
+void         db_begin_access(DbTable* table, bool write);
+void         db_end_access(DbTable* table);
+bool         table_is_empty(DbTable* table);
+void         table_write_schema(DbTable* table, const Schema* schema);
+bool         table_truncate_partition(DbTable* table, uint32_t partition_idx);
 
 TableCursor* table_start(DbTable* table);
-TableCursor* table_find(DbTable* table, uint32_t key);
+TableCursor* table_seek(DbTable* table, const uint8_t* key);
+TableCursor* table_find(DbTable* table, const uint8_t* key);
+void         sort_key_lookups(KeyLookup* lookups, uint32_t count);
+uint32_t     table_multi_get(DbTable* table, KeyLookup* lookups, uint32_t count);
+bool         table_find_leaf(DbTable* table, const uint8_t* key, TableCursor* cursor, uint8_t* upper_bound);
 void*        cursor_value(TableCursor* cursor);
+uint8_t*     cursor_key(TableCursor* cursor);
 void         cursor_advance(TableCursor* cursor);
+uint64_t     table_compact(DbTable* table);
+uint64_t     table_delete_range(DbTable* table, const uint8_t* low, const uint8_t* high, uint32_t* pages_released);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include "trace.h"
+
+static bool            tracing;
+static uint64_t        trace_start_ns;
+static TraceRing*      rings;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t   ring_key;
+static pthread_once_t  ring_key_once = PTHREAD_ONCE_INIT;
+
+static _Thread_local TraceRing* thread_ring;
+static _Thread_local uint32_t   thread_id;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static void release_ring(void* ring) {
+    __atomic_store_n(&((TraceRing*)ring)->in_use, false, __ATOMIC_RELEASE);
+}
+
+static void create_ring_key(void) {
+    pthread_key_create(&ring_key, release_ring);
+}
+
+// Runs on a thread's first event: takes the ring of a thread that has
+// exited, or allocates one. Scan workers come and go with every scan, so
+// without reuse the list would grow without bound.
+static TraceRing* acquire_ring(void) {
+    pthread_once(&ring_key_once, create_ring_key);
+    pthread_mutex_lock(&rings_lock);
+    TraceRing* ring = rings;
+    while (ring && __atomic_load_n(&ring->in_use, __ATOMIC_ACQUIRE))
+        ring = ring->next;
+    if (!ring) {
+        ring = calloc(1, sizeof(TraceRing));
+        if (!ring) {
+            pthread_mutex_unlock(&rings_lock);
+            return NULL;
+        }
+        ring->next = rings;
+        rings = ring;
+    }
+    ring->in_use = true;
+    pthread_mutex_unlock(&rings_lock);
+
+    pthread_setspecific(ring_key, ring);
+    thread_ring = ring;
+    thread_id = (uint32_t)gettid();
+    return ring;
+}
+
+// Returns the span's start time, or 0 when tracing is off so that
+// trace_end drops it.
+uint64_t trace_begin(void) {
+    if (!__atomic_load_n(&tracing, __ATOMIC_RELAXED))
+        return 0;
+    return monotonic_ns();
+}
+
+void trace_end(uint64_t start_ns, const char* name, const char* category, uint32_t page_idx) {
+    if (start_ns == 0)
+        return;
+    uint64_t end_ns = monotonic_ns();
+    TraceRing* ring = thread_ring ? thread_ring : acquire_ring();
+    if (!ring)
+        return;
+
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    TraceEvent* event = &ring->events[head & (TRACE_RING_EVENTS - 1)];
+    event->name = name;
+    event->category = category;
+    event->start_ns = start_ns;
+    event->duration_ns = end_ns - start_ns;
+    event->page_idx = page_idx;
+    event->thread_id = thread_id;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+bool trace_running(void) {
+    return __atomic_load_n(&tracing, __ATOMIC_RELAXED);
+}
+
+void trace_start(void) {
+    trace_start_ns = monotonic_ns();
+    __atomic_store_n(&tracing, true, __ATOMIC_RELAXED);
+}
+
+// Copies the ring's events recorded since tracing started into events.
+// The owner keeps writing while this runs, so head is read again after
+// the copy and any slot it may have reached meanwhile is discarded.
+static uint32_t collect_ring(TraceRing* ring, TraceEvent* events, bool* overwritten) {
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t first = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+    for (uint64_t i = first; i < head; i++)
+        events[i - first] = ring->events[i & (TRACE_RING_EVENTS - 1)];
+
+    uint64_t new_head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t valid_from = new_head + 1 > TRACE_RING_EVENTS ? new_head + 1 - TRACE_RING_EVENTS : 0;
+    uint64_t oldest = first < valid_from ? valid_from : first;
+    uint32_t count = 0;
+    for (uint64_t i = oldest; i < head; i++) {
+        if (events[i - first].start_ns < trace_start_ns)
+            continue;
+        if (count == 0 && i == oldest && i > 0)
+            *overwritten = true;    // the event before it may belong to this trace
+        events[count++] = events[i - first];
+    }
+    return count;
+}
+
+static int compare_trace_events(const void* a, const void* b) {
+    const TraceEvent* event_a = a;
+    const TraceEvent* event_b = b;
+    return (event_a->start_ns > event_b->start_ns) - (event_a->start_ns < event_b->start_ns);
+}
+
+// Writes Chrome trace-event JSON: one complete ("X") event per span,
+// with timestamps in microseconds from .trace start.
+static void write_trace_events(FILE* file, TraceEvent* events, uint64_t num_events) {
+    int pid = (int)getpid();
+    fprintf(file, "{\"traceEvents\":[");
+    for (uint64_t i = 0; i < num_events; i++) {
+        TraceEvent* event = &events[i];
+        fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u",
+                i == 0 ? "" : ",", event->name, event->category, (double)(event->start_ns - trace_start_ns) / 1000.0,
+                (double)event->duration_ns / 1000.0, pid, event->thread_id);
+        if (event->page_idx != INVALID_PAGE_IDX)
+            fprintf(file, ",\"args\":{\"page\":%u}", event->page_idx);
+        fprintf(file, "}");
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+}
+
+// Turns tracing off and writes every event recorded since trace_start,
+// in start order. overwritten is set when a ring wrapped and lost some.
+bool trace_stop(const char* filename, uint64_t* num_events, bool* overwritten) {
+    __atomic_store_n(&tracing, false, __ATOMIC_RELAXED);
+    *num_events = 0;
+    *overwritten = false;
+
+    pthread_mutex_lock(&rings_lock);
+    uint32_t num_rings = 0;
+    for (TraceRing* ring = rings; ring; ring = ring->next)
+        num_rings++;
+    TraceEvent* events = malloc(((size_t)num_rings * TRACE_RING_EVENTS + 1) * sizeof(TraceEvent));
+    if (!events) {
+        pthread_mutex_unlock(&rings_lock);
+        return false;
+    }
+    for (TraceRing* ring = rings; ring; ring = ring->next)
+        *num_events += collect_ring(ring, events + *num_events, overwritten);
+    pthread_mutex_unlock(&rings_lock);
+
+    qsort(events, *num_events, sizeof(TraceEvent), compare_trace_events);
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        free(events);
+        return false;
+    }
+    write_trace_events(file, events, *num_events);
+    bool ok = !ferror(file);
+    ok = (fclose(file) == 0) && ok;
+    free(events);
+    return ok;
+}
+
+void print_trace_status(void) {
+    uint32_t num_rings = 0;
+    pthread_mutex_lock(&rings_lock);
+    for (TraceRing* ring = rings; ring; ring = ring->next)
+        num_rings++;
+    pthread_mutex_unlock(&rings_lock);
+
+    if (trace_running())
+        printf("Tracing for %.3f s, %u thread buffers of %u events\n",
+               (double)(monotonic_ns() - trace_start_ns) / 1e9, num_rings, TRACE_RING_EVENTS);
+    else
+        printf("Tracing is off\n");
+}
@@ -0,0 +1,29 @@
+#ifndef DB_TRACE_H
+#define DB_TRACE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "common.h"
+
+// Trace points are built in with -DDB_TRACE (make TRACE=1, the default)
+// and cost one flag check while tracing is off. Built without it they
+// expand to nothing and their arguments are never evaluated.
+#ifdef DB_TRACE
+#define TRACE_BEGIN(span)                          uint64_t span = trace_begin()
+#define TRACE_END(span, name, category, page_idx)  trace_end(span, name, category, page_idx)
+#else
+#define TRACE_BEGIN(span)
+#define TRACE_END(span, name, category, page_idx)
+#endif
+
+uint64_t trace_begin(void);
+void     trace_end(uint64_t start_ns, const char* name, const char* category, uint32_t page_idx);
+bool     trace_running(void);
+void     trace_start(void);
+bool     trace_stop(const char* filename, uint64_t* num_events, bool* overwritten);
+void     print_trace_status(void);
+
+#endif
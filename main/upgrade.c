@@ -0,0 +1,220 @@
+#include "upgrade.h"
+
+// A file written before DB_VERSION_TOMBSTONES, read straight from disk
+// rather than through a pager.
+typedef struct {
+    int      file_descriptor;
+    uint32_t format_version;    // 0 for a file without a header page
+    uint32_t page_size;
+    uint32_t num_pages;
+    uint32_t root_page_idx;
+    KeyType  key_type;
+    bool     narrow;            // 32-bit keys and ids
+    uint32_t key_size;
+    uint32_t cell_size;
+    uint32_t max_cells;
+} LegacyFile;
+
+static uint32_t read_u32(const uint8_t* page, uint32_t offset) {
+    uint32_t value;
+    memcpy(&value, page + offset, sizeof(uint32_t));
+    return value;
+}
+
+static bool read_legacy_page(LegacyFile* legacy, uint32_t page_idx, uint8_t* page) {
+    if (page_idx >= legacy->num_pages)
+        return false;
+    off_t offset = (off_t)page_idx * legacy->page_size;
+    return pread(legacy->file_descriptor, page, legacy->page_size, offset) == (ssize_t)legacy->page_size;
+}
+
+// Recognizes a file that needs upgrading: one whose header predates
+// DB_VERSION_TOMBSTONES, or one with no header whose page 0 is a root
+// node, as written before the header page existed. Anything else is left
+// for pager_open to accept or reject. Returns NULL if the file is not a
+// legacy file, or why it cannot be upgraded.
+static const char* open_legacy_file(LegacyFile* legacy, bool* found) {
+    *found = false;
+    off_t file_length = lseek(legacy->file_descriptor, 0, SEEK_END);
+    if (file_length < MIN_PAGE_SIZE)
+        return NULL;
+
+    uint8_t* first_page = malloc(MIN_PAGE_SIZE);
+    bool read = pread(legacy->file_descriptor, first_page, MIN_PAGE_SIZE, 0) == MIN_PAGE_SIZE;
+    DbHeader header;
+    if (read && deserialize_db_header(first_page, &header)) {
+        *found = header.format_version < DB_VERSION_TOMBSTONES;
+        legacy->format_version = header.format_version;
+        legacy->page_size = header.page_size;
+        legacy->root_page_idx = header.root_page_idx;
+        legacy->key_type = (KeyType)header.key_type;
+        legacy->narrow = header.format_version < DB_VERSION_KEY_TYPE;
+    }
+    else if (read) {
+        *found = file_length % DEFAULT_PAGE_SIZE == 0 && first_page[NODE_TYPE_OFFSET] <= NODE_LEAF && first_page[IS_ROOT_OFFSET] == 1;
+        legacy->format_version = 0;
+        legacy->page_size = DEFAULT_PAGE_SIZE;
+        legacy->root_page_idx = 0;
+        legacy->key_type = KEY_TYPE_INT64;
+        legacy->narrow = true;
+    }
+    free(first_page);
+    if (!*found)
+        return NULL;
+
+    if (legacy->page_size < MIN_PAGE_SIZE || legacy->page_size > MAX_PAGE_SIZE || legacy->key_type > KEY_TYPE_TENANT_INT64)
+        return "its header is corrupt";
+    legacy->num_pages = (uint32_t)(file_length / legacy->page_size);
+    legacy->key_size = legacy->narrow ? LEGACY_NARROW_KEY_SIZE : key_type_size(legacy->key_type);
+    legacy->cell_size = legacy->key_size + (legacy->narrow ? LEGACY_NARROW_ROW_SIZE : USER_ROW_SIZE);
+    legacy->max_cells = (legacy->page_size - LEGACY_LEAF_NODE_HEADER_SIZE) / legacy->cell_size;
+    return NULL;
+}
+
+// Internal nodes kept their layout, so the leftmost leaf is found by
+// following the first child (or the right child of a node without keys).
+static bool read_first_leaf(LegacyFile* legacy, uint8_t* page, uint32_t* page_idx) {
+    *page_idx = legacy->root_page_idx;
+    for (uint32_t depth = 0; depth < MAX_TREE_HEIGHT; depth++) {
+        if (!read_legacy_page(legacy, *page_idx, page))
+            return false;
+        if (page[NODE_TYPE_OFFSET] == NODE_LEAF)
+            return true;
+        if (page[NODE_TYPE_OFFSET] != NODE_INTERNAL)
+            return false;
+
+        uint32_t num_keys = read_u32(page, INTERNAL_NODE_NUM_KEYS_OFFSET);
+        *page_idx = read_u32(page, num_keys > 0 ? INTERNAL_NODE_HEADER_SIZE : INTERNAL_NODE_RIGHT_CHILD_OFFSET);
+    }
+    return false;
+}
+
+static void read_legacy_row(LegacyFile* legacy, const uint8_t* value, UserRow* row) {
+    if (!legacy->narrow) {
+        deserialize_user_row((void*)value, row);
+        return;
+    }
+    row->tenant_id = 0;
+    row->id = read_u32(value, 0);
+    memcpy(row->values, value + sizeof(uint32_t), ROW_PAYLOAD_SIZE);
+}
+
+// Walks the leaf chain in key order and inserts the rows
+// IMPORT_BATCH_ROWS at a time. A chain with more leaves than the file has
+// pages loops. Returns why the rows could not be read, or NULL.
+static const char* copy_legacy_rows(LegacyFile* legacy, DbTable* table, uint64_t* rows_copied) {
+    uint8_t* page = malloc(legacy->page_size);
+    BatchRow* rows = malloc(IMPORT_BATCH_ROWS * sizeof(BatchRow));
+    uint32_t num_rows = 0;
+    uint32_t page_idx;
+    const char* error = NULL;
+    if (!read_first_leaf(legacy, page, &page_idx))
+        error = "its tree is corrupt";
+
+    for (uint32_t num_leaves = 1; !error; num_leaves++) {
+        uint32_t num_cells = read_u32(page, LEAF_NODE_NUM_CELLS_OFFSET);
+        if (page[NODE_TYPE_OFFSET] != NODE_LEAF || num_cells > legacy->max_cells || num_leaves > legacy->num_pages) {
+            error = "its tree is corrupt";
+            break;
+        }
+
+        for (uint32_t i = 0; i < num_cells; i++) {
+            BatchRow* batch_row = &rows[num_rows];
+            const uint8_t* cell = page + LEGACY_LEAF_NODE_HEADER_SIZE + i * legacy->cell_size;
+            read_legacy_row(legacy, cell + legacy->key_size, &batch_row->row);
+            memset(batch_row->key, 0, KEY_MAX_SIZE);
+            encode_key(table->layout.key_type, batch_row->row.tenant_id, batch_row->row.id, batch_row->key);
+            batch_row->position = num_rows++;
+            if (num_rows == IMPORT_BATCH_ROWS) {
+                *rows_copied += insert_rows(table, rows, num_rows);
+                num_rows = 0;
+                pager_yield(table->db_pager);
+            }
+        }
+
+        page_idx = read_u32(page, LEAF_NODE_NEXT_LEAF_OFFSET);
+        if (page_idx == 0)
+            break;
+        if (!read_legacy_page(legacy, page_idx, page))
+            error = "its tree is corrupt";
+    }
+    if (!error)
+        *rows_copied += insert_rows(table, rows, num_rows);
+
+    free(rows);
+    free(page);
+    return error;
+}
+
+// Copies the rows of a file from before DB_VERSION_TOMBSTONES into
+// "<db>-upgrade", a plain b-tree file in the current layout with the old
+// key type and page size, and swaps it in. The original file is kept as
+// "<db>-legacy". Files in the current format are left untouched.
+void upgrade_legacy_file(const char* filename, DbOptions* options) {
+    if (strcmp(filename, IN_MEMORY_DB_NAME) == 0)
+        return;
+    LegacyFile legacy = { .file_descriptor = open(filename, O_RDONLY) };
+    if (legacy.file_descriptor == -1)
+        return;
+
+    bool found;
+    const char* error = open_legacy_file(&legacy, &found);
+    if (!found) {
+        close(legacy.file_descriptor);
+        return;
+    }
+
+    size_t upgrade_length = strlen(filename) + sizeof(UPGRADE_FILE_SUFFIX);
+    size_t backup_length = strlen(filename) + sizeof(UPGRADE_BACKUP_SUFFIX);
+    size_t hot_list_length = upgrade_length + sizeof(HOT_LIST_SUFFIX);
+    char* upgrade_filename = malloc(upgrade_length);
+    char* backup_filename = malloc(backup_length);
+    char* hot_list_filename = malloc(hot_list_length);
+    snprintf(upgrade_filename, upgrade_length, "%s" UPGRADE_FILE_SUFFIX, filename);
+    snprintf(backup_filename, backup_length, "%s" UPGRADE_BACKUP_SUFFIX, filename);
+    snprintf(hot_list_filename, hot_list_length, "%s" HOT_LIST_SUFFIX, upgrade_filename);
+    uint64_t rows_copied = 0;
+    if (!error) {
+        // The caller's options apply once the upgraded file is reopened.
+        DbOptions upgrade_options = *options;
+        upgrade_options.key_type = legacy.key_type;
+        upgrade_options.engine = STORAGE_ENGINE_BTREE;
+        upgrade_options.page_size = legacy.page_size;
+        upgrade_options.direct_io = false;
+        upgrade_options.shared = false;
+        upgrade_options.warm_cache = false;
+        upgrade_options.hash_index = false;
+        upgrade_options.num_partitions = 0;
+        upgrade_options.partition_width = 0;
+        upgrade_options.replication_log = NULL;
+        upgrade_options.replica_of = NULL;
+
+        unlink(upgrade_filename);
+        DbTable* table = db_open(upgrade_filename, &upgrade_options);
+        pager_begin_write(table->db_pager);
+        error = copy_legacy_rows(&legacy, table, &rows_copied);
+        pager_end_write(table->db_pager);
+        db_close(table);
+        unlink(hot_list_filename);
+    }
+    close(legacy.file_descriptor);
+
+    if (!error && rename(filename, backup_filename) != 0)
+        error = "the original file could not be renamed";
+    else if (!error && rename(upgrade_filename, filename) != 0) {
+        rename(backup_filename, filename);
+        error = "the upgraded file could not be renamed";
+    }
+    if (error) {
+        unlink(upgrade_filename);
+        printf(ANSI_COLOR_RED "Cannot upgrade '%s' from db format version %u: %s.\n" ANSI_COLOR_RESET,
+               filename, legacy.format_version, error);
+        exit(EXIT_FAILURE);
+    }
+
+    printf(ANSI_COLOR_YELLOW "Upgraded '%s' from db format version %u to %u. Rows copied: %" PRIu64 ". The original is kept as '%s'.\n" ANSI_COLOR_RESET,
+           filename, legacy.format_version, DB_FORMAT_VERSION, rows_copied, backup_filename);
+    free(upgrade_filename);
+    free(backup_filename);
+    free(hot_list_filename);
+}
@@ -0,0 +1,16 @@
+#ifndef DB_UPGRADE_H
+#define DB_UPGRADE_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "common.h"
+#include "pager.h"
+#include "row.h"
+#include "key.h"
+#include "execution.h"
+
+void upgrade_legacy_file(const char* filename, DbOptions* options);
+
+#endif
@@ -0,0 +1,196 @@
+#include "warmup.h"
+#include "node.h"
+
+typedef struct {
+    uint32_t page_idx;
+    uint32_t score;
+} HotPage;
+
+static int compare_hot_pages(const void* a, const void* b) {
+    const HotPage* page_a = a;
+    const HotPage* page_b = b;
+    if (page_a->score != page_b->score)
+        return page_a->score < page_b->score ? 1 : -1;
+    return (page_a->page_idx > page_b->page_idx) - (page_a->page_idx < page_b->page_idx);
+}
+
+static int compare_page_numbers(const void* a, const void* b) {
+    uint32_t page_a = *(const uint32_t*)a;
+    uint32_t page_b = *(const uint32_t*)b;
+    return (page_a > page_b) - (page_a < page_b);
+}
+
+// Reads the list left by the last close. A missing file means nothing to
+// warm; a damaged one is reported and ignored.
+static void warmup_read_list(WarmUp* warm_up) {
+    FILE* file = fopen(warm_up->filename, "rb");
+    if (!file)
+        return;
+
+    uint8_t header[HOT_LIST_HEADER_SIZE];
+    uint32_t version, count;
+    struct stat list_stat;
+    if (fread(header, HOT_LIST_HEADER_SIZE, 1, file) != 1 || memcmp(header, HOT_LIST_MAGIC, 8) != 0 ||
+        fstat(fileno(file), &list_stat) != 0) {
+        printf(ANSI_COLOR_RED "Ignoring '%s': not a hot page list.\n" ANSI_COLOR_RESET, warm_up->filename);
+        fclose(file);
+        return;
+    }
+    memcpy(&version, header + 8, sizeof(uint32_t));
+    memcpy(&count, header + 12, sizeof(uint32_t));
+    if (version != HOT_LIST_VERSION || (uint64_t)list_stat.st_size != HOT_LIST_HEADER_SIZE + (uint64_t)count * sizeof(uint32_t)) {
+        printf(ANSI_COLOR_RED "Ignoring '%s': unsupported version or truncated list.\n" ANSI_COLOR_RESET, warm_up->filename);
+        fclose(file);
+        return;
+    }
+
+    warm_up->page_idxs = malloc((size_t)count * sizeof(uint32_t));
+    if (fread(warm_up->page_idxs, sizeof(uint32_t), count, file) != count) {
+        printf(ANSI_COLOR_RED "Ignoring '%s': truncated list.\n" ANSI_COLOR_RESET, warm_up->filename);
+        count = 0;
+    }
+    warm_up->num_pages = count;
+    fclose(file);
+}
+
+WarmUp* warmup_open(const char* db_filename) {
+    WarmUp* warm_up = malloc(sizeof(WarmUp));
+    size_t name_length = strlen(db_filename) + sizeof(HOT_LIST_SUFFIX);
+    warm_up->filename = malloc(name_length);
+    snprintf(warm_up->filename, name_length, "%s" HOT_LIST_SUFFIX, db_filename);
+    warm_up->page_idxs = NULL;
+    warm_up->num_pages = 0;
+    warm_up->pages_loaded = 0;
+    warm_up->db_pager = NULL;
+    warm_up->running = false;
+    warm_up->stop = false;
+    warm_up->finished = false;
+    return warm_up;
+}
+
+static void* warmup_main(void* argument) {
+    WarmUp* warm_up = argument;
+    DbPager* db_pager = warm_up->db_pager;
+    pthread_mutex_lock(&db_pager->latch);
+
+    uint32_t next = 0;
+    while (!warm_up->stop && next < warm_up->num_pages && db_pager->num_cached_pages < db_pager->cache_capacity) {
+        uint32_t batch = warm_up->num_pages - next;
+        if (batch > PAGER_READ_RUN_PAGES)
+            batch = PAGER_READ_RUN_PAGES;
+        warm_up->pages_loaded += pager_load_pages(db_pager, warm_up->page_idxs + next, batch);
+        next += batch;
+        pthread_mutex_unlock(&db_pager->latch);
+        pthread_mutex_lock(&db_pager->latch);
+    }
+    warm_up->finished = !warm_up->stop;
+
+    pthread_mutex_unlock(&db_pager->latch);
+    return NULL;
+}
+
+// Loads the saved list in the background. Called with the latch held;
+// the thread starts loading once the REPL releases it.
+void warmup_start(WarmUp* warm_up, DbPager* db_pager) {
+    warmup_read_list(warm_up);
+    if (warm_up->num_pages == 0)
+        return;
+
+    warm_up->db_pager = db_pager;
+    if (pthread_create(&warm_up->thread, NULL, warmup_main, warm_up) != 0) {
+        printf(ANSI_COLOR_RED "Unable to start the warm-up thread\n" ANSI_COLOR_RESET);
+        exit(EXIT_FAILURE);
+    }
+    warm_up->running = true;
+}
+
+// Joins the warm-up thread before db_close saves the hot list and frees
+// the frames the thread is loading pages into. Called with the latch
+// held, so stop is seen between two batches of reads and never while one
+// is being added to the cache; the latch is released for the join so the
+// thread can take it once more to finish.
+void warmup_stop(WarmUp* warm_up, DbPager* db_pager) {
+    if (!warm_up->running)
+        return;
+
+    warm_up->stop = true;
+    pthread_mutex_unlock(&db_pager->latch);
+    pthread_join(warm_up->thread, NULL);
+    pthread_mutex_lock(&db_pager->latch);
+    warm_up->running = false;
+}
+
+// Records the pages worth reloading next time: every cached internal node,
+// then the cached leaves with the most hits, up to the cache capacity. The
+// list is written sorted by page number so that warm-up reads sequentially.
+void warmup_save(WarmUp* warm_up, DbPager* db_pager) {
+    // A session closed before its warm-up finished has not seen the hot
+    // set yet; keep the list it started from.
+    if (warm_up->db_pager && !warm_up->finished)
+        return;
+
+    uint32_t limit = db_pager->num_pages < db_pager->num_page_slots ? db_pager->num_pages : db_pager->num_page_slots;
+    HotPage* candidates = malloc((size_t)db_pager->num_cached_pages * sizeof(HotPage));
+    uint32_t num_candidates = 0;
+    for (uint32_t page_idx = DB_HEADER_PAGE_IDX + 1; page_idx < limit; page_idx++) {
+        void* page = db_pager->pages[page_idx];
+        // The free list head is a trunk page, not a node.
+        if (page == NULL || page_idx == db_pager->header.free_list_head)
+            continue;
+        candidates[num_candidates].page_idx = page_idx;
+        candidates[num_candidates].score = get_node_type(page) == NODE_INTERNAL ? UINT32_MAX : db_pager->hit_counts[page_idx];
+        num_candidates++;
+    }
+
+    qsort(candidates, num_candidates, sizeof(HotPage), compare_hot_pages);
+    uint32_t count = num_candidates < db_pager->cache_capacity - 1 ? num_candidates : db_pager->cache_capacity - 1;
+    uint32_t* page_idxs = malloc((size_t)count * sizeof(uint32_t));
+    for (uint32_t i = 0; i < count; i++)
+        page_idxs[i] = candidates[i].page_idx;
+    qsort(page_idxs, count, sizeof(uint32_t), compare_page_numbers);
+    free(candidates);
+
+    // Written beside the database and renamed over the old list, so a crash
+    // leaves either list intact.
+    size_t name_length = strlen(warm_up->filename) + sizeof(".tmp");
+    char* temporary_filename = malloc(name_length);
+    snprintf(temporary_filename, name_length, "%s.tmp", warm_up->filename);
+
+    uint8_t header[HOT_LIST_HEADER_SIZE];
+    uint32_t version = HOT_LIST_VERSION;
+    memcpy(header, HOT_LIST_MAGIC, 8);
+    memcpy(header + 8, &version, sizeof(uint32_t));
+    memcpy(header + 12, &count, sizeof(uint32_t));
+
+    FILE* file = fopen(temporary_filename, "wb");
+    bool ok = file && fwrite(header, HOT_LIST_HEADER_SIZE, 1, file) == 1 &&
+              fwrite(page_idxs, sizeof(uint32_t), count, file) == count;
+    if (file && fclose(file) != 0)
+        ok = false;
+    if (ok && rename(temporary_filename, warm_up->filename) != 0)
+        ok = false;
+    if (!ok) {
+        printf(ANSI_COLOR_RED "Error writing hot page list '%s'.\n" ANSI_COLOR_RESET, warm_up->filename);
+        unlink(temporary_filename);
+    }
+
+    free(temporary_filename);
+    free(page_idxs);
+}
+
+void warmup_close(WarmUp* warm_up) {
+    free(warm_up->page_idxs);
+    free(warm_up->filename);
+    free(warm_up);
+}
+
+void print_warmup_status(DbTable* table) {
+    WarmUp* warm_up = table->warm_up;
+    if (!warm_up || warm_up->db_pager == NULL) {
+        printf("Warm-up is off.\n");
+        return;
+    }
+
+    printf("Warm-up: loaded %u of %u listed pages from '%s'%s\n", warm_up->pages_loaded, warm_up->num_pages,
+           warm_up->filename, warm_up->finished ? " (done)" : "");
+}
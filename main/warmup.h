@@ -0,0 +1,20 @@
+#ifndef DB_WARMUP_H
+#define DB_WARMUP_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "common.h"
+#include "pager.h"
+
+WarmUp* warmup_open(const char* db_filename);
+void    warmup_start(WarmUp* warm_up, DbPager* pager);
+void    warmup_stop(WarmUp* warm_up, DbPager* pager);
+void    warmup_save(WarmUp* warm_up, DbPager* pager);
+void    warmup_close(WarmUp* warm_up);
+void    print_warmup_status(DbTable* table);
+
+#endif
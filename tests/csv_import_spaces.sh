@@ -0,0 +1,10 @@
+#!/bin/sh
+# CSV fields end only at a comma, so values may hold spaces.
+DB_BIN=${1:-db/db}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+printf '1,John Doe,jd@x.com\n2,  Jane Q Public ,jq@x.com\n' > "$DIR/rows.csv"
+OUTPUT=$(printf "import '%s'\nselect\n.exit\n" "$DIR/rows.csv" | "$DB_BIN" "$DIR/test.db")
+echo "$OUTPUT" | grep -q "(1, John Doe, jd@x.com)" || { echo "$OUTPUT"; exit 1; }
+echo "$OUTPUT" | grep -q "(2, Jane Q Public, jq@x.com)" || { echo "$OUTPUT"; exit 1; }
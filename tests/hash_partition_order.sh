@@ -0,0 +1,11 @@
+#!/bin/sh
+# select and export on a hash-partitioned table come out sorted by key.
+DB_BIN=${1:-db/db}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+OUTPUT=$(printf "insert values (5, e, e@x), (2, b, b@x), (1, a, a@x), (3, c, c@x), (4, d, d@x)\nselect\nexport '%s'\n.exit\n" "$DIR/rows.csv" |
+         "$DB_BIN" "$DIR/test.db" --partitions 4)
+ROWS=$(echo "$OUTPUT" | grep -o "^.*([0-9]*," | grep -o "[0-9]*,$" | tr -d '\n')
+[ "$ROWS" = "1,2,3,4,5," ] || { echo "$OUTPUT"; exit 1; }
+[ "$(cut -d, -f1 "$DIR/rows.csv" | tr '\n' ' ')" = "1 2 3 4 5 " ] || { cat "$DIR/rows.csv"; exit 1; }
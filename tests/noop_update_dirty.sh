@@ -0,0 +1,15 @@
+#!/bin/sh
+# An update that matches no row must leave every page clean.
+DB_BIN=${1:-db/db}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+seq 1 20000 | awk '{ printf "%d,user%d,u%d@example.com\n", $1, $1, $1 }' > "$DIR/rows.csv"
+printf "import '%s'\n.exit\n" "$DIR/rows.csv" | "$DB_BIN" "$DIR/test.db" > /dev/null
+
+OUTPUT=$(printf ".timer on\nupdate where username = 'nobody' set email=x@y.z\n.exit\n" | "$DB_BIN" "$DIR/test.db")
+echo "$OUTPUT" | grep -q "(Updated 0 rows)" || { echo "$OUTPUT"; exit 1; }
+echo "$OUTPUT" | grep -q "dirtied 0$" || { echo "$OUTPUT"; exit 1; }
+
+OUTPUT=$(printf ".timer on\nupdate where username = 'user7' set email=x@y.z\n.exit\n" | "$DB_BIN" "$DIR/test.db")
+echo "$OUTPUT" | grep -q "dirtied 1$" || { echo "$OUTPUT"; exit 1; }
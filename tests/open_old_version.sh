@@ -0,0 +1,38 @@
+#!/bin/sh
+# Files from before format version 4 are upgraded with their rows: a
+# header-less file with an internal root and two leaves, and a version 1
+# file. A newer version is refused.
+DB_BIN=${1:-db/db}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+u32() {
+    printf "$(printf '\\%03o\\%03o\\%03o\\%03o' $(($1 & 255)) $(($1 >> 8 & 255)) $(($1 >> 16 & 255)) $(($1 >> 24 & 255)))"
+}
+zeros() { head -c "$1" /dev/zero; }
+# A 32-bit key, then the row: id, username[33], email[256].
+cell() { u32 "$1"; u32 "$1"; printf '%s' "$2"; zeros $((33 - ${#2})); printf '%s' "$3"; zeros $((256 - ${#3})); }
+# type, is_root, parent, num_cells, next_leaf, then the cells.
+leaf() { printf "\\001\\00$1"; u32 "$2"; u32 1; u32 "$3"; cell "$4" "$5" "$6"; zeros $((4096 - 14 - 297)); }
+# type, is_root, parent, num_keys, right_child, then child and key.
+internal() { printf '\000\001'; u32 0; u32 1; u32 "$1"; u32 "$2"; u32 "$3"; zeros $((4096 - 22)); }
+# magic, format version, page number width, root page.
+header() { printf 'CSQLDB\032\000'; u32 "$1"; u32 4; u32 "$2"; zeros $((4096 - 20)); }
+
+{ internal 2 1 1; leaf 0 0 2 1 alice alice@example.com; leaf 0 0 0 2 bob bob@example.com; } > "$DIR/v0.db"
+OUTPUT=$(printf "insert 3 carol carol@example.com\n.exit\n" | "$DB_BIN" "$DIR/v0.db")
+echo "$OUTPUT" | grep -q "from db format version 0 to 4. Rows copied: 2." || { echo "$OUTPUT"; exit 1; }
+OUTPUT=$(printf "select\n.exit\n" | "$DB_BIN" "$DIR/v0.db")
+for row in "(1, alice, alice@example.com)" "(2, bob, bob@example.com)" "(3, carol, carol@example.com)"; do
+    echo "$OUTPUT" | grep -qF "$row" || { echo "$OUTPUT"; exit 1; }
+done
+[ -f "$DIR/v0.db-legacy" ] || { echo "original not kept"; exit 1; }
+
+{ header 1 1; leaf 1 0 0 7 dave dave@example.com; } > "$DIR/v1.db"
+OUTPUT=$(printf "select\n.exit\n" | "$DB_BIN" "$DIR/v1.db")
+echo "$OUTPUT" | grep -qF "(7, dave, dave@example.com)" || { echo "$OUTPUT"; exit 1; }
+[ "$(od -An -tu4 -j8 -N4 "$DIR/v1.db" | tr -d ' ')" = "4" ] || { echo "version not rewritten"; exit 1; }
+
+header 99 1 > "$DIR/v99.db"
+OUTPUT=$(printf ".exit\n" | "$DB_BIN" "$DIR/v99.db")
+echo "$OUTPUT" | grep -q "newer than this build" || { echo "$OUTPUT"; exit 1; }